@@ -1,93 +1,250 @@
-/**
- * @file ar.h
- * @author Nate Novak (novak.n@northeastern.edu)
- * @brief Header file for ar.cpp
- * @date 2022-03-23
- */
-
-#include <cstdio>
-#include <cstring>
-#include <cstdlib>
-#include <dirent.h>
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <opencv2/opencv.hpp>
-
-/**
- * @brief Function to detect and extract chessboard
- * 
- * @param src source image to find the corners in 
- * @param dst dst image that displays the the corners
- * @param patsize size of the pattern
- * @param corner_set vector of the point location of each corner  
- * @param pattern_found bool passed by reference to determine if corners were found. 
- * @return int return non-zero value on failure. 
- */
-int detect_chessboard(const cv::Mat &src, cv::Size patsize, std::vector<cv::Point2f> &corner_set, bool &pattern_found);
-
-/**
- * @brief Function to get the point set if there's a pattern
- * 
- * @param pat_size size of the pattern
- * @param point_set point set to write to
- * @return int 
- */
-int get_point_set(const cv::Size pat_size, std::vector<cv::Vec3f> &point_set); 
-
-/**
- * @brief Function to draw a cube 
- * 
- * @param points vector of world points to write to
- * @param origin origin of the cube
- * @param scale scale of the cube
- * @param color color of the cube
- * @return int 
- */
-int draw_axes(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale); 
-
-/**
- * @brief Function to draw a cube 
- * 
- * @param points vector of world points to write to
- * @param origin origin of the cube
- * @param scale scale of the cube
- * @param color color of the cube
- * @return int 
- */
-int draw_cube(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale); 
-
-/**
- * @brief Function to draw a cube 
- * 
- * @param points point list to write to 
- * @param origin origin of the cube
- * @param scale scale of the cube
- * @param color color of the cube
- * @return int 
- */
-int draw_rect_prism(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d); 
-
-/**
- * @brief Function to draw a rooftop for my house
- * 
- * @param points points to write to
- * @param origin origin for where to start drawing 
- * @param w width
- * @param h height 
- * @param d depth
- * @return int 
- */
-int draw_roof(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d);
-
-/**
- * @brief Function to draw a door 
- * 
- * @param points point list to write to
- * @param origin origin of the door
- * @param w width
- * @param h height
- * @param d depth
- * @return int 
- */
-int draw_door(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d); 
\ No newline at end of file
+/**
+ * @file ar.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for ar.cpp
+ * @date 2022-03-23
+ */
+
+#ifndef AR_H
+#define AR_H
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <climits>
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#include "detector.h"
+
+// what gets drawn on top of the board
+enum overlay_mode {
+  OVERLAY_AXES = 0, // 3D axes at the board origin
+  OVERLAY_HOUSE = 1, // my virtual object
+  OVERLAY_OBJ = 2 // the obj file model (extension)
+};
+
+// one board found by detect_chessboards
+struct board_detection {
+  cv::Size patsize; // which of the registered sizes it is
+  std::vector<cv::Point2f> corner_set; // corners in frame coordinates
+  cv::Rect region; // candidate region it was found in
+  cv::Mat rotations; // pose, filled in by solve_board_poses
+  cv::Mat translations;
+};
+
+// the boards found in a frame. Slots past count are kept, so the next frame's
+// boards reuse their corner vectors and poses
+struct board_set {
+  std::vector<board_detection> slots;
+  int count; // slots in use
+};
+
+// buffers detect_chessboards reuses from one frame to the next
+struct board_search {
+  cv::Mat gray; // src converted, when it is BGR
+
+  // harris peaks and their clusters, see find_candidate_regions
+  cv::Mat small;
+  cv::Mat response;
+  cv::Mat localmax;
+  cv::Mat taken;
+  std::vector<std::pair<float, cv::Point2f> > peaks;
+  std::vector<int> cell_start;
+  std::vector<int> cell_of;
+  std::vector<int> bucket;
+  std::vector<int> fill;
+  std::vector<float> nn;
+  std::vector<int> parent;
+  std::vector<int> cluster_size; // indexed by the cluster's root peak
+  std::vector<cv::Vec4f> cluster_box;
+  std::vector<float> cluster_spacing;
+  std::vector<cv::Rect> regions;
+
+  // one of each per region, searched in parallel
+  std::vector<cv::Mat> rois; // region copies the found boards are masked out of
+  std::vector<std::vector<cv::Point2f> > corners;
+  std::vector<board_set> found;
+};
+
+/**
+ * @brief Function to detect and extract chessboard
+ * 
+ * @param src source image to find the corners in 
+ * @param dst dst image that displays the the corners
+ * @param patsize size of the pattern
+ * @param corner_set vector of the point location of each corner  
+ * @param pattern_found bool passed by reference to determine if corners were found. 
+ * @param backend detector_backend to find the corners with
+ * @return int return non-zero value on failure. 
+ */
+int detect_chessboard(const cv::Mat &src, cv::Size patsize, std::vector<cv::Point2f> &corner_set, bool &pattern_found, int backend = DETECT_CLASSIC);
+
+/**
+ * @brief Function to detect every board of the registered sizes in a frame
+ * 
+ * Harris corners on a downscaled copy are clustered into candidate regions,
+ * each region is searched in parallel and every board found in a region is
+ * masked out before the region is searched again. Only the regions are
+ * searched, so the cost follows the area covered by boards rather than the
+ * number of boards times the frame; bench.exe times a frame with 1, 2 and
+ * 4 boards.
+ * 
+ * @param src source image to find the boards in
+ * @param patsizes registered board sizes, searched in the order given
+ * @param max_boards stop after this many boards
+ * @param search buffers reused between frames
+ * @param boards boards to write to, their slots are reused
+ * @return int return non-zero value on failure. 
+ */
+int detect_chessboards(const cv::Mat &src, const std::vector<cv::Size> &patsizes, int max_boards, board_search &search, board_set &boards); 
+
+/**
+ * @brief Function to get the pose of every detected board
+ * 
+ * @param boards boards from detect_chessboards, rotations and translations are written
+ * @param cam_mat camera matrix at the resolution the boards were detected at
+ * @param distcoeff distortion coefficients
+ * @param point_set buffer for each board's world points, reused between frames
+ * @return int 
+ */
+int solve_board_poses(board_set &boards, const cv::Mat &cam_mat, const cv::Mat &distcoeff, std::vector<cv::Vec3f> &point_set); 
+
+/**
+ * @brief Function to get how well a pose explains the corners it was solved from
+ * 
+ * @param point_set world points of the corners
+ * @param corner_set image points of the corners
+ * @param rotations rotation vector from solvePnP
+ * @param translations translation vector from solvePnP
+ * @param cam_mat camera matrix
+ * @param distcoeff distortion coefficients
+ * @param projected buffer for the reprojected corners, reused between frames
+ * @return double rms reprojection error in pixels
+ */
+double reprojection_error(const std::vector<cv::Vec3f> &point_set, const std::vector<cv::Point2f> &corner_set, const cv::Mat &rotations, const cv::Mat &translations, const cv::Mat &cam_mat, const cv::Mat &distcoeff, std::vector<cv::Point2f> &projected); 
+
+/**
+ * @brief Function to get the point set if there's a pattern
+ * 
+ * @param pat_size size of the pattern
+ * @param point_set point set to write to
+ * @return int 
+ */
+int get_point_set(const cv::Size pat_size, std::vector<cv::Vec3f> &point_set); 
+
+/**
+ * @brief Function to draw a cube 
+ * 
+ * @param points vector of world points to write to
+ * @param origin origin of the cube
+ * @param scale scale of the cube
+ * @param color color of the cube
+ * @return int 
+ */
+int draw_axes(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale); 
+
+/**
+ * @brief Function to draw a cube 
+ * 
+ * @param points vector of world points to write to
+ * @param origin origin of the cube
+ * @param scale scale of the cube
+ * @param color color of the cube
+ * @return int 
+ */
+int draw_cube(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale); 
+
+/**
+ * @brief Function to draw a cube 
+ * 
+ * @param points point list to write to 
+ * @param origin origin of the cube
+ * @param scale scale of the cube
+ * @param color color of the cube
+ * @return int 
+ */
+int draw_rect_prism(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d); 
+
+/**
+ * @brief Function to draw a rooftop for my house
+ * 
+ * @param points points to write to
+ * @param origin origin for where to start drawing 
+ * @param w width
+ * @param h height 
+ * @param d depth
+ * @return int 
+ */
+int draw_roof(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d);
+
+/**
+ * @brief Function to draw a door 
+ * 
+ * @param points point list to write to
+ * @param origin origin of the door
+ * @param w width
+ * @param h height
+ * @param d depth
+ * @return int 
+ */
+int draw_door(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d);
+
+/**
+ * @brief Function to get the world points of an overlay
+ * 
+ * @param mode overlay_mode to get the points for
+ * @param patsize size of the board the overlay sits on
+ * @param objpoints obj file vertices, only used by OVERLAY_OBJ
+ * @param drawpoints vector of world points to write to
+ * @return int 
+ */
+int get_overlay_points(int mode, cv::Size patsize, const std::map<int, std::vector<float> > &objpoints, std::vector<cv::Vec3f> &drawpoints); 
+
+/**
+ * @brief Function to draw an overlay from its projected points
+ * 
+ * @param dst image to draw on
+ * @param mode overlay_mode that produced the points
+ * @param image_points points from get_overlay_points projected into dst
+ * @param connections obj file faces, only used by OVERLAY_OBJ
+ * @param lod level of detail, OVERLAY_OBJ draws every (1 << lod)-th face
+ * @return int 
+ */
+int draw_overlay(cv::Mat &dst, int mode, const std::vector<cv::Point2f> &image_points, const std::vector<std::vector<int> > &connections, int lod = 0); 
+
+/**
+ * @brief Function to get the part of a frame an overlay covers
+ * 
+ * @param image_points projected overlay points
+ * @param margin pixels added on every side for the line width
+ * @param size frame size
+ * @return cv::Rect bounding box clipped to the frame, empty if the overlay is off screen
+ */
+cv::Rect overlay_bounds(const std::vector<cv::Point2f> &image_points, int margin, cv::Size size); 
+
+/**
+ * @brief Function to warp an image onto a quad of the frame, like kermit in gif.exe
+ * 
+ * Only the box the quad lands in is warped and composited, not the whole frame.
+ * 
+ * @param dst frame to draw on in place
+ * @param img image to warp, its corners go to quad in order
+ * @param quad where the top left, top right, bottom right and bottom left corners land
+ * @param warped buffer for the warped box, grown to the largest box and reused between frames
+ * @param mask buffer for the quad's mask, grown like warped
+ * @param poly buffer for the quad in box coordinates, reused between frames
+ * @param copied bytes written and read by the composite are added to it
+ * @return int return non-zero value if nothing was drawn
+ */
+int composite_quad(cv::Mat &dst, const cv::Mat &img, const std::vector<cv::Point2f> &quad, cv::Mat &warped, cv::Mat &mask, std::vector<cv::Point2i> &poly, long &copied); 
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file board_tracker.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for board_tracker.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef BOARD_TRACKER_H
+#define BOARD_TRACKER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "cal_profile.h"
+#include "detector.h"
+
+// one pose from the detection thread
+struct tracked_pose {
+  int64_t time_ns; // capture time of the frame it was found in
+  cv::Vec3d rvec;
+  cv::Vec3d tvec;
+};
+
+/**
+ * @brief Board detection and solvePnP on a thread of their own
+ *
+ * The frame loop hands every frame to submit_board_frame and draws right away
+ * with board_pose_at, which interpolates between the two newest poses (SLERP on
+ * rotation, lerp on translation) or extrapolates past them to the frame's
+ * capture time. The detection thread always takes the newest frame, so a slow
+ * detector lowers how often the pose is measured, not the frame rate.
+ */
+struct board_tracker {
+  int backend;
+  cv::Size patsize;
+
+  std::mutex lock;
+  std::condition_variable ready;
+  cv::Mat pending; // newest frame not taken by the detection thread yet, a copy
+  int64_t pending_time;
+  cal_profile pending_cal; // intrinsics at the pending frame's size
+  bool fresh; // pending holds a frame
+  bool stopping;
+  std::thread thread;
+
+  tracked_pose poses[2]; // oldest first
+  int num_poses; // 0 once a detection misses the board
+
+  refine_stats refine; // written by the detection thread only
+  std::atomic<long> submitted;
+  std::atomic<long> detected; // frames the detection thread ran on
+  std::atomic<long> replaced; // submitted frames a newer one replaced before detection
+};
+
+/**
+ * @brief Function to start the detection thread
+ *
+ * @param backend detector_backend
+ * @param patsize inner corners of the board
+ * @param bt tracker to start
+ * @return int return non-zero value on failure
+ */
+int open_board_tracker(int backend, cv::Size patsize, board_tracker &bt);
+
+/**
+ * @brief Function to hand a frame to the detection thread, never waits for the detection
+ *
+ * The frame and intrinsics are copied. A frame the thread has not taken yet is replaced.
+ *
+ * @param bt open tracker
+ * @param src frame to detect in, gray or BGR
+ * @param time_ns capture time of the frame
+ * @param cal intrinsics at src's size
+ * @return int
+ */
+int submit_board_frame(board_tracker &bt, const cv::Mat &src, int64_t time_ns, const cal_profile &cal);
+
+/**
+ * @brief Function to get the board pose at a time from the newest detections
+ *
+ * Extrapolation goes at most one detection interval, and no more than 200 ms,
+ * past the newest pose. Two poses more than half a second apart, or a
+ * jump between them, are not blended and the newest is held instead.
+ *
+ * @param bt open tracker
+ * @param time_ns time to get the pose at, usually the capture time of the frame being drawn
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int return non-zero value when the board is not being tracked
+ */
+int board_pose_at(board_tracker &bt, int64_t time_ns, cv::Mat &rvec, cv::Mat &tvec);
+
+/**
+ * @brief Function to stop the detection thread and print how often it ran
+ *
+ * @param bt tracker to close
+ * @param name loop name to print
+ * @return int
+ */
+int close_board_tracker(board_tracker &bt, const char *name);
+
+#endif
@@ -0,0 +1,49 @@
+/**
+ * @file cal_profile.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for cal_profile.cpp
+ * @date 2022-04-02
+ */
+
+#ifndef CAL_PROFILE_H
+#define CAL_PROFILE_H
+
+#include <string>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Calibration of one camera at one resolution.
+ *
+ * The intrinsics are only valid at image_size. An image_size of 0x0 means
+ * the profile came from an old calibration.csv that did not record it, in
+ * which case it is assumed to match whatever it is used with.
+ */
+struct cal_profile {
+  std::string camera_id; // identity of the camera that was calibrated
+  cv::Size image_size; // resolution the calibration images were captured at
+  cv::Mat cam_mat; // 3x3 CV_64FC1 camera matrix
+  cv::Mat distcoeff; // 5x1 CV_64FC1 distortion coefficients
+};
+
+/**
+ * @brief Function to rescale a calibration profile to a different resolution
+ *
+ * fx, cx are scaled by the width ratio and fy, cy by the height ratio. The
+ * distortion coefficients act on normalized coordinates so they are copied as is.
+ *
+ * @param src profile to rescale
+ * @param size resolution the profile will be used at
+ * @param dst profile to write to, valid at size
+ * @return int return non-zero value on failure
+ */
+int scale_cal_profile(const cal_profile &src, cv::Size size, cal_profile &dst);
+
+/**
+ * @brief Function to print a calibration profile
+ *
+ * @param profile profile to print
+ * @return int
+ */
+int print_cal_profile(const cal_profile &profile);
+
+#endif
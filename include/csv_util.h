@@ -12,6 +12,7 @@
 #define CVS_UTIL_H
 
 #include <vector>
+#include "cal_profile.h"
 /*
   Given a filename, and image filename, and the image features, by
   default the function will append a line of data to the CSV format
@@ -84,6 +85,58 @@ int append_rot_trans_data_csv( char *filename, std::vector<std::vector<float> >
  */
 int read_calibration_data_csv( char *filename, cv::Mat &cam_mat, cv::Mat &distcoeff, int echo_file );
 
+/**
+ * @brief Function to write a calibration profile to a csv
+ *
+ * Writes the same columns as append_calibration_data_csv followed by the
+ * calibration image width, height and the camera id, so older readers still
+ * find the camera matrix and distortion coefficients where they expect them.
+ *
+ * @param filename name of csv file
+ * @param profile calibration profile to write
+ * @param reset_file indicator whether to reset the file or not
+ * @return int return non-zero value on failure
+ */
+int append_cal_profile_csv( char *filename, cal_profile &profile, int reset_file );
+
+/**
+ * @brief Function to read a calibration profile from a csv file.
+ *
+ * Files written by append_calibration_data_csv are accepted too; their
+ * image_size is left at 0x0.
+ *
+ * @param filename name of csv file
+ * @param camera_id id of the profile to load, empty string for the first one in the file
+ * @param profile profile to write to
+ * @param echo_file if true, print the data.
+ * @return int return non-zero value on failure
+ */
+int read_cal_profile_csv( char *filename, const std::string &camera_id, cal_profile &profile, int echo_file );
+
+/**
+ * @brief Function to write the board corners found in one image to a csv
+ *
+ * Each row is the image name followed by x,y of every corner in get_point_set
+ * order. An image without a board is written as just its name.
+ *
+ * @param filename name of csv file
+ * @param image_name name of the image the corners belong to
+ * @param corner_set corners to write, may be empty
+ * @param reset_file indicator whether to reset the file or not
+ * @return int return non-zero value on failure
+ */
+int append_corner_data_csv( char *filename, const char *image_name, const std::vector<cv::Point2f> &corner_set, int reset_file );
+
+/**
+ * @brief Function to read the board corners of a sequence of images from a csv
+ *
+ * @param filename name of csv file
+ * @param names image name of each row
+ * @param corners corners of each row, empty where the image has no board
+ * @return int return non-zero value on failure
+ */
+int read_corner_data_csv( char *filename, std::vector<std::string> &names, std::vector<std::vector<cv::Point2f> > &corners );
+
 /**
  * @brief Function to read the virtual object data from a csv file. 
  * 
@@ -0,0 +1,111 @@
+/**
+ * @file detector.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for detector.cpp
+ * @date 2022-04-09
+ */
+
+#ifndef DETECTOR_H
+#define DETECTOR_H
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// ways of finding the board corners
+enum detector_backend {
+  DETECT_CLASSIC = 0, // findChessboardCorners + cornerSubPix
+  DETECT_SB = 1, // findChessboardCornersSB, already sub-pixel accurate
+  DETECT_CHARUCO = 2, // ChArUco board, works with part of the board hidden
+  DETECT_NUM_BACKENDS = 3
+};
+
+// how much work refine_corners did, summed over calls
+struct refine_stats {
+  long corners; // corners refined
+  long iterations; // iterations over all corners
+  long window_sum; // sum of the window half-size used per call
+  long calls;
+};
+
+/**
+ * @brief Function to get a detector backend from its name
+ *
+ * @param name "classic", "sb" or "charuco"
+ * @return int detector_backend, -1 if the name is unknown
+ */
+int parse_detector_backend(const char *name);
+
+/**
+ * @brief Function to get the name of a detector backend
+ *
+ * @param backend detector_backend
+ * @return const char*
+ */
+const char *detector_backend_name(int backend);
+
+/**
+ * @brief Function to check whether a backend was compiled in
+ *
+ * @param backend detector_backend
+ * @return true if detect_board can use it
+ */
+bool detector_available(int backend);
+
+/**
+ * @brief Function to find the inner corners of a board
+ *
+ * corner_ids[i] is the index of corner_set[i] in the full patsize grid, in the
+ * same order as get_point_set. Classic and SB only report full boards, ChArUco
+ * reports whichever corners it can see.
+ *
+ * @param src source image to find the corners in, BGR or already gray
+ * @param backend detector_backend to use
+ * @param patsize inner corners of the board (a ChArUco board has one more square each way)
+ * @param corner_set vector of the point location of each corner found
+ * @param corner_ids vector of the grid index of each corner found
+ * @param pattern_found bool passed by reference, true if every corner was found
+ * @param stats if not NULL, sub-pixel refinement work is added to it
+ * @return int return non-zero value on failure.
+ */
+int detect_board(const cv::Mat &src, int backend, cv::Size patsize, std::vector<cv::Point2f> &corner_set, std::vector<int> &corner_ids, bool &pattern_found, refine_stats *stats = NULL);
+
+/**
+ * @brief Function to refine the corners of a full board to sub-pixel accuracy
+ *
+ * Does what cornerSubPix does, but the search window is sized from the
+ * spacing between neighbouring corners (at most 11x11, the old fixed size) so
+ * it never reaches the next corner, each corner stops on its own once it moves
+ * less than 0.1 pixel, and corners are refined in parallel with the window sums
+ * vectorized.
+ *
+ * @param gray grayscale image the corners were found in
+ * @param corner_set corners in get_point_set order, refined in place
+ * @param patsize size of the pattern
+ * @param stats if not NULL, work done is added to it
+ * @return int return non-zero value on failure.
+ */
+int refine_corners(const cv::Mat &gray, std::vector<cv::Point2f> &corner_set, cv::Size patsize, refine_stats *stats = NULL);
+
+/**
+ * @brief Function to set how many iterations refine_corners runs per corner at most
+ *
+ * Applies to every thread from the next call on, the compute governor lowers it
+ * to spend less time refining.
+ *
+ * @param iters iterations per corner, 30 by default
+ * @return int return non-zero value if iters is not positive
+ */
+int set_refine_iterations(int iters);
+
+/**
+ * @brief Function to get the world points of some corners of a board
+ *
+ * @param patsize size of the pattern
+ * @param corner_ids grid index of each corner
+ * @param point_set point set to write to
+ * @return int
+ */
+int get_point_subset(cv::Size patsize, const std::vector<int> &corner_ids, std::vector<cv::Vec3f> &point_set);
+
+#endif
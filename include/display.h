@@ -0,0 +1,86 @@
+/**
+ * @file display.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for display.cpp
+ * @date 2022-04-18
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <opencv2/opencv.hpp>
+
+#define KEY_QUEUE_SIZE 64 // power of two
+
+/**
+ * @brief Window shown and pumped from its own thread
+ *
+ * The frame loop hands frames to show_frame and reads keys with poll_key,
+ * neither waits on HighGUI. Every HighGUI call is made on the display thread.
+ * On macOS, where windows have to live on the main thread, show_frame and
+ * poll_key do the work inline instead.
+ */
+struct frame_display {
+  std::string window;
+  bool headless; // --no-display, nothing is shown and only Ctrl-C is read
+
+  std::mutex lock;
+  cv::Mat pending; // newest frame not shown yet, a copy owned by the display
+  bool fresh; // pending holds a frame the display thread has not taken
+  std::thread thread;
+  std::atomic<bool> stop;
+
+  // keys from the display thread to the frame loop, one writer and one reader
+  int keys[KEY_QUEUE_SIZE];
+  std::atomic<unsigned> key_head; // next slot the display thread writes
+  std::atomic<unsigned> key_tail; // next slot the frame loop reads
+
+  std::atomic<long> shown;
+  std::atomic<long> skipped; // replaced before the display thread got to them
+};
+
+/**
+ * @brief Function to open the window and start the display thread
+ *
+ * Ctrl-C is turned into a 'q' key so a headless run still shuts down cleanly.
+ *
+ * @param window window name
+ * @param headless true to show nothing
+ * @param d display to start
+ * @return int return non-zero value on failure
+ */
+int open_display(const std::string &window, bool headless, frame_display &d);
+
+/**
+ * @brief Function to hand a frame to the display, never waits for it to be shown
+ *
+ * The frame is copied, so the caller can draw into it again right away. If the
+ * display has not shown the last frame yet it is replaced.
+ *
+ * @param d open display
+ * @param frame frame to show
+ * @return int
+ */
+int show_frame(frame_display &d, const cv::Mat &frame);
+
+/**
+ * @brief Function to get the next key pressed in the window
+ *
+ * @param d open display
+ * @return int key code as returned by cv::waitKeyEx, -1 if no key is waiting
+ */
+int poll_key(frame_display &d);
+
+/**
+ * @brief Function to stop the display thread and close the window
+ *
+ * @param d display to close
+ * @return int
+ */
+int close_display(frame_display &d);
+
+#endif
@@ -0,0 +1,182 @@
+/**
+ * @file frame_pipeline.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for frame_pipeline.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ar.h"
+#include "board_tracker.h"
+#include "cal_profile.h"
+#include "detector.h"
+#include "frame_workspace.h"
+#include "motion_gate.h"
+#include "pose_filter.h"
+#include "pose_log.h"
+
+// what a pipeline draws on the board
+enum pipeline_mode {
+  PIPELINE_AR = 0, // ar.exe, the overlay drawn on the board
+  PIPELINE_GIF = 1 // gif.exe, kermit warped onto the board
+};
+
+// the flags of ar.exe and gif.exe that change what comes out of a frame
+struct pipeline_settings {
+  int mode; // pipeline_mode
+  int overlay; // overlay_mode drawn in PIPELINE_AR, can change between frames
+  int backend; // detector_backend
+  float det_scale; // --detect-scale, the governor can change it between frames
+  bool gating; // reuse the last detection while the motion gate sees nothing move
+  int motion_threshold;
+  int motion_max_reuse;
+  bool filtering; // --pose-filter
+  double pose_lead_ms;
+  bool multi_board; // --multi-board, every board of boardsizes gets its own overlay
+  std::vector<cv::Size> boardsizes;
+  int max_boards;
+};
+
+// things every pipeline draws with, loaded once and shared read only
+struct pipeline_model {
+  cv::Size patternsize; // inner corners of the board
+  std::map<int, std::vector<float> > objpoints; // obj file vertices, only loaded for PIPELINE_AR
+  std::vector<std::vector<int> > connections; // obj file faces
+  std::vector<cv::Mat> kerms; // kermit frames, only loaded for PIPELINE_GIF
+};
+
+// what came out of one frame for the single tracked board, the first board with --multi-board
+struct pipeline_result {
+  bool found;
+  std::vector<cv::Point2f> corners; // in frame pixels, empty when the board was not found or the pose was blended
+  cv::Vec3d rvec; // pose solvePnP measured
+  cv::Vec3d tvec;
+  cv::Vec3d draw_rvec; // pose the overlay was drawn with, filtered with --pose-filter
+  cv::Vec3d draw_tvec;
+};
+
+/**
+ * @brief The per-frame processing of ar.exe and gif.exe
+ *
+ * One frame goes through the motion gate, detection at the detection scale or
+ * the reuse of the last detection, solvePnP with the detection intrinsics, the
+ * pose filter, and the projection and drawing at the frame size. The camera
+ * loops, replay.exe and offline.exe all run their frames through
+ * run_frame_pipeline, so what the replays check is what the loops do.
+ * Everything carried from one frame to the next lives here, so one pipeline
+ * runs one sequence in order.
+ */
+struct frame_pipeline {
+  pipeline_settings set;
+  const pipeline_model *model;
+  cal_profile calib; // as loaded from the calibration file
+  cal_profile frame_calib; // calib rescaled to the frame size
+  cal_profile det_calib; // calib rescaled to the detection size
+
+  motion_gate gate;
+  pose_filter filter;
+  refine_stats refine;
+  int kermitcount; // kermit frame drawn next
+  long frames;
+
+  // set by the governor between frames
+  int detect_every; // detect every n-th frame and reuse the last detection in between
+  int lod; // overlay level of detail
+
+  board_tracker *tracker; // with --async-detect detection runs on the tracker's thread, NULL otherwise
+  pose_log *poses; // every measured pose is recorded here, NULL for none
+
+  // results of the last detection, reused while the motion gate sees nothing move near them
+  // and on the frames between detections
+  bool last_valid; // false until a detection at the current settings is kept
+  bool last_found;
+  std::vector<cv::Point2f> last_corners;
+  std::vector<int> last_ids;
+  board_set last_boards; // --multi-board, detected into in place and drawn from on every frame
+  cv::Mat last_rotations;
+  cv::Mat last_translations;
+  cv::Rect last_roi; // empty while nothing was found, so motion anywhere brings detection back
+
+  cv::Mat gray; // gray plane of BGR frames, for callers that do not have one
+  cv::Mat det_frame;
+  cv::Mat draw_rotations;
+  cv::Mat draw_translations;
+  frame_workspace ws;
+};
+
+/**
+ * @brief Function to fill in the settings ar.exe starts with
+ *
+ * @param set settings to write to
+ * @return int
+ */
+int init_pipeline_settings(pipeline_settings &set);
+
+/**
+ * @brief Function to parse a pipeline mode name
+ *
+ * @param name ar or gif
+ * @return int pipeline_mode, -1 if unknown
+ */
+int parse_pipeline_mode(const char *name);
+
+/**
+ * @brief Function to load what a pipeline draws with
+ *
+ * @param mode pipeline_mode, the obj file is only read for PIPELINE_AR and kermit's frames for PIPELINE_GIF
+ * @param patternsize inner corners of the board
+ * @param obj_fn obj file for OVERLAY_OBJ
+ * @param kerm_dir directory with kermit's input-0.png to input-18.png
+ * @param m model to write to
+ * @return int return non-zero value on failure
+ */
+int load_pipeline_model(int mode, cv::Size patternsize, const char *obj_fn, const char *kerm_dir, pipeline_model &m);
+
+/**
+ * @brief Function to set up a pipeline at the start of a sequence
+ *
+ * @param set settings
+ * @param calib calibration, rescaled to whatever size the frames are
+ * @param model shared model, has to outlive the pipeline
+ * @param p pipeline to set up
+ * @return int return non-zero value on failure
+ */
+int open_frame_pipeline(const pipeline_settings &set, const cal_profile &calib, const pipeline_model *model, frame_pipeline &p);
+
+/**
+ * @brief Function to run one frame through the pipeline
+ *
+ * The caller calls begin_frame on the pipeline's workspace at the top of its
+ * loop. Every stage is timed into the profiler, every buffer the pipeline
+ * reuses is watched with watch_buffer, and the OpenCV calls that allocate
+ * inside OpenCV are marked with ALLOC_EXEMPT.
+ *
+ * @param p pipeline
+ * @param gray gray plane of the frame
+ * @param dst BGR frame the overlay is drawn on in place, empty to not draw
+ * @param captured capture time of the frame, ns on the prof_now clock
+ * @param r result to write to
+ * @return int return non-zero value on failure
+ */
+int run_frame_pipeline(frame_pipeline &p, const cv::Mat &gray, cv::Mat &dst, int64_t captured, pipeline_result &r);
+
+/**
+ * @brief Function to draw a frame's overlay from its result
+ *
+ * run_frame_pipeline calls it, and it can draw results a different pipeline
+ * measured, as long as the frames are drawn in order.
+ *
+ * @param p pipeline, its model, settings, intrinsics, level of detail and kermit frame are used
+ * @param dst BGR frame to draw on in place
+ * @param r result of the frame
+ * @return int
+ */
+int draw_pipeline_result(frame_pipeline &p, cv::Mat &dst, const pipeline_result &r);
+
+#endif
@@ -0,0 +1,76 @@
+/**
+ * @file frame_source.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for frame_source.cpp
+ * @date 2022-04-05
+ */
+
+#ifndef FRAME_SOURCE_H
+#define FRAME_SOURCE_H
+
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Somewhere frames come from: a camera, a video file or a directory of images.
+ */
+struct frame_source {
+  std::string spec; // what was asked for, e.g. "0", "run1.avi", "./cal_imgs"
+  int live; // non-zero for cameras, frames arrive in real time and can be missed
+  cv::VideoCapture cap; // camera or video file
+  std::vector<std::string> files; // image directory, sorted by name
+  int next_file;
+};
+
+/**
+ * @brief Function to open a frame source
+ *
+ * A spec made only of digits is a camera index, a directory is read as a
+ * sequence of images in name order, anything else is handed to cv::VideoCapture
+ * (video files and printf style image sequences like img%04d.png).
+ *
+ * @param spec source to open
+ * @param src frame source to write to
+ * @return int return non-zero value on failure
+ */
+int open_frame_source(const std::string &spec, frame_source &src);
+
+/**
+ * @brief Function to read the next frame from a frame source
+ *
+ * @param src frame source to read from
+ * @param frame frame to write to
+ * @return int return non-zero value when the source has no more frames
+ */
+int read_frame_source(frame_source &src, cv::Mat &frame);
+
+/**
+ * @brief Function to get the number of frames in a frame source
+ *
+ * @param src frame source
+ * @return long number of frames, -1 for cameras and videos that do not say
+ */
+long frame_source_length(frame_source &src);
+
+/**
+ * @brief Function to move a frame source to a frame, so the next read returns it
+ *
+ * Videos seek through the backend, which is frame accurate for the usual
+ * containers with FFmpeg but not for every codec.
+ *
+ * @param src frame source, not a camera
+ * @param frame index of the frame to read next
+ * @return int return non-zero value on failure
+ */
+int seek_frame_source(frame_source &src, long frame);
+
+/**
+ * @brief Function to close a frame source
+ *
+ * @param src frame source to close
+ * @return int
+ */
+int close_frame_source(frame_source &src);
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * @file frame_workspace.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for frame_workspace.cpp
+ * @date 2022-04-17
+ */
+
+#ifndef FRAME_WORKSPACE_H
+#define FRAME_WORKSPACE_H
+
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ar.h"
+
+// OpenCV calls a frame makes that allocate on the heap inside OpenCV on every
+// call, every Mat OpenCV creates for itself is a new UMatData. Allocations made
+// inside them are counted apart from the frame's own, see ALLOC_EXEMPT. Nothing
+// else is exempt, the frame loops' own code has to keep its buffers
+enum alloc_exempt {
+  EXEMPT_NONE = -1, // counted, for our code that runs inside an exempt call
+  EXEMPT_FIND = 0, // findChessboardCorners(SB) and the ChArUco detector keep quads and contours in vectors
+  EXEMPT_POSE, // solvePnP, projectPoints, findHomography and Rodrigues work in temporary Mats
+  EXEMPT_IMGPROC, // cvtColor, resize, cornerHarris, dilate, minMaxLoc, getRectSubPix, warpPerspective and masked copies
+  EXEMPT_DRAW, // line, arrowedLine, circle and fillConvexPoly keep polygon edges in vectors
+  EXEMPT_PARALLEL, // parallel_for_ hands every call to its thread pool as a new job
+  NUM_EXEMPT
+};
+
+/**
+ * @brief Buffers a frame loop reuses from one frame to the next
+ *
+ * Vectors are cleared but keep their capacity and Mats are only reallocated
+ * when the frame size or type changes, so once the first frames have been
+ * through the loop a frame does not go to the heap for any of these.
+ */
+struct frame_workspace {
+  // board detection and pose
+  std::vector<cv::Point2f> corner_set;
+  std::vector<int> corner_ids;
+  std::vector<cv::Vec3f> point_set;
+  board_search search; // --multi-board, the boards are kept in the frame_pipeline
+  cv::Mat rotations;
+  cv::Mat translations;
+  std::vector<cv::Point2f> projected; // corners reprojected for the pose log's error
+
+  // overlay
+  std::vector<cv::Vec3f> drawpoints;
+  std::vector<cv::Point2f> image_points;
+  std::vector<cv::Point2i> poly;
+  cv::Mat warped;
+  cv::Mat mask;
+
+  // harris corners, the gray plane comes from the luma_frame
+  cv::Mat har_small; // gray plane downscaled when the governor lowers the harris scale
+  cv::Mat har_data;
+  cv::Mat har_norm;
+
+  // bytes the overlay copied or composited, the rest of the frame is drawn on in place
+  long copy_bytes; // this frame
+  long total_copy_bytes; // every frame before this one
+
+  // heap allocations on the frame loop thread, see begin_frame and end_frame
+  long frames;
+  long allocs_start; // alloc_count() when warm up ended
+  long exempt_start[NUM_EXEMPT]; // exempt_count() of every call when warm up ended
+  long frame_allocs_start; // alloc_count() at the top of this frame
+  long alloc_frames; // frames after warm up that allocated
+  long first_alloc_frame;
+  long first_allocs; // allocations the first of them made
+
+  // where each watched buffer's memory was last seen, see watch_buffer
+  std::vector<const char *> watch_names;
+  std::vector<int> watch_index;
+  std::vector<const void *> watch_data;
+  bool frame_moved; // a watched buffer moved this frame
+  long moved_frames; // frames after warm up in which a watched buffer moved
+  long first_moved_frame;
+  const char *first_moved; // name of the first buffer that moved after warm up
+  int first_moved_index;
+};
+
+/**
+ * @brief Function to get the number of heap allocations made on this thread
+ *
+ * Counts calls to operator new outside the exempt OpenCV calls. Only counted
+ * when built with -DAR_COUNT_ALLOCS. A Mat's pixels go through cv::fastMalloc,
+ * but every new Mat also allocates its UMatData header, so a Mat that is
+ * reallocated is counted.
+ *
+ * @return long allocations so far, -1 when not counted
+ */
+long alloc_count();
+
+/**
+ * @brief Function to get the number of heap allocations made on this thread inside one of the exempt calls
+ *
+ * @param call alloc_exempt
+ * @return long allocations so far, -1 when not counted
+ */
+long exempt_count(int call);
+
+/**
+ * @brief Counts the heap allocations of the enclosing scope as made inside an exempt OpenCV call
+ */
+class alloc_exempt_scope {
+ public:
+  explicit alloc_exempt_scope(int call);
+  ~alloc_exempt_scope();
+
+ private:
+  int prev;
+};
+
+#define ALLOC_CONCAT_(a, b) a##b
+#define ALLOC_CONCAT(a, b) ALLOC_CONCAT_(a, b)
+#ifdef AR_COUNT_ALLOCS
+#define ALLOC_EXEMPT(call) alloc_exempt_scope ALLOC_CONCAT(alloc_exempt_, __LINE__)(call)
+#else
+#define ALLOC_EXEMPT(call)
+#endif
+
+/**
+ * @brief Function to set up an empty workspace
+ *
+ * @param ws workspace to set up
+ * @return int
+ */
+int init_frame_workspace(frame_workspace &ws);
+
+/**
+ * @brief Function to call at the top of every frame, empties the per-frame vectors
+ *
+ * @param ws workspace of the loop
+ * @return int
+ */
+int begin_frame(frame_workspace &ws);
+
+/**
+ * @brief Function to call at the bottom of every frame, counts it if it allocated after warm up
+ *
+ * Only counts when built with -DAR_COUNT_ALLOCS, allocations inside the exempt
+ * OpenCV calls do not count.
+ *
+ * @param ws workspace of the loop
+ * @return int return non-zero value if the frame allocated after warm up
+ */
+int end_frame(frame_workspace &ws);
+
+/**
+ * @brief Function to check that a buffer keeps its memory once the loop has warmed up
+ *
+ * Call it for every buffer the loop reuses at the end of each frame, with the
+ * buffer's data pointer. A Mat that is reallocated or a vector that grows gets
+ * a new pointer, which after warm up counts the frame as one that allocated.
+ * Buffers that are still empty, or first get memory after warm up, are not
+ * counted, only ones that had memory and moved.
+ *
+ * @param ws workspace of the loop
+ * @param name buffer name, a string that outlives the workspace
+ * @param data the buffer's data pointer this frame
+ * @param index which of a set of buffers of the same name, -1 for a single one
+ * @return int return non-zero value if the buffer moved after warm up
+ */
+int watch_buffer(frame_workspace &ws, const char *name, const void *data, int index = -1);
+
+/**
+ * @brief Function to watch every Mat and vector of the workspace, at the end of a frame
+ *
+ * @param ws workspace of the loop
+ * @return int return non-zero value if a buffer moved after warm up
+ */
+int watch_frame_workspace(frame_workspace &ws);
+
+/**
+ * @brief Function to print the heap allocations per frame once the loop has warmed up
+ *
+ * The operator new counts are only printed when built with -DAR_COUNT_ALLOCS,
+ * the frames in which a watched buffer moved always are.
+ *
+ * @param ws workspace of the loop
+ * @param name loop name to print
+ * @return int return non-zero value if a frame allocated or a watched buffer moved after warm up
+ */
+int print_frame_allocs(const frame_workspace &ws, const char *name);
+
+/**
+ * @brief Function to print how many bytes the overlay copied per frame
+ *
+ * @param ws workspace of the loop
+ * @param name loop name to print
+ * @return int
+ */
+int print_frame_copies(const frame_workspace &ws, const char *name);
+
+#endif
@@ -0,0 +1,107 @@
+/**
+ * @file governor.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for governor.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <cstdint>
+#include <vector>
+#include "profiler.h"
+
+#define GOVERNOR_WINDOW_NS 1000000000LL // decisions are made on one second of frames
+#define GOVERNOR_CALM_WINDOWS 3 // windows in a row with room to spare before a knob is raised again
+
+// settings the governor can trade for time, each a ladder of steps from full quality down
+enum governor_knob {
+  KNOB_DET_SCALE = 0, // size of the frame detection runs on, on top of --detect-scale
+  KNOB_DETECT_EVERY, // detect every n-th frame, the ones between reuse the last result
+  KNOB_SUBPIX, // sub-pixel refinement iterations per corner
+  KNOB_LOD, // overlay level of detail
+  KNOB_HARRIS_SCALE, // size of the frame cornerHarris runs on
+  NUM_KNOBS
+};
+
+/**
+ * @brief Adjusts a frame loop's knobs to hold a frame rate or a cpu budget
+ *
+ * Once a window it reads the stage timings from the profiler and the
+ * process cpu time. Over budget it lowers the knob whose stages cost the most
+ * per frame, one step at a time. After a few windows with room to spare it
+ * raises the knob it lowered last, so the most recent compromise is undone
+ * first. Every window's decision is logged at info level with the numbers
+ * behind it, outside the per-frame log cap.
+ *
+ * The frame rate target only counts the loop's own work per frame, not the
+ * time spent waiting on the camera, so a camera slower than the target does
+ * not get every knob turned down.
+ */
+struct compute_governor {
+  double target_fps; // 0 for no frame rate target
+  double core_budget; // cores of cpu time per second the whole process may use, 0 for no budget
+  unsigned knobs; // bit (1 << governor_knob) for every knob the loop applies
+  float base_det_scale; // --detect-scale, KNOB_DET_SCALE scales down from here
+
+  int level[NUM_KNOBS]; // step down each knob's ladder, 0 is full quality
+  std::vector<int> lowered; // knobs in the order they were lowered
+  int calm; // windows in a row with room to spare
+
+  int64_t window_start;
+  double cpu_start; // process cpu seconds at window_start
+  long frames; // frames in the window
+  int64_t stage_start[NUM_STAGES]; // profiler totals at window_start
+
+  // settings for the loop, current after governor_frame returns true
+  float det_scale;
+  int detect_every;
+  int subpix_iters;
+  int lod;
+  float harris_scale;
+
+  long windows;
+  long changes;
+};
+
+/**
+ * @brief Function to get the name of a knob
+ *
+ * @param knob governor_knob
+ * @return const char*
+ */
+const char *governor_knob_name(int knob);
+
+/**
+ * @brief Function to set up a governor with every knob at full quality
+ *
+ * @param target_fps frame rate to hold, 0 for none
+ * @param core_budget cores of cpu the process may use, 0 for none
+ * @param knobs bit (1 << governor_knob) for every knob the loop applies
+ * @param det_scale detection scale at full quality
+ * @param g governor to set up
+ * @return int return non-zero value if there is neither a target nor a budget
+ */
+int init_governor(double target_fps, double core_budget, unsigned knobs, float det_scale, compute_governor &g);
+
+/**
+ * @brief Function to count a frame, and at the end of a window decide whether to change a knob
+ *
+ * Call once per frame after its stages were recorded.
+ *
+ * @param g governor
+ * @return true if a setting changed and the loop has to apply it
+ */
+bool governor_frame(compute_governor &g);
+
+/**
+ * @brief Function to print how often the governor changed a knob and where they ended
+ *
+ * @param g governor
+ * @param name loop name to print
+ * @return int
+ */
+int print_governor(const compute_governor &g, const char *name);
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * @file image_writer.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for image_writer.cpp
+ * @date 2022-04-16
+ */
+
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// an image waiting to be encoded
+struct image_job {
+  std::string path;
+  cv::Mat img;
+};
+
+/**
+ * @brief Background image writer
+ *
+ * Queueing an image only copies its pixels, the encoding and disk I/O happen
+ * on the writer threads. Files are numbered on from the highest number already
+ * in the directory, so nothing earlier is overwritten.
+ */
+struct image_writer {
+  std::string dir; // ends in a slash
+  std::string prefix;
+  std::string ext; // ".png" or ".jpg"
+  std::vector<int> params; // imwrite parameters
+  int max_queue;
+  int next_id;
+
+  std::mutex lock;
+  std::condition_variable ready; // a job was queued
+  std::condition_variable idle; // the queue drained
+  std::deque<image_job> jobs;
+  int busy; // jobs being encoded
+  bool stopping;
+  std::vector<std::thread> threads;
+
+  std::atomic<long> written;
+  std::atomic<long> dropped; // queue was full
+  std::atomic<long> failed; // imwrite failed
+};
+
+/**
+ * @brief Function to start an image writer
+ *
+ * @param dir directory to write to
+ * @param prefix start of every file name, followed by the image number
+ * @param format "png" or "jpg"
+ * @param quality png compression 0-9 or jpg quality 0-100, -1 for the default (png 3, jpg 95)
+ * @param max_queue images waiting to be written, more are dropped
+ * @param nthreads writer threads
+ * @param w writer to start
+ * @return int return non-zero value on failure
+ */
+int open_image_writer(const std::string &dir, const std::string &prefix, const std::string &format, int quality, int max_queue, int nthreads, image_writer &w);
+
+/**
+ * @brief Function to queue an image to be written, never blocks on encoding
+ *
+ * @param w open writer
+ * @param img image to write, copied
+ * @param path if not NULL, the file name it will be written to
+ * @return int return non-zero value if the queue was full and the image was dropped
+ */
+int queue_image(image_writer &w, const cv::Mat &img, std::string *path = NULL);
+
+/**
+ * @brief Function to write everything still queued and stop the writer threads
+ *
+ * @param w writer to close
+ * @return int
+ */
+int close_image_writer(image_writer &w);
+
+#endif
@@ -0,0 +1,80 @@
+/**
+ * @file latest_capture.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for latest_capture.cpp
+ * @date 2022-04-18
+ */
+
+#ifndef LATEST_CAPTURE_H
+#define LATEST_CAPTURE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <opencv2/opencv.hpp>
+
+/**
+ * @brief Camera reader that always hands out the newest frame
+ *
+ * A thread grab()s every frame the camera delivers, so the driver queue never
+ * backs up, and retrieve()s it into a back buffer that is swapped into the slot
+ * once decoded. A frame that finished while the loop was busy is ready the
+ * moment it asks. With lazy decoding only the frame grabbed after the loop asks
+ * is retrieved, which saves converting frames nobody takes, but the loop then
+ * always waits for the next grab.
+ */
+struct latest_capture {
+  cv::VideoCapture *cap;
+
+  std::mutex lock;
+  std::condition_variable ready;
+  bool lazy; // only retrieve frames grabbed while the loop is waiting
+  bool want; // the loop is waiting for a frame
+  bool fresh; // slot holds a frame the loop has not taken
+  bool failed; // grab or retrieve failed, no more frames
+  bool stopping;
+  cv::Mat slot; // newest decoded frame, under lock
+  int64_t slot_time; // capture time of slot, ns on the prof_now clock
+  cv::Mat back; // frame being retrieved, only touched by the grab thread
+  std::thread thread;
+
+  std::atomic<bool> hw_time; // capture times come from the driver's buffer timestamps
+  std::atomic<long> grabbed;
+  std::atomic<long> retrieved;
+  std::atomic<long> taken; // frames handed to the loop
+};
+
+/**
+ * @brief Function to shrink the driver queue and start grabbing
+ *
+ * @param cap open camera, read only through the latest_capture until it is closed
+ * @param lc capture to start
+ * @param lazy only decode frames grabbed after the loop asks for one
+ * @return int return non-zero value on failure
+ */
+int open_latest_capture(cv::VideoCapture *cap, latest_capture &lc, bool lazy = false);
+
+/**
+ * @brief Function to get the newest frame not taken yet, waits at most one frame interval
+ *
+ * The frame's buffer is swapped with the one passed in, which is decoded
+ * into later on, so nothing is copied or allocated once sizes settle.
+ *
+ * @param lc open capture
+ * @param frame frame to write to
+ * @param time_ns capture time of the frame, ns on the prof_now clock
+ * @return int return non-zero value when the camera has stopped
+ */
+int read_latest(latest_capture &lc, cv::Mat &frame, int64_t &time_ns);
+
+/**
+ * @brief Function to stop grabbing and print how many frames were skipped
+ *
+ * @param lc capture to close
+ * @return int
+ */
+int close_latest_capture(latest_capture &lc);
+
+#endif
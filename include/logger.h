@@ -0,0 +1,90 @@
+/**
+ * @file logger.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for logger.cpp
+ * @date 2022-04-13
+ */
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <cstddef>
+
+#define LOG_MSG_LEN 200 // longer messages are cut off
+
+enum log_level {
+  LOG_DEBUG = 0, // per-frame detail, poses and image points
+  LOG_INFO,
+  LOG_WARN,
+  LOG_ERROR,
+  LOG_OFF
+};
+
+/**
+ * @brief Function to get a log level from its name
+ *
+ * @param name "debug", "info", "warn", "error" or "off"
+ * @return int log_level, -1 if the name is unknown
+ */
+int parse_log_level(const char *name);
+
+/**
+ * @brief Function to start the background writer
+ *
+ * Until this is called log_msg writes straight to stdout.
+ *
+ * @param level messages below this level are dropped before they are queued
+ * @param filename file to append to, NULL for stdout
+ * @param max_per_frame messages kept per frame, the rest of the frame's messages are counted and dropped
+ * @return int return non-zero value on failure
+ */
+int log_start(int level, const char *filename = NULL, int max_per_frame = 8);
+
+/**
+ * @brief Function to write everything still queued and stop the writer
+ *
+ * @return int
+ */
+int log_stop();
+
+/**
+ * @brief Function to check whether a message of this level would be kept
+ *
+ * Lets a caller skip building a message nobody will see.
+ *
+ * @param level log_level
+ * @return true if log_msg would queue it
+ */
+bool log_enabled(int level);
+
+/**
+ * @brief Function to mark the start of a new frame for rate limiting and the log prefix
+ *
+ * @param frame frame number
+ */
+void log_frame(long frame);
+
+/**
+ * @brief Function to log a message
+ *
+ * The message is formatted into a fixed-size record and queued, the writer
+ * thread does the actual I/O. If the queue is full the message is dropped and
+ * counted rather than blocking the caller.
+ *
+ * @param level log_level
+ * @param fmt printf format
+ */
+void log_msg(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Function to log a message that is not counted against the per-frame cap
+ *
+ * For rare decisions that must never be lost to a frame's chatter, like the
+ * governor's once a window. The queue being full still drops it.
+ *
+ * @param level log_level
+ * @param fmt printf format
+ */
+void log_event(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file luma.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for luma.cpp
+ * @date 2022-04-19
+ */
+
+#ifndef LUMA_H
+#define LUMA_H
+
+#include <opencv2/opencv.hpp>
+
+// pixel layout of the frames a camera delivers
+enum raw_format {
+  RAW_BGR = 0, // converted by the backend, the default
+  RAW_GRAY, // GREY, the frame is the luma plane
+  RAW_YUYV, // packed 4:2:2, Y in channel 0 of a CV_8UC2 frame
+  RAW_UYVY, // packed 4:2:2, Y in channel 1
+  RAW_NV12, // 4:2:0, Y plane on top of interleaved UV, rows * 3 / 2 rows
+  RAW_NV21,
+  RAW_I420, // 4:2:0, Y plane on top of separate U and V planes
+  RAW_YV12
+};
+
+/**
+ * @brief One frame with its luma plane, and BGR only once something asks for it
+ */
+struct luma_frame {
+  cv::Mat raw; // as captured
+  int format; // raw_format
+  cv::Mat gray; // Y plane, a view into raw where the layout allows it
+  cv::Mat bgr; // built by luma_bgr, or raw itself for RAW_BGR
+  bool have_bgr;
+};
+
+/**
+ * @brief Function to ask the camera for frames without the BGR conversion
+ *
+ * Sets CAP_PROP_CONVERT_RGB to false and checks the pixel format it gets.
+ * Compressed formats such as MJPG would need decoding anyway, so the conversion
+ * is switched back on for those.
+ *
+ * @param cap open camera
+ * @return int raw_format the frames will arrive in
+ */
+int open_luma_capture(cv::VideoCapture *cap);
+
+/**
+ * @brief Function to get the name of a raw format
+ *
+ * @param format raw_format
+ * @return const char*
+ */
+const char *raw_format_name(int format);
+
+/**
+ * @brief Function to take a captured frame and produce its gray plane
+ *
+ * The gray plane is made once per frame here, everything that needs intensity
+ * shares it. Frames that do not match format, for example a BGR frame from a
+ * backend that ignored CAP_PROP_CONVERT_RGB, are treated as what they are.
+ *
+ * @param raw captured frame
+ * @param format raw_format from open_luma_capture
+ * @param lf frame to write to, its buffers are reused
+ * @return int return non-zero value on failure
+ */
+int load_luma_frame(const cv::Mat &raw, int format, luma_frame &lf);
+
+/**
+ * @brief Function to get the frame in BGR, converting it the first time it is asked for
+ *
+ * The conversion writes into lf.bgr, so a caller that needs a particular
+ * buffer (for example one from next_record_frame) can put it there first.
+ *
+ * @param lf loaded frame
+ * @return cv::Mat& the BGR frame
+ */
+cv::Mat &luma_bgr(luma_frame &lf);
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file motion_gate.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for motion_gate.cpp
+ * @date 2022-04-19
+ */
+
+#ifndef MOTION_GATE_H
+#define MOTION_GATE_H
+
+#include <opencv2/opencv.hpp>
+
+#define MOTION_BLOCK 16 // block side in downsampled pixels, one simd register wide
+
+/**
+ * @brief Cheap change detector deciding whether the last detection still holds
+ *
+ * The gray frame is downsampled and compared block by block, with the sum of
+ * absolute differences, against the frame the last detection ran on. Comparing
+ * against that frame rather than the previous one means slow drift adds up
+ * until it is noticed.
+ */
+struct motion_gate {
+  int scale; // downsample factor
+  int threshold; // mean absolute difference per pixel for a block to count as moved
+  int max_reuse; // detect at least every max_reuse + 1 frames anyway
+
+  cv::Mat small; // current frame, downsampled
+  cv::Mat ref; // downsampled frame of the last detection
+  int reused; // frames in a row the result was reused
+
+  long frames;
+  long gated; // frames the detection was skipped on
+};
+
+/**
+ * @brief Function to set up a motion gate
+ *
+ * @param scale downsample factor before comparing, at least 1
+ * @param threshold mean absolute difference per pixel for a block to count as moved
+ * @param max_reuse most frames in a row to reuse a result for
+ * @param g gate to set up
+ * @return int return non-zero value on failure
+ */
+int init_motion_gate(int scale, int threshold, int max_reuse, motion_gate &g);
+
+/**
+ * @brief Function to decide whether the last detection can be reused for this frame
+ *
+ * Only the blocks overlapping roi are compared, and the comparison stops at
+ * the first one that moved. When the answer is no the caller is expected to
+ * detect on this frame, and it becomes the new reference.
+ *
+ * @param g gate
+ * @param gray gray frame the detection runs on
+ * @param roi area the last result depends on in gray's pixels, empty for the whole frame
+ * @return true if nothing in roi moved since the last detection
+ */
+bool motion_reuse(motion_gate &g, const cv::Mat &gray, const cv::Rect &roi);
+
+/**
+ * @brief Function to print how many detections the gate saved
+ *
+ * @param g gate
+ * @param name loop name to print
+ * @return int
+ */
+int print_motion_gate(const motion_gate &g, const char *name);
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * @file offline.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for offline.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef OFFLINE_H
+#define OFFLINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "cal_profile.h"
+#include "replay.h"
+#include "thread_pool.h"
+
+// a run of frames processed by one task, from its own reader and pipeline
+struct offline_segment {
+  long first; // first frame whose result is kept
+  long end; // one past the last frame, the source may run out before it
+  long warmup_first; // frame the pipeline starts at, the ones before first only bring its state up to date
+  long done_end; // one past the last frame actually processed, set when the segment finishes
+  bool done;
+  bool failed;
+  double secs; // wall time the segment took
+};
+
+/**
+ * @brief A recording split into segments that run in parallel on a thread pool
+ *
+ * Every segment opens the source itself, seeks to warmup frames before its
+ * first frame and runs a fresh frame_pipeline from there. The warm-up frames
+ * are processed but not kept, so the motion gate, the last detection and the
+ * pose filter are where a run through the whole recording would have them by
+ * the time the segment's own frames start.
+ *
+ * Segments write their results into their own part of results, and finishing
+ * one wakes whoever waits for it, so the results can be consumed in frame
+ * order while later segments still run.
+ */
+struct offline_job {
+  std::string source; // video file or image directory
+  pipeline_settings set;
+  const pipeline_model *model;
+  cal_profile calib;
+  double fps; // frame times for the pose filter
+  std::string img_dir; // when not empty, segments draw every frame and write it here
+  std::string img_format;
+
+  long total; // frames in the source, as far as it says
+  int warmup;
+  std::vector<offline_segment> segments;
+  std::vector<pipeline_result> results; // one per frame
+
+  std::mutex lock;
+  std::condition_variable finished; // signalled when a segment is done
+  std::atomic<long> frames_done; // kept frames processed over every segment
+  std::atomic<long> warmup_frames; // warm-up frames processed over every segment
+};
+
+/**
+ * @brief Function to split a recording into segments
+ *
+ * @param total frames in the recording
+ * @param segment frames per segment
+ * @param warmup frames processed before each segment's first, and not kept
+ * @param job job to write the segments to, source and settings are set by the caller
+ * @return int return non-zero value on failure
+ */
+int plan_offline_job(long total, long segment, int warmup, offline_job &job);
+
+/**
+ * @brief Function to queue every segment of a job on a pool
+ *
+ * @param pool pool to run on, work stealing keeps every worker busy when segments differ in cost
+ * @param job planned job, it has to outlive the pool's work
+ * @return int
+ */
+int start_offline_job(thread_pool &pool, offline_job &job);
+
+/**
+ * @brief Function to wait for a segment to finish
+ *
+ * @param job job
+ * @param idx index of the segment
+ * @return int return non-zero value if the segment failed
+ */
+int wait_offline_segment(offline_job &job, int idx);
+
+#endif
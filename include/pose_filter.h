@@ -0,0 +1,115 @@
+/**
+ * @file pose_filter.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for pose_filter.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef POSE_FILTER_H
+#define POSE_FILTER_H
+
+#include <cstdint>
+#include <opencv2/opencv.hpp>
+
+// defaults for hand-held boards at 30 fps, tune them on a recorded log with posefilt.exe
+#define POSE_ROT_ACCEL 2.0 // rad/s^2
+#define POSE_TRANS_ACCEL 10.0 // board squares/s^2
+#define POSE_ROT_NOISE 0.005 // rad
+#define POSE_TRANS_NOISE 0.03 // board squares
+
+/**
+ * @brief Constant velocity Kalman filter on a board pose
+ *
+ * Rotation is filtered on the tangent space of SO(3): the state keeps a
+ * rotation matrix and an angular velocity, and each measurement is turned
+ * into the rotation vector from the predicted rotation to the measured one.
+ * Translation is filtered as a position and velocity. With the same noise on
+ * every axis each of the six axes is its own two state filter, so they share
+ * one 2x2 covariance per group.
+ */
+struct pose_filter {
+  double rot_accel; // process noise, angular acceleration std in rad/s^2
+  double trans_accel; // process noise, acceleration std in board squares/s^2
+  double rot_noise; // measurement std in rad
+  double trans_noise; // measurement std in board squares
+
+  bool init; // state holds a pose
+  int64_t time_ns; // time of the state
+  cv::Matx33d rot; // camera from board rotation
+  cv::Vec3d rot_vel; // angular velocity in camera coordinates, rad/s
+  cv::Vec3d trans;
+  cv::Vec3d trans_vel; // board squares/s
+  cv::Matx22d rot_cov; // [angle, rate] covariance of one rotation axis
+  cv::Matx22d trans_cov; // [position, velocity] covariance of one translation axis
+
+  long updates;
+  long resets; // gaps and jumps that restarted the filter
+};
+
+/**
+ * @brief Function to set up a pose filter
+ *
+ * @param rot_accel angular acceleration std in rad/s^2, larger follows faster motion with less smoothing
+ * @param trans_accel acceleration std in board squares/s^2
+ * @param rot_noise rotation measurement std in rad
+ * @param trans_noise translation measurement std in board squares
+ * @param f filter to set up
+ * @return int return non-zero value on failure
+ */
+int init_pose_filter(double rot_accel, double trans_accel, double rot_noise, double trans_noise, pose_filter &f);
+
+/**
+ * @brief Function to correct the filter with a measured pose
+ *
+ * The filter restarts from the measurement after a gap of more than half a
+ * second or a jump that no smooth motion explains, such as solvePnP flipping
+ * to the mirrored solution.
+ *
+ * @param f filter
+ * @param time_ns time the frame was captured
+ * @param rvec rotation vector from solvePnP
+ * @param tvec translation vector from solvePnP
+ * @return int return non-zero value on failure
+ */
+int update_pose_filter(pose_filter &f, int64_t time_ns, const cv::Mat &rvec, const cv::Mat &tvec);
+
+/**
+ * @brief Function to get the filtered pose at a time, extrapolated with the velocities
+ *
+ * Extrapolation is capped at 200 ms past the last measurement.
+ *
+ * @param f filter
+ * @param time_ns time to get the pose at, usually capture time plus the display latency
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int return non-zero value if the filter holds no pose
+ */
+int predict_pose(const pose_filter &f, int64_t time_ns, cv::Mat &rvec, cv::Mat &tvec);
+
+/**
+ * @brief Function to interpolate between two poses, SLERP on rotation and lerp on translation
+ *
+ * alpha outside [0, 1] extrapolates along the same motion.
+ *
+ * @param rvec0 first rotation vector
+ * @param tvec0 first translation vector
+ * @param rvec1 second rotation vector
+ * @param tvec1 second translation vector
+ * @param alpha 0 for the first pose, 1 for the second
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int
+ */
+int interpolate_pose(const cv::Vec3d &rvec0, const cv::Vec3d &tvec0, const cv::Vec3d &rvec1, const cv::Vec3d &tvec1,
+                     double alpha, cv::Vec3d &rvec, cv::Vec3d &tvec);
+
+/**
+ * @brief Function to get the angle between two rotations
+ *
+ * @param rvec0 first rotation vector
+ * @param rvec1 second rotation vector
+ * @return double angle in radians
+ */
+double rotation_distance(const cv::Vec3d &rvec0, const cv::Vec3d &rvec1);
+
+#endif
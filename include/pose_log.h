@@ -0,0 +1,118 @@
+/**
+ * @file pose_log.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for pose_log.cpp
+ * @date 2022-04-14
+ */
+
+#ifndef POSE_LOG_H
+#define POSE_LOG_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#define POSE_LOG_VERSION 2
+
+// start of the file
+struct pose_log_header {
+  char magic[8]; // "POSELOG"
+  uint32_t version; // POSE_LOG_VERSION
+  uint32_t record_size; // sizeof(pose_record)
+  uint64_t capacity; // records the file has room for
+  uint64_t count; // records written, filled in on close
+};
+
+// one pose, the file is a pose_log_header followed by capacity of these
+struct pose_record {
+  int64_t time_ns; // system clock when the pose was written, ns since the epoch
+  int64_t capture_ns; // capture time of the frame, ns on the prof_now clock
+  uint32_t camera; // session id, 0 for ar.exe
+  uint32_t frame; // frame number within the camera
+  double rvec[3]; // solvePnP rotation vector
+  double tvec[3]; // solvePnP translation vector
+  float reproj_err; // rms reprojection error of the board corners, pixels
+  uint32_t valid; // written last, 1 once the record is complete
+};
+
+/**
+ * @brief Memory-mapped pose log
+ *
+ * The whole file is sized and mapped when it is opened, so writing a pose is
+ * a copy into memory that never allocates or makes a system call. A
+ * background thread flushes the mapping to disk once a second.
+ */
+struct pose_log {
+  std::string filename;
+  char *base; // mapped file
+  uint64_t map_size;
+  uint64_t capacity;
+  std::atomic<uint64_t> next; // next free record
+  std::atomic<uint64_t> dropped; // poses that did not fit
+  std::atomic<bool> stop;
+  std::thread flusher;
+#ifdef _WIN32
+  void *file;
+  void *mapping;
+#else
+  int fd;
+#endif
+};
+
+/**
+ * @brief Function to create a pose log and map it
+ *
+ * @param filename file to create, overwritten if it exists
+ * @param capacity number of poses the file has room for
+ * @param log pose log to write to
+ * @return int return non-zero value on failure
+ */
+int open_pose_log(const std::string &filename, uint64_t capacity, pose_log &log);
+
+/**
+ * @brief Function to record a pose, safe to call from several threads at once
+ *
+ * @param log open pose log
+ * @param camera camera or session id
+ * @param frame frame number within the camera
+ * @param capture_ns capture time of the frame, ns on the prof_now clock
+ * @param rvec rotation vector from solvePnP
+ * @param tvec translation vector from solvePnP
+ * @param reproj_err rms reprojection error in pixels
+ * @return int return non-zero value if the log is full
+ */
+int write_pose(pose_log &log, int camera, long frame, int64_t capture_ns, const cv::Mat &rvec, const cv::Mat &tvec, float reproj_err);
+
+/**
+ * @brief Function to flush a pose log, trim it to the poses written and unmap it
+ *
+ * @param log pose log to close
+ * @return int return non-zero value on failure
+ */
+int close_pose_log(pose_log &log);
+
+/**
+ * @brief Function to read every complete pose from a pose log
+ *
+ * Also reads logs that were never closed, for example after a crash, by
+ * skipping every record that was not finished.
+ *
+ * @param filename pose log file
+ * @param records vector of poses to write to
+ * @return int return non-zero value on failure
+ */
+int read_pose_log(const char *filename, std::vector<pose_record> &records);
+
+/**
+ * @brief Function to convert a pose log to a csv
+ *
+ * @param filename pose log file
+ * @param csv_filename name of csv file
+ * @return int return non-zero value on failure
+ */
+int pose_log_to_csv(const char *filename, const char *csv_filename);
+
+#endif
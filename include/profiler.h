@@ -0,0 +1,165 @@
+/**
+ * @file profiler.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for profiler.cpp
+ * @date 2022-04-12
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <chrono>
+#include <cstdint>
+
+// pipeline stages that get timed
+enum prof_stage {
+  STAGE_CAPTURE = 0, // reading a frame from the camera
+  STAGE_GRAY, // color to gray conversion
+  STAGE_FIND, // findChessboardCorners and the other detectors
+  STAGE_SUBPIX, // sub-pixel corner refinement
+  STAGE_PNP, // solvePnP
+  STAGE_PROJECT, // projectPoints
+  STAGE_HARRIS, // cornerHarris and normalize in har_main
+  STAGE_DRAW, // drawing the overlay
+  STAGE_DISPLAY, // imshow and the key poll
+  STAGE_FRAME, // the whole loop iteration
+  STAGE_LATENCY, // from the camera capturing the frame to handing it to the display
+  STAGE_MOTION, // the motion gate deciding whether to detect
+  NUM_STAGES
+};
+
+/**
+ * @brief Function to get the name of a stage
+ *
+ * @param stage prof_stage
+ * @return const char*
+ */
+const char *prof_stage_name(int stage);
+
+/**
+ * @brief Function to get a timestamp for prof_record
+ *
+ * @return int64_t nanoseconds on the monotonic clock
+ */
+inline int64_t prof_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Function to add one timing to a stage's histogram
+ *
+ * Every thread writes to its own histograms, so recording takes no lock and
+ * no atomic read-modify-write. While a trace is recording the stage is also
+ * added to it, as ending now.
+ *
+ * @param stage prof_stage
+ * @param ns duration in nanoseconds
+ */
+void prof_record(int stage, int64_t ns);
+
+/**
+ * @brief Function to start recording every timed stage into a trace
+ *
+ * Events go into a ring buffer allocated here, so recording never allocates.
+ * Once it is full the oldest events are overwritten.
+ *
+ * @param capacity number of events kept, rounded up to a power of two
+ * @return int return non-zero value on failure
+ */
+int trace_start(int capacity = 1 << 18);
+
+/**
+ * @brief Function to check whether a trace is being recorded
+ *
+ * @return true between trace_start and trace_stop
+ */
+bool trace_enabled();
+
+/**
+ * @brief Function to stop recording the trace, events already recorded are kept
+ *
+ * @return int
+ */
+int trace_stop();
+
+/**
+ * @brief Function to write the recorded events as Chrome trace JSON
+ *
+ * The file opens in chrome://tracing or ui.perfetto.dev, with one track per thread.
+ *
+ * @param filename name of json file
+ * @return int return non-zero value on failure
+ */
+int trace_dump_json(const char *filename);
+
+/**
+ * @brief Function to write p50/p95/p99 of every stage, merged over all threads, to a csv
+ *
+ * @param filename name of csv file
+ * @return int return non-zero value on failure
+ */
+int prof_dump_csv(const char *filename);
+
+/**
+ * @brief Function to print p50/p95/p99 of every stage
+ *
+ * @return int
+ */
+int prof_print();
+
+/**
+ * @brief Function to get p95 of every stage, merged over all threads
+ *
+ * @param p95_ms NUM_STAGES values in milliseconds to write to, 0 for stages never timed
+ * @param counts if not NULL, NUM_STAGES timing counts to write to
+ * @return int
+ */
+int prof_stage_p95(double *p95_ms, uint64_t *counts = NULL);
+
+/**
+ * @brief Function to read the p95 of every stage back from a csv written by prof_dump_csv
+ *
+ * @param filename name of csv file
+ * @param p95_ms NUM_STAGES values in milliseconds to write to, -1 for stages not in the file
+ * @return int return non-zero value on failure
+ */
+int prof_read_p95_csv(const char *filename, double *p95_ms);
+
+/**
+ * @brief Function to get the total time spent in every stage, summed over all threads
+ *
+ * Cheap enough to call once a second, the difference between two calls is the
+ * time spent in between.
+ *
+ * @param sums NUM_STAGES totals in nanoseconds to write to
+ * @return int
+ */
+int prof_stage_sums(int64_t *sums);
+
+/**
+ * @brief Function to clear every histogram
+ *
+ * Only meant for between runs, counts recorded at the same time can be lost.
+ *
+ * @return int
+ */
+int prof_reset();
+
+/**
+ * @brief Times the enclosing scope into a stage
+ */
+class prof_scope {
+ public:
+  explicit prof_scope(int stage) : stage(stage), start(prof_now()) {}
+  ~prof_scope() { prof_record(stage, prof_now() - start); }
+
+ private:
+  int stage;
+  int64_t start;
+};
+
+#define PROF_CONCAT_(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_(a, b)
+#define PROF_SCOPE(stage) prof_scope PROF_CONCAT(prof_scope_, __LINE__)(stage)
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * @file replay.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for replay.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frame_pipeline.h"
+
+/**
+ * @brief Function to run one frame of a recording through a pipeline
+ *
+ * Converts the frame to gray and runs it through run_frame_pipeline like the
+ * camera loops do, timing the whole frame into the profiler and counting it
+ * with end_frame if it allocated.
+ *
+ * @param p pipeline
+ * @param frame BGR or gray frame, the overlay is drawn on it in place
+ * @param time_ns capture time of the frame, for the pose filter
+ * @param r result to write to
+ * @param draw whether to draw the overlay, frames that are only run to bring the state up to date skip it
+ * @return int return non-zero value on failure
+ */
+int replay_frame(frame_pipeline &p, cv::Mat &frame, int64_t time_ns, pipeline_result &r, bool draw = true);
+
+/**
+ * @brief Function to write the results of a sequence as golden files
+ *
+ * dir gets corners.csv (a row per frame, just the name where the board was not
+ * found) and poses.csv (the measured pose of the frames where it was).
+ *
+ * @param dir directory to write to, created if it does not exist
+ * @param names name of each frame
+ * @param times capture time of each frame
+ * @param results result of each frame
+ * @return int return non-zero value on failure
+ */
+int write_replay_golden(const std::string &dir, const std::vector<std::string> &names, const std::vector<int64_t> &times, const std::vector<pipeline_result> &results);
+
+/**
+ * @brief Function to read golden files written by write_replay_golden
+ *
+ * @param dir directory to read from
+ * @param names name of each frame to write to
+ * @param results result of each frame to write to, without the drawn pose
+ * @return int return non-zero value on failure
+ */
+int read_replay_golden(const std::string &dir, std::vector<std::string> &names, std::vector<pipeline_result> &results);
+
+#endif
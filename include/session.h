@@ -0,0 +1,136 @@
+/**
+ * @file session.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for session.cpp
+ * @date 2022-04-05
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "ar.h"
+#include "cal_profile.h"
+#include "frame_source.h"
+#include "pose_log.h"
+#include "thread_pool.h"
+
+typedef std::chrono::steady_clock::time_point frame_time;
+
+/**
+ * @brief Things every session draws with, loaded once and shared read only.
+ */
+struct ar_model {
+  cv::Size patternsize; // inner corners of the board
+  std::map<int, std::vector<float> > objpoints; // obj file vertices
+  std::vector<std::vector<int> > connections; // obj file faces
+};
+
+/**
+ * @brief Per-camera counters, reset every time they are reported.
+ */
+struct session_stats {
+  int frames; // frames processed
+  int dropped; // camera frames replaced before they could be processed
+  int found; // frames where the board was found
+  double latency_sum; // capture to finished overlay, ms
+  double latency_max;
+  frame_time window_start;
+};
+
+/**
+ * @brief One camera with its own calibration, pose and overlay.
+ *
+ * At most one frame of a session is processed at a time, so the pose state
+ * needs no locking. Live cameras keep only the newest unprocessed frame, which
+ * is how every camera slows down by the same amount when the pool is saturated.
+ */
+struct ar_session {
+  int id;
+  frame_source source;
+  cal_profile calib; // as loaded from the calibration file
+  cal_profile frame_calib; // calib rescaled to the current frame size
+  int overlay; // overlay_mode
+  const ar_model *model;
+  pose_log *poses; // shared pose recorder, NULL to not record
+  long frame_no; // frames processed so far
+
+  // pose state
+  bool pose_valid;
+  cv::Mat rotations;
+  cv::Mat translations;
+
+  // shared between the capture thread, the pool and the display
+  std::mutex lock;
+  bool busy; // a frame is queued on or running in the pool
+  cv::Mat pending; // newest live frame waiting for the session to be free
+  frame_time pending_time;
+  cv::Mat out; // last finished overlay
+  bool out_new;
+  session_stats stats;
+
+  std::atomic<bool> stop;
+  std::atomic<bool> done; // source ran out of frames
+  std::thread capture_thread;
+};
+
+/**
+ * @brief Function to open a session's source and calibration
+ *
+ * @param id index of the session
+ * @param spec frame source, optionally followed by @camera_id to pick the calibration profile
+ * @param cal_fn calibration csv
+ * @param model shared board and obj data
+ * @param overlay overlay_mode to draw
+ * @param s session to write to
+ * @return int return non-zero value on failure
+ */
+int open_session(int id, const std::string &spec, char *cal_fn, const ar_model *model, int overlay, ar_session &s);
+
+/**
+ * @brief Function to start feeding a session's frames to the pool
+ *
+ * @param pool pool shared by all sessions
+ * @param s session to start
+ * @return int return non-zero value on failure
+ */
+int start_session(thread_pool &pool, ar_session &s);
+
+/**
+ * @brief Function to stop a session and wait for its capture thread
+ *
+ * Frames already queued on the pool still finish, call pool.wait_idle() before
+ * destroying the session.
+ *
+ * @param s session to stop
+ * @return int
+ */
+int stop_session(ar_session &s);
+
+/**
+ * @brief Function to detect the board and draw the overlay on one frame
+ *
+ * @param s session the frame belongs to
+ * @param frame captured frame, the overlay is drawn on it in place
+ * @param dst frame with the overlay drawn on it, shares frame's pixels
+ * @param captured time the frame was captured
+ * @return int return non-zero value on failure
+ */
+int process_session_frame(ar_session &s, cv::Mat &frame, cv::Mat &dst, frame_time captured);
+
+/**
+ * @brief Function to print each session's fps and latency since the last report
+ *
+ * @param sessions sessions to report on
+ * @return int
+ */
+int print_session_stats(std::vector<ar_session *> &sessions);
+
+#endif
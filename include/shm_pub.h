@@ -0,0 +1,160 @@
+/**
+ * @file shm_pub.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for shm_pub.cpp
+ * @date 2022-04-15
+ */
+
+#ifndef SHM_PUB_H
+#define SHM_PUB_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#define SHM_VERSION 1
+
+// start of the shared memory segment, followed by the slots
+struct shm_header {
+  char magic[8]; // "ARSHM"
+  uint32_t version; // SHM_VERSION
+  uint32_t slots; // slots in the ring
+  uint32_t slot_size; // bytes per slot, header included
+  uint32_t max_corners; // room for corners per slot
+  uint32_t max_frame_bytes; // room for the frame per slot, 0 if frames are not published
+  uint32_t pad;
+  std::atomic<uint64_t> latest; // number of the newest published frame, 0 before the first
+};
+
+// start of a slot, followed by max_corners x/y floats and then the frame pixels
+struct shm_slot {
+  std::atomic<uint64_t> seq; // seqlock, odd while the slot is being written
+  uint64_t number; // publish number, 1 for the first frame
+  int64_t time_ns; // steady clock when published, the same clock in every process
+  uint32_t found; // 1 if the board was found and the pose is valid
+  uint32_t ncorners;
+  double rvec[3];
+  double tvec[3];
+  int32_t width; // frame size and cv type, 0 when no frame was published
+  int32_t height;
+  int32_t type;
+  uint32_t frame_bytes;
+};
+
+// one frame as read by a consumer
+struct shm_pose {
+  uint64_t number;
+  int64_t time_ns;
+  bool found;
+  cv::Vec3d rvec;
+  cv::Vec3d tvec;
+  std::vector<cv::Point2f> corner_set;
+};
+
+struct shm_publisher {
+  std::string name;
+  char *base;
+  size_t size;
+  uint64_t number; // frames published
+};
+
+struct shm_subscriber {
+  std::string name;
+  char *base;
+  size_t size;
+};
+
+/**
+ * @brief Function to get the steady clock in ns, comparable between processes on one host
+ *
+ * @return int64_t
+ */
+int64_t shm_now();
+
+/**
+ * @brief Function to create the shared memory ring and map it
+ *
+ * @param name shared memory name, like "/ar_pose"
+ * @param slots frames kept in the ring, a reader has slots - 1 frames of time to copy one out
+ * @param max_corners most corners a frame can carry
+ * @param max_frame_bytes most bytes of pixels a frame can carry, 0 to publish poses only
+ * @param pub publisher to write to
+ * @return int return non-zero value on failure
+ */
+int open_shm_publisher(const char *name, int slots, int max_corners, size_t max_frame_bytes, shm_publisher &pub);
+
+/**
+ * @brief Function to publish one frame's pose, corners and optionally the frame itself
+ *
+ * Never waits for readers. A reader that is still copying the slot being
+ * overwritten sees the sequence change and retries.
+ *
+ * @param pub open publisher
+ * @param found true if the board was found and rvec/tvec are valid
+ * @param corner_set corners found, cut to max_corners
+ * @param rvec rotation vector from solvePnP, ignored if not found
+ * @param tvec translation vector from solvePnP, ignored if not found
+ * @param frame frame to publish, NULL or too large to skip it
+ * @return int return non-zero value on failure
+ */
+int shm_publish(shm_publisher &pub, bool found, const std::vector<cv::Point2f> &corner_set, const cv::Mat &rvec, const cv::Mat &tvec, const cv::Mat *frame = NULL);
+
+/**
+ * @brief Function to unmap and remove the shared memory ring
+ *
+ * @param pub publisher to close
+ * @return int
+ */
+int close_shm_publisher(shm_publisher &pub);
+
+/**
+ * @brief Function to map a publisher's ring for reading
+ *
+ * @param name shared memory name the publisher used
+ * @param sub subscriber to write to
+ * @return int return non-zero value on failure, for example no publisher yet
+ */
+int open_shm_subscriber(const char *name, shm_subscriber &sub);
+
+/**
+ * @brief Function to get the number of the newest published frame
+ *
+ * @param sub open subscriber
+ * @return uint64_t 0 before the first frame
+ */
+uint64_t shm_latest(const shm_subscriber &sub);
+
+/**
+ * @brief Function to copy out a consistent frame
+ *
+ * @param sub open subscriber
+ * @param number frame to read, 0 for the newest
+ * @param pose pose to write to
+ * @param frame if not NULL, the frame pixels are copied here (empty if none were published)
+ * @return int return non-zero value if the frame was already overwritten
+ */
+int shm_read(shm_subscriber &sub, uint64_t number, shm_pose &pose, cv::Mat *frame = NULL);
+
+/**
+ * @brief Function to wait for a frame newer than the one last read
+ *
+ * Spins, then yields, so a waiting reader sees a new frame within microseconds.
+ *
+ * @param sub open subscriber
+ * @param last number of the last frame read
+ * @param timeout_ms give up after this long
+ * @return uint64_t number of the newest frame, 0 on timeout
+ */
+uint64_t shm_wait(const shm_subscriber &sub, uint64_t last, int timeout_ms);
+
+/**
+ * @brief Function to unmap the ring
+ *
+ * @param sub subscriber to close
+ * @return int
+ */
+int close_shm_subscriber(shm_subscriber &sub);
+
+#endif
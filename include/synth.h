@@ -0,0 +1,148 @@
+/**
+ * @file synth.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for synth.cpp
+ * @date 2022-04-20
+ */
+
+#ifndef SYNTH_H
+#define SYNTH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "cal_profile.h"
+
+// one frame of a trajectory, the board pose solvePnP should find
+struct synth_pose {
+  int64_t time_ns; // from the start of the sequence
+  cv::Vec3d rvec;
+  cv::Vec3d tvec; // in board squares, like solvePnP with get_point_set
+};
+
+// what is done to a rendered frame to make it look like a camera took it
+struct synth_params {
+  double blur; // gaussian blur sigma in pixels, defocus
+  double exposure; // share of the frame interval the shutter is open, the board moves while it is
+  double noise; // gaussian noise std in gray levels
+  double gain; // brightness multiplier
+  double gradient; // brightness change from the left edge to the right, as a share
+  double occlusion; // chance per frame of something covering part of the board
+};
+
+/**
+ * @brief Renders a board through a calibrated camera, lens distortion included
+ *
+ * Every output pixel is split into supersample x supersample samples. Each
+ * sample's ray is undistorted once, up front, and intersected with the board
+ * plane for every frame, so a frame costs one homography per sample and the
+ * edges come out area-averaged like a real sensor.
+ */
+struct synth_renderer {
+  cal_profile cal; // intrinsics at the output size
+  cv::Size patsize; // inner corners, the board has one more square each way
+  int supersample;
+  cv::Mat rays; // CV_32FC2 normalized image coordinates of every sample
+  cv::Mat samples; // CV_32F board brightness per sample, reused between frames
+};
+
+/**
+ * @brief Function to make a trajectory
+ *
+ * Built in are orbit (the camera swings around the board), sweep (the board
+ * crosses the view at a slant), shake (hand tremor on a slow drift) and static.
+ * Anything else is read as a csv from posecsv.exe, so a recorded session can be
+ * rendered again; its poses keep their times and frames is only an upper limit.
+ *
+ * @param name built in trajectory or csv file
+ * @param cal intrinsics at the output size, the built in ones are sized to fill about half the frame
+ * @param patsize inner corners of the board
+ * @param frames number of frames
+ * @param fps frame rate of the built in trajectories
+ * @param poses vector of poses to write to
+ * @return int return non-zero value on failure
+ */
+int synth_trajectory(const std::string &name, const cal_profile &cal, cv::Size patsize, int frames, double fps, std::vector<synth_pose> &poses);
+
+/**
+ * @brief Function to make intrinsics for a distortion free camera with a 60 degree field of view
+ *
+ * For rendering on a machine without a calibration.csv.
+ *
+ * @param size image size
+ * @param cal profile to write to
+ * @return int
+ */
+int default_synth_camera(cv::Size size, cal_profile &cal);
+
+/**
+ * @brief Function to set up a renderer
+ *
+ * @param cal intrinsics, image_size is the output size
+ * @param patsize inner corners of the board
+ * @param supersample samples per pixel each way, at least 1
+ * @param r renderer to set up
+ * @return int return non-zero value on failure
+ */
+int init_synth_renderer(const cal_profile &cal, cv::Size patsize, int supersample, synth_renderer &r);
+
+/**
+ * @brief Function to render the board at one pose, without noise or lighting
+ *
+ * @param r renderer
+ * @param rvec rotation vector
+ * @param tvec translation vector
+ * @param dst CV_32F image at the output size, 0 to 255
+ * @return int
+ */
+int render_board(synth_renderer &r, const cv::Vec3d &rvec, const cv::Vec3d &tvec, cv::Mat &dst);
+
+/**
+ * @brief Function to render one frame of a trajectory as a camera would have taken it
+ *
+ * With exposure the frame averages poses around its own, interpolated toward
+ * the neighbouring frames, so fast motion smears like it does on a real shutter.
+ *
+ * @param r renderer
+ * @param p effects
+ * @param poses trajectory
+ * @param k frame to render
+ * @param rng random numbers for noise and occlusion, seed it for repeatable sequences
+ * @param dst CV_8UC1 frame to write to
+ * @param occluded if not NULL, set to whether part of the board was covered
+ * @return int return non-zero value on failure
+ */
+int render_synth_frame(synth_renderer &r, const synth_params &p, const std::vector<synth_pose> &poses, int k, cv::RNG &rng, cv::Mat &dst, bool *occluded = NULL);
+
+/**
+ * @brief Function to get the corners a perfect detector would find at a pose
+ *
+ * @param r renderer
+ * @param pose pose of the frame
+ * @param corners corners in get_point_set order to write to
+ * @return int
+ */
+int synth_corners(const synth_renderer &r, const synth_pose &pose, std::vector<cv::Point2f> &corners);
+
+/**
+ * @brief Function to write a trajectory as csv, one "image,time_ns,rx,ry,rz,tx,ty,tz" row per frame
+ *
+ * @param filename name of csv file
+ * @param names image name of each pose
+ * @param poses trajectory
+ * @return int return non-zero value on failure
+ */
+int write_synth_poses_csv(const char *filename, const std::vector<std::string> &names, const std::vector<synth_pose> &poses);
+
+/**
+ * @brief Function to read a trajectory written by write_synth_poses_csv
+ *
+ * @param filename name of csv file
+ * @param names image name of each pose to write to
+ * @param poses trajectory to write to
+ * @return int return non-zero value on failure
+ */
+int read_synth_poses_csv(const char *filename, std::vector<std::string> &names, std::vector<synth_pose> &poses);
+
+#endif
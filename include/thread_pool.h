@@ -0,0 +1,87 @@
+/**
+ * @file thread_pool.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for thread_pool.cpp
+ * @date 2022-04-05
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Work-stealing thread pool shared by everything that runs per frame.
+ *
+ * Every worker owns a queue. Tasks are handed out round-robin and each worker
+ * runs its own queue oldest first, so tasks that resubmit themselves (one per
+ * camera session) take turns instead of starving each other. A worker with an
+ * empty queue steals the newest task from the back of another worker's queue.
+ */
+class thread_pool {
+ public:
+  /**
+   * @brief Construct a new thread pool
+   *
+   * @param nthreads number of workers, 0 for one per hardware thread
+   */
+  explicit thread_pool(int nthreads = 0);
+  ~thread_pool();
+
+  thread_pool(const thread_pool &) = delete;
+  thread_pool &operator=(const thread_pool &) = delete;
+
+  /**
+   * @brief Function to queue a task
+   *
+   * @param task task to run on one of the workers
+   */
+  void submit(std::function<void()> task);
+
+  /**
+   * @brief Function to block until every submitted task has finished
+   */
+  void wait_idle();
+
+  /**
+   * @brief Function to get the number of workers
+   *
+   * @return int
+   */
+  int size() const { return (int) workers.size(); }
+
+  /**
+   * @brief Function to get the index of the calling worker
+   *
+   * @return int worker index, -1 when not called from a worker of any pool
+   */
+  static int worker_index();
+
+ private:
+  struct worker_queue {
+    std::mutex lock;
+    std::deque<std::function<void()> > tasks;
+  };
+
+  void worker_loop(int idx);
+  bool pop_task(int idx, std::function<void()> &task);
+
+  std::vector<std::unique_ptr<worker_queue> > queues;
+  std::vector<std::thread> workers;
+  std::mutex sleep_lock;
+  std::condition_variable wake; // signalled when a task is submitted
+  std::condition_variable idle; // signalled when pending drops to 0
+  std::atomic<int> queued; // tasks sitting in a queue
+  std::atomic<int> pending; // tasks queued or running
+  std::atomic<unsigned> next_queue;
+  bool stopping;
+};
+
+#endif
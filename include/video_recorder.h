@@ -0,0 +1,113 @@
+/**
+ * @file video_recorder.h
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Header file for video_recorder.cpp
+ * @date 2022-04-17
+ */
+
+#ifndef VIDEO_RECORDER_H
+#define VIDEO_RECORDER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+// what to do with a finished frame when the encoder is behind
+enum record_policy {
+  RECORD_DROP_NEWEST = 0, // drop the new frame, what is queued keeps playing smoothly
+  RECORD_DROP_OLDEST, // drop the oldest queued frame, the recording stays close to live
+  RECORD_QUEUE, // never drop, the queue grows until the encoder catches up
+  RECORD_BLOCK // never drop, record_frame waits for room, for offline work where nothing runs live
+};
+
+/**
+ * @brief Background video recorder
+ *
+ * Frames are handed over by reference, the encoder thread is the only one
+ * that touches the pixels after that. Frame buffers go back to a pool once
+ * they are encoded, so a recording loop does not allocate a new frame each time.
+ */
+struct video_recorder {
+  std::string filename;
+  double fps;
+  int policy; // record_policy
+  int max_queue;
+
+  bool y4m; // raw YUV4MPEG2 instead of cv::VideoWriter
+  cv::VideoWriter writer;
+  FILE *y4m_fp;
+  cv::Size size; // size of the recording, set by the first frame
+
+  std::mutex lock;
+  std::condition_variable ready;
+  std::condition_variable room; // signalled when the encoder takes a frame off the queue
+  std::deque<cv::Mat> queue; // finished frames waiting to be encoded
+  std::vector<cv::Mat> pool; // encoded frames whose buffers can be reused
+  bool stopping;
+  std::thread thread;
+
+  std::atomic<long> written;
+  std::atomic<long> dropped;
+  int max_depth; // deepest the queue got
+};
+
+/**
+ * @brief Function to get a record policy from its name
+ *
+ * @param name "drop", "drop-oldest" or "queue"
+ * @return int record_policy, -1 if the name is unknown
+ */
+int parse_record_policy(const char *name);
+
+/**
+ * @brief Function to start a recording
+ *
+ * A .y4m filename writes raw YUV4MPEG2, anything else goes to cv::VideoWriter
+ * (MJPG for .avi, mp4v for .mp4).
+ *
+ * @param filename file to record to
+ * @param fps frame rate written to the file
+ * @param policy record_policy when the encoder is behind
+ * @param max_queue frames that can wait for the encoder
+ * @param rec recorder to start
+ * @return int return non-zero value on failure
+ */
+int open_video_recorder(const std::string &filename, double fps, int policy, int max_queue, video_recorder &rec);
+
+/**
+ * @brief Function to get a frame buffer to draw the next frame into
+ *
+ * @param rec open recorder
+ * @param size frame size
+ * @param type frame type
+ * @return cv::Mat a buffer from the pool, or a new one if none is free
+ */
+cv::Mat next_record_frame(video_recorder &rec, cv::Size size, int type);
+
+/**
+ * @brief Function to hand a finished frame to the encoder
+ *
+ * Only the reference is queued, so the caller must not draw into the frame
+ * afterwards. Get the next one from next_record_frame.
+ *
+ * @param rec open recorder
+ * @param frame finished frame
+ * @return int return non-zero value if a frame was dropped
+ */
+int record_frame(video_recorder &rec, const cv::Mat &frame);
+
+/**
+ * @brief Function to encode everything queued, close the file and report dropped frames
+ *
+ * @param rec recorder to close
+ * @return int
+ */
+int close_video_recorder(video_recorder &rec);
+
+#endif
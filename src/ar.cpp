@@ -1,207 +1,921 @@
-/**
- * @file ar.cpp
- * @author Nate Novak (novak.n@northeastern.edu)
- * @brief Library of functions for conducting augmented reality
- * @date 2022-03-23
- */ 
-#include "../include/ar.h"
-
-/**
- * @brief Function to detect and extract chessboard
- * 
- * @param src source image to find the corners in 
- * @param dst dst image that displays the the corners
- * @param patsize size of the pattern
- * @param corner_set vector of the point location of each corner  
- * @param pattern_found bool passed by reference to determine if corners were found. 
- * @return int return non-zero value on failure. 
- */
-int detect_chessboard(const cv::Mat &src, cv::Size patsize, std::vector<cv::Point2f> &corner_set, bool &pattern_found) { 
-  pattern_found = cv::findChessboardCorners(src, patsize, corner_set, cv::CALIB_CB_FAST_CHECK); 
-
-  if(pattern_found) {
-    cv::Mat gray; 
-    cv::cvtColor(src, gray, cv::COLOR_RGB2GRAY); 
-    cv::cornerSubPix(gray, corner_set, cv::Size(11, 11), cv::Size(-1, -1), cv::TermCriteria(cv::TermCriteria::EPS + cv::TermCriteria::MAX_ITER, 30, 0.1));
-  }   
-  return 0; 
-} 
-
-/**
- * @brief Function to get the point set if there's a pattern
- * 
- * @param pat_size size of the pattern
- * @param point_set point set to write to
- * @return int N/A
- */
-int get_point_set(const cv::Size pat_size, std::vector<cv::Vec3f> &point_set) {
-  
-  for(int i = 0; i < pat_size.height; i++) {
-    for(int j = 0; j < pat_size.width; j++) {
-      cv::Vec3f point3d; 
-      point3d[0] = j; 
-      point3d[1] = -i; 
-      point3d[2] = 0; 
-      point_set.push_back( point3d ); 
-    }
-  }
-
-  return 0; 
-}
-
-/**
- * @brief Function to draw a cube 
- * 
- * @param points vector of world points to write to
- * @param origin origin of the cube
- * @param scale scale of the cube
- * @param color color of the cube
- * @return int 
- */
-int draw_axes(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale){
-  points.push_back(cv::Vec3f(0, 0, 0)); // origin 
-  points.push_back(cv::Vec3f(0, 0, 1)); // z axis
-  points.push_back(cv::Vec3f(1, 0, 0)); // x axis
-  points.push_back(cv::Vec3f(0, 1, 0)); // y axis
-
-  return 0; 
-} 
-
-/**
- * @brief Function to draw a cube 
- * 
- * @param points point list to write to 
- * @param origin origin of the cube
- * @param scale scale of the cube
- * @param color color of the cube
- * @return int 
- */
-int draw_cube(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale) {
-  // get origin points
-  float xo = origin[0]; 
-  float yo = origin[1]; 
-  float zo = origin[2];
-  
-  // init points 
-  cv::Vec3f p000(xo + scale * 0, yo - scale * 0, zo + scale * 0); //0
-  points.push_back(p000); 
-  cv::Vec3f p100(xo + scale * 1, yo - scale * 0, zo + scale * 0); //1
-  points.push_back(p100); 
-  cv::Vec3f p101(xo + scale * 1, yo - scale * 0, zo + scale * 1); //2
-  points.push_back(p101); 
-  cv::Vec3f p001(xo + scale * 0, yo - scale * 0, zo + scale * 1); //3
-  points.push_back(p001); 
-  cv::Vec3f p010(xo + scale * 0, yo - scale * 1, zo + scale * 0); //4
-  points.push_back(p010); 
-  cv::Vec3f p110(xo + scale * 1, yo - scale * 1, zo + scale * 0); //5
-  points.push_back(p110); 
-  cv::Vec3f p111(xo + scale * 1, yo - scale * 1, zo + scale * 1); //6
-  points.push_back(p111);  
-  cv::Vec3f p011(xo + scale * 0, yo - scale * 1, zo + scale * 1); //7
-  points.push_back(p011);  
-
-  return 0; 
-}
-
-/**
- * @brief Function to draw a cube 
- * 
- * @param points point list to write to 
- * @param origin origin of the cube
- * @param w width
- * @param h height
- * @param d depth
- * @return int 
- */
-int draw_rect_prism(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d) {
-  // get origin points
-  float xo = origin[0]; 
-  float yo = origin[1]; 
-  float zo = origin[2];
-  
-  // init points 
-  cv::Vec3f p000(xo + w * 0, yo - h * 0, zo + d * 0); //0
-  points.push_back(p000); 
-  cv::Vec3f p100(xo + w * 1, yo - h * 0, zo + d * 0); //1
-  points.push_back(p100); 
-  cv::Vec3f p101(xo + w * 1, yo - h * 0, zo + d * 1); //2
-  points.push_back(p101); 
-  cv::Vec3f p001(xo + w * 0, yo - h * 0, zo + d * 1); //3
-  points.push_back(p001); 
-  cv::Vec3f p010(xo + w * 0, yo - h * 1, zo + d * 0); //4
-  points.push_back(p010); 
-  cv::Vec3f p110(xo + w * 1, yo - h * 1, zo + d * 0); //5
-  points.push_back(p110); 
-  cv::Vec3f p111(xo + w * 1, yo - h * 1, zo + d * 1); //6
-  points.push_back(p111);  
-  cv::Vec3f p011(xo + w * 0, yo - h * 1, zo + d * 1); //7
-  points.push_back(p011);  
-
-  return 0; 
-}
-
-/**
- * @brief Function to draw a rooftop for my house
- * 
- * @param points points to write to
- * @param origin origin for where to start drawing 
- * @param w width
- * @param h height 
- * @param d depth
- * @return int 
- */
-int draw_roof(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d) {
-  // get origin points
-  float xo = origin[0]; 
-  float yo = origin[1]; 
-  float zo = origin[2];
-
-  // back triangle
-  cv::Vec3f p000(xo + w * 0, yo + h * 0, zo + d * 0); // 8
-  points.push_back(p000); 
-  cv::Vec3f ph10(xo + w * 0.5, yo + h * 1, zo + d * 0); // 9
-  points.push_back(ph10); 
-  cv::Vec3f p100(xo + w * 1, yo + h * 0, zo + d * 0); // 10
-  points.push_back(p100); 
-  // front triangle
-  cv::Vec3f p001(xo + w * 0, yo + h * 0, zo + d * 1); // 11
-  points.push_back(p001); 
-  cv::Vec3f ph11(xo + w * 0.5, yo + h * 1, zo + d * 1); // 12
-  points.push_back(ph11); 
-  cv::Vec3f p101(xo + w * 1, yo + h * 0, zo + d * 1); // 13
-  points.push_back(p101);
-
-  return 0;
-}
-
-/**
- * @brief Function to draw a door 
- * 
- * @param points point list to write to
- * @param origin origin of the door
- * @param w width
- * @param h height
- * @param d depth
- * @return int 
- */
-int draw_door(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d) {
-  // get origin points
-  float xo = origin[0]; 
-  float yo = origin[1]; 
-  float zo = origin[2];
-
-  // Frame
-  cv::Vec3f p00(xo + w * 0, yo + h * 0, zo + d * 1); // 14
-  points.push_back(p00);
-  cv::Vec3f p01(xo + w * 0, yo + h * 1, zo + d * 1); // 15
-  points.push_back(p01);
-  cv::Vec3f p11(xo + w * 1, yo + h * 1, zo + d * 1); // 16
-  points.push_back(p11);
-  cv::Vec3f p10(xo + w * 1, yo + h * 0, zo + d * 1); // 17
-  points.push_back(p10);
-
-  // knob loc
-  cv::Vec3f knob(xo + w * 0.2, yo + h * 0.6, zo + d * 1); // 18
-  points.push_back(knob); 
-  return 0; 
-}
\ No newline at end of file
+/**
+ * @file ar.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Library of functions for conducting augmented reality
+ * @date 2022-03-23
+ */ 
+#include "../include/ar.h"
+#include "../include/frame_workspace.h"
+#include "../include/profiler.h"
+
+/**
+ * @brief Function to detect and extract chessboard
+ * 
+ * @param src source image to find the corners in 
+ * @param dst dst image that displays the the corners
+ * @param patsize size of the pattern
+ * @param corner_set vector of the point location of each corner  
+ * @param pattern_found bool passed by reference to determine if corners were found. 
+ * @param backend detector_backend to find the corners with
+ * @return int return non-zero value on failure. 
+ */
+int detect_chessboard(const cv::Mat &src, cv::Size patsize, std::vector<cv::Point2f> &corner_set, bool &pattern_found, int backend) { 
+  std::vector<int> corner_ids; 
+  if(detect_board(src, backend, patsize, corner_set, corner_ids, pattern_found) != 0) {
+    return -1; 
+  }
+
+  // callers of this one want the whole board or nothing
+  if(!pattern_found) {
+    corner_set.clear(); 
+  }
+  return 0; 
+} 
+
+/**
+ * @brief Function to find the parts of a frame that look like chessboards
+ * 
+ * Harris peaks are linked to neighbours closer than 1.5x their own grid
+ * spacing, so the corners of one board end up in one cluster whatever its size.
+ * 
+ * @param gray grayscale frame
+ * @param min_corners smallest cluster worth searching
+ * @param s buffers reused between frames, the regions are written to s.regions in frame coordinates
+ * @return int 
+ */
+static int find_candidate_regions(const cv::Mat &gray, int min_corners, board_search &s) {
+  s.regions.clear(); 
+
+  // about 320 pixels across is enough to see where the boards are
+  double scale = std::min(1.0, 320.0 / std::max(gray.cols, gray.rows)); 
+  double maxval = 0; 
+  {
+    ALLOC_EXEMPT(EXEMPT_IMGPROC); 
+    cv::resize(gray, s.small, cv::Size(), scale, scale, cv::INTER_AREA); 
+    cv::cornerHarris(s.small, s.response, 3, 3, 0.04); 
+    cv::dilate(s.response, s.localmax, cv::Mat()); 
+    cv::minMaxLoc(s.response, NULL, &maxval); 
+  }
+  if(maxval <= 0) {
+    return 0; 
+  }
+  const cv::Mat &small = s.small; 
+
+  // sized for the most peaks there can be once, so later frames never grow them
+  const int max_peaks = 2000; 
+  if(s.peaks.capacity() < small.total()) {
+    s.peaks.reserve(small.total()); 
+  }
+  if(s.nn.capacity() < max_peaks) {
+    s.cell_of.reserve(max_peaks); 
+    s.bucket.reserve(max_peaks); 
+    s.nn.reserve(max_peaks); 
+    s.parent.reserve(max_peaks); 
+    s.cluster_size.reserve(max_peaks); 
+    s.cluster_box.reserve(max_peaks); 
+    s.cluster_spacing.reserve(max_peaks); 
+    s.regions.reserve(max_peaks); 
+  }
+
+  // keep the local maxima, strongest first
+  std::vector<std::pair<float, cv::Point2f> > &peaks = s.peaks; 
+  peaks.clear(); 
+  for(int i = 0; i < s.response.rows; i++) {
+    const float *rrow = s.response.ptr<float>(i); 
+    const float *mrow = s.localmax.ptr<float>(i); 
+    for(int j = 0; j < s.response.cols; j++) {
+      if(rrow[j] > 0.01 * maxval && rrow[j] >= mrow[j]) {
+        peaks.push_back(std::make_pair(rrow[j], cv::Point2f(j, i))); 
+      }
+    }
+  }
+  std::sort(peaks.begin(), peaks.end(), 
+            [](const std::pair<float, cv::Point2f> &a, const std::pair<float, cv::Point2f> &b) { return a.first > b.first; }); 
+
+  // flat maxima show up as runs of equal peaks, keep one per 5x5 neighbourhood
+  s.taken.create(small.size(), CV_8UC1); 
+  memset(s.taken.data, 0, s.taken.total()); // a new Mat is continuous
+  int n = 0; 
+  for(int k = 0; k < peaks.size() && n < max_peaks; k++) {
+    cv::Point p = peaks[k].second; 
+    if(s.taken.at<uchar>(p.y, p.x)) {
+      continue; 
+    }
+    peaks[n++] = peaks[k]; 
+    for(int y = std::max(p.y - 2, 0); y <= std::min(p.y + 2, small.rows - 1); y++) {
+      uchar *trow = s.taken.ptr<uchar>(y); 
+      for(int x = std::max(p.x - 2, 0); x <= std::min(p.x + 2, small.cols - 1); x++) {
+        trow[x] = 1; 
+      }
+    }
+  }
+  peaks.resize(n); 
+
+  // bucket the peaks in a grid of cells a little wider than the 5x5 suppression, 
+  // so the neighbour searches only look at the cells around each peak
+  const int cell = 8; 
+  int gcols = (small.cols + cell - 1) / cell; 
+  int grows = (small.rows + cell - 1) / cell; 
+  int max_ring = std::max(gcols, grows); 
+  std::vector<int> &cell_start = s.cell_start; 
+  std::vector<int> &cell_of = s.cell_of; 
+  std::vector<int> &bucket = s.bucket; 
+  cell_start.assign(gcols * grows + 1, 0); 
+  cell_of.resize(n); 
+  for(int i = 0; i < n; i++) {
+    cell_of[i] = ((int) peaks[i].second.y / cell) * gcols + (int) peaks[i].second.x / cell; 
+    cell_start[cell_of[i] + 1]++; 
+  }
+  for(int c = 0; c < gcols * grows; c++) {
+    cell_start[c + 1] += cell_start[c]; 
+  }
+  bucket.resize(n); 
+  s.fill.assign(cell_start.begin(), cell_start.end() - 1); 
+  for(int i = 0; i < n; i++) {
+    bucket[s.fill[cell_of[i]]++] = i; 
+  }
+
+  // grid spacing of each peak is the distance to its nearest neighbour. Rings of
+  // cells are searched outwards until no peak in the next ring can be closer
+  std::vector<float> &nn = s.nn; 
+  nn.assign(n, FLT_MAX); 
+  for(int i = 0; i < n; i++) {
+    int cx = cell_of[i] % gcols; 
+    int cy = cell_of[i] / gcols; 
+    for(int r = 0; r <= max_ring && nn[i] > (r - 1) * cell; r++) {
+      for(int dy = -r; dy <= r; dy++) {
+        int y = cy + dy; 
+        if(y < 0 || y >= grows) {
+          continue; 
+        }
+        // the top and bottom rows of the ring are whole, the rest only their two ends
+        int step = (dy == -r || dy == r) ? 1 : 2 * r; 
+        for(int dx = -r; dx <= r; dx += step) {
+          int x = cx + dx; 
+          if(x < 0 || x >= gcols) {
+            continue; 
+          }
+          int c = y * gcols + x; 
+          for(int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+            int j = bucket[k]; 
+            if(j != i) {
+              nn[i] = std::min(nn[i], (float) cv::norm(peaks[i].second - peaks[j].second)); 
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // union find over the links, a link is never longer than 1.5x either end's spacing
+  std::vector<int> &parent = s.parent; 
+  parent.resize(n); 
+  for(int i = 0; i < n; i++) {
+    parent[i] = i; 
+  }
+  auto root = [&parent](int i) {
+    while(parent[i] != i) {
+      parent[i] = parent[parent[i]]; 
+      i = parent[i]; 
+    }
+    return i; 
+  }; 
+  for(int i = 0; i < n; i++) {
+    if(nn[i] == FLT_MAX) {
+      continue; 
+    }
+    int cx = cell_of[i] % gcols; 
+    int cy = cell_of[i] / gcols; 
+    int reach = std::min(max_ring, (int) std::ceil(1.5 * nn[i] / cell)); 
+    for(int y = std::max(cy - reach, 0); y <= std::min(cy + reach, grows - 1); y++) {
+      for(int x = std::max(cx - reach, 0); x <= std::min(cx + reach, gcols - 1); x++) {
+        int c = y * gcols + x; 
+        for(int k = cell_start[c]; k < cell_start[c + 1]; k++) {
+          int j = bucket[k]; 
+          if(j <= i) {
+            continue; 
+          }
+          float d = cv::norm(peaks[i].second - peaks[j].second); 
+          if(d <= 1.5 * std::min(nn[i], nn[j])) {
+            parent[root(i)] = root(j); 
+          }
+        }
+      }
+    }
+  }
+
+  // size, bounds and summed spacing of every cluster, kept at its root peak
+  s.cluster_size.assign(n, 0); 
+  s.cluster_box.assign(n, cv::Vec4f(FLT_MAX, FLT_MAX, 0, 0)); 
+  s.cluster_spacing.assign(n, 0.0f); 
+  for(int i = 0; i < n; i++) {
+    int r = root(i); 
+    cv::Point2f p = peaks[i].second; 
+    cv::Vec4f &box = s.cluster_box[r]; 
+    box[0] = std::min(box[0], p.x); 
+    box[1] = std::min(box[1], p.y); 
+    box[2] = std::max(box[2], p.x); 
+    box[3] = std::max(box[3], p.y); 
+    s.cluster_spacing[r] += nn[i]; 
+    s.cluster_size[r]++; 
+  }
+
+  cv::Rect frame_rect(0, 0, gray.cols, gray.rows); 
+  std::vector<cv::Rect> &found = s.regions; 
+  for(int r = 0; r < n; r++) {
+    if(s.cluster_size[r] == 0 || s.cluster_size[r] < min_corners) {
+      continue; 
+    }
+
+    const cv::Vec4f &box = s.cluster_box[r]; 
+    float spacing = s.cluster_spacing[r] / s.cluster_size[r]; 
+
+    // findChessboardCorners needs the outer squares and some quiet border around them
+    float pad = 2.5 * spacing + 4; 
+    cv::Rect rect(cvFloor((box[0] - pad) / scale), cvFloor((box[1] - pad) / scale), 
+                  cvCeil((box[2] - box[0] + 2 * pad) / scale), cvCeil((box[3] - box[1] + 2 * pad) / scale)); 
+    rect &= frame_rect; 
+    if(!rect.empty()) {
+      found.push_back(rect); 
+    }
+  }
+
+  // overlapping regions are searched as one so a board is never split
+  bool merged = true; 
+  while(merged) {
+    merged = false; 
+    for(int i = 0; i < found.size() && !merged; i++) {
+      for(int j = i + 1; j < found.size(); j++) {
+        if((found[i] & found[j]).area() > 0) {
+          found[i] |= found[j]; 
+          found.erase(found.begin() + j); 
+          merged = true; 
+          break; 
+        }
+      }
+    }
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to paint over a found board so the next search cannot find it again
+ * 
+ * @param gray image the board was found in
+ * @param corner_set corners of the board in gray's coordinates
+ * @param patsize size of the board
+ * @return int 
+ */
+static int mask_board(cv::Mat &gray, const std::vector<cv::Point2f> &corner_set, cv::Size patsize) {
+  int w = patsize.width; 
+  int h = patsize.height; 
+  cv::Point2f outer[4] = { corner_set[0], corner_set[w - 1], corner_set[w * h - 1], corner_set[w * (h - 1)] }; 
+  cv::Point2f center = (outer[0] + outer[1] + outer[2] + outer[3]) * 0.25; 
+  float spacing = cv::norm(corner_set[1] - corner_set[0]); 
+
+  // grow the inner corner quad past the outer squares
+  cv::Point poly[4]; 
+  for(int k = 0; k < 4; k++) {
+    cv::Point2f dir = outer[k] - center; 
+    float len = std::max(1.0, cv::norm(dir)); 
+    poly[k] = outer[k] + dir * (1.5 * 1.415 * spacing / len); 
+  }
+
+  ALLOC_EXEMPT(EXEMPT_DRAW); 
+  cv::fillConvexPoly(gray, poly, 4, cv::mean(gray)); 
+  return 0; 
+}
+
+/**
+ * @brief Function to find every board in one candidate region
+ * 
+ * @param gray grayscale frame
+ * @param region region to search
+ * @param patsizes registered board sizes
+ * @param max_boards stop after this many boards
+ * @param roi buffer for the region's copy, grown to the largest region and reused between frames
+ * @param corner_set buffer for the corners of a board, reused between frames
+ * @param boards boards to write to, their slots are reused
+ * @return int 
+ */
+static int search_region(const cv::Mat &gray, cv::Rect region, const std::vector<cv::Size> &patsizes, int max_boards, cv::Mat &roi, std::vector<cv::Point2f> &corner_set, board_set &boards) {
+  // own copy, masking must not leak into other regions. Regions change size
+  // every frame, so the buffer only grows and the copy is a view of its top left
+  if(roi.rows < region.height || roi.cols < region.width || roi.type() != gray.type()) {
+    roi.create(std::max(roi.rows, region.height), std::max(roi.cols, region.width), gray.type()); 
+  }
+  cv::Mat view = roi(cv::Rect(0, 0, region.width, region.height)); 
+  gray(region).copyTo(view); 
+
+  boards.count = 0; 
+  while(boards.count < max_boards) {
+    bool found = false; 
+    for(int k = 0; k < patsizes.size() && !found; k++) {
+      int64_t t0 = prof_now(); 
+      bool board_found; 
+      {
+        ALLOC_EXEMPT(EXEMPT_FIND); 
+        board_found = cv::findChessboardCorners(view, patsizes[k], corner_set, cv::CALIB_CB_FAST_CHECK); 
+      }
+      prof_record(STAGE_FIND, prof_now() - t0); 
+      if(!board_found) {
+        continue; 
+      }
+      t0 = prof_now(); 
+      refine_corners(view, corner_set, patsizes[k]); 
+      prof_record(STAGE_SUBPIX, prof_now() - t0); 
+      mask_board(view, corner_set, patsizes[k]); 
+
+      if(boards.count == boards.slots.size()) {
+        boards.slots.push_back(board_detection()); 
+      }
+      board_detection &b = boards.slots[boards.count++]; 
+      b.patsize = patsizes[k]; 
+      b.region = region; 
+      b.corner_set.clear(); 
+      for(int i = 0; i < corner_set.size(); i++) {
+        b.corner_set.push_back(corner_set[i] + cv::Point2f(region.x, region.y)); 
+      }
+      found = true; 
+    }
+    if(!found) {
+      break; 
+    }
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to detect every board of the registered sizes in a frame
+ * 
+ * Harris corners on a downscaled copy are clustered into candidate regions,
+ * each region is searched in parallel and every board found in a region is
+ * masked out before the region is searched again. Only the regions are
+ * searched, so the cost follows the area covered by boards rather than the
+ * number of boards times the frame; bench.exe times a frame with 1, 2 and
+ * 4 boards.
+ * 
+ * @param src source image to find the boards in
+ * @param patsizes registered board sizes, searched in the order given
+ * @param max_boards stop after this many boards
+ * @param search buffers reused between frames
+ * @param boards boards to write to, their slots are reused
+ * @return int return non-zero value on failure. 
+ */
+int detect_chessboards(const cv::Mat &src, const std::vector<cv::Size> &patsizes, int max_boards, board_search &search, board_set &boards) {
+  boards.count = 0; 
+  if(patsizes.empty() || src.empty()) {
+    return -1; 
+  }
+
+  cv::Mat gray; 
+  if(src.channels() == 3) {
+    PROF_SCOPE(STAGE_GRAY); 
+    ALLOC_EXEMPT(EXEMPT_IMGPROC); 
+    cv::cvtColor(src, search.gray, cv::COLOR_BGR2GRAY); 
+    gray = search.gray; 
+  } else {
+    gray = src; 
+  }
+
+  // a cluster needs at least half the corners of the smallest board
+  int min_corners = INT_MAX; 
+  for(int k = 0; k < patsizes.size(); k++) {
+    min_corners = std::min(min_corners, patsizes[k].area() / 2); 
+  }
+
+  std::vector<cv::Rect> &regions = search.regions; 
+  find_candidate_regions(gray, min_corners, search); 
+  if(regions.empty()) {
+    regions.push_back(cv::Rect(0, 0, gray.cols, gray.rows)); // nothing stood out, fall back to the whole frame
+  }
+
+  // every region gets its own buffers, they only grow with the most regions seen
+  if(search.found.size() < regions.size()) {
+    search.rois.resize(regions.size()); 
+    search.corners.resize(regions.size()); 
+    search.found.resize(regions.size(), board_set()); 
+  }
+  {
+    ALLOC_EXEMPT(EXEMPT_PARALLEL); 
+    cv::parallel_for_(cv::Range(0, regions.size()), [&](const cv::Range &range) {
+      ALLOC_EXEMPT(EXEMPT_NONE); 
+      for(int i = range.start; i < range.end; i++) {
+        search_region(gray, regions[i], patsizes, max_boards, search.rois[i], search.corners[i], search.found[i]); 
+      }
+    }); 
+  }
+
+  // gather into the caller's slots, assign keeps each slot's corner vector
+  for(int i = 0; i < regions.size(); i++) {
+    const board_set &found = search.found[i]; 
+    for(int j = 0; j < found.count && boards.count < max_boards; j++) {
+      if(boards.count == boards.slots.size()) {
+        boards.slots.push_back(board_detection()); 
+      }
+      board_detection &b = boards.slots[boards.count++]; 
+      b.patsize = found.slots[j].patsize; 
+      b.region = found.slots[j].region; 
+      b.corner_set.assign(found.slots[j].corner_set.begin(), found.slots[j].corner_set.end()); 
+    }
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to get the pose of every detected board
+ * 
+ * @param boards boards from detect_chessboards, rotations and translations are written
+ * @param cam_mat camera matrix at the resolution the boards were detected at
+ * @param distcoeff distortion coefficients
+ * @param point_set buffer for each board's world points, reused between frames
+ * @return int 
+ */
+int solve_board_poses(board_set &boards, const cv::Mat &cam_mat, const cv::Mat &distcoeff, std::vector<cv::Vec3f> &point_set) {
+  PROF_SCOPE(STAGE_PNP); 
+  for(int i = 0; i < boards.count; i++) {
+    board_detection &b = boards.slots[i]; 
+    point_set.clear(); 
+    get_point_set(b.patsize, point_set); 
+    ALLOC_EXEMPT(EXEMPT_POSE); 
+    cv::solvePnP(point_set, b.corner_set, cam_mat, distcoeff, b.rotations, b.translations); 
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to get how well a pose explains the corners it was solved from
+ * 
+ * @param point_set world points of the corners
+ * @param corner_set image points of the corners
+ * @param rotations rotation vector from solvePnP
+ * @param translations translation vector from solvePnP
+ * @param cam_mat camera matrix
+ * @param distcoeff distortion coefficients
+ * @param projected buffer for the reprojected corners, reused between frames
+ * @return double rms reprojection error in pixels
+ */
+double reprojection_error(const std::vector<cv::Vec3f> &point_set, const std::vector<cv::Point2f> &corner_set, const cv::Mat &rotations, const cv::Mat &translations, const cv::Mat &cam_mat, const cv::Mat &distcoeff, std::vector<cv::Point2f> &projected) {
+  if(point_set.empty() || point_set.size() != corner_set.size()) {
+    return 0; 
+  }
+
+  {
+    ALLOC_EXEMPT(EXEMPT_POSE); 
+    cv::projectPoints(point_set, rotations, translations, cam_mat, distcoeff, projected); 
+  }
+
+  double sum = 0; 
+  for(int i = 0; i < projected.size(); i++) {
+    cv::Point2f d = projected[i] - corner_set[i]; 
+    sum += d.x * d.x + d.y * d.y; 
+  }
+
+  return sqrt(sum / projected.size()); 
+}
+
+/**
+ * @brief Function to get the point set if there's a pattern
+ * 
+ * @param pat_size size of the pattern
+ * @param point_set point set to write to
+ * @return int N/A
+ */
+int get_point_set(const cv::Size pat_size, std::vector<cv::Vec3f> &point_set) {
+  
+  for(int i = 0; i < pat_size.height; i++) {
+    for(int j = 0; j < pat_size.width; j++) {
+      cv::Vec3f point3d; 
+      point3d[0] = j; 
+      point3d[1] = -i; 
+      point3d[2] = 0; 
+      point_set.push_back( point3d ); 
+    }
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to draw a cube 
+ * 
+ * @param points vector of world points to write to
+ * @param origin origin of the cube
+ * @param scale scale of the cube
+ * @param color color of the cube
+ * @return int 
+ */
+int draw_axes(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale){
+  points.push_back(cv::Vec3f(0, 0, 0)); // origin 
+  points.push_back(cv::Vec3f(0, 0, 1)); // z axis
+  points.push_back(cv::Vec3f(1, 0, 0)); // x axis
+  points.push_back(cv::Vec3f(0, 1, 0)); // y axis
+
+  return 0; 
+} 
+
+/**
+ * @brief Function to draw a cube 
+ * 
+ * @param points point list to write to 
+ * @param origin origin of the cube
+ * @param scale scale of the cube
+ * @param color color of the cube
+ * @return int 
+ */
+int draw_cube(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float scale) {
+  // get origin points
+  float xo = origin[0]; 
+  float yo = origin[1]; 
+  float zo = origin[2];
+  
+  // init points 
+  cv::Vec3f p000(xo + scale * 0, yo - scale * 0, zo + scale * 0); //0
+  points.push_back(p000); 
+  cv::Vec3f p100(xo + scale * 1, yo - scale * 0, zo + scale * 0); //1
+  points.push_back(p100); 
+  cv::Vec3f p101(xo + scale * 1, yo - scale * 0, zo + scale * 1); //2
+  points.push_back(p101); 
+  cv::Vec3f p001(xo + scale * 0, yo - scale * 0, zo + scale * 1); //3
+  points.push_back(p001); 
+  cv::Vec3f p010(xo + scale * 0, yo - scale * 1, zo + scale * 0); //4
+  points.push_back(p010); 
+  cv::Vec3f p110(xo + scale * 1, yo - scale * 1, zo + scale * 0); //5
+  points.push_back(p110); 
+  cv::Vec3f p111(xo + scale * 1, yo - scale * 1, zo + scale * 1); //6
+  points.push_back(p111);  
+  cv::Vec3f p011(xo + scale * 0, yo - scale * 1, zo + scale * 1); //7
+  points.push_back(p011);  
+
+  return 0; 
+}
+
+/**
+ * @brief Function to draw a cube 
+ * 
+ * @param points point list to write to 
+ * @param origin origin of the cube
+ * @param w width
+ * @param h height
+ * @param d depth
+ * @return int 
+ */
+int draw_rect_prism(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d) {
+  // get origin points
+  float xo = origin[0]; 
+  float yo = origin[1]; 
+  float zo = origin[2];
+  
+  // init points 
+  cv::Vec3f p000(xo + w * 0, yo - h * 0, zo + d * 0); //0
+  points.push_back(p000); 
+  cv::Vec3f p100(xo + w * 1, yo - h * 0, zo + d * 0); //1
+  points.push_back(p100); 
+  cv::Vec3f p101(xo + w * 1, yo - h * 0, zo + d * 1); //2
+  points.push_back(p101); 
+  cv::Vec3f p001(xo + w * 0, yo - h * 0, zo + d * 1); //3
+  points.push_back(p001); 
+  cv::Vec3f p010(xo + w * 0, yo - h * 1, zo + d * 0); //4
+  points.push_back(p010); 
+  cv::Vec3f p110(xo + w * 1, yo - h * 1, zo + d * 0); //5
+  points.push_back(p110); 
+  cv::Vec3f p111(xo + w * 1, yo - h * 1, zo + d * 1); //6
+  points.push_back(p111);  
+  cv::Vec3f p011(xo + w * 0, yo - h * 1, zo + d * 1); //7
+  points.push_back(p011);  
+
+  return 0; 
+}
+
+/**
+ * @brief Function to draw a rooftop for my house
+ * 
+ * @param points points to write to
+ * @param origin origin for where to start drawing 
+ * @param w width
+ * @param h height 
+ * @param d depth
+ * @return int 
+ */
+int draw_roof(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d) {
+  // get origin points
+  float xo = origin[0]; 
+  float yo = origin[1]; 
+  float zo = origin[2];
+
+  // back triangle
+  cv::Vec3f p000(xo + w * 0, yo + h * 0, zo + d * 0); // 8
+  points.push_back(p000); 
+  cv::Vec3f ph10(xo + w * 0.5, yo + h * 1, zo + d * 0); // 9
+  points.push_back(ph10); 
+  cv::Vec3f p100(xo + w * 1, yo + h * 0, zo + d * 0); // 10
+  points.push_back(p100); 
+  // front triangle
+  cv::Vec3f p001(xo + w * 0, yo + h * 0, zo + d * 1); // 11
+  points.push_back(p001); 
+  cv::Vec3f ph11(xo + w * 0.5, yo + h * 1, zo + d * 1); // 12
+  points.push_back(ph11); 
+  cv::Vec3f p101(xo + w * 1, yo + h * 0, zo + d * 1); // 13
+  points.push_back(p101);
+
+  return 0;
+}
+
+/**
+ * @brief Function to draw a door 
+ * 
+ * @param points point list to write to
+ * @param origin origin of the door
+ * @param w width
+ * @param h height
+ * @param d depth
+ * @return int 
+ */
+int draw_door(std::vector<cv::Vec3f> &points, cv::Vec3f origin, float w, float h, float d) {
+  // get origin points
+  float xo = origin[0]; 
+  float yo = origin[1]; 
+  float zo = origin[2];
+
+  // Frame
+  cv::Vec3f p00(xo + w * 0, yo + h * 0, zo + d * 1); // 14
+  points.push_back(p00);
+  cv::Vec3f p01(xo + w * 0, yo + h * 1, zo + d * 1); // 15
+  points.push_back(p01);
+  cv::Vec3f p11(xo + w * 1, yo + h * 1, zo + d * 1); // 16
+  points.push_back(p11);
+  cv::Vec3f p10(xo + w * 1, yo + h * 0, zo + d * 1); // 17
+  points.push_back(p10);
+
+  // knob loc
+  cv::Vec3f knob(xo + w * 0.2, yo + h * 0.6, zo + d * 1); // 18
+  points.push_back(knob); 
+  return 0; 
+}
+
+/**
+ * @brief Function to get the world points of an overlay
+ * 
+ * @param mode overlay_mode to get the points for
+ * @param patsize size of the board the overlay sits on
+ * @param objpoints obj file vertices, only used by OVERLAY_OBJ
+ * @param drawpoints vector of world points to write to
+ * @return int 
+ */
+int get_overlay_points(int mode, cv::Size patsize, const std::map<int, std::vector<float> > &objpoints, std::vector<cv::Vec3f> &drawpoints) {
+  int first = drawpoints.size(); 
+
+  if(mode == OVERLAY_HOUSE) {
+    float w = 3.0; 
+    float h = 4.0; 
+    float d = 5.5; 
+    float cenx = 4.5 - 0.5 * w;
+    float ceny = -3.0 + 0.5 * h; 
+    float cenz = 0; 
+    cv::Vec3f origin(cenx, ceny, cenz); 
+    draw_rect_prism(drawpoints, origin, w, h, d); // get points for a rectangular prism
+    cv::Vec3f rooforig(cenx, ceny, cenz);
+    float roofh = 2.0;  
+    draw_roof(drawpoints, rooforig, w, roofh, d); // get points for the roof
+    cv::Vec3f doororig(4.5 - .25 * w, ceny  - h, cenz);
+    draw_door(drawpoints, doororig, 0.25 * w, 0.25 * h, d);  // get points for the door
+  } else if(mode == OVERLAY_OBJ) {
+    float cenx = 4.5; 
+    float ceny = -3.0; 
+    float cenz = 1.0; 
+    // obj vertices are numbered from 1
+    for(int i = 1; i <= objpoints.size(); i++) {
+      const std::vector<float> &vert = objpoints.at(i); 
+      cv::Vec3f npoint; 
+      npoint[0] = cenx + vert[0]; 
+      npoint[1] = ceny + vert[1]; 
+      npoint[2] = cenz + vert[2]; 
+      drawpoints.push_back(npoint); 
+    }
+  } else {
+    draw_axes(drawpoints, cv::Vec3f(0, 0, 0), 1);
+    return 0; 
+  }
+
+  // the models are placed for a 9x6 board, keep them centered on other sizes
+  cv::Vec3f shift((patsize.width - 9) * 0.5f, -(patsize.height - 6) * 0.5f, 0); 
+  for(int i = first; i < drawpoints.size(); i++) {
+    drawpoints[i] = drawpoints[i] + shift; 
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to draw an overlay from its projected points
+ * 
+ * @param dst image to draw on
+ * @param mode overlay_mode that produced the points
+ * @param image_points points from get_overlay_points projected into dst
+ * @param connections obj file faces, only used by OVERLAY_OBJ
+ * @param lod level of detail, OVERLAY_OBJ draws every (1 << lod)-th face
+ * @return int 
+ */
+int draw_overlay(cv::Mat &dst, int mode, const std::vector<cv::Point2f> &image_points, const std::vector<std::vector<int> > &connections, int lod) {
+  ALLOC_EXEMPT(EXEMPT_DRAW); // nothing below allocates but OpenCV's drawing
+  if(mode == OVERLAY_HOUSE) {
+    // rectangle
+    // 0 -> 1
+    cv::line(dst, image_points[0], image_points[1], {255, 0, 0}, 2); 
+    // 1 -> 2
+    cv::line(dst, image_points[1], image_points[2], {255, 0, 0}, 2); 
+    // 2 -> 3 
+    cv::line(dst, image_points[2], image_points[3], {255, 0, 0}, 2); 
+    // 3 -> 0 
+    cv::line(dst, image_points[3], image_points[0], {255, 0, 0}, 2); 
+    // 4 -> 5
+    cv::line(dst, image_points[4], image_points[5], {255, 0, 0}, 2); 
+    // 5 -> 6
+    cv::line(dst, image_points[5], image_points[6], {255, 0, 0}, 2); 
+    // 6 -> 7
+    cv::line(dst, image_points[6], image_points[7], {255, 0, 0}, 2); 
+    // 7 -> 4
+    cv::line(dst, image_points[7], image_points[4], {255, 0, 0}, 2); 
+    // 0 -> 4
+    cv::line(dst, image_points[0], image_points[4], {255, 0, 0}, 2); 
+    // 1 -> 5
+    cv::line(dst, image_points[1], image_points[5], {255, 0, 0}, 2); 
+    // 2 -> 6
+    cv::line(dst, image_points[2], image_points[6], {255, 0, 0}, 2); 
+    // 3 -> 7  
+    cv::line(dst, image_points[3], image_points[7], {255, 0, 0}, 2); 
+
+    // roof
+    // 8 -> 9
+    cv::line(dst, image_points[8], image_points[9], {0, 0, 255}, 2); 
+    // 9 -> 10
+    cv::line(dst, image_points[9], image_points[10], {0, 0, 255}, 2); 
+    // 10 -> 8
+    cv::line(dst, image_points[10], image_points[8], {0, 0, 255}, 2); 
+    // 11 -> 12
+    cv::line(dst, image_points[11], image_points[12], {0, 0, 255}, 2); 
+    // 12 -> 13
+    cv::line(dst, image_points[12], image_points[13], {0, 0, 255}, 2); 
+    // 13 -> 11
+    cv::line(dst, image_points[13], image_points[11], {0, 0, 255}, 2);
+    // 8 -> 11
+    cv::line(dst, image_points[8], image_points[11], {0, 0, 255}, 2); 
+    // 9 -> 12
+    cv::line(dst, image_points[9], image_points[12], {0, 0, 255}, 2); 
+    // 10 -> 13
+    cv::line(dst, image_points[10], image_points[13], {0, 0, 255}, 2); 
+
+    //door
+    // 14 -> 15
+    cv::line(dst, image_points[14], image_points[15], {0, 0, 0}, 2); 
+    // 15 -> 16
+    cv::line(dst, image_points[15], image_points[16], {0, 0, 0}, 2);
+    // 16 -> 17
+    cv::line(dst, image_points[16], image_points[17], {0, 0, 0}, 2);
+    // 17 -> 14
+    cv::line(dst, image_points[17], image_points[14], {0, 0, 0}, 2);
+    // doorknob
+    cv::circle(dst, image_points[18], 2, {0, 0, 0}, 3); 
+  } else if(mode == OVERLAY_OBJ) {
+    // loop through the connections array, obj vertices are numbered from 1
+    for(int i = 0; i < connections.size(); i += 1 << lod) {
+      const std::vector<int> &curvec = connections[i]; // get current
+      // read_vo_data_obj drops faces outside the file's vertices, this catches faces and points from different files
+      bool inside = !curvec.empty(); 
+      for(int j = 0; j < curvec.size() && inside; j++) {
+        inside = curvec[j] >= 1 && curvec[j] <= (int) image_points.size(); 
+      }
+      if(!inside) {
+        continue; 
+      }
+      int first = curvec[0]; // record the first
+      int prev = -1; // init prev
+      for(int j = 1; j < curvec.size(); j++) { // loop through the current vec of connections
+        int current = curvec[j]; // set current j
+        if(j == 1) { // if j == 1, then previous is the first point
+          prev = curvec[0]; 
+        }
+        // the last point connects to the first point
+        if(j == curvec.size() - 1) {
+          cv::line(dst, image_points[current - 1], image_points[first - 1], {255, 0, 0}, 1); 
+        } else {
+          cv::line(dst, image_points[current - 1], image_points[prev - 1], {255, 0, 0,}, 1); // otherwise, connect current with previous
+          prev = current; // update previous
+        }
+      }
+    }
+  } else {
+    cv::arrowedLine(dst, image_points[0], image_points[1], {255, 0, 0}, 2); // z
+    cv::arrowedLine(dst, image_points[0], image_points[2], {0, 255, 0}, 2); // y
+    cv::arrowedLine(dst, image_points[0], image_points[3], {0, 0, 255}, 2); // x
+  }
+
+  return 0; 
+}
+
+/**
+ * @brief Function to get the part of a frame an overlay covers
+ * 
+ * @param image_points projected overlay points
+ * @param margin pixels added on every side for the line width
+ * @param size frame size
+ * @return cv::Rect bounding box clipped to the frame, empty if the overlay is off screen
+ */
+cv::Rect overlay_bounds(const std::vector<cv::Point2f> &image_points, int margin, cv::Size size) {
+  if(image_points.empty()) {
+    return cv::Rect(); 
+  }
+
+  float minx = FLT_MAX, miny = FLT_MAX, maxx = -FLT_MAX, maxy = -FLT_MAX; 
+  for(int i = 0; i < image_points.size(); i++) {
+    minx = std::min(minx, image_points[i].x); 
+    miny = std::min(miny, image_points[i].y); 
+    maxx = std::max(maxx, image_points[i].x); 
+    maxy = std::max(maxy, image_points[i].y); 
+  }
+
+  // points far off screen are clamped before they can overflow an int
+  float lo = -1e6f, hi = 1e6f; 
+  int x0 = (int) std::floor(std::max(lo, std::min(hi, minx))) - margin; 
+  int y0 = (int) std::floor(std::max(lo, std::min(hi, miny))) - margin; 
+  int x1 = (int) std::ceil(std::max(lo, std::min(hi, maxx))) + margin + 1; 
+  int y1 = (int) std::ceil(std::max(lo, std::min(hi, maxy))) + margin + 1; 
+
+  return cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(0, 0, size.width, size.height); 
+}
+
+/**
+ * @brief Function to warp an image onto a quad of the frame, like kermit in gif.exe
+ * 
+ * Only the box the quad lands in is warped and composited, not the whole frame.
+ * 
+ * @param dst frame to draw on in place
+ * @param img image to warp, its corners go to quad in order
+ * @param quad where the top left, top right, bottom right and bottom left corners land
+ * @param warped buffer for the warped box, grown to the largest box and reused between frames
+ * @param mask buffer for the quad's mask, grown like warped
+ * @param poly buffer for the quad in box coordinates, reused between frames
+ * @param copied bytes written and read by the composite are added to it
+ * @return int return non-zero value if nothing was drawn
+ */
+int composite_quad(cv::Mat &dst, const cv::Mat &img, const std::vector<cv::Point2f> &quad, cv::Mat &warped, cv::Mat &mask, std::vector<cv::Point2i> &poly, long &copied) {
+  cv::Point2f corners[4] = {
+    cv::Point2f(0, 0), 
+    cv::Point2f(img.cols, 0), 
+    cv::Point2f(img.cols, img.rows), 
+    cv::Point2f(0, img.rows)
+  }; 
+  cv::Mat h; 
+  {
+    ALLOC_EXEMPT(EXEMPT_POSE); 
+    h = cv::findHomography(cv::Mat(4, 1, CV_32FC2, corners), quad); // find the homography
+  }
+
+  cv::Rect dirty = overlay_bounds(quad, 1, dst.size()); 
+  if(h.empty() || dirty.area() == 0) {
+    return -1; 
+  }
+
+  // the box changes size every frame, so the buffers only ever grow and the box is a view of their top left
+  if(warped.rows < dirty.height || warped.cols < dirty.width || warped.type() != img.type()) {
+    warped.create(std::max(warped.rows, dirty.height), std::max(warped.cols, dirty.width), img.type()); 
+  }
+  if(mask.rows < dirty.height || mask.cols < dirty.width) {
+    mask.create(std::max(mask.rows, dirty.height), std::max(mask.cols, dirty.width), CV_8UC1); 
+  }
+  cv::Rect box(0, 0, dirty.width, dirty.height); 
+  cv::Mat warped_box = warped(box); 
+  cv::Mat mask_box = mask(box); 
+
+  // move the homography's origin to the corner of the box
+  cv::Matx33d shift(1, 0, -dirty.x, 0, 1, -dirty.y, 0, 0, 1); 
+  {
+    ALLOC_EXEMPT(EXEMPT_IMGPROC); 
+    cv::warpPerspective(img, warped_box, shift * cv::Matx33d(h), dirty.size(), cv::INTER_CUBIC); 
+  }
+
+  // convert the points to integers rather than floats, relative to the box
+  poly.clear(); 
+  for(int i = 0; i < quad.size(); i++) {
+    poly.push_back(cv::Point2i((int) quad[i].x - dirty.x, (int) quad[i].y - dirty.y)); 
+  }
+
+  cv::Mat dst_roi = dst(dirty); 
+  {
+    ALLOC_EXEMPT(EXEMPT_DRAW); 
+    mask_box.setTo(cv::Scalar::all(0)); 
+    cv::fillConvexPoly(mask_box, poly, cv::Scalar::all(255), cv::LINE_AA); 
+  }
+  {
+    ALLOC_EXEMPT(EXEMPT_IMGPROC); 
+    warped_box.copyTo(dst_roi, mask_box); 
+  }
+  // the warp writes the box once and the composite reads it and writes the frame
+  copied += 2 * warped_box.total() * warped_box.elemSize() + dst_roi.total() * dst_roi.elemSize(); 
+
+  return 0; 
+}
@@ -1,295 +1,445 @@
-/**
- * @file ar_main.cpp
- * @author Nate Novak (novak.n@northeastern.edu)
- * @brief Main function for the AR portion of project 4
- * @date 2022-03-22
- */
-
-#include <cstdio>
-#include <cstring>
-#include <cstdlib>
-#include <dirent.h>
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <opencv2/opencv.hpp>
-#include "../include/csv_util.h"
-#include "../include/ar.h"
-
-int main(int argc, char *argv[]) {
-  cv::VideoCapture *capdev;
-
-  // open the video device
-  capdev = new cv::VideoCapture(0);
-  if( !capdev->isOpened() ) {
-    printf("Unable to open video device\n");
-    return(-1);
-  }
-
-  // get some properties of the image
-  cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
-                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
-  printf("Expected size: %d %d\n", refS.width, refS.height);
-  
-  cv::namedWindow("Cal/AR", 1); 
-  cv::Mat frame;
-  cv::Mat dst; 
-
-  // declare calibration data
-  cv::Mat cam_mat(3, 3, CV_64FC1); 
-  cv::Mat distcoeff(5, 1, CV_64FC1); 
-
-  read_calibration_data_csv("calibration.csv", cam_mat, distcoeff, 0); 
-
-  // print calibration data
-  printf("Camera Matrix\n"); 
-  for(int i = 0; i < cam_mat.rows; i++) {
-    for(int j = 0; j < cam_mat.cols; j++) {
-      printf("%.4f ", cam_mat.at<double>(i, j)); 
-    }
-    printf("\n"); 
-  }
-  printf("\n"); 
-
-  printf("Distortion Coefficients\n"); 
-  for(int i = 0; i < distcoeff.rows; i++) {
-    printf("%.4f ", distcoeff.at<double>(i, 0)); 
-  }
-  printf("\n\n"); 
-
-  // declare size
-  cv::Size patternsize(9, 6); 
-
-  bool show_vo = false;
-  bool show_ext = false;  
-
-  // get the extension stuff from the object file
-  std::map<int, std::vector<float> >  objpoints; 
-  std::vector<std::vector<int> > connections; 
-
-  read_vo_data_obj("shuttle.obj", objpoints, connections); 
-  
-  // print various data about the obj file
-  printf("Points (%d):\n", objpoints.size()); 
-  for(int i = 1; i <= objpoints.size(); i++) {
-    std::vector<float> vect = objpoints[i]; 
-    for(int j = 0; j < vect.size(); j++) {
-      if(j != vect.size() - 1) {
-        printf("%.4f, ", vect[j]); 
-      } else {
-        printf("%.4f ", vect[j]); 
-      }
-    }
-    printf("\n"); 
-  }
-  printf("\n\n"); 
-
-  printf("Connections (%d):\n", connections.size()); 
-  for(int i = 0; i < connections.size(); i++) {
-    std::vector<int> cur = connections[i]; 
-    for(int j = 0; j < cur.size(); j++) {
-      if(j != cur.size() - 1) {
-        printf("%d, ", cur[j]);
-      } else {
-        printf("%d ", cur[j]);
-      }
-      
-    }
-    printf("\n"); 
-  }
-
-  for(;;) {
-    *capdev >> frame; // get a new frame from the camera, treat as a stream
-    if( frame.empty() ) {
-      printf("frame is empty\n");
-      break;
-    }  
-
-    bool patternfound = false;
-
-    std::vector<cv::Point2f> corner_set;
-    std::vector<cv::Vec3f> point_set;  
-    cv::Mat rotations; 
-    cv::Mat translations;
-    std::vector<cv::Point2f> image_points; 
-
-    detect_chessboard(frame, patternsize, corner_set, patternfound); 
-
-    frame.copyTo(dst); 
-
-    if(patternfound) {
-      printf("pattern found\n"); 
-      get_point_set(patternsize, point_set); // Get the point set for the panner
-      cv::solvePnP(point_set, corner_set, cam_mat, distcoeff, rotations, translations);
-
-      // print results
-      printf("Rotations:\n");
-      for(int i = 0; i < rotations.rows; i++) {
-        printf("%.4f ", rotations.at<double>(i, 0));
-      } 
-      printf("\n\n"); 
-
-      printf("Translations:\n");
-      for(int i = 0; i < translations.rows; i++) {
-        printf("%.4f ", rotations.at<double>(i, 0)); 
-      }
-      printf("\n\n");
-
-      std::vector<cv::Vec3f> drawpoints;
-      if(show_vo) {
-        float w = 3.0; 
-        float h = 4.0; 
-        float d = 5.5; 
-        float cenx = 4.5 - 0.5 * w;
-        float ceny = -3.0 + 0.5 * h; 
-        float cenz = 0; 
-        cv::Vec3f origin(cenx, ceny, cenz); 
-        draw_rect_prism(drawpoints, origin, w, h, d); // get points for a rectangular prism
-        cv::Vec3f rooforig(cenx, ceny, cenz);
-        float roofh = 2.0;  
-        draw_roof(drawpoints, rooforig, w, roofh, d); // get points for the roof
-        cv::Vec3f doororig(4.5 - .25 * w, ceny  - h, cenz);
-        draw_door(drawpoints, doororig, 0.25 * w, 0.25 * h, d);  // get points for the door
-      } else if(show_ext) {
-        float cenx = 4.5; 
-        float ceny = -3.0; 
-        float cenz = 1.0; 
-        // create 
-        for(int i = 1; i <= objpoints.size(); i++) {
-          cv::Vec3f npoint; 
-          npoint[0] = cenx + objpoints[i][0]; 
-          npoint[1] = ceny + objpoints[i][1]; 
-          npoint[2] = cenz + objpoints[i][2]; 
-          drawpoints.push_back(npoint); 
-        }
-      } else {
-        draw_axes(drawpoints, cv::Vec3f(0, 0, 0), 1);
-      }
-      
-      // project the points and get the image points  
-      cv::projectPoints(drawpoints, rotations, translations, cam_mat, distcoeff, image_points);  
-      
-      // uncomment for debugging
-      /*printf("Image Points ( %d )\n[", image_points.size()); 
-      for(int i = 0; i < image_points.size(); i++) {
-        printf("(%.4f, %.4f) ", image_points[i].x, image_points[i].y); 
-      }
-      printf("\b]\n\n");*/
-      
-      if(show_vo) {
-        // rectangle
-        // 0 -> 1
-        cv::line(dst, image_points[0], image_points[1], {255, 0, 0}, 2); 
-        // 1 -> 2
-        cv::line(dst, image_points[1], image_points[2], {255, 0, 0}, 2); 
-        // 2 -> 3 
-        cv::line(dst, image_points[2], image_points[3], {255, 0, 0}, 2); 
-        // 3 -> 0 
-        cv::line(dst, image_points[3], image_points[0], {255, 0, 0}, 2); 
-        // 4 -> 5
-        cv::line(dst, image_points[4], image_points[5], {255, 0, 0}, 2); 
-        // 5 -> 6
-        cv::line(dst, image_points[5], image_points[6], {255, 0, 0}, 2); 
-        // 6 -> 7
-        cv::line(dst, image_points[6], image_points[7], {255, 0, 0}, 2); 
-        // 7 -> 4
-        cv::line(dst, image_points[7], image_points[4], {255, 0, 0}, 2); 
-        // 0 -> 4
-        cv::line(dst, image_points[0], image_points[4], {255, 0, 0}, 2); 
-        // 1 -> 5
-        cv::line(dst, image_points[1], image_points[5], {255, 0, 0}, 2); 
-        // 2 -> 6
-        cv::line(dst, image_points[2], image_points[6], {255, 0, 0}, 2); 
-        // 3 -> 7  
-        cv::line(dst, image_points[3], image_points[7], {255, 0, 0}, 2); 
-
-        // roof
-        // 8 -> 9
-        cv::line(dst, image_points[8], image_points[9], {0, 0, 255}, 2); 
-        // 9 -> 10
-        cv::line(dst, image_points[9], image_points[10], {0, 0, 255}, 2); 
-        // 10 -> 8
-        cv::line(dst, image_points[10], image_points[8], {0, 0, 255}, 2); 
-        // 11 -> 12
-        cv::line(dst, image_points[11], image_points[12], {0, 0, 255}, 2); 
-        // 12 -> 13
-        cv::line(dst, image_points[12], image_points[13], {0, 0, 255}, 2); 
-        // 13 -> 11
-        cv::line(dst, image_points[13], image_points[11], {0, 0, 255}, 2);
-        // 8 -> 11
-        cv::line(dst, image_points[8], image_points[11], {0, 0, 255}, 2); 
-        // 9 -> 12
-        cv::line(dst, image_points[9], image_points[12], {0, 0, 255}, 2); 
-        // 10 -> 13
-        cv::line(dst, image_points[10], image_points[13], {0, 0, 255}, 2); 
-
-        //door
-        // 14 -> 15
-        cv::line(dst, image_points[14], image_points[15], {0, 0, 0}, 2); 
-        // 15 -> 16
-        cv::line(dst, image_points[15], image_points[16], {0, 0, 0}, 2);
-        // 16 -> 17
-        cv::line(dst, image_points[16], image_points[17], {0, 0, 0}, 2);
-        // 17 -> 14
-        cv::line(dst, image_points[17], image_points[14], {0, 0, 0}, 2);
-        // doorknob
-        cv::circle(dst, image_points[18], 2, {0, 0, 0}, 3); 
-      } else if(show_ext) {
-        // put back in a map for easy organization
-        // given the .obj file. May be overkill on second thought
-        std::map<int, cv::Point2f> pointmap; 
-        for(int i = 0; i < image_points.size(); i++) {
-          pointmap[i + 1] = image_points[i];  
-        }
-
-        // loop through the connections array
-        for(int i = 0; i < connections.size(); i++) {
-          std::vector<int> curvec = connections[i]; // get current
-          int first = curvec[0]; // record the first
-          int prev = -1; // init prev
-          for(int j = 1; j < curvec.size(); j++) { // loop through the current vec of connections
-            int current = curvec[j]; // set current j
-            if(j == 1) { // if j == 1, then previous is the first point
-              prev = curvec[0]; 
-            }
-            // the last point connects to the first point
-            if(j == curvec.size() - 1) {
-              cv::line(dst, pointmap[current], pointmap[first], {255, 0, 0}, 1); 
-            } else {
-              cv::line(dst, pointmap[current], pointmap[prev], {255, 0, 0,}, 1); // otherwise, connect current with previous
-              prev = current; // update previous
-            }
-          }
-        }
-      } else {
-        cv::arrowedLine(dst, image_points[0], image_points[1], {255, 0, 0}, 2); // z
-        cv::arrowedLine(dst, image_points[0], image_points[2], {0, 255, 0}, 2); // y
-        cv::arrowedLine(dst, image_points[0], image_points[3], {0, 0, 255}, 2); // x
-      }  
-    }
-
-    cv::imshow("Cal/AR", dst);
-
-    char keyEx = cv::waitKeyEx(10); 
-    if(keyEx == 'q') {
-      break; 
-    } else if (keyEx == 'n') {
-      show_vo = !show_vo;
-      show_ext = false; 
-    } else if (keyEx == 'e') {
-      show_ext = !show_ext; 
-      show_vo = false; 
-    } else if (keyEx == 's') {
-      int id = -1; 
-      printf("What number do you want to assign this image?\n");  
-      std::cin >> id; 
-      std::string name = "./imgs/image" + std::to_string(id) + ".png"; 
-      cv::imwrite(name, dst); 
-    } 
-  }
-
-  printf("Bye!\n"); 
-
-  delete capdev;
-  return(0);
+/**
+ * @file ar_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for the AR portion of project 4
+ * @date 2022-03-22
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/cal_profile.h"
+#include "../include/ar.h"
+#include "../include/profiler.h"
+#include "../include/logger.h"
+#include "../include/pose_log.h"
+#include "../include/shm_pub.h"
+#include "../include/image_writer.h"
+#include "../include/video_recorder.h"
+#include "../include/frame_workspace.h"
+#include "../include/display.h"
+#include "../include/latest_capture.h"
+#include "../include/luma.h"
+#include "../include/board_tracker.h"
+#include "../include/governor.h"
+#include "../include/frame_pipeline.h"
+
+int main(int argc, char *argv[]) {
+  cv::VideoCapture *capdev;
+
+  // detection can run on a downscaled copy of the frame to save cpu,
+  // the overlay is still projected at full resolution
+  float det_scale = 1.0;
+  // with --multi-board every board of the registered sizes gets its own object
+  bool multi_board = false;
+  std::vector<cv::Size> boardsizes;
+  int max_boards = 8;
+  int backend = DETECT_CLASSIC;
+  char prof_fn[256] = "profile.csv"; // stage timings, written on 'p' and at exit
+  char trace_fn[256] = ""; // with --trace every stage of every frame is written here at exit
+  bool headless = false; // --no-display runs as fast as the frames can be processed
+  bool buffered = false; // --buffered reads every frame in order instead of always the newest
+  bool lazy_decode = false; // --lazy-decode only decodes frames grabbed while the loop waits
+  bool bgr_capture = false; // --bgr-capture leaves the BGR conversion to the backend
+  bool gating = true; // reuse the last detection while nothing near the board moves
+  int motion_threshold = 6; 
+  int motion_max_reuse = 30; 
+  bool filtering = false; // --pose-filter draws with a smoothed pose
+  double pose_lead_ms = 0; // and extrapolates it this far past the capture time
+  bool async_detect = false; // --async-detect draws every frame and detects on a thread of its own
+  double target_fps = 0; // with --target-fps or --core-budget the governor trades quality for time
+  double core_budget = 0; 
+  int log_level = LOG_INFO; // debug also logs the pose of every frame
+  char log_fn[256] = ""; // log to stdout unless --log is given
+  char pose_fn[256] = ""; // with --pose-log every pose is recorded here
+  long pose_capacity = 1 << 20; 
+  char shm_name[256] = ""; // with --publish other processes can read the pose from shared memory
+  bool publish_frame = false; 
+  std::string img_format = "png"; // snapshots are encoded on a background thread
+  int img_quality = -1; 
+  int burst_every = 10; // with burst on ('b') every burst_every-th frame is saved
+  char record_fn[256] = ""; // with --record the composited output is encoded on a background thread
+  double record_fps = 0; // 0 to use the camera frame rate
+  int record_policy = RECORD_DROP_NEWEST; 
+  int record_queue = 8; 
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--detect-scale") == 0 && i + 1 < argc) {
+      det_scale = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--multi-board") == 0) {
+      multi_board = true;
+    } else if(strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+      int w = 0, h = 0;
+      if(sscanf(argv[++i], "%dx%d", &w, &h) == 2 && w > 1 && h > 1) {
+        boardsizes.push_back(cv::Size(w, h));
+        multi_board = true;
+      }
+    } else if(strcmp(argv[i], "--max-boards") == 0 && i + 1 < argc) {
+      max_boards = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      strncpy(prof_fn, argv[++i], sizeof(prof_fn) - 1);
+    } else if(strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+      log_level = parse_log_level(argv[++i]);
+      if(log_level < 0) {
+        printf("Unknown log level %s (debug, info, warn, error, off)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      strncpy(log_fn, argv[++i], sizeof(log_fn) - 1);
+    } else if(strcmp(argv[i], "--pose-log") == 0 && i + 1 < argc) {
+      strncpy(pose_fn, argv[++i], sizeof(pose_fn) - 1);
+    } else if(strcmp(argv[i], "--pose-log-capacity") == 0 && i + 1 < argc) {
+      pose_capacity = atol(argv[++i]);
+    } else if(strcmp(argv[i], "--publish") == 0 && i + 1 < argc) {
+      strncpy(shm_name, argv[++i], sizeof(shm_name) - 1);
+    } else if(strcmp(argv[i], "--publish-frame") == 0) {
+      publish_frame = true;
+    } else if(strcmp(argv[i], "--img-format") == 0 && i + 1 < argc) {
+      img_format = argv[++i];
+    } else if(strcmp(argv[i], "--img-quality") == 0 && i + 1 < argc) {
+      img_quality = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+      burst_every = std::max(1, atoi(argv[++i]));
+    } else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      strncpy(record_fn, argv[++i], sizeof(record_fn) - 1);
+    } else if(strcmp(argv[i], "--record-fps") == 0 && i + 1 < argc) {
+      record_fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--record-queue") == 0 && i + 1 < argc) {
+      record_queue = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--record-policy") == 0 && i + 1 < argc) {
+      record_policy = parse_record_policy(argv[++i]);
+      if(record_policy < 0) {
+        printf("Unknown record policy %s (drop, drop-oldest, queue)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      strncpy(trace_fn, argv[++i], sizeof(trace_fn) - 1);
+      trace_start();
+    } else if(strcmp(argv[i], "--no-display") == 0) {
+      headless = true;
+    } else if(strcmp(argv[i], "--buffered") == 0) {
+      buffered = true;
+    } else if(strcmp(argv[i], "--lazy-decode") == 0) {
+      lazy_decode = true;
+    } else if(strcmp(argv[i], "--bgr-capture") == 0) {
+      bgr_capture = true;
+    } else if(strcmp(argv[i], "--no-motion-gate") == 0) {
+      gating = false;
+    } else if(strcmp(argv[i], "--motion-threshold") == 0 && i + 1 < argc) {
+      motion_threshold = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--motion-max-reuse") == 0 && i + 1 < argc) {
+      motion_max_reuse = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--async-detect") == 0) {
+      async_detect = true;
+    } else if(strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc) {
+      target_fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--core-budget") == 0 && i + 1 < argc) {
+      core_budget = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--pose-filter") == 0) {
+      filtering = true;
+    } else if(strcmp(argv[i], "--pose-lead-ms") == 0 && i + 1 < argc) {
+      filtering = true;
+      pose_lead_ms = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--detector") == 0 && i + 1 < argc) {
+      backend = parse_detector_backend(argv[++i]);
+      if(!detector_available(backend)) {
+        printf("Unknown or unavailable detector %s (classic, sb, charuco)\n", argv[i]);
+        return(-1);
+      }
+    }
+  }
+  if(det_scale <= 0.0 || det_scale > 1.0) {
+    printf("--detect-scale must be in (0, 1]\n");
+    return(-1);
+  }
+  if(async_detect && multi_board) {
+    printf("--async-detect tracks a single board, it does not work with --multi-board\n");
+    return(-1);
+  }
+
+  // the detection thread already decouples how often detection runs, so it only gets the other knobs
+  bool governing = target_fps > 0 || core_budget > 0; 
+  unsigned knobs = (1u << KNOB_DET_SCALE) | (1u << KNOB_SUBPIX) | (1u << KNOB_LOD); 
+  if(!async_detect) {
+    knobs |= 1u << KNOB_DETECT_EVERY; 
+  }
+  compute_governor gov; 
+  if(governing && init_governor(target_fps, core_budget, knobs, det_scale, gov) != 0) {
+    printf("--target-fps and --core-budget must not be negative\n");
+    return(-1);
+  }
+
+  log_start(log_level, log_fn); 
+
+  // open the video device
+  capdev = new cv::VideoCapture(0);
+  if( !capdev->isOpened() ) {
+    printf("Unable to open video device\n");
+    return(-1);
+  }
+
+  // get some properties of the image
+  cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
+                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
+  printf("Expected size: %d %d\n", refS.width, refS.height);
+
+  // detection only needs the gray plane, take it from the camera's YUV frames when it can
+  int raw_format = bgr_capture ? RAW_BGR : open_luma_capture(capdev); 
+  luma_frame lf; 
+  
+  cv::Mat frame;
+  cv::Mat dst; 
+
+  // declare calibration data
+  cal_profile calib; 
+  if(read_cal_profile_csv("calibration.csv", "", calib, 0) != 0) {
+    printf("Unable to read calibration.csv\n"); 
+    return(-1); 
+  }
+
+  // print calibration data
+  print_cal_profile(calib); 
+
+  // declare size
+  cv::Size patternsize(9, 6); 
+  if(boardsizes.empty()) {
+    boardsizes.push_back(patternsize); 
+  }
+
+  bool show_vo = false;
+  bool show_ext = false;  
+
+  // get the extension stuff from the object file
+  pipeline_model model; 
+  load_pipeline_model(PIPELINE_AR, patternsize, "shuttle.obj", "kerm", model); 
+  
+  // print various data about the obj file, every vertex and face only at debug level
+  log_msg(LOG_INFO, "shuttle.obj: %d points, %d connections", (int) model.objpoints.size(), (int) model.connections.size()); 
+  if(log_enabled(LOG_DEBUG)) {
+    for(int i = 1; i <= model.objpoints.size(); i++) {
+      std::vector<float> vect = model.objpoints[i]; 
+      log_msg(LOG_DEBUG, "point %d: %.4f, %.4f, %.4f", i, vect[0], vect[1], vect[2]); 
+    }
+    for(int i = 0; i < model.connections.size(); i++) {
+      std::string line; 
+      for(int j = 0; j < model.connections[i].size(); j++) {
+        line += (j > 0 ? ", " : "") + std::to_string(model.connections[i][j]); 
+      }
+      log_msg(LOG_DEBUG, "connection %d: %s", i, line.c_str()); 
+    }
+  }
+
+  // detection, pose, filter and overlay, the same steps replay.exe checks recordings with
+  pipeline_settings set; 
+  init_pipeline_settings(set); 
+  set.backend = backend; 
+  set.det_scale = det_scale; 
+  set.gating = gating; 
+  set.motion_threshold = motion_threshold; 
+  set.motion_max_reuse = motion_max_reuse; 
+  set.filtering = filtering; 
+  set.pose_lead_ms = pose_lead_ms; 
+  set.multi_board = multi_board; 
+  set.boardsizes = boardsizes; 
+  set.max_boards = max_boards; 
+  frame_pipeline pipe; 
+  if(open_frame_pipeline(set, calib, &model, pipe) != 0) {
+    return(-1); 
+  }
+  pipeline_result result; 
+
+  pose_log poses; 
+  bool record_poses = strlen(pose_fn) > 0; 
+  if(record_poses && open_pose_log(pose_fn, pose_capacity, poses) != 0) {
+    return(-1); 
+  }
+  pipe.poses = record_poses ? &poses : NULL; 
+
+  shm_publisher publisher; 
+  bool publishing = strlen(shm_name) > 0; 
+  if(publishing) {
+    // room for the composited frame at the capture size, larger frames go out without it
+    size_t frame_bytes = publish_frame ? (size_t) refS.area() * 3 : 0; 
+    if(open_shm_publisher(shm_name, 8, patternsize.area(), frame_bytes, publisher) != 0) {
+      return(-1); 
+    }
+  }
+
+  image_writer snapshots; 
+  if(open_image_writer("./imgs/", "image", img_format, img_quality, 16, 2, snapshots) != 0) {
+    return(-1); 
+  }
+  bool bursting = false; 
+
+  video_recorder recorder; 
+  bool have_recorder = strlen(record_fn) > 0; 
+  if(have_recorder) {
+    double fps = record_fps > 0 ? record_fps : capdev->get(cv::CAP_PROP_FPS); 
+    if(open_video_recorder(record_fn, fps, record_policy, record_queue, recorder) != 0) {
+      return(-1); 
+    }
+  }
+  bool recording = have_recorder; 
+
+  // a thread grabs and decodes every frame so the driver queue never backs up, the loop takes the newest
+  latest_capture latest; 
+  if(!buffered && open_latest_capture(capdev, latest, lazy_decode) != 0) {
+    return(-1); 
+  }
+
+  // the window is shown and its events pumped on a thread of its own
+  frame_display display; 
+  open_display("Cal/AR", headless, display); 
+
+  // with --async-detect the loop runs at the camera rate whatever the detector costs
+  board_tracker tracker; 
+  if(async_detect) {
+    open_board_tracker(backend, patternsize, tracker); 
+    pipe.tracker = &tracker; 
+  }
+
+  long frame_no = 0; 
+  for(;;) {
+    long frame_id = frame_no++; 
+    log_frame(frame_id); 
+    begin_frame(pipe.ws); 
+    int64_t frame_start = prof_now(); 
+    if(recording && raw_format == RAW_BGR && !frame.empty()) {
+      // the last frame now belongs to the encoder, capture into a buffer it is done with
+      frame = next_record_frame(recorder, frame.size(), frame.type()); 
+    }
+    int64_t captured = frame_start; // when the camera took the frame, carried through to the display
+    if(buffered) {
+      *capdev >> frame; // get a new frame from the camera, treat as a stream
+    } else if(read_latest(latest, frame, captured) != 0) {
+      frame.release(); 
+    }
+    prof_record(STAGE_CAPTURE, prof_now() - frame_start); 
+    if( frame.empty() || load_luma_frame(frame, raw_format, lf) != 0 ) {
+      printf("frame is empty\n");
+      break;
+    }  
+
+    // BGR is only built when something shows, records, saves or publishes the frame,
+    // and a BGR capture is drawn on in place since nothing reads the raw frame afterwards
+    if(!headless || recording || bursting || (publishing && publish_frame)) {
+      if(recording && !lf.have_bgr) {
+        lf.bgr = next_record_frame(recorder, lf.gray.size(), CV_8UC3); 
+      }
+      dst = luma_bgr(lf); 
+    } else {
+      dst.release(); 
+    }
+
+    pipe.set.overlay = show_vo ? OVERLAY_HOUSE : (show_ext ? OVERLAY_OBJ : OVERLAY_AXES);
+    run_frame_pipeline(pipe, lf.gray, dst, captured, result); 
+
+    if(bursting && frame_id % burst_every == 0) {
+      queue_image(snapshots, dst); 
+    }
+
+    if(publishing) {
+      shm_publish(publisher, result.found, pipe.ws.corner_set, pipe.ws.rotations, pipe.ws.translations, publish_frame ? &dst : NULL); 
+    }
+
+    if(recording) {
+      record_frame(recorder, dst); 
+    }
+
+    int64_t t0 = prof_now(); 
+    show_frame(display, dst); 
+    prof_record(STAGE_LATENCY, prof_now() - captured); 
+
+    char keyEx = poll_key(display); 
+    prof_record(STAGE_DISPLAY, prof_now() - t0); 
+    prof_record(STAGE_FRAME, prof_now() - frame_start); 
+    if(governing && governor_frame(gov)) {
+      pipe.set.det_scale = gov.det_scale; 
+      pipe.detect_every = async_detect ? 1 : gov.detect_every; 
+      set_refine_iterations(gov.subpix_iters); 
+      pipe.lod = gov.lod; 
+      pipe.last_valid = false; // kept results are at the old settings
+    }
+    if(keyEx == 'q') {
+      break; 
+    } else if (keyEx == 'n') {
+      show_vo = !show_vo;
+      show_ext = false; 
+    } else if (keyEx == 'e') {
+      show_ext = !show_ext; 
+      show_vo = false; 
+    } else if (keyEx == 'p') {
+      prof_print(); 
+      prof_dump_csv(prof_fn); 
+    } else if (keyEx == 's') {
+      std::string name; 
+      if(queue_image(snapshots, dst, &name) == 0) {
+        log_msg(LOG_INFO, "Saving %s", name.c_str()); 
+      }
+    } else if (keyEx == 'b') {
+      bursting = !bursting; 
+      log_msg(LOG_INFO, "Burst %s, every %d frames", bursting ? "on" : "off", burst_every); 
+    } else if (keyEx == 'r' && have_recorder) {
+      recording = !recording; 
+      if(!recording) {
+        // the encoder may still hold the last frame
+        frame.release(); 
+        lf.bgr.release(); 
+        dst.release(); 
+      }
+      log_msg(LOG_INFO, "Recording %s", recording ? "resumed" : "paused"); 
+    } 
+  }
+
+  if(!buffered) {
+    close_latest_capture(latest); 
+  }
+  refine_stats refine = pipe.refine; 
+  if(async_detect) {
+    close_board_tracker(tracker, "ar"); 
+    refine = tracker.refine; 
+  }
+
+  if(refine.corners > 0) {
+    log_msg(LOG_INFO, "Sub-pixel refinement: %.2f iterations per corner", (double) refine.iterations / refine.corners); 
+  }
+
+  if(gating) {
+    print_motion_gate(pipe.gate, "ar"); 
+  }
+  if(governing) {
+    print_governor(gov, "ar"); 
+  }
+  if(filtering) {
+    printf("ar: pose filter took %ld poses, restarted %ld times on a jump\n", pipe.filter.updates, pipe.filter.resets); 
+  }
+  print_frame_allocs(pipe.ws, "ar"); 
+  print_frame_copies(pipe.ws, "ar"); 
+  prof_print(); 
+  prof_dump_csv(prof_fn); 
+  if(trace_enabled()) {
+    trace_dump_json(trace_fn); 
+  }
+
+  close_image_writer(snapshots); 
+  if(have_recorder) {
+    close_video_recorder(recorder); 
+  }
+  if(record_poses) {
+    close_pose_log(poses); 
+  }
+  if(publishing) {
+    close_shm_publisher(publisher); 
+  }
+  log_stop(); 
+  close_display(display); 
+  printf("Bye!\n"); 
+
+  delete capdev;
+  return(0);
 }
\ No newline at end of file
@@ -0,0 +1,637 @@
+/**
+ * @file bench_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for timing the AR and csv library functions
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <opencv2/opencv.hpp>
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "../include/csv_util.h"
+#include "../include/ar.h"
+#include "../include/calibration.h"
+#include "../include/profiler.h"
+#include "../include/synth.h"
+
+#define MAX_ITERS 100000 // per case, however fast the function is
+#define MIN_ITERS 5
+
+// timings of one function at one size
+struct bench_result {
+  std::string name;
+  std::string param; // size it ran at, e.g. "640x480" or "10000 rows"
+  long iters;
+  double mean_ns;
+  double p50_ns;
+  double p95_ns;
+  double min_ns;
+};
+
+// what the cases run against, made once before any timing
+struct bench_data {
+  std::string dir;
+  cv::Size patsize;
+  std::vector<cv::Size> image_sizes;
+  std::vector<cv::Mat> images; // a board rendered at each image size
+  std::vector<cal_profile> cals; // intrinsics of each image
+  std::vector<int> board_counts; // boards in each multi-board frame
+  std::vector<cv::Mat> multi_images; // 1280x720, a board in each of the first board_counts quarters
+  cal_profile multi_cal;
+  std::vector<int> model_sizes; // vertices in each generated obj
+  std::vector<std::string> obj_files;
+  std::vector<int> row_counts; // rows in each generated feature csv
+  std::vector<std::string> csv_files;
+  std::string cal_file;
+};
+
+/**
+ * @brief Function to send stdout to the null device while a reader that prints on every call is timed
+ *
+ * @param quiet true to silence, false to restore
+ */
+static void quiet_stdout(bool quiet) {
+  static int saved = -1;
+  fflush(stdout);
+#ifdef _WIN32
+  if(quiet && saved < 0) {
+    saved = _dup(1);
+    int null_fd = _open("NUL", _O_WRONLY);
+    _dup2(null_fd, 1);
+    _close(null_fd);
+  } else if(!quiet && saved >= 0) {
+    _dup2(saved, 1);
+    _close(saved);
+    saved = -1;
+  }
+#else
+  if(quiet && saved < 0) {
+    saved = dup(1);
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, 1);
+    close(null_fd);
+  } else if(!quiet && saved >= 0) {
+    dup2(saved, 1);
+    close(saved);
+    saved = -1;
+  }
+#endif
+}
+
+/**
+ * @brief Function to check whether a case was asked for
+ *
+ * @param filter --filter, empty for every case
+ * @param name function the case times
+ * @return true if the case should run
+ */
+static bool wanted(const std::string &filter, const char *name) {
+  return filter.empty() || std::string(name).find(filter) != std::string::npos;
+}
+
+/**
+ * @brief Function to time one case
+ *
+ * Runs fn once to warm up, then until min_secs have passed and at least
+ * MIN_ITERS calls were made.
+ *
+ * @param name function being timed
+ * @param param size it runs at
+ * @param min_secs time to spend
+ * @param quiet silence stdout while timing
+ * @param fn one call of the function
+ * @return bench_result
+ */
+static bench_result run_case(const char *name, const std::string &param, double min_secs, bool quiet, const std::function<void()> &fn) {
+  std::vector<double> times;
+  if(quiet) {
+    quiet_stdout(true);
+  }
+  fn();
+  int64_t start = prof_now();
+  while(times.size() < MAX_ITERS && (times.size() < MIN_ITERS || (prof_now() - start) * 1e-9 < min_secs)) {
+    int64_t t0 = prof_now();
+    fn();
+    times.push_back((double) (prof_now() - t0));
+  }
+  if(quiet) {
+    quiet_stdout(false);
+  }
+
+  bench_result res;
+  res.name = name;
+  res.param = param;
+  res.iters = times.size();
+  double sum = 0;
+  for(int i = 0; i < times.size(); i++) {
+    sum += times[i];
+  }
+  std::sort(times.begin(), times.end());
+  res.mean_ns = sum / times.size();
+  res.p50_ns = times[times.size() / 2];
+  res.p95_ns = times[std::min(times.size() - 1, (size_t) (times.size() * 0.95))];
+  res.min_ns = times[0];
+
+  printf("%-24s %-14s %8ld %12.1f %12.1f %12.1f\n", name, param.c_str(), res.iters, res.mean_ns * 1e-3, res.p50_ns * 1e-3, res.p95_ns * 1e-3);
+  fflush(stdout);
+  return res;
+}
+
+/**
+ * @brief Function to write an obj model of a wavy sheet with about n vertices
+ *
+ * @param filename name of obj file
+ * @param n vertices
+ * @return int return non-zero value on failure
+ */
+static int write_bench_obj(const std::string &filename, int n) {
+  FILE *fp = fopen(filename.c_str(), "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename.c_str());
+    return(-1);
+  }
+  int side = std::max(2, (int) sqrt((double) n));
+  for(int i = 0; i < side; i++) {
+    for(int j = 0; j < side; j++) {
+      fprintf(fp, "v %.6f %.6f %.6f\n", 8.0 * j / (side - 1), -5.0 * i / (side - 1), 1 + 0.3 * sin(i * 0.7) * cos(j * 0.5));
+    }
+  }
+  // two triangles per grid cell, vertices are numbered from 1
+  for(int i = 0; i + 1 < side; i++) {
+    for(int j = 0; j + 1 < side; j++) {
+      int a = i * side + j + 1, b = a + 1, c = a + side, d = c + 1;
+      fprintf(fp, "f %d %d %d\n", a, b, d);
+      fprintf(fp, "f %d %d %d\n", a, d, c);
+    }
+  }
+  fclose(fp);
+  return(0);
+}
+
+/**
+ * @brief Function to write a feature csv of rows x cols floats like the ones read_image_data_csv reads
+ *
+ * @param filename name of csv file
+ * @param rows rows
+ * @param cols floats per row
+ * @return int return non-zero value on failure
+ */
+static int write_bench_csv(const std::string &filename, int rows, int cols) {
+  FILE *fp = fopen(filename.c_str(), "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename.c_str());
+    return(-1);
+  }
+  cv::RNG rng(rows);
+  for(int i = 0; i < rows; i++) {
+    for(int j = 0; j < cols; j++) {
+      fprintf(fp, j == 0 ? "%.4f" : ",%.4f", rng.uniform(0.0f, 1000.0f));
+    }
+    fprintf(fp, "\n");
+  }
+  fclose(fp);
+  return(0);
+}
+
+/**
+ * @brief Function to make the images and files the cases run against
+ *
+ * @param d data to fill in, dir, patsize and the size lists set
+ * @return int return non-zero value on failure
+ */
+static int make_bench_data(bench_data &d) {
+#ifdef _WIN32
+  _mkdir(d.dir.c_str());
+#else
+  mkdir(d.dir.c_str(), 0755);
+#endif
+
+  // the board at a slant, with sensor noise, rendered at every size
+  for(int i = 0; i < d.image_sizes.size(); i++) {
+    cal_profile cal;
+    default_synth_camera(d.image_sizes[i], cal);
+    std::vector<synth_pose> poses;
+    synth_renderer r;
+    if(synth_trajectory("static", cal, d.patsize, 1, 30, poses) != 0 || init_synth_renderer(cal, d.patsize, 2, r) != 0) {
+      return(-1);
+    }
+    synth_params p = synth_params();
+    p.gain = 1;
+    p.noise = 2;
+    cv::RNG rng(1);
+    cv::Mat gray, bgr;
+    render_synth_frame(r, p, poses, 0, rng, gray);
+    cv::cvtColor(gray, bgr, cv::COLOR_GRAY2BGR); // the camera loops hand BGR to detect_chessboard
+    d.images.push_back(bgr);
+    d.cals.push_back(cal);
+  }
+
+  // the same board in each quarter of a 1280x720 frame, the quarters without one are background
+  cv::Size quarter(640, 360);
+  cal_profile qcal;
+  default_synth_camera(quarter, qcal);
+  std::vector<synth_pose> qposes;
+  synth_renderer qr;
+  if(synth_trajectory("static", qcal, d.patsize, 1, 30, qposes) != 0 || init_synth_renderer(qcal, d.patsize, 2, qr) != 0) {
+    return(-1);
+  }
+  synth_pose empty = qposes[0];
+  empty.tvec = cv::Vec3d(0, 0, -1); // behind the camera
+  qposes.push_back(empty);
+  synth_params qp = synth_params();
+  qp.gain = 1;
+  qp.noise = 2;
+  cv::RNG qrng(1);
+  for(int i = 0; i < d.board_counts.size(); i++) {
+    cv::Mat gray(quarter.height * 2, quarter.width * 2, CV_8UC1), tile, bgr;
+    for(int q = 0; q < 4; q++) {
+      render_synth_frame(qr, qp, qposes, q < d.board_counts[i] ? 0 : 1, qrng, tile);
+      tile.copyTo(gray(cv::Rect((q % 2) * quarter.width, (q / 2) * quarter.height, quarter.width, quarter.height)));
+    }
+    cv::cvtColor(gray, bgr, cv::COLOR_GRAY2BGR);
+    d.multi_images.push_back(bgr);
+  }
+  default_synth_camera(cv::Size(quarter.width * 2, quarter.height * 2), d.multi_cal);
+
+  for(int i = 0; i < d.model_sizes.size(); i++) {
+    std::string fn = d.dir + "/model" + std::to_string(d.model_sizes[i]) + ".obj";
+    if(write_bench_obj(fn, d.model_sizes[i]) != 0) {
+      return(-1);
+    }
+    d.obj_files.push_back(fn);
+  }
+  for(int i = 0; i < d.row_counts.size(); i++) {
+    std::string fn = d.dir + "/features" + std::to_string(d.row_counts[i]) + ".csv";
+    if(write_bench_csv(fn, d.row_counts[i], 16) != 0) {
+      return(-1);
+    }
+    d.csv_files.push_back(fn);
+  }
+
+  d.cal_file = d.dir + "/calibration.csv";
+  cv::Mat cam_mat = d.cals[0].cam_mat.clone();
+  cv::Mat distcoeff = d.cals[0].distcoeff.clone();
+  quiet_stdout(true);
+  int ret = append_calibration_data_csv((char *) d.cal_file.c_str(), cam_mat, distcoeff, 1);
+  quiet_stdout(false);
+
+  return(ret);
+}
+
+/**
+ * @brief Function to write results as json, one benchmark per line so --compare can read them back
+ *
+ * @param filename name of json file
+ * @param results results to write
+ * @return int return non-zero value on failure
+ */
+static int write_bench_json(const char *filename, const std::vector<bench_result> &results) {
+  FILE *fp = fopen(filename, "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename);
+    return(-1);
+  }
+  fprintf(fp, "{\n  \"opencv\": \"%s\",\n  \"threads\": %d,\n  \"benchmarks\": [\n", CV_VERSION, cv::getNumThreads());
+  for(int i = 0; i < results.size(); i++) {
+    const bench_result &r = results[i];
+    fprintf(fp, "    {\"name\": \"%s\", \"param\": \"%s\", \"iterations\": %ld, \"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p95_ns\": %.1f, \"min_ns\": %.1f}%s\n",
+            r.name.c_str(), r.param.c_str(), r.iters, r.mean_ns, r.p50_ns, r.p95_ns, r.min_ns, i + 1 < results.size() ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+  fclose(fp);
+  return(0);
+}
+
+/**
+ * @brief Function to read results written by write_bench_json
+ *
+ * @param filename name of json file
+ * @param results results to write to
+ * @return int return non-zero value on failure
+ */
+static int read_bench_json(const char *filename, std::vector<bench_result> &results) {
+  FILE *fp = fopen(filename, "r");
+  if(!fp) {
+    printf("Unable to open %s\n", filename);
+    return(-1);
+  }
+  char line[1024];
+  char name[256], param[256];
+  while(fgets(line, sizeof(line), fp)) {
+    const char *obj = strstr(line, "{\"name\"");
+    if(!obj) {
+      continue;
+    }
+    bench_result r;
+    if(sscanf(obj, "{\"name\": \"%255[^\"]\", \"param\": \"%255[^\"]\", \"iterations\": %ld, \"mean_ns\": %lf, \"p50_ns\": %lf, \"p95_ns\": %lf, \"min_ns\": %lf",
+              name, param, &r.iters, &r.mean_ns, &r.p50_ns, &r.p95_ns, &r.min_ns) != 7) {
+      continue;
+    }
+    r.name = name;
+    r.param = param;
+    results.push_back(r);
+  }
+  fclose(fp);
+  if(results.empty()) {
+    printf("No benchmarks in %s\n", filename);
+    return(-1);
+  }
+  return(0);
+}
+
+/**
+ * @brief Function to compare two runs on the median, flagging cases that got slower than the threshold
+ *
+ * @param base_fn json of the run to compare against
+ * @param new_fn json of the new run
+ * @param threshold percent slower that counts as a regression
+ * @return int number of regressions, -1 on failure
+ */
+static int compare_runs(const char *base_fn, const char *new_fn, double threshold) {
+  std::vector<bench_result> base, cur;
+  if(read_bench_json(base_fn, base) != 0 || read_bench_json(new_fn, cur) != 0) {
+    return(-1);
+  }
+  std::map<std::string, const bench_result *> by_key;
+  for(int i = 0; i < base.size(); i++) {
+    by_key[base[i].name + " " + base[i].param] = &base[i];
+  }
+
+  int regressions = 0, improvements = 0;
+  printf("%-24s %-14s %12s %12s %8s\n", "function", "size", "base p50 us", "new p50 us", "change");
+  for(int i = 0; i < cur.size(); i++) {
+    std::map<std::string, const bench_result *>::iterator it = by_key.find(cur[i].name + " " + cur[i].param);
+    if(it == by_key.end()) {
+      printf("%-24s %-14s %12s %12.1f %8s\n", cur[i].name.c_str(), cur[i].param.c_str(), "-", cur[i].p50_ns * 1e-3, "new");
+      continue;
+    }
+    const bench_result &b = *it->second;
+    double change = b.p50_ns > 0 ? 100.0 * (cur[i].p50_ns - b.p50_ns) / b.p50_ns : 0;
+    const char *flag = "";
+    if(change > threshold) {
+      flag = "  REGRESSION";
+      regressions++;
+    } else if(change < -threshold) {
+      flag = "  faster";
+      improvements++;
+    }
+    printf("%-24s %-14s %12.1f %12.1f %+7.1f%%%s\n", cur[i].name.c_str(), cur[i].param.c_str(), b.p50_ns * 1e-3,
+           cur[i].p50_ns * 1e-3, change, flag);
+    by_key.erase(it);
+  }
+  for(std::map<std::string, const bench_result *>::iterator it = by_key.begin(); it != by_key.end(); ++it) {
+    printf("%-24s %-14s %12.1f %12s %8s\n", it->second->name.c_str(), it->second->param.c_str(), it->second->p50_ns * 1e-3, "-", "gone");
+  }
+  printf("\n%d regressions and %d improvements beyond %.0f%%\n", regressions, improvements, threshold);
+
+  return(regressions);
+}
+
+int main(int argc, char *argv[]) {
+  char json_fn[256] = "";
+  double min_secs = 0.25;
+  std::string filter = "";
+  bool quick = false;
+  double threshold = 10;
+  std::vector<std::string> compare_fns;
+  bench_data d;
+  d.dir = "bench_data";
+  d.patsize = cv::Size(9, 6);
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      strncpy(json_fn, argv[++i], sizeof(json_fn) - 1);
+    } else if(strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+      min_secs = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      filter = argv[++i];
+    } else if(strcmp(argv[i], "--dir") == 0 && i + 1 < argc) {
+      d.dir = argv[++i];
+    } else if(strcmp(argv[i], "--quick") == 0) {
+      quick = true;
+    } else if(strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+      compare_fns.push_back(argv[++i]);
+      compare_fns.push_back(argv[++i]);
+    } else {
+      printf("usage: %s [--json out.json] [--min-time secs] [--filter name] [--quick] [--dir bench_data]\n", argv[0]);
+      printf("       %s --compare base.json new.json [--threshold percent]\n", argv[0]);
+      printf("  times the AR and csv library functions at several image, model and file sizes and board counts,\n");
+      printf("  --compare flags every case whose median got slower by more than the threshold (default 10%%)\n");
+      return(-1);
+    }
+  }
+
+  if(!compare_fns.empty()) {
+    int regressions = compare_runs(compare_fns[0].c_str(), compare_fns[1].c_str(), threshold);
+    return(regressions == 0 ? 0 : 1);
+  }
+
+  if(quick) {
+    d.image_sizes.push_back(cv::Size(640, 480));
+    d.model_sizes.push_back(1000);
+    d.row_counts.push_back(1000);
+  } else {
+    d.image_sizes.push_back(cv::Size(320, 240));
+    d.image_sizes.push_back(cv::Size(640, 480));
+    d.image_sizes.push_back(cv::Size(1280, 720));
+    d.image_sizes.push_back(cv::Size(1920, 1080));
+    d.model_sizes.push_back(100);
+    d.model_sizes.push_back(1000);
+    d.model_sizes.push_back(10000);
+    d.row_counts.push_back(100);
+    d.row_counts.push_back(1000);
+    d.row_counts.push_back(10000);
+  }
+  // detect_chessboards at every count, it is meant to grow slower than the boards do
+  d.board_counts.push_back(1);
+  d.board_counts.push_back(2);
+  d.board_counts.push_back(4);
+  if(make_bench_data(d) != 0) {
+    printf("Unable to make the benchmark data in %s\n", d.dir.c_str());
+    return(-1);
+  }
+
+  printf("%-24s %-14s %8s %12s %12s %12s\n", "function", "size", "iters", "mean us", "p50 us", "p95 us");
+  std::vector<bench_result> results;
+  std::vector<cv::Vec3f> points;
+  std::vector<cv::Point2f> corner_set;
+  bool found = false;
+  std::string board = std::to_string(d.patsize.width) + "x" + std::to_string(d.patsize.height);
+  // detection, the bulk of a frame
+  for(int i = 0; i < d.images.size(); i++) {
+    const cv::Mat &img = d.images[i];
+    std::string size = std::to_string(img.cols) + "x" + std::to_string(img.rows);
+    if(wanted(filter, "detect_chessboard")) {
+      results.push_back(run_case("detect_chessboard", size, min_secs, false, [&]() {
+        corner_set.clear();
+        detect_chessboard(img, d.patsize, corner_set, found);
+      }));
+    }
+    if(wanted(filter, "det_ext_corners")) {
+      cv::Mat dst;
+      results.push_back(run_case("det_ext_corners", size, min_secs, false, [&]() {
+        corner_set.clear();
+        det_ext_corners(img, dst, d.patsize, corner_set, found);
+      }));
+    }
+  }
+
+  // --multi-board detection and poses, per frame at 1, 2 and 4 boards
+  std::vector<cv::Size> patsizes(1, d.patsize);
+  board_search search;
+  board_set found_boards = board_set();
+  std::vector<cv::Vec3f> point_set;
+  for(int i = 0; i < d.multi_images.size(); i++) {
+    const cv::Mat &img = d.multi_images[i];
+    std::string count = std::to_string(d.board_counts[i]) + (d.board_counts[i] == 1 ? " board" : " boards");
+    if(wanted(filter, "detect_chessboards")) {
+      results.push_back(run_case("detect_chessboards", count, min_secs, false, [&]() {
+        detect_chessboards(img, patsizes, 8, search, found_boards);
+      }));
+      if(found_boards.count != d.board_counts[i]) {
+        printf("  found %d of the %d boards\n", found_boards.count, d.board_counts[i]);
+      }
+    }
+    if(wanted(filter, "solve_board_poses")) {
+      detect_chessboards(img, patsizes, 8, search, found_boards);
+      results.push_back(run_case("solve_board_poses", count, min_secs, false, [&]() {
+        solve_board_poses(found_boards, d.multi_cal.cam_mat, d.multi_cal.distcoeff, point_set);
+      }));
+    }
+  }
+
+  // board geometry
+  std::vector<cv::Size> boards;
+  boards.push_back(d.patsize);
+  if(!quick) {
+    boards.push_back(cv::Size(20, 15));
+    boards.push_back(cv::Size(50, 50));
+  }
+  for(int i = 0; i < boards.size() && wanted(filter, "get_point_set"); i++) {
+    results.push_back(run_case("get_point_set", std::to_string(boards[i].width) + "x" + std::to_string(boards[i].height), min_secs, false, [&]() {
+      points.clear();
+      get_point_set(boards[i], points);
+    }));
+  }
+
+  // overlay geometry builders
+  cv::Vec3f origin(0, 0, 0);
+  if(wanted(filter, "draw_axes")) {
+    results.push_back(run_case("draw_axes", "-", min_secs, false, [&]() { points.clear(); draw_axes(points, origin, 1); }));
+  }
+  if(wanted(filter, "draw_cube")) {
+    results.push_back(run_case("draw_cube", "-", min_secs, false, [&]() { points.clear(); draw_cube(points, origin, 1); }));
+  }
+  if(wanted(filter, "draw_rect_prism")) {
+    results.push_back(run_case("draw_rect_prism", "-", min_secs, false, [&]() { points.clear(); draw_rect_prism(points, origin, 3, 2, 2); }));
+  }
+  if(wanted(filter, "draw_roof")) {
+    results.push_back(run_case("draw_roof", "-", min_secs, false, [&]() { points.clear(); draw_roof(points, origin, 3, 1, 2); }));
+  }
+  if(wanted(filter, "draw_door")) {
+    results.push_back(run_case("draw_door", "-", min_secs, false, [&]() { points.clear(); draw_door(points, origin, 1, 1.5, 0); }));
+  }
+  std::map<int, std::vector<float> > no_model;
+  if(wanted(filter, "get_overlay_points")) {
+    results.push_back(run_case("get_overlay_points", "house", min_secs, false, [&]() {
+      points.clear();
+      get_overlay_points(OVERLAY_HOUSE, d.patsize, no_model, points);
+    }));
+  }
+
+  // obj models, read and then projected and drawn like ar_main does
+  const cal_profile &cal = d.cals[std::min(1, (int) d.cals.size() - 1)];
+  cv::Mat canvas = cv::Mat::zeros(cal.image_size, CV_8UC3);
+  std::vector<cv::Vec3f> board_points;
+  get_point_set(d.patsize, board_points);
+  std::vector<cv::Point2f> board_corners;
+  std::vector<synth_pose> poses;
+  synth_trajectory("static", cal, d.patsize, 1, 30, poses); // the pose the images were rendered at
+  cv::Vec3d rvec = poses[0].rvec, tvec = poses[0].tvec;
+  cv::projectPoints(board_points, rvec, tvec, cal.cam_mat, cal.distcoeff, board_corners);
+  for(int i = 0; i < d.obj_files.size(); i++) {
+    std::string verts = std::to_string(d.model_sizes[i]) + " verts";
+    std::map<int, std::vector<float> > objpoints;
+    std::vector<std::vector<int> > connections;
+    if(wanted(filter, "read_vo_data_obj")) {
+      results.push_back(run_case("read_vo_data_obj", verts, min_secs, true, [&]() {
+        objpoints.clear();
+        connections.clear();
+        read_vo_data_obj((char *) d.obj_files[i].c_str(), objpoints, connections);
+      }));
+    }
+    quiet_stdout(true);
+    objpoints.clear();
+    connections.clear();
+    read_vo_data_obj((char *) d.obj_files[i].c_str(), objpoints, connections);
+    quiet_stdout(false);
+
+    std::vector<cv::Vec3f> model;
+    get_overlay_points(OVERLAY_OBJ, d.patsize, objpoints, model);
+    std::vector<cv::Point2f> image_points;
+    if(wanted(filter, "get_overlay_points")) {
+      results.push_back(run_case("get_overlay_points", verts, min_secs, false, [&]() {
+        points.clear();
+        get_overlay_points(OVERLAY_OBJ, d.patsize, objpoints, points);
+      }));
+    }
+    if(wanted(filter, "projectPoints")) {
+      results.push_back(run_case("projectPoints", verts, min_secs, false, [&]() {
+        cv::projectPoints(model, rvec, tvec, cal.cam_mat, cal.distcoeff, image_points);
+      }));
+    }
+    cv::projectPoints(model, rvec, tvec, cal.cam_mat, cal.distcoeff, image_points);
+    if(wanted(filter, "draw_overlay")) {
+      results.push_back(run_case("draw_overlay", verts, min_secs, false, [&]() {
+        draw_overlay(canvas, OVERLAY_OBJ, image_points, connections);
+      }));
+    }
+  }
+
+  // pose from the board corners, as in ar_main
+  if(wanted(filter, "solvePnP")) {
+    cv::Mat r, t;
+    results.push_back(run_case("solvePnP", board, min_secs, false, [&]() {
+      cv::solvePnP(board_points, board_corners, cal.cam_mat, cal.distcoeff, r, t);
+    }));
+  }
+
+  // csv readers
+  if(wanted(filter, "read_calibration_data_csv")) {
+    cv::Mat cam_mat(3, 3, CV_64FC1), distcoeff(5, 1, CV_64FC1);
+    results.push_back(run_case("read_calibration_data_csv", "1 profile", min_secs, true, [&]() {
+      read_calibration_data_csv((char *) d.cal_file.c_str(), cam_mat, distcoeff, 0);
+    }));
+  }
+  for(int i = 0; i < d.csv_files.size() && wanted(filter, "read_image_data_csv"); i++) {
+    std::vector<std::vector<float> > data;
+    results.push_back(run_case("read_image_data_csv", std::to_string(d.row_counts[i]) + " rows", min_secs, true, [&]() {
+      data.clear();
+      read_image_data_csv((char *) d.csv_files[i].c_str(), data, 0);
+    }));
+  }
+
+  if(strlen(json_fn) > 0 && write_bench_json(json_fn, results) != 0) {
+    return(-1);
+  }
+
+  return(0);
+}
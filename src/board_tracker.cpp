@@ -0,0 +1,198 @@
+/**
+ * @file board_tracker.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Board detection on its own thread, poses interpolated to every drawn frame
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <algorithm>
+#include "../include/board_tracker.h"
+#include "../include/pose_filter.h"
+#include "../include/profiler.h"
+
+#define MAX_BLEND_GAP_NS 500000000LL // poses further apart are not blended
+#define MAX_STALE_NS 500000000LL // stop drawing when the newest pose is this old
+#define MAX_EXTRAPOLATE_NS 200000000LL
+#define MAX_BLEND_JUMP_RAD 0.5 // solvePnP flipped to the mirrored solution
+
+/**
+ * @brief Function run on the detection thread
+ *
+ * @param bt tracker the thread belongs to
+ */
+static void run_detection(board_tracker *bt) {
+  cv::Mat work;
+  int64_t work_time;
+  cal_profile cal;
+  std::vector<cv::Point2f> corner_set;
+  std::vector<int> corner_ids;
+  std::vector<cv::Vec3f> point_set;
+  cv::Mat rvec, tvec;
+
+  for(;;) {
+    {
+      std::unique_lock<std::mutex> guard(bt->lock);
+      bt->ready.wait(guard, [bt] { return bt->fresh || bt->stopping; });
+      if(bt->stopping) {
+        break;
+      }
+      // swap, so the next submit copies into the buffer this thread just finished with
+      cv::swap(work, bt->pending);
+      work_time = bt->pending_time;
+      bt->pending_cal.cam_mat.copyTo(cal.cam_mat);
+      bt->pending_cal.distcoeff.copyTo(cal.distcoeff);
+      bt->fresh = false;
+    }
+
+    corner_set.clear();
+    corner_ids.clear();
+    bool found = false;
+    detect_board(work, bt->backend, bt->patsize, corner_set, corner_ids, found, &bt->refine);
+    // a ChArUco board still gives a pose with part of it covered
+    found = found || corner_ids.size() >= 6;
+    if(found) {
+      get_point_subset(bt->patsize, corner_ids, point_set);
+      PROF_SCOPE(STAGE_PNP);
+      cv::solvePnP(point_set, corner_set, cal.cam_mat, cal.distcoeff, rvec, tvec);
+    }
+    bt->detected++;
+
+    std::lock_guard<std::mutex> guard(bt->lock);
+    if(!found) {
+      bt->num_poses = 0;
+      continue;
+    }
+    tracked_pose p;
+    p.time_ns = work_time;
+    p.rvec = cv::Vec3d(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2));
+    p.tvec = cv::Vec3d(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+    if(bt->num_poses == 2) {
+      bt->poses[0] = bt->poses[1];
+    }
+    bt->num_poses = std::min(bt->num_poses + 1, 2);
+    bt->poses[bt->num_poses - 1] = p;
+  }
+}
+
+/**
+ * @brief Function to start the detection thread
+ *
+ * @param backend detector_backend
+ * @param patsize inner corners of the board
+ * @param bt tracker to start
+ * @return int return non-zero value on failure
+ */
+int open_board_tracker(int backend, cv::Size patsize, board_tracker &bt) {
+  if(!detector_available(backend)) {
+    return(-1);
+  }
+
+  bt.backend = backend;
+  bt.patsize = patsize;
+  bt.pending_time = 0;
+  bt.fresh = false;
+  bt.stopping = false;
+  bt.num_poses = 0;
+  bt.refine = refine_stats();
+  bt.submitted = 0;
+  bt.detected = 0;
+  bt.replaced = 0;
+  bt.thread = std::thread(run_detection, &bt);
+
+  return(0);
+}
+
+/**
+ * @brief Function to hand a frame to the detection thread, never waits for the detection
+ *
+ * The frame and intrinsics are copied. A frame the thread has not taken yet is replaced.
+ *
+ * @param bt open tracker
+ * @param src frame to detect in, gray or BGR
+ * @param time_ns capture time of the frame
+ * @param cal intrinsics at src's size
+ * @return int
+ */
+int submit_board_frame(board_tracker &bt, const cv::Mat &src, int64_t time_ns, const cal_profile &cal) {
+  std::lock_guard<std::mutex> guard(bt.lock);
+  if(bt.fresh) {
+    bt.replaced++;
+  }
+  src.copyTo(bt.pending);
+  bt.pending_time = time_ns;
+  cal.cam_mat.copyTo(bt.pending_cal.cam_mat);
+  cal.distcoeff.copyTo(bt.pending_cal.distcoeff);
+  bt.fresh = true;
+  bt.submitted++;
+  bt.ready.notify_one();
+
+  return(0);
+}
+
+/**
+ * @brief Function to get the board pose at a time from the newest detections
+ *
+ * Extrapolation goes at most one detection interval, and no more than 200 ms,
+ * past the newest pose. Two poses more than half a second apart, or a
+ * jump between them, are not blended and the newest is held instead.
+ *
+ * @param bt open tracker
+ * @param time_ns time to get the pose at, usually the capture time of the frame being drawn
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int return non-zero value when the board is not being tracked
+ */
+int board_pose_at(board_tracker &bt, int64_t time_ns, cv::Mat &rvec, cv::Mat &tvec) {
+  tracked_pose p0, p1;
+  int n;
+  {
+    std::lock_guard<std::mutex> guard(bt.lock);
+    n = bt.num_poses;
+    p0 = bt.poses[0];
+    p1 = bt.poses[n > 1 ? 1 : 0];
+  }
+  if(n == 0 || time_ns - p1.time_ns > MAX_STALE_NS) {
+    return(-1);
+  }
+
+  cv::Vec3d r = p1.rvec, t = p1.tvec;
+  int64_t gap = p1.time_ns - p0.time_ns;
+  if(n == 2 && gap > 0 && gap <= MAX_BLEND_GAP_NS && rotation_distance(p0.rvec, p1.rvec) < MAX_BLEND_JUMP_RAD) {
+    int64_t ahead = std::min<int64_t>(time_ns - p1.time_ns, std::min<int64_t>(gap, MAX_EXTRAPOLATE_NS));
+    int64_t at = std::max(p1.time_ns + ahead, p0.time_ns);
+    interpolate_pose(p0.rvec, p0.tvec, p1.rvec, p1.tvec, (double) (at - p0.time_ns) / gap, r, t);
+  }
+
+  rvec.create(3, 1, CV_64F);
+  tvec.create(3, 1, CV_64F);
+  for(int i = 0; i < 3; i++) {
+    rvec.at<double>(i) = r[i];
+    tvec.at<double>(i) = t[i];
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to stop the detection thread and print how often it ran
+ *
+ * @param bt tracker to close
+ * @param name loop name to print
+ * @return int
+ */
+int close_board_tracker(board_tracker &bt, const char *name) {
+  {
+    std::lock_guard<std::mutex> guard(bt.lock);
+    bt.stopping = true;
+    bt.ready.notify_all();
+  }
+  if(bt.thread.joinable()) {
+    bt.thread.join();
+  }
+
+  printf("%s: detected on %ld of %ld frames drawn, %ld replaced by a newer frame first\n", name, bt.detected.load(),
+         bt.submitted.load(), bt.replaced.load());
+
+  return(0);
+}
@@ -0,0 +1,75 @@
+/**
+ * @file cal_profile.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Functions for using calibration profiles at any resolution
+ * @date 2022-04-02
+ */
+
+#include "../include/cal_profile.h"
+
+/**
+ * @brief Function to rescale a calibration profile to a different resolution
+ *
+ * fx, cx are scaled by the width ratio and fy, cy by the height ratio. The
+ * distortion coefficients act on normalized coordinates so they are copied as is.
+ *
+ * @param src profile to rescale
+ * @param size resolution the profile will be used at
+ * @param dst profile to write to, valid at size
+ * @return int return non-zero value on failure
+ */
+int scale_cal_profile(const cal_profile &src, cv::Size size, cal_profile &dst) {
+  if(src.cam_mat.empty() || size.width <= 0 || size.height <= 0) {
+    return -1;
+  }
+
+  dst.camera_id = src.camera_id;
+  dst.cam_mat = src.cam_mat.clone();
+  dst.distcoeff = src.distcoeff.clone();
+  dst.image_size = size;
+
+  // unknown calibration size, nothing to scale against
+  if(src.image_size.width <= 0 || src.image_size.height <= 0 || src.image_size == size) {
+    return 0;
+  }
+
+  double sx = (double) size.width / src.image_size.width;
+  double sy = (double) size.height / src.image_size.height;
+
+  // pixel centers sit at +0.5, so scale about the image corner rather than pixel 0
+  dst.cam_mat.at<double>(0, 0) = src.cam_mat.at<double>(0, 0) * sx; // fx
+  dst.cam_mat.at<double>(0, 1) = src.cam_mat.at<double>(0, 1) * sx; // skew
+  dst.cam_mat.at<double>(0, 2) = (src.cam_mat.at<double>(0, 2) + 0.5) * sx - 0.5; // cx
+  dst.cam_mat.at<double>(1, 1) = src.cam_mat.at<double>(1, 1) * sy; // fy
+  dst.cam_mat.at<double>(1, 2) = (src.cam_mat.at<double>(1, 2) + 0.5) * sy - 0.5; // cy
+
+  return 0;
+}
+
+/**
+ * @brief Function to print a calibration profile
+ *
+ * @param profile profile to print
+ * @return int
+ */
+int print_cal_profile(const cal_profile &profile) {
+  printf("Camera: %s (%d x %d)\n", profile.camera_id.empty() ? "unknown" : profile.camera_id.c_str(),
+         profile.image_size.width, profile.image_size.height);
+
+  printf("Camera Matrix\n");
+  for(int i = 0; i < profile.cam_mat.rows; i++) {
+    for(int j = 0; j < profile.cam_mat.cols; j++) {
+      printf("%.4f ", profile.cam_mat.at<double>(i, j));
+    }
+    printf("\n");
+  }
+  printf("\n");
+
+  printf("Distortion Coefficients\n");
+  for(int i = 0; i < profile.distcoeff.rows; i++) {
+    printf("%.4f ", profile.distcoeff.at<double>(i, 0));
+  }
+  printf("\n\n");
+
+  return 0;
+}
@@ -42,7 +42,7 @@ int getstring( FILE *fp, char os[] ) {
     os[p] = ch;
     p++;
   }
-   printf("\n"); // uncomment for debugging
+  //printf("\n"); // uncomment for debugging
   os[p] = '\0';
 
   return(eol); // return true if eol
@@ -524,7 +524,7 @@ int append_rot_trans_data_csv( char *filename, std::vector<std::vector<float> >
     for(int j = 0; j < rot_or_trans[i].size(); j++) {
       char tmp[256];
       if(j == rot_or_trans[i].size() - 1) {
-        sprintf(tmp, ".4f", rot_or_trans[i][j]);
+        sprintf(tmp, "%.4f", rot_or_trans[i][j]);
       } else {
         sprintf(tmp, "%.4f,", rot_or_trans[i][j]);
       }
@@ -603,6 +603,208 @@ int read_calibration_data_csv( char *filename, cv::Mat &cam_mat, cv::Mat &distco
   return(0);
 }
 
+/**
+ * @brief Function to write a calibration profile to a csv
+ *
+ * Writes the same columns as append_calibration_data_csv followed by the
+ * calibration image width, height and the camera id, so older readers still
+ * find the camera matrix and distortion coefficients where they expect them.
+ *
+ * @param filename name of csv file
+ * @param profile calibration profile to write
+ * @param reset_file indicator whether to reset the file or not
+ * @return int return non-zero value on failure
+ */
+int append_cal_profile_csv( char *filename, cal_profile &profile, int reset_file ) {
+  char mode[8];
+  FILE *fp;
+
+  strcpy(mode, "a");
+
+  if( reset_file ) {
+    strcpy( mode, "w" );
+  }
+
+  fp = fopen( filename, mode );
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename );
+    return(-1);
+  }
+
+  fprintf(fp, "cm00 cm01 cm02 cm10 cm11 cm12 cm20 cm21 cm22 dist1 dist2 dist3 dist4 dist5 width height camera_id\n");
+
+  // write the camera matrix to the file
+  for(int i = 0; i < profile.cam_mat.rows; i++) {
+    for(int j = 0; j < profile.cam_mat.cols; j++) {
+      fprintf(fp, "%.6f,", profile.cam_mat.at<double>(i, j));
+    }
+  }
+
+  // write the distcoeff to the file
+  for(int i = 0; i < profile.distcoeff.rows; i++) {
+    fprintf(fp, "%.6f,", profile.distcoeff.at<double>(i, 0));
+  }
+
+  // resolution and camera the intrinsics belong to
+  fprintf(fp, "%d,%d,%s\n", profile.image_size.width, profile.image_size.height, profile.camera_id.c_str());
+
+  fclose(fp);
+
+  return(0);
+}
+
+/**
+ * @brief Function to read a calibration profile from a csv file.
+ *
+ * Files written by append_calibration_data_csv are accepted too; their
+ * image_size is left at 0x0.
+ *
+ * @param filename name of csv file
+ * @param camera_id id of the profile to load, empty string for the first one in the file
+ * @param profile profile to write to
+ * @param echo_file if true, print the data.
+ * @return int return non-zero value on failure
+ */
+int read_cal_profile_csv( char *filename, const std::string &camera_id, cal_profile &profile, int echo_file ) {
+  FILE *fp;
+  char line[1024];
+
+  fp = fopen(filename, "r");
+  if( !fp ) {
+    printf("Unable to open calibration file %s\n", filename);
+    return(-1);
+  }
+
+  int found = 0;
+  while( !found && fgets(line, sizeof(line), fp) ) {
+    // every data row is preceded by a header row of column names
+    if( line[0] == 'c' ) {
+      continue;
+    }
+
+    double vals[14];
+    int ncells = 0;
+    char *tok = strtok(line, ",\r\n");
+    while( tok && ncells < 14 ) {
+      vals[ncells] = atof(tok);
+      ncells++;
+      tok = strtok(NULL, ",\r\n");
+    }
+    if( ncells < 14 ) {
+      continue;
+    }
+
+    // optional columns, missing in calibration files from before profiles
+    int width = tok ? atoi(tok) : 0;
+    tok = tok ? strtok(NULL, ",\r\n") : NULL;
+    int height = tok ? atoi(tok) : 0;
+    tok = tok ? strtok(NULL, ",\r\n") : NULL;
+    std::string id = tok ? tok : "";
+
+    if( !camera_id.empty() && camera_id != id ) {
+      continue;
+    }
+
+    profile.camera_id = id;
+    profile.image_size = cv::Size(width, height);
+    profile.cam_mat.create(3, 3, CV_64FC1);
+    profile.distcoeff.create(5, 1, CV_64FC1);
+    for(int i = 0; i < 9; i++) {
+      profile.cam_mat.at<double>(i / 3, i % 3) = vals[i];
+    }
+    for(int i = 0; i < 5; i++) {
+      profile.distcoeff.at<double>(i, 0) = vals[9 + i];
+    }
+    found = 1;
+  }
+  fclose(fp);
+
+  if( !found ) {
+    printf("No calibration for camera '%s' in %s\n", camera_id.c_str(), filename);
+    return(-1);
+  }
+
+  if( echo_file ) {
+    print_cal_profile(profile);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to write the board corners found in one image to a csv
+ *
+ * Each row is the image name followed by x,y of every corner in get_point_set
+ * order. An image without a board is written as just its name.
+ *
+ * @param filename name of csv file
+ * @param image_name name of the image the corners belong to
+ * @param corner_set corners to write, may be empty
+ * @param reset_file indicator whether to reset the file or not
+ * @return int return non-zero value on failure
+ */
+int append_corner_data_csv( char *filename, const char *image_name, const std::vector<cv::Point2f> &corner_set, int reset_file ) {
+  FILE *fp;
+
+  fp = fopen( filename, reset_file ? "w" : "a" );
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename );
+    return(-1);
+  }
+
+  fprintf(fp, "%s", image_name);
+  for(int i = 0; i < corner_set.size(); i++) {
+    fprintf(fp, ",%.4f,%.4f", corner_set[i].x, corner_set[i].y);
+  }
+  fprintf(fp, "\n");
+
+  fclose(fp);
+
+  return(0);
+}
+
+/**
+ * @brief Function to read the board corners of a sequence of images from a csv
+ *
+ * @param filename name of csv file
+ * @param names image name of each row
+ * @param corners corners of each row, empty where the image has no board
+ * @return int return non-zero value on failure
+ */
+int read_corner_data_csv( char *filename, std::vector<std::string> &names, std::vector<std::vector<cv::Point2f> > &corners ) {
+  FILE *fp;
+  char name[256];
+
+  fp = fopen(filename, "r");
+  if( !fp ) {
+    printf("Unable to open corner file %s\n", filename);
+    return(-1);
+  }
+
+  for(;;) {
+    int ch = fgetc(fp);
+    if( ch == EOF ) {
+      break;
+    }
+    ungetc(ch, fp);
+
+    std::vector<cv::Point2f> corner_set;
+    int eol = getstring( fp, name );
+    while( !eol ) {
+      float x, y;
+      getfloat( fp, &x );
+      eol = getfloat( fp, &y );
+      corner_set.push_back(cv::Point2f(x, y));
+    }
+
+    names.push_back(name);
+    corners.push_back(corner_set);
+  }
+  fclose(fp);
+
+  return(0);
+}
+
 /**
  * @brief Function to read the virtual object data from a csv file. 
  * 
@@ -626,6 +828,7 @@ int read_vo_data_obj( char *filename, std::map<int, std::vector<float> > &points
 
   printf("Reading %s\n", filename);
   int pointcounter = 1; 
+  int skipped = 0; // faces dropped for indices outside the vertices
   for(;;) {
     std::vector<float> fvec;
     std::vector<int> dvec; 
@@ -670,10 +873,28 @@ int read_vo_data_obj( char *filename, std::map<int, std::vector<float> > &points
       points[pointcounter] = fvec; 
       pointcounter++; 
     } else {
-      connections.push_back( dvec ); 
+      // negative indices count back from the last vertex read so far, and a face
+      // pointing at a vertex that does not exist is dropped so nothing reads past the points
+      bool valid = true; 
+      for(int i = 0; i < dvec.size(); i++) {
+        if(dvec[i] < 0) {
+          dvec[i] += pointcounter; 
+        }
+        if(dvec[i] < 1 || dvec[i] >= pointcounter) {
+          valid = false; 
+        }
+      }
+      if(valid) {
+        connections.push_back( dvec ); 
+      } else {
+        skipped++; 
+      }
     }
   }
   fclose(fp);
+  if(skipped > 0) {
+    printf("Skipped %d faces with vertex indices outside 1 to %d\n", skipped, pointcounter - 1);
+  }
   printf("Finished reading OBJ file\n");
   return(0);
 }
@@ -0,0 +1,224 @@
+/**
+ * @file detbench_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for comparing the chessboard detector backends
+ * @date 2022-04-09
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cmath>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/detector.h"
+#include "../include/frame_source.h"
+
+// results of one backend over the whole dataset
+struct backend_result {
+  int backend;
+  double secs; // time spent detecting
+  int runs; // frames x repeats
+  int detected; // full boards found
+  long corners; // corners found, counts partial ChArUco boards
+  int scored; // detections that had ground truth
+  long err_count; // scored corners
+  double err_sum; // pixel error of every scored corner
+  double err_sq_sum;
+  double err_max;
+  refine_stats refine; // sub-pixel refinement work, classic only
+};
+
+/**
+ * @brief Function to get the error of detected corners against ground truth
+ *
+ * A full board can come back in reverse order when it is seen upside down,
+ * so full boards are scored in whichever order fits best.
+ *
+ * @param corner_set detected corners
+ * @param corner_ids grid index of each detected corner
+ * @param truth ground truth corners of the whole board
+ * @param errs vector of per corner errors to write to
+ * @return int
+ */
+static int corner_errors(const std::vector<cv::Point2f> &corner_set, const std::vector<int> &corner_ids, const std::vector<cv::Point2f> &truth, std::vector<double> &errs) {
+  int n = truth.size();
+  std::vector<double> fwd, rev;
+  for(int i = 0; i < corner_set.size(); i++) {
+    int id = corner_ids[i];
+    if(id < 0 || id >= n) {
+      continue;
+    }
+    fwd.push_back(cv::norm(corner_set[i] - truth[id]));
+    rev.push_back(cv::norm(corner_set[i] - truth[n - 1 - id]));
+  }
+
+  double fwd_sum = 0, rev_sum = 0;
+  for(int i = 0; i < fwd.size(); i++) {
+    fwd_sum += fwd[i];
+    rev_sum += rev[i];
+  }
+  bool full = corner_set.size() == n;
+  errs = (full && rev_sum < fwd_sum) ? rev : fwd;
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  char truth_fn[256] = "";
+  char csv_fn[256] = "";
+  cv::Size patternsize(9, 6);
+  int repeat = 1;
+  std::vector<int> backends;
+  std::string dataset = "";
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--truth") == 0 && i + 1 < argc) {
+      strncpy(truth_fn, argv[++i], sizeof(truth_fn) - 1);
+    } else if(strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+      strncpy(csv_fn, argv[++i], sizeof(csv_fn) - 1);
+    } else if(strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%dx%d", &patternsize.width, &patternsize.height);
+    } else if(strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+      repeat = std::max(1, atoi(argv[++i]));
+    } else if(strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+      int b = parse_detector_backend(argv[++i]);
+      if(b < 0) {
+        printf("Unknown detector %s\n", argv[i]);
+        return(-1);
+      }
+      backends.push_back(b);
+    } else {
+      dataset = argv[i];
+    }
+  }
+
+  if(dataset.empty()) {
+    printf("usage: %s [--truth corners.csv] [--backend classic|sb|charuco]... [--board WxH] [--repeat n] [--csv results.csv] dataset\n", argv[0]);
+    printf("  dataset is a video file or a directory of images, truth rows are matched to frames in order\n");
+    return(-1);
+  }
+
+  if(backends.empty()) {
+    for(int b = 0; b < DETECT_NUM_BACKENDS; b++) {
+      if(detector_available(b)) {
+        backends.push_back(b);
+      }
+    }
+  }
+
+  // load everything up front so decoding is not part of the timing
+  frame_source src;
+  if(open_frame_source(dataset, src) != 0) {
+    return(-1);
+  }
+  std::vector<cv::Mat> frames;
+  cv::Mat frame;
+  while(read_frame_source(src, frame) == 0) {
+    frames.push_back(frame.clone());
+  }
+  close_frame_source(src);
+  if(frames.empty()) {
+    printf("No frames in %s\n", dataset.c_str());
+    return(-1);
+  }
+
+  std::vector<std::string> truth_names;
+  std::vector<std::vector<cv::Point2f> > truth;
+  if(strlen(truth_fn) > 0) {
+    if(read_corner_data_csv(truth_fn, truth_names, truth) != 0) {
+      return(-1);
+    }
+    if(truth.size() != frames.size()) {
+      printf("%d ground truth rows for %d frames, scoring the first %d\n", (int) truth.size(), (int) frames.size(),
+             (int) std::min(truth.size(), frames.size()));
+    }
+  }
+
+  printf("%d frames, board %dx%d, %d repeats\n\n", (int) frames.size(), patternsize.width, patternsize.height, repeat);
+
+  std::vector<backend_result> results;
+  for(int k = 0; k < backends.size(); k++) {
+    backend_result res = backend_result();
+    res.backend = backends[k];
+    if(!detector_available(res.backend)) {
+      printf("%s: not available in this build\n", detector_backend_name(res.backend));
+      continue;
+    }
+
+    for(int r = 0; r < repeat; r++) {
+      for(int f = 0; f < frames.size(); f++) {
+        std::vector<cv::Point2f> corner_set;
+        std::vector<int> corner_ids;
+        bool found = false;
+
+        int64 t0 = cv::getTickCount();
+        detect_board(frames[f], res.backend, patternsize, corner_set, corner_ids, found, &res.refine);
+        res.secs += (cv::getTickCount() - t0) / cv::getTickFrequency();
+        res.runs++;
+        res.detected += found ? 1 : 0;
+        res.corners += corner_set.size();
+
+        // accuracy does not change between repeats
+        if(r > 0 || f >= truth.size() || truth[f].size() != patternsize.area() || corner_set.empty()) {
+          continue;
+        }
+        std::vector<double> errs;
+        corner_errors(corner_set, corner_ids, truth[f], errs);
+        res.scored++;
+        res.err_count += errs.size();
+        for(int i = 0; i < errs.size(); i++) {
+          res.err_sum += errs[i];
+          res.err_sq_sum += errs[i] * errs[i];
+          res.err_max = std::max(res.err_max, errs[i]);
+        }
+      }
+    }
+    results.push_back(res);
+  }
+
+  printf("%-8s %9s %9s %9s %9s %9s %9s\n", "backend", "fps", "detected", "corners", "err mean", "err rms", "err max");
+  for(int k = 0; k < results.size(); k++) {
+    backend_result &res = results[k];
+    long nerr = std::max(1L, res.err_count);
+    double fps = res.secs > 0 ? res.runs / res.secs : 0;
+    double rate = 100.0 * res.detected / res.runs;
+    double corners = (double) res.corners / res.runs;
+    double mean = res.err_sum / nerr;
+    double rms = sqrt(res.err_sq_sum / nerr);
+    printf("%-8s %9.1f %8.1f%% %9.1f %9.3f %9.3f %9.3f\n", detector_backend_name(res.backend), fps, rate, corners, mean, rms, res.err_max);
+  }
+  for(int k = 0; k < results.size(); k++) {
+    refine_stats &rs = results[k].refine;
+    if(rs.corners > 0) {
+      printf("%s sub-pixel refinement: %.2f iterations per corner, window %.1f pixels\n", detector_backend_name(results[k].backend),
+             (double) rs.iterations / rs.corners, 2.0 * rs.window_sum / rs.calls + 1);
+    }
+  }
+  if(truth.empty()) {
+    printf("\nno --truth given, corner errors not measured\n");
+  }
+
+  if(strlen(csv_fn) > 0) {
+    FILE *fp = fopen(csv_fn, "w");
+    if(!fp) {
+      printf("Unable to open output file %s\n", csv_fn);
+      return(-1);
+    }
+    fprintf(fp, "backend,fps,detection_rate,corners_per_frame,err_mean,err_rms,err_max\n");
+    for(int k = 0; k < results.size(); k++) {
+      backend_result &res = results[k];
+      long nerr = std::max(1L, res.err_count);
+      fprintf(fp, "%s,%.2f,%.4f,%.2f,%.4f,%.4f,%.4f\n", detector_backend_name(res.backend),
+              res.secs > 0 ? res.runs / res.secs : 0, (double) res.detected / res.runs, (double) res.corners / res.runs,
+              res.err_sum / nerr, sqrt(res.err_sq_sum / nerr), res.err_max);
+    }
+    fclose(fp);
+  }
+
+  return(0);
+}
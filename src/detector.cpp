@@ -0,0 +1,473 @@
+/**
+ * @file detector.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Interchangeable chessboard detectors
+ * @date 2022-04-09
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cfloat>
+#include <cmath>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include "../include/detector.h"
+#include "../include/frame_workspace.h"
+#include "../include/profiler.h"
+#include <opencv2/core/hal/intrin.hpp>
+
+// 4.9 dropped the operator overloads on universal intrinsics in favour of functions
+#if CV_SIMD128
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+#define SP_ADD(a, b) cv::v_add(a, b)
+#define SP_SUB(a, b) cv::v_sub(a, b)
+#define SP_MUL(a, b) cv::v_mul(a, b)
+#else
+#define SP_ADD(a, b) ((a) + (b))
+#define SP_SUB(a, b) ((a) - (b))
+#define SP_MUL(a, b) ((a) * (b))
+#endif
+#endif
+
+// corners refined together, one per simd lane
+#define REFINE_BATCH 4
+
+// ChArUco comes with objdetect from 4.7 on, before that it needs opencv_contrib
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7)
+#define HAVE_CHARUCO_DETECTOR 1
+#elif defined(HAVE_OPENCV_ARUCO)
+#include <opencv2/aruco/charuco.hpp>
+#define HAVE_CHARUCO_CONTRIB 1
+#endif
+
+static const char *backend_names[DETECT_NUM_BACKENDS] = { "classic", "sb", "charuco" };
+
+static std::atomic<int> refine_max_iters(30); // per corner, see set_refine_iterations
+
+/**
+ * @brief Function to get a detector backend from its name
+ *
+ * @param name "classic", "sb" or "charuco"
+ * @return int detector_backend, -1 if the name is unknown
+ */
+int parse_detector_backend(const char *name) {
+  for(int i = 0; i < DETECT_NUM_BACKENDS; i++) {
+    if(strcmp(name, backend_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Function to get the name of a detector backend
+ *
+ * @param backend detector_backend
+ * @return const char*
+ */
+const char *detector_backend_name(int backend) {
+  if(backend < 0 || backend >= DETECT_NUM_BACKENDS) {
+    return "unknown";
+  }
+  return backend_names[backend];
+}
+
+/**
+ * @brief Function to check whether a backend was compiled in
+ *
+ * @param backend detector_backend
+ * @return true if detect_board can use it
+ */
+bool detector_available(int backend) {
+  if(backend == DETECT_CHARUCO) {
+#if defined(HAVE_CHARUCO_DETECTOR) || defined(HAVE_CHARUCO_CONTRIB)
+    return true;
+#else
+    return false;
+#endif
+  }
+  return backend >= 0 && backend < DETECT_NUM_BACKENDS;
+}
+
+#if defined(HAVE_CHARUCO_DETECTOR) || defined(HAVE_CHARUCO_CONTRIB)
+/**
+ * @brief Function to find the ChArUco corners in a frame
+ *
+ * The board has patsize + 1 squares each way, 1 unit squares like
+ * get_point_set and markers from DICT_4X4_50. Boards are built once per size.
+ *
+ * @param gray grayscale frame
+ * @param patsize inner corners of the board
+ * @param corner_set vector of corners to write to
+ * @param corner_ids vector of corner ids to write to
+ * @return int
+ */
+static int detect_charuco(const cv::Mat &gray, cv::Size patsize, std::vector<cv::Point2f> &corner_set, std::vector<int> &corner_ids) {
+  static std::mutex cache_lock;
+  cv::Size squares(patsize.width + 1, patsize.height + 1);
+  std::pair<int, int> key(squares.width, squares.height);
+
+#ifdef HAVE_CHARUCO_DETECTOR
+  static std::map<std::pair<int, int>, cv::Ptr<cv::aruco::CharucoDetector> > detectors;
+  cv::Ptr<cv::aruco::CharucoDetector> detector;
+  {
+    std::lock_guard<std::mutex> guard(cache_lock);
+    cv::Ptr<cv::aruco::CharucoDetector> &cached = detectors[key];
+    if(!cached) {
+      cv::aruco::Dictionary dict = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+      cv::aruco::CharucoBoard board(squares, 1.0f, 0.7f, dict);
+      cached = cv::makePtr<cv::aruco::CharucoDetector>(board);
+    }
+    detector = cached;
+  }
+  detector->detectBoard(gray, corner_set, corner_ids);
+#else
+  static std::map<std::pair<int, int>, cv::Ptr<cv::aruco::CharucoBoard> > boards;
+  cv::Ptr<cv::aruco::Dictionary> dict = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+  cv::Ptr<cv::aruco::CharucoBoard> board;
+  {
+    std::lock_guard<std::mutex> guard(cache_lock);
+    cv::Ptr<cv::aruco::CharucoBoard> &cached = boards[key];
+    if(!cached) {
+      cached = cv::aruco::CharucoBoard::create(squares.width, squares.height, 1.0f, 0.7f, dict);
+    }
+    board = cached;
+  }
+
+  std::vector<int> marker_ids;
+  std::vector<std::vector<cv::Point2f> > marker_corners;
+  cv::aruco::detectMarkers(gray, dict, marker_corners, marker_ids);
+  if(!marker_ids.empty()) {
+    cv::aruco::interpolateCornersCharuco(marker_corners, marker_ids, gray, board, corner_set, corner_ids);
+  }
+#endif
+
+  return 0;
+}
+#endif
+
+/**
+ * @brief Function to find the inner corners of a board
+ *
+ * corner_ids[i] is the index of corner_set[i] in the full patsize grid, in the
+ * same order as get_point_set. Classic and SB only report full boards, ChArUco
+ * reports whichever corners it can see.
+ *
+ * @param src source image to find the corners in, BGR or already gray
+ * @param backend detector_backend to use
+ * @param patsize inner corners of the board (a ChArUco board has one more square each way)
+ * @param corner_set vector of the point location of each corner found
+ * @param corner_ids vector of the grid index of each corner found
+ * @param pattern_found bool passed by reference, true if every corner was found
+ * @param stats if not NULL, sub-pixel refinement work is added to it
+ * @return int return non-zero value on failure.
+ */
+int detect_board(const cv::Mat &src, int backend, cv::Size patsize, std::vector<cv::Point2f> &corner_set, std::vector<int> &corner_ids, bool &pattern_found, refine_stats *stats) {
+  corner_set.clear();
+  corner_ids.clear();
+  pattern_found = false;
+
+  // every detector works on intensity, convert once here rather than inside each of them
+  cv::Mat gray;
+  if(src.channels() == 3) {
+    PROF_SCOPE(STAGE_GRAY);
+    ALLOC_EXEMPT(EXEMPT_IMGPROC);
+    cv::cvtColor(src, gray, cv::COLOR_BGR2GRAY);
+  } else {
+    gray = src;
+  }
+
+  if(backend == DETECT_CLASSIC) {
+    {
+      PROF_SCOPE(STAGE_FIND);
+      ALLOC_EXEMPT(EXEMPT_FIND);
+      pattern_found = cv::findChessboardCorners(gray, patsize, corner_set, cv::CALIB_CB_FAST_CHECK);
+    }
+    if(pattern_found) {
+      PROF_SCOPE(STAGE_SUBPIX);
+      refine_corners(gray, corner_set, patsize, stats);
+    }
+  } else if(backend == DETECT_SB) {
+    // the SB detector fits the corners itself, there is nothing for cornerSubPix to add
+    PROF_SCOPE(STAGE_FIND);
+    ALLOC_EXEMPT(EXEMPT_FIND);
+    pattern_found = cv::findChessboardCornersSB(gray, patsize, corner_set, 0);
+  } else if(backend == DETECT_CHARUCO) {
+#if defined(HAVE_CHARUCO_DETECTOR) || defined(HAVE_CHARUCO_CONTRIB)
+    PROF_SCOPE(STAGE_FIND);
+    ALLOC_EXEMPT(EXEMPT_FIND);
+    detect_charuco(gray, patsize, corner_set, corner_ids);
+    pattern_found = corner_set.size() == patsize.area();
+    return 0;
+#else
+    printf("ChArUco detection needs OpenCV 4.7 or the aruco contrib module\n");
+    return -1;
+#endif
+  } else {
+    return -1;
+  }
+
+  if(!pattern_found) {
+    corner_set.clear();
+    return 0;
+  }
+  for(int i = 0; i < corner_set.size(); i++) {
+    corner_ids.push_back(i);
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Function to set how many iterations refine_corners runs per corner at most
+ *
+ * Applies to every thread from the next call on, the compute governor lowers it
+ * to spend less time refining.
+ *
+ * @param iters iterations per corner, 30 by default
+ * @return int return non-zero value if iters is not positive
+ */
+int set_refine_iterations(int iters) {
+  if(iters <= 0) {
+    return -1;
+  }
+  refine_max_iters.store(iters, std::memory_order_relaxed);
+  return 0;
+}
+
+/**
+ * @brief Function to get the world points of some corners of a board
+ *
+ * @param patsize size of the pattern
+ * @param corner_ids grid index of each corner
+ * @param point_set point set to write to
+ * @return int
+ */
+int get_point_subset(cv::Size patsize, const std::vector<int> &corner_ids, std::vector<cv::Vec3f> &point_set) {
+  for(int k = 0; k < corner_ids.size(); k++) {
+    int i = corner_ids[k] / patsize.width;
+    int j = corner_ids[k] % patsize.width;
+    point_set.push_back(cv::Vec3f(j, -i, 0));
+  }
+
+  return 0;
+}
+
+/**
+ * @brief Function to accumulate the gradient system of a batch of corners
+ *
+ * patch holds REFINE_BATCH interleaved (win + 2) x (win + 2) patches, lane l of
+ * pixel k at patch[k * REFINE_BATCH + l]. For every lane this sums, over the
+ * window, the terms of the 2x2 system cornerSubPix solves: a, b, c are
+ * G = [a b; b c] and bb1, bb2 the right hand side.
+ *
+ * @param patch interleaved patches
+ * @param half window half-size
+ * @param mask (2 * half + 1)^2 gaussian weights
+ * @param sums 5 x REFINE_BATCH floats to write a, b, c, bb1, bb2 to
+ */
+static void accumulate_batch(const float *patch, int half, const float *mask, float *sums) {
+  int win = 2 * half + 1;
+  int stride = (win + 2) * REFINE_BATCH;
+
+#if CV_SIMD128
+  cv::v_float32x4 a = cv::v_setzero_f32(), b = a, c = a, bb1 = a, bb2 = a;
+  for(int i = 0; i < win; i++) {
+    const float *up = patch + i * stride;
+    const float *mid = up + stride;
+    const float *down = mid + stride;
+    cv::v_float32x4 py = cv::v_setall_f32((float) (i - half));
+    for(int j = 0; j < win; j++) {
+      cv::v_float32x4 tgx = SP_SUB(cv::v_load(mid + (j + 2) * REFINE_BATCH), cv::v_load(mid + j * REFINE_BATCH));
+      cv::v_float32x4 tgy = SP_SUB(cv::v_load(down + (j + 1) * REFINE_BATCH), cv::v_load(up + (j + 1) * REFINE_BATCH));
+      cv::v_float32x4 m = cv::v_setall_f32(mask[i * win + j]);
+      cv::v_float32x4 px = cv::v_setall_f32((float) (j - half));
+      cv::v_float32x4 gxx = SP_MUL(SP_MUL(tgx, tgx), m);
+      cv::v_float32x4 gxy = SP_MUL(SP_MUL(tgx, tgy), m);
+      cv::v_float32x4 gyy = SP_MUL(SP_MUL(tgy, tgy), m);
+      a = SP_ADD(a, gxx);
+      b = SP_ADD(b, gxy);
+      c = SP_ADD(c, gyy);
+      bb1 = cv::v_fma(gxx, px, cv::v_fma(gxy, py, bb1));
+      bb2 = cv::v_fma(gxy, px, cv::v_fma(gyy, py, bb2));
+    }
+  }
+  cv::v_store(sums, a);
+  cv::v_store(sums + REFINE_BATCH, b);
+  cv::v_store(sums + 2 * REFINE_BATCH, c);
+  cv::v_store(sums + 3 * REFINE_BATCH, bb1);
+  cv::v_store(sums + 4 * REFINE_BATCH, bb2);
+#else
+  for(int k = 0; k < 5 * REFINE_BATCH; k++) {
+    sums[k] = 0;
+  }
+  for(int i = 0; i < win; i++) {
+    const float *up = patch + i * stride;
+    const float *mid = up + stride;
+    const float *down = mid + stride;
+    float py = i - half;
+    for(int j = 0; j < win; j++) {
+      float m = mask[i * win + j];
+      float px = j - half;
+      for(int l = 0; l < REFINE_BATCH; l++) {
+        float tgx = mid[(j + 2) * REFINE_BATCH + l] - mid[j * REFINE_BATCH + l];
+        float tgy = down[(j + 1) * REFINE_BATCH + l] - up[(j + 1) * REFINE_BATCH + l];
+        float gxx = tgx * tgx * m;
+        float gxy = tgx * tgy * m;
+        float gyy = tgy * tgy * m;
+        sums[l] += gxx;
+        sums[REFINE_BATCH + l] += gxy;
+        sums[2 * REFINE_BATCH + l] += gyy;
+        sums[3 * REFINE_BATCH + l] += gxx * px + gxy * py;
+        sums[4 * REFINE_BATCH + l] += gxy * px + gyy * py;
+      }
+    }
+  }
+#endif
+}
+
+/**
+ * @brief Function to refine the corners of a full board to sub-pixel accuracy
+ *
+ * Does what cornerSubPix does, but the search window is sized from the
+ * spacing between neighbouring corners (at most 11x11, the old fixed size) so
+ * it never reaches the next corner, each corner stops on its own once it moves
+ * less than 0.1 pixel, and corners are refined in parallel with the window sums
+ * vectorized.
+ *
+ * @param gray grayscale image the corners were found in
+ * @param corner_set corners in get_point_set order, refined in place
+ * @param patsize size of the pattern
+ * @param stats if not NULL, work done is added to it
+ * @return int return non-zero value on failure.
+ */
+int refine_corners(const cv::Mat &gray, std::vector<cv::Point2f> &corner_set, cv::Size patsize, refine_stats *stats) {
+  const int max_iters = refine_max_iters.load(std::memory_order_relaxed);
+  const float eps = 0.1f;
+  int n = corner_set.size();
+  if(n == 0 || gray.channels() != 1) {
+    return -1;
+  }
+
+  // closest pair of grid neighbours, the window has to stay short of it
+  int half = 5;
+  if(n == patsize.area()) {
+    float spacing = FLT_MAX;
+    for(int i = 0; i < patsize.height; i++) {
+      for(int j = 0; j < patsize.width; j++) {
+        int idx = i * patsize.width + j;
+        if(j + 1 < patsize.width) {
+          spacing = std::min(spacing, (float) cv::norm(corner_set[idx + 1] - corner_set[idx]));
+        }
+        if(i + 1 < patsize.height) {
+          spacing = std::min(spacing, (float) cv::norm(corner_set[idx + patsize.width] - corner_set[idx]));
+        }
+      }
+    }
+    half = std::max(2, std::min(5, (int) (0.4f * spacing)));
+  }
+  int win = 2 * half + 1;
+
+  // the window is at most 11x11, so the weights and patches fit on the stack
+  float mask[11 * 11];
+  for(int i = 0; i < win; i++) {
+    for(int j = 0; j < win; j++) {
+      float y = (float) (i - half) / half;
+      float x = (float) (j - half) / half;
+      mask[i * win + j] = exp(-x * x - y * y);
+    }
+  }
+
+  std::atomic<long> iterations(0);
+  int nbatches = (n + REFINE_BATCH - 1) / REFINE_BATCH;
+  ALLOC_EXEMPT(EXEMPT_PARALLEL);
+  cv::parallel_for_(cv::Range(0, nbatches), [&](const cv::Range &range) {
+    ALLOC_EXEMPT(EXEMPT_NONE);
+    int psize = win + 2;
+    float patch[13 * 13 * REFINE_BATCH] = {0};
+    float lane_buf[13 * 13];
+    cv::Mat lane_patch(psize, psize, CV_32FC1, lane_buf);
+    float sums[5 * REFINE_BATCH];
+    long used = 0;
+
+    for(int bt = range.start; bt < range.end; bt++) {
+      int first = bt * REFINE_BATCH;
+      int count = std::min(REFINE_BATCH, n - first);
+      cv::Point2f start[REFINE_BATCH];
+      cv::Point2f cur[REFINE_BATCH];
+      bool active[REFINE_BATCH];
+      for(int l = 0; l < REFINE_BATCH; l++) {
+        active[l] = l < count;
+        start[l] = cur[l] = active[l] ? corner_set[first + l] : cv::Point2f(0, 0);
+      }
+
+      for(int iter = 0; iter < max_iters; iter++) {
+        int nactive = 0;
+        for(int l = 0; l < REFINE_BATCH; l++) {
+          if(!active[l]) {
+            continue;
+          }
+          nactive++;
+          // converged lanes keep their last patch, their sums are simply ignored
+          {
+            ALLOC_EXEMPT(EXEMPT_IMGPROC);
+            cv::getRectSubPix(gray, cv::Size(psize, psize), cur[l], lane_patch, CV_32F);
+          }
+          const float *src = lane_patch.ptr<float>(0);
+          for(int k = 0; k < psize * psize; k++) {
+            patch[k * REFINE_BATCH + l] = src[k];
+          }
+        }
+        if(nactive == 0) {
+          break;
+        }
+
+        accumulate_batch(patch, half, mask, sums);
+
+        for(int l = 0; l < REFINE_BATCH; l++) {
+          if(!active[l]) {
+            continue;
+          }
+          used++;
+          float a = sums[l], b = sums[REFINE_BATCH + l], c = sums[2 * REFINE_BATCH + l];
+          float bb1 = sums[3 * REFINE_BATCH + l], bb2 = sums[4 * REFINE_BATCH + l];
+          float det = a * c - b * b;
+          if(fabs(det) <= FLT_EPSILON * FLT_EPSILON) {
+            active[l] = false;
+            continue;
+          }
+          float scale = 1.0f / det;
+          cv::Point2f next(cur[l].x + c * scale * bb1 - b * scale * bb2,
+                           cur[l].y - b * scale * bb1 + a * scale * bb2);
+          cv::Point2f move = next - cur[l];
+          cur[l] = next;
+          if(move.x * move.x + move.y * move.y <= eps * eps ||
+             next.x < 0 || next.x >= gray.cols || next.y < 0 || next.y >= gray.rows) {
+            active[l] = false;
+          }
+        }
+      }
+
+      for(int l = 0; l < count; l++) {
+        // a corner that wandered out of its window latched onto something else
+        cv::Point2f d = cur[l] - start[l];
+        if(fabs(d.x) > half || fabs(d.y) > half) {
+          cur[l] = start[l];
+        }
+        corner_set[first + l] = cur[l];
+      }
+    }
+    iterations += used;
+  });
+
+  if(stats) {
+    stats->corners += n;
+    stats->iterations += iterations.load();
+    stats->window_sum += half;
+    stats->calls++;
+  }
+
+  return 0;
+}
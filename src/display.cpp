@@ -0,0 +1,185 @@
+/**
+ * @file display.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Display thread with its own HighGUI event pump and a lock-free key queue
+ * @date 2022-04-18
+ */
+
+#include <cstdio>
+#include <csignal>
+#include "../include/display.h"
+
+#ifdef __APPLE__
+#define DISPLAY_INLINE 1 // Cocoa windows only work from the main thread
+#else
+#define DISPLAY_INLINE 0
+#endif
+
+static volatile sig_atomic_t interrupted = 0;
+
+/**
+ * @brief Function called on Ctrl-C, poll_key turns it into 'q'
+ *
+ * @param sig signal number
+ */
+static void on_interrupt(int sig) {
+  (void) sig;
+  interrupted = 1;
+}
+
+/**
+ * @brief Function to add a key to the queue, run on the display thread only
+ *
+ * @param d display
+ * @param key key code
+ */
+static void push_key(frame_display &d, int key) {
+  unsigned head = d.key_head.load(std::memory_order_relaxed);
+  if(head - d.key_tail.load(std::memory_order_acquire) >= KEY_QUEUE_SIZE) {
+    return; // nobody is reading keys, drop it
+  }
+  d.keys[head & (KEY_QUEUE_SIZE - 1)] = key;
+  d.key_head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Function run on the display thread
+ *
+ * @param d display the thread belongs to
+ */
+static void run_display(frame_display *d) {
+  cv::namedWindow(d->window, 1);
+  cv::Mat showing;
+
+  while(!d->stop) {
+    bool have = false;
+    {
+      std::lock_guard<std::mutex> guard(d->lock);
+      if(d->fresh) {
+        cv::swap(showing, d->pending); // the loop copies the next frame into the old buffer
+        d->fresh = false;
+        have = true;
+      }
+    }
+    if(have) {
+      cv::imshow(d->window, showing);
+      d->shown++;
+    }
+
+    // pumps the window events, and waits a little when there was nothing to show
+    int key = cv::waitKeyEx(have ? 1 : 5);
+    if(key >= 0) {
+      push_key(*d, key);
+    }
+  }
+
+  cv::destroyWindow(d->window);
+}
+
+/**
+ * @brief Function to open the window and start the display thread
+ *
+ * Ctrl-C is turned into a 'q' key so a headless run still shuts down cleanly.
+ *
+ * @param window window name
+ * @param headless true to show nothing
+ * @param d display to start
+ * @return int return non-zero value on failure
+ */
+int open_display(const std::string &window, bool headless, frame_display &d) {
+  d.window = window;
+  d.headless = headless;
+  d.fresh = false;
+  d.stop = false;
+  d.key_head = 0;
+  d.key_tail = 0;
+  d.shown = 0;
+  d.skipped = 0;
+  signal(SIGINT, on_interrupt);
+
+  if(headless) {
+    return(0);
+  }
+  if(DISPLAY_INLINE) {
+    cv::namedWindow(window, 1);
+    return(0);
+  }
+  d.thread = std::thread(run_display, &d);
+
+  return(0);
+}
+
+/**
+ * @brief Function to hand a frame to the display, never waits for it to be shown
+ *
+ * The frame is copied, so the caller can draw into it again right away. If the
+ * display has not shown the last frame yet it is replaced.
+ *
+ * @param d open display
+ * @param frame frame to show
+ * @return int
+ */
+int show_frame(frame_display &d, const cv::Mat &frame) {
+  if(d.headless) {
+    return(0);
+  }
+  if(DISPLAY_INLINE) {
+    cv::imshow(d.window, frame);
+    d.shown++;
+    return(0);
+  }
+
+  std::lock_guard<std::mutex> guard(d.lock);
+  if(d.fresh) {
+    d.skipped++;
+  }
+  frame.copyTo(d.pending); // reuses the buffer the display thread swapped out
+  d.fresh = true;
+
+  return(0);
+}
+
+/**
+ * @brief Function to get the next key pressed in the window
+ *
+ * @param d open display
+ * @return int key code as returned by cv::waitKeyEx, -1 if no key is waiting
+ */
+int poll_key(frame_display &d) {
+  if(interrupted) {
+    return 'q';
+  }
+  if(d.headless) {
+    return(-1);
+  }
+  if(DISPLAY_INLINE) {
+    return cv::waitKeyEx(1);
+  }
+
+  unsigned tail = d.key_tail.load(std::memory_order_relaxed);
+  if(tail == d.key_head.load(std::memory_order_acquire)) {
+    return(-1);
+  }
+  int key = d.keys[tail & (KEY_QUEUE_SIZE - 1)];
+  d.key_tail.store(tail + 1, std::memory_order_release);
+
+  return key;
+}
+
+/**
+ * @brief Function to stop the display thread and close the window
+ *
+ * @param d display to close
+ * @return int
+ */
+int close_display(frame_display &d) {
+  d.stop = true;
+  if(d.thread.joinable()) {
+    d.thread.join();
+  }
+  if(!d.headless && d.skipped > 0) {
+    printf("Display showed %ld frames, %ld were replaced before they could be shown\n", d.shown.load(), d.skipped.load());
+  }
+
+  return(0);
+}
@@ -0,0 +1,404 @@
+/**
+ * @file frame_pipeline.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief The per-frame processing shared by the ar.exe and gif.exe loops and their replays
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/logger.h"
+#include "../include/profiler.h"
+#include "../include/frame_pipeline.h"
+
+#define KERM_FRAMES 19 // kerm/input-0.png to input-18.png
+
+/**
+ * @brief Function to fill in the settings ar.exe starts with
+ *
+ * @param set settings to write to
+ * @return int
+ */
+int init_pipeline_settings(pipeline_settings &set) {
+  set.mode = PIPELINE_AR;
+  set.overlay = OVERLAY_AXES;
+  set.backend = DETECT_CLASSIC;
+  set.det_scale = 1.0;
+  set.gating = true;
+  set.motion_threshold = 6;
+  set.motion_max_reuse = 30;
+  set.filtering = false;
+  set.pose_lead_ms = 0;
+  set.multi_board = false;
+  set.boardsizes.clear();
+  set.max_boards = 8;
+  return 0;
+}
+
+/**
+ * @brief Function to parse a pipeline mode name
+ *
+ * @param name ar or gif
+ * @return int pipeline_mode, -1 if unknown
+ */
+int parse_pipeline_mode(const char *name) {
+  if(strcmp(name, "ar") == 0) {
+    return PIPELINE_AR;
+  }
+  if(strcmp(name, "gif") == 0) {
+    return PIPELINE_GIF;
+  }
+  return -1;
+}
+
+/**
+ * @brief Function to load what a pipeline draws with
+ *
+ * @param mode pipeline_mode, the obj file is only read for PIPELINE_AR and kermit's frames for PIPELINE_GIF
+ * @param patternsize inner corners of the board
+ * @param obj_fn obj file for OVERLAY_OBJ
+ * @param kerm_dir directory with kermit's input-0.png to input-18.png
+ * @param m model to write to
+ * @return int return non-zero value on failure
+ */
+int load_pipeline_model(int mode, cv::Size patternsize, const char *obj_fn, const char *kerm_dir, pipeline_model &m) {
+  m.patternsize = patternsize;
+  m.objpoints.clear();
+  m.connections.clear();
+  m.kerms.clear();
+
+  if(mode == PIPELINE_AR) {
+    // a missing obj file only leaves the obj overlay empty
+    read_vo_data_obj((char *) obj_fn, m.objpoints, m.connections);
+  }
+
+  if(mode == PIPELINE_GIF) {
+    for(int i = 0; i < KERM_FRAMES; i++) {
+      std::string fname = std::string(kerm_dir) + "/input-" + std::to_string(i) + ".png";
+      cv::Mat kerm = cv::imread(fname);
+      if(kerm.empty()) {
+        printf("Unable to read %s\n", fname.c_str());
+        return(-1);
+      }
+      m.kerms.push_back(kerm);
+    }
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to set up a pipeline at the start of a sequence
+ *
+ * @param set settings
+ * @param calib calibration, rescaled to whatever size the frames are
+ * @param model shared model, has to outlive the pipeline
+ * @param p pipeline to set up
+ * @return int return non-zero value on failure
+ */
+int open_frame_pipeline(const pipeline_settings &set, const cal_profile &calib, const pipeline_model *model, frame_pipeline &p) {
+  if(set.det_scale <= 0.0 || set.det_scale > 1.0) {
+    printf("--detect-scale must be in (0, 1]\n");
+    return(-1);
+  }
+  if(set.mode == PIPELINE_GIF && model->kerms.empty()) {
+    printf("gif mode needs kermit's frames\n");
+    return(-1);
+  }
+
+  p.set = set;
+  if(p.set.boardsizes.empty()) {
+    p.set.boardsizes.push_back(model->patternsize);
+  }
+  p.model = model;
+  p.calib = calib;
+  p.frame_calib = cal_profile();
+  p.det_calib = cal_profile();
+  if(init_motion_gate(4, set.motion_threshold, set.motion_max_reuse, p.gate) != 0) {
+    printf("--motion-threshold and --motion-max-reuse must not be negative\n");
+    return(-1);
+  }
+  init_pose_filter(POSE_ROT_ACCEL, POSE_TRANS_ACCEL, POSE_ROT_NOISE, POSE_TRANS_NOISE, p.filter);
+  p.refine = refine_stats();
+  p.kermitcount = 0;
+  p.frames = 0;
+  p.detect_every = 1;
+  p.lod = 0;
+  p.tracker = NULL;
+  p.poses = NULL;
+
+  p.last_valid = false;
+  p.last_found = false;
+  p.last_corners.clear();
+  p.last_ids.clear();
+  p.last_boards.count = 0;
+  p.last_roi = cv::Rect();
+  init_frame_workspace(p.ws);
+
+  return(0);
+}
+
+/**
+ * @brief Function to check that the buffers a pipeline reuses keep their memory
+ *
+ * @param p pipeline, at the end of a frame
+ * @return int return non-zero value if a buffer moved after warm up
+ */
+static int watch_pipeline(frame_pipeline &p) {
+  int moved = watch_frame_workspace(p.ws);
+  if(p.set.det_scale < 1.0) {
+    moved |= watch_buffer(p.ws, "det_frame", p.det_frame.data); // otherwise it is the caller's gray plane
+  }
+  moved |= watch_buffer(p.ws, "draw_rotations", p.draw_rotations.data);
+  moved |= watch_buffer(p.ws, "draw_translations", p.draw_translations.data);
+  moved |= watch_buffer(p.ws, "last_rotations", p.last_rotations.data);
+  moved |= watch_buffer(p.ws, "last_translations", p.last_translations.data);
+  moved |= watch_buffer(p.ws, "last_corners", p.last_corners.data());
+  moved |= watch_buffer(p.ws, "last_ids", p.last_ids.data());
+  moved |= watch_buffer(p.ws, "last_boards", p.last_boards.slots.data());
+  for(int b = 0; b < p.last_boards.slots.size(); b++) {
+    const board_detection &board = p.last_boards.slots[b];
+    moved |= watch_buffer(p.ws, "last_boards.corner_set", board.corner_set.data(), b);
+    moved |= watch_buffer(p.ws, "last_boards.rotations", board.rotations.data, b);
+    moved |= watch_buffer(p.ws, "last_boards.translations", board.translations.data, b);
+  }
+  return moved;
+}
+
+/**
+ * @brief Function to run one frame through the pipeline
+ *
+ * The caller calls begin_frame on the pipeline's workspace at the top of its
+ * loop. Every stage is timed into the profiler, every buffer the pipeline
+ * reuses is watched with watch_buffer, and the OpenCV calls that allocate
+ * inside OpenCV are marked with ALLOC_EXEMPT.
+ *
+ * @param p pipeline
+ * @param gray gray plane of the frame
+ * @param dst BGR frame the overlay is drawn on in place, empty to not draw
+ * @param captured capture time of the frame, ns on the prof_now clock
+ * @param r result to write to
+ * @return int return non-zero value on failure
+ */
+int run_frame_pipeline(frame_pipeline &p, const cv::Mat &gray, cv::Mat &dst, int64_t captured, pipeline_result &r) {
+  if(gray.empty()) {
+    return(-1);
+  }
+  long frame_id = p.frames++;
+  const pipeline_model &m = *p.model;
+
+  // everything below lives in the workspace, so a frame does not allocate
+  std::vector<cv::Point2f> &corner_set = p.ws.corner_set;
+  std::vector<int> &corner_ids = p.ws.corner_ids;
+  std::vector<cv::Vec3f> &point_set = p.ws.point_set;
+  cv::Mat &rotations = p.ws.rotations;
+  cv::Mat &translations = p.ws.translations;
+
+  cv::Size frame_size = gray.size();
+  if(frame_size != p.frame_calib.image_size) {
+    if(p.calib.image_size.area() == 0) {
+      p.calib.image_size = frame_size; // old calibration file, assume it matches the camera
+    }
+    scale_cal_profile(p.calib, frame_size, p.frame_calib);
+  }
+  // the governor can change the detection scale too
+  cv::Size det_size(cvRound(frame_size.width * p.set.det_scale), cvRound(frame_size.height * p.set.det_scale));
+  if(det_size != p.det_calib.image_size) {
+    scale_cal_profile(p.calib, det_size, p.det_calib);
+  }
+
+  // every detector shares the one gray plane
+  if(p.set.det_scale < 1.0) {
+    ALLOC_EXEMPT(EXEMPT_IMGPROC);
+    cv::resize(gray, p.det_frame, p.det_calib.image_size, 0, 0, cv::INTER_AREA);
+  } else {
+    p.det_frame = gray;
+  }
+
+  // kept results are only reused while they are from the current settings
+  bool async_detect = p.tracker != NULL;
+  bool skipped = p.detect_every > 1 && frame_id % p.detect_every != 0 && p.last_valid;
+  bool reused = !async_detect && (skipped || (p.set.gating && motion_reuse(p.gate, p.det_frame, p.last_roi))) && p.last_valid;
+  bool patternfound = false;
+  r.found = false;
+  r.corners.clear();
+
+  if(async_detect) {
+    // detection runs behind the loop, the pose is blended from its newest results to this frame's capture time
+    submit_board_frame(*p.tracker, p.det_frame, captured, p.det_calib);
+    patternfound = board_pose_at(*p.tracker, captured, rotations, translations) == 0;
+  } else if(p.set.multi_board) {
+    // detection goes straight into the one kept set, the frames that reuse it draw it as it is
+    board_set &boards = p.last_boards;
+    if(!reused) {
+      detect_chessboards(p.det_frame, p.set.boardsizes, p.set.max_boards, p.ws.search, boards);
+      solve_board_poses(boards, p.det_calib.cam_mat, p.det_calib.distcoeff, point_set);
+      p.last_valid = true;
+      p.last_roi = cv::Rect();
+      for(int b = 0; b < boards.count; b++) {
+        p.last_roi |= cv::boundingRect(boards.slots[b].corner_set);
+      }
+    }
+
+    // the first board is the frame's result, so replay.exe can check this path too
+    if(boards.count > 0) {
+      const board_detection &first = boards.slots[0];
+      r.found = true;
+      for(int i = 0; i < first.corner_set.size(); i++) {
+        r.corners.push_back(first.corner_set[i] * (1.0f / p.set.det_scale));
+      }
+      r.rvec = cv::Vec3d(first.rotations.at<double>(0, 0), first.rotations.at<double>(1, 0), first.rotations.at<double>(2, 0));
+      r.tvec = cv::Vec3d(first.translations.at<double>(0, 0), first.translations.at<double>(1, 0), first.translations.at<double>(2, 0));
+      r.draw_rvec = r.rvec;
+      r.draw_tvec = r.tvec;
+    }
+
+    // every board is drawn with its own measured pose
+    std::vector<cv::Vec3f> &drawpoints = p.ws.drawpoints;
+    std::vector<cv::Point2f> &image_points = p.ws.image_points;
+    for(int b = 0; b < boards.count && !dst.empty(); b++) {
+      const board_detection &board = boards.slots[b];
+      drawpoints.clear();
+      get_overlay_points(p.set.overlay, board.patsize, m.objpoints, drawpoints);
+      {
+        PROF_SCOPE(STAGE_PROJECT);
+        ALLOC_EXEMPT(EXEMPT_POSE);
+        cv::projectPoints(drawpoints, board.rotations, board.translations, p.frame_calib.cam_mat, p.frame_calib.distcoeff, image_points);
+      }
+      PROF_SCOPE(STAGE_DRAW);
+      draw_overlay(dst, p.set.overlay, image_points, m.connections, p.lod);
+    }
+    watch_pipeline(p);
+    return(0);
+  } else if(reused) {
+    corner_set = p.last_corners;
+    corner_ids = p.last_ids;
+    patternfound = p.last_found;
+  } else {
+    detect_board(p.det_frame, p.set.backend, m.patternsize, corner_set, corner_ids, patternfound, &p.refine);
+    // a ChArUco board still gives a pose with part of it covered
+    patternfound = patternfound || corner_ids.size() >= 6;
+  }
+
+  if(patternfound) {
+    log_msg(LOG_DEBUG, "pattern found, %d corners", (int) corner_set.size());
+    get_point_subset(m.patternsize, corner_ids, point_set); // Get the point set for the corners that were found
+    // the pose does not depend on resolution, so solve it with the detection intrinsics
+    if(reused) {
+      p.last_rotations.copyTo(rotations);
+      p.last_translations.copyTo(translations);
+    } else if(!async_detect) {
+      PROF_SCOPE(STAGE_PNP);
+      ALLOC_EXEMPT(EXEMPT_POSE);
+      cv::solvePnP(point_set, corner_set, p.det_calib.cam_mat, p.det_calib.distcoeff, rotations, translations);
+    }
+    // blended poses have no corners to score them against
+    if(p.poses && !async_detect) {
+      double err = reprojection_error(point_set, corner_set, rotations, translations, p.det_calib.cam_mat, p.det_calib.distcoeff, p.ws.projected) / p.set.det_scale;
+      write_pose(*p.poses, 0, frame_id, captured, rotations, translations, err);
+    }
+
+    log_msg(LOG_DEBUG, "rotations %.4f %.4f %.4f translations %.4f %.4f %.4f",
+            rotations.at<double>(0, 0), rotations.at<double>(1, 0), rotations.at<double>(2, 0),
+            translations.at<double>(0, 0), translations.at<double>(1, 0), translations.at<double>(2, 0));
+
+    r.found = true;
+    for(int i = 0; i < corner_set.size(); i++) {
+      r.corners.push_back(corner_set[i] * (1.0f / p.set.det_scale));
+    }
+    r.rvec = cv::Vec3d(rotations.at<double>(0, 0), rotations.at<double>(1, 0), rotations.at<double>(2, 0));
+    r.tvec = cv::Vec3d(translations.at<double>(0, 0), translations.at<double>(1, 0), translations.at<double>(2, 0));
+
+    if(p.set.filtering) {
+      // smooth the pose and move it on from the capture time by the lead
+      update_pose_filter(p.filter, captured, rotations, translations);
+      predict_pose(p.filter, captured + (int64_t) (p.set.pose_lead_ms * 1e6), p.draw_rotations, p.draw_translations);
+    } else {
+      rotations.copyTo(p.draw_rotations);
+      translations.copyTo(p.draw_translations);
+    }
+    r.draw_rvec = cv::Vec3d(p.draw_rotations.at<double>(0, 0), p.draw_rotations.at<double>(1, 0), p.draw_rotations.at<double>(2, 0));
+    r.draw_tvec = cv::Vec3d(p.draw_translations.at<double>(0, 0), p.draw_translations.at<double>(1, 0), p.draw_translations.at<double>(2, 0));
+
+    if(!dst.empty()) {
+      draw_pipeline_result(p, dst, r);
+    }
+  }
+
+  if(!reused && !async_detect) {
+    p.last_valid = true;
+    p.last_corners = corner_set;
+    p.last_ids = corner_ids;
+    p.last_found = patternfound;
+    p.last_roi = cv::Rect();
+    if(patternfound) {
+      rotations.copyTo(p.last_rotations);
+      translations.copyTo(p.last_translations);
+      p.last_roi = cv::boundingRect(corner_set);
+    }
+  }
+
+  watch_pipeline(p);
+  return(0);
+}
+
+/**
+ * @brief Function to draw a frame's overlay from its result
+ *
+ * run_frame_pipeline calls it, and it can draw results a different pipeline
+ * measured, as long as the frames are drawn in order.
+ *
+ * @param p pipeline, its model, settings, intrinsics, level of detail and kermit frame are used
+ * @param dst BGR frame to draw on in place
+ * @param r result of the frame
+ * @return int
+ */
+int draw_pipeline_result(frame_pipeline &p, cv::Mat &dst, const pipeline_result &r) {
+  if(!r.found) {
+    return(0);
+  }
+  const pipeline_model &m = *p.model;
+  std::vector<cv::Point2f> &image_points = p.ws.image_points;
+  std::vector<cv::Vec3f> &drawpoints = p.ws.drawpoints;
+
+  if(dst.size() != p.frame_calib.image_size) {
+    if(p.calib.image_size.area() == 0) {
+      p.calib.image_size = dst.size();
+    }
+    scale_cal_profile(p.calib, dst.size(), p.frame_calib);
+  }
+
+  drawpoints.clear();
+  if(p.set.mode == PIPELINE_GIF) {
+    // kermit covers the board's outer corners
+    drawpoints.push_back(cv::Vec3f(0, 0, 0));
+    drawpoints.push_back(cv::Vec3f(m.patternsize.width, 0, 0));
+    drawpoints.push_back(cv::Vec3f(m.patternsize.width, -m.patternsize.height, 0));
+    drawpoints.push_back(cv::Vec3f(0, -m.patternsize.height, 0));
+  } else {
+    get_overlay_points(p.set.overlay, m.patternsize, m.objpoints, drawpoints);
+  }
+  // project the points and get the image points
+  {
+    PROF_SCOPE(STAGE_PROJECT);
+    ALLOC_EXEMPT(EXEMPT_POSE);
+    cv::projectPoints(drawpoints, r.draw_rvec, r.draw_tvec, p.frame_calib.cam_mat, p.frame_calib.distcoeff, image_points);
+  }
+
+  PROF_SCOPE(STAGE_DRAW);
+  if(p.set.mode == PIPELINE_GIF) {
+    // only the box kermit lands in is warped and composited, not the whole frame
+    if(composite_quad(dst, m.kerms[p.kermitcount], image_points, p.ws.warped, p.ws.mask, p.ws.poly, p.ws.copy_bytes) == 0) {
+      log_msg(LOG_DEBUG, "kermit composited, %ld bytes", p.ws.copy_bytes);
+    }
+    p.kermitcount = (p.kermitcount + 1) % m.kerms.size();
+  } else {
+    draw_overlay(dst, p.set.overlay, image_points, m.connections, p.lod);
+  }
+
+  return(0);
+}
@@ -0,0 +1,151 @@
+/**
+ * @file frame_source.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Functions for reading frames from cameras, videos and image directories
+ * @date 2022-04-05
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <algorithm>
+#include "../include/frame_source.h"
+
+/**
+ * @brief Function to check whether a file name looks like an image
+ *
+ * @param name file name
+ * @return true if it has an image extension
+ */
+static bool is_image_file(const char *name) {
+  return strstr(name, ".png") || strstr(name, ".jpg") || strstr(name, ".jpeg") ||
+         strstr(name, ".bmp") || strstr(name, ".ppm") || strstr(name, ".tif");
+}
+
+/**
+ * @brief Function to open a frame source
+ *
+ * A spec made only of digits is a camera index, a directory is read as a
+ * sequence of images in name order, anything else is handed to cv::VideoCapture
+ * (video files and printf style image sequences like img%04d.png).
+ *
+ * @param spec source to open
+ * @param src frame source to write to
+ * @return int return non-zero value on failure
+ */
+int open_frame_source(const std::string &spec, frame_source &src) {
+  src.spec = spec;
+  src.live = 0;
+  src.files.clear();
+  src.next_file = 0;
+
+  if(!spec.empty() && spec.find_first_not_of("0123456789") == std::string::npos) {
+    src.live = 1;
+    if(!src.cap.open(atoi(spec.c_str()))) {
+      printf("Unable to open video device %s\n", spec.c_str());
+      return(-1);
+    }
+    return(0);
+  }
+
+  DIR *dirp = opendir(spec.c_str());
+  if(dirp) {
+    struct dirent *dp;
+    while((dp = readdir(dirp)) != NULL) {
+      if(is_image_file(dp->d_name)) {
+        src.files.push_back(spec + "/" + dp->d_name);
+      }
+    }
+    closedir(dirp);
+    std::sort(src.files.begin(), src.files.end());
+
+    if(src.files.empty()) {
+      printf("No images in %s\n", spec.c_str());
+      return(-1);
+    }
+    return(0);
+  }
+
+  if(!src.cap.open(spec)) {
+    printf("Unable to open %s\n", spec.c_str());
+    return(-1);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to read the next frame from a frame source
+ *
+ * @param src frame source to read from
+ * @param frame frame to write to
+ * @return int return non-zero value when the source has no more frames
+ */
+int read_frame_source(frame_source &src, cv::Mat &frame) {
+  if(!src.files.empty()) {
+    if(src.next_file >= src.files.size()) {
+      return(-1);
+    }
+    frame = cv::imread(src.files[src.next_file]);
+    src.next_file++;
+    return frame.empty() ? -1 : 0;
+  }
+
+  src.cap >> frame;
+  return frame.empty() ? -1 : 0;
+}
+
+/**
+ * @brief Function to get the number of frames in a frame source
+ *
+ * @param src frame source
+ * @return long number of frames, -1 for cameras and videos that do not say
+ */
+long frame_source_length(frame_source &src) {
+  if(src.live) {
+    return(-1);
+  }
+  if(!src.files.empty()) {
+    return (long) src.files.size();
+  }
+  long n = (long) src.cap.get(cv::CAP_PROP_FRAME_COUNT);
+  return n > 0 ? n : -1;
+}
+
+/**
+ * @brief Function to move a frame source to a frame, so the next read returns it
+ *
+ * Videos seek through the backend, which is frame accurate for the usual
+ * containers with FFmpeg but not for every codec.
+ *
+ * @param src frame source, not a camera
+ * @param frame index of the frame to read next
+ * @return int return non-zero value on failure
+ */
+int seek_frame_source(frame_source &src, long frame) {
+  if(src.live || frame < 0) {
+    return(-1);
+  }
+  if(!src.files.empty()) {
+    if(frame > src.files.size()) {
+      return(-1);
+    }
+    src.next_file = (int) frame;
+    return(0);
+  }
+  return src.cap.set(cv::CAP_PROP_POS_FRAMES, (double) frame) ? 0 : -1;
+}
+
+/**
+ * @brief Function to close a frame source
+ *
+ * @param src frame source to close
+ * @return int
+ */
+int close_frame_source(frame_source &src) {
+  src.cap.release();
+  src.files.clear();
+  src.next_file = 0;
+  return(0);
+}
@@ -0,0 +1,384 @@
+/**
+ * @file frame_workspace.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Buffers reused across frames and a heap allocation count for the frame loops
+ * @date 2022-04-17
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "../include/frame_workspace.h"
+
+// frames the loop runs before allocations are counted, the buffers grow to size in these
+#define WARMUP_FRAMES 30
+
+#ifdef AR_COUNT_ALLOCS
+// replaces the global operator new so every allocation on a thread is counted,
+// against the exempt call it was made in if there is one
+static thread_local long thread_allocs = 0;
+static thread_local long thread_exempt[NUM_EXEMPT] = {0};
+static thread_local int thread_call = EXEMPT_NONE;
+
+static inline void count_alloc() {
+  if(thread_call == EXEMPT_NONE) {
+    thread_allocs++;
+  } else {
+    thread_exempt[thread_call]++;
+  }
+}
+
+void *operator new(std::size_t size) {
+  count_alloc();
+  void *p = malloc(size ? size : 1);
+  if(!p) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void *operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  count_alloc();
+  return malloc(size ? size : 1);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  count_alloc();
+  return malloc(size ? size : 1);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+  free(p);
+}
+#endif
+
+/**
+ * @brief Function to get the number of heap allocations made on this thread
+ *
+ * Counts calls to operator new outside the exempt OpenCV calls. Only counted
+ * when built with -DAR_COUNT_ALLOCS. A Mat's pixels go through cv::fastMalloc,
+ * but every new Mat also allocates its UMatData header, so a Mat that is
+ * reallocated is counted.
+ *
+ * @return long allocations so far, -1 when not counted
+ */
+long alloc_count() {
+#ifdef AR_COUNT_ALLOCS
+  return thread_allocs;
+#else
+  return -1;
+#endif
+}
+
+/**
+ * @brief Function to get the number of heap allocations made on this thread inside one of the exempt calls
+ *
+ * @param call alloc_exempt
+ * @return long allocations so far, -1 when not counted
+ */
+long exempt_count(int call) {
+#ifdef AR_COUNT_ALLOCS
+  if(call < 0 || call >= NUM_EXEMPT) {
+    return -1;
+  }
+  return thread_exempt[call];
+#else
+  return -1;
+#endif
+}
+
+alloc_exempt_scope::alloc_exempt_scope(int call) {
+#ifdef AR_COUNT_ALLOCS
+  prev = thread_call;
+  thread_call = call;
+#else
+  prev = call;
+#endif
+}
+
+alloc_exempt_scope::~alloc_exempt_scope() {
+#ifdef AR_COUNT_ALLOCS
+  thread_call = prev;
+#endif
+}
+
+// what each exempt call is printed as
+static const char *exempt_names[NUM_EXEMPT] = { "find", "pose", "imgproc", "draw", "parallel" };
+
+/**
+ * @brief Function to set up an empty workspace
+ *
+ * @param ws workspace to set up
+ * @return int
+ */
+int init_frame_workspace(frame_workspace &ws) {
+  ws.frames = 0;
+  ws.allocs_start = -1;
+  for(int i = 0; i < NUM_EXEMPT; i++) {
+    ws.exempt_start[i] = -1;
+  }
+  ws.frame_allocs_start = -1;
+  ws.alloc_frames = 0;
+  ws.first_alloc_frame = -1;
+  ws.first_allocs = 0;
+  ws.copy_bytes = 0;
+  ws.total_copy_bytes = 0;
+  ws.watch_names.clear();
+  ws.watch_index.clear();
+  ws.watch_data.clear();
+  ws.frame_moved = false;
+  ws.moved_frames = 0;
+  ws.first_moved_frame = -1;
+  ws.first_moved = NULL;
+  ws.first_moved_index = -1;
+
+  // enough for a 9x6 board and the house, the obj model grows them on its first frame
+  ws.corner_set.reserve(64);
+  ws.corner_ids.reserve(64);
+  ws.point_set.reserve(64);
+  ws.projected.reserve(64);
+  ws.drawpoints.reserve(64);
+  ws.image_points.reserve(64);
+  ws.poly.reserve(8);
+  // the watch list is filled on the first frame, and by boards that only show up later
+  ws.watch_names.reserve(128);
+  ws.watch_index.reserve(128);
+  ws.watch_data.reserve(128);
+
+  return 0;
+}
+
+/**
+ * @brief Function to call at the top of every frame, empties the per-frame vectors
+ *
+ * @param ws workspace of the loop
+ * @return int
+ */
+int begin_frame(frame_workspace &ws) {
+  ws.corner_set.clear();
+  ws.corner_ids.clear();
+  ws.point_set.clear();
+  ws.drawpoints.clear();
+  ws.image_points.clear();
+  ws.poly.clear();
+  ws.total_copy_bytes += ws.copy_bytes;
+  ws.copy_bytes = 0;
+  ws.frame_moved = false;
+
+  if(ws.frames++ == WARMUP_FRAMES) {
+    ws.allocs_start = alloc_count();
+    for(int i = 0; i < NUM_EXEMPT; i++) {
+      ws.exempt_start[i] = exempt_count(i);
+    }
+  }
+  ws.frame_allocs_start = alloc_count();
+
+  return 0;
+}
+
+/**
+ * @brief Function to call at the bottom of every frame, counts it if it allocated after warm up
+ *
+ * Only counts when built with -DAR_COUNT_ALLOCS, allocations inside the exempt
+ * OpenCV calls do not count.
+ *
+ * @param ws workspace of the loop
+ * @return int return non-zero value if the frame allocated after warm up
+ */
+int end_frame(frame_workspace &ws) {
+  if(ws.frame_allocs_start < 0 || ws.frames <= WARMUP_FRAMES) {
+    return 0;
+  }
+  long allocs = alloc_count() - ws.frame_allocs_start;
+  if(allocs <= 0) {
+    return 0;
+  }
+
+  ws.alloc_frames++;
+  if(ws.first_alloc_frame < 0) {
+    ws.first_alloc_frame = ws.frames - 1;
+    ws.first_allocs = allocs;
+  }
+  return -1;
+}
+
+/**
+ * @brief Function to check that a buffer keeps its memory once the loop has warmed up
+ *
+ * Call it for every buffer the loop reuses at the end of each frame, with the
+ * buffer's data pointer. A Mat that is reallocated or a vector that grows gets
+ * a new pointer, which after warm up counts the frame as one that allocated.
+ * Buffers that are still empty, or first get memory after warm up, are not
+ * counted, only ones that had memory and moved.
+ *
+ * @param ws workspace of the loop
+ * @param name buffer name, a string that outlives the workspace
+ * @param data the buffer's data pointer this frame
+ * @param index which of a set of buffers of the same name, -1 for a single one
+ * @return int return non-zero value if the buffer moved after warm up
+ */
+int watch_buffer(frame_workspace &ws, const char *name, const void *data, int index) {
+  int idx = 0;
+  while(idx < ws.watch_names.size() && (ws.watch_index[idx] != index || strcmp(ws.watch_names[idx], name) != 0)) {
+    idx++;
+  }
+  if(idx == ws.watch_names.size()) {
+    ws.watch_names.push_back(name);
+    ws.watch_index.push_back(index);
+    ws.watch_data.push_back(NULL);
+  }
+
+  // an empty buffer this frame says nothing, a released one that comes back elsewhere still counts
+  const void *last = ws.watch_data[idx];
+  if(!data || data == last) {
+    return 0;
+  }
+  ws.watch_data[idx] = data;
+  if(!last || ws.frames <= WARMUP_FRAMES) {
+    return 0;
+  }
+
+  if(!ws.frame_moved) {
+    ws.frame_moved = true;
+    ws.moved_frames++;
+  }
+  if(!ws.first_moved) {
+    ws.first_moved = name;
+    ws.first_moved_index = index;
+    ws.first_moved_frame = ws.frames - 1;
+  }
+  return -1;
+}
+
+/**
+ * @brief Function to watch every Mat and vector of the workspace, at the end of a frame
+ *
+ * @param ws workspace of the loop
+ * @return int return non-zero value if a buffer moved after warm up
+ */
+int watch_frame_workspace(frame_workspace &ws) {
+  int moved = 0;
+  moved |= watch_buffer(ws, "corner_set", ws.corner_set.data());
+  moved |= watch_buffer(ws, "corner_ids", ws.corner_ids.data());
+  moved |= watch_buffer(ws, "point_set", ws.point_set.data());
+  moved |= watch_buffer(ws, "rotations", ws.rotations.data);
+  moved |= watch_buffer(ws, "translations", ws.translations.data);
+  moved |= watch_buffer(ws, "projected", ws.projected.data());
+  moved |= watch_buffer(ws, "drawpoints", ws.drawpoints.data());
+  moved |= watch_buffer(ws, "image_points", ws.image_points.data());
+  moved |= watch_buffer(ws, "poly", ws.poly.data());
+  moved |= watch_buffer(ws, "warped", ws.warped.data);
+  moved |= watch_buffer(ws, "mask", ws.mask.data);
+  moved |= watch_buffer(ws, "har_small", ws.har_small.data);
+  moved |= watch_buffer(ws, "har_data", ws.har_data.data);
+  moved |= watch_buffer(ws, "har_norm", ws.har_norm.data);
+
+  // --multi-board's search, the per-region buffers only grow with the most regions seen
+  board_search &s = ws.search;
+  moved |= watch_buffer(ws, "search.small", s.small.data);
+  moved |= watch_buffer(ws, "search.response", s.response.data);
+  moved |= watch_buffer(ws, "search.localmax", s.localmax.data);
+  moved |= watch_buffer(ws, "search.taken", s.taken.data);
+  moved |= watch_buffer(ws, "search.peaks", s.peaks.data());
+  moved |= watch_buffer(ws, "search.cell_start", s.cell_start.data());
+  moved |= watch_buffer(ws, "search.cell_of", s.cell_of.data());
+  moved |= watch_buffer(ws, "search.bucket", s.bucket.data());
+  moved |= watch_buffer(ws, "search.fill", s.fill.data());
+  moved |= watch_buffer(ws, "search.nn", s.nn.data());
+  moved |= watch_buffer(ws, "search.parent", s.parent.data());
+  moved |= watch_buffer(ws, "search.cluster_size", s.cluster_size.data());
+  moved |= watch_buffer(ws, "search.cluster_box", s.cluster_box.data());
+  moved |= watch_buffer(ws, "search.cluster_spacing", s.cluster_spacing.data());
+  moved |= watch_buffer(ws, "search.regions", s.regions.data());
+  moved |= watch_buffer(ws, "search.rois", s.rois.data());
+  moved |= watch_buffer(ws, "search.corners", s.corners.data());
+  moved |= watch_buffer(ws, "search.found", s.found.data());
+  for(int i = 0; i < s.found.size(); i++) {
+    moved |= watch_buffer(ws, "search.rois", s.rois[i].data, i);
+    moved |= watch_buffer(ws, "search.corners", s.corners[i].data(), i);
+    moved |= watch_buffer(ws, "search.found", s.found[i].slots.data(), i);
+  }
+  return moved;
+}
+
+/**
+ * @brief Function to print the heap allocations per frame once the loop has warmed up
+ *
+ * The operator new counts are only printed when built with -DAR_COUNT_ALLOCS,
+ * the frames in which a watched buffer moved always are.
+ *
+ * @param ws workspace of the loop
+ * @param name loop name to print
+ * @return int return non-zero value if a frame allocated or a watched buffer moved after warm up
+ */
+int print_frame_allocs(const frame_workspace &ws, const char *name) {
+  long frames = ws.frames - WARMUP_FRAMES;
+  if(frames <= 0) {
+    return 0; // the loop never got past warm up
+  }
+  int ret = 0;
+
+  if(ws.allocs_start >= 0) {
+    long allocs = alloc_count() - ws.allocs_start;
+    printf("%s: %ld heap allocations in %ld frames after warm up, %.2f per frame\n", name, allocs, frames, (double) allocs / frames);
+    printf("%s: inside OpenCV", name);
+    for(int i = 0; i < NUM_EXEMPT; i++) {
+      printf(" %s %.2f", exempt_names[i], (double) (exempt_count(i) - ws.exempt_start[i]) / frames);
+    }
+    printf(" per frame, not counted\n");
+  }
+  if(ws.alloc_frames > 0) {
+    printf("%s: %ld of %ld frames after warm up allocated, first frame %ld with %ld\n", name, ws.alloc_frames, frames,
+           ws.first_alloc_frame, ws.first_allocs);
+    ret = -1;
+  }
+  if(ws.moved_frames > 0) {
+    char first[64];
+    if(ws.first_moved_index >= 0) {
+      snprintf(first, sizeof(first), "%s[%d]", ws.first_moved, ws.first_moved_index);
+    } else {
+      snprintf(first, sizeof(first), "%s", ws.first_moved);
+    }
+    printf("%s: buffers were reallocated in %ld of %ld frames after warm up, first %s in frame %ld\n", name, ws.moved_frames,
+           frames, first, ws.first_moved_frame);
+    return(-1);
+  }
+  printf("%s: %d buffers kept their memory over %ld frames after warm up\n", name, (int) ws.watch_names.size(), frames);
+
+  return ret;
+}
+
+/**
+ * @brief Function to print how many bytes the overlay copied per frame
+ *
+ * @param ws workspace of the loop
+ * @param name loop name to print
+ * @return int
+ */
+int print_frame_copies(const frame_workspace &ws, const char *name) {
+  if(ws.frames == 0) {
+    return 0;
+  }
+
+  long bytes = ws.total_copy_bytes + ws.copy_bytes;
+  printf("%s: overlay copied %.1f KB per frame over %ld frames\n", name, bytes / 1024.0 / ws.frames, ws.frames);
+
+  return 0;
+}
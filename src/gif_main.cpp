@@ -1,163 +1,211 @@
-/**
- * @file ar_main.cpp
- * @author Nate Novak (novak.n@northeastern.edu)
- * @brief Main function for the gif extension
- * @date 2022-03-24
- */
-
-#include <cstdio>
-#include <cstring>
-#include <cstdlib>
-#include <dirent.h>
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <opencv2/opencv.hpp>
-#include "../include/csv_util.h"
-#include "../include/ar.h"
-
-int main(int argc, char *argv[]) {
-  cv::VideoCapture *capdev;
-
-  // open the video device
-  capdev = new cv::VideoCapture(0);
-  if( !capdev->isOpened() ) {
-    printf("Unable to open kermit.gif\n");
-    return(-1);
-  }
-  
-   // get some properties of the image
-  cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
-                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
-  printf("Expected size: %d %d\n", refS.width, refS.height);
-
-  cv::namedWindow("Kermit", 1); 
-  cv::Mat frame;
-  cv::Mat dst; 
-
-  cv::Mat cam_mat(3, 3, CV_64FC1); 
-  cv::Mat distcoeff(5, 1, CV_64FC1); 
-
-  read_calibration_data_csv("calibration.csv", cam_mat, distcoeff, 0); 
-
-  // print calibration data
-  printf("Camera Matrix\n"); 
-  for(int i = 0; i < cam_mat.rows; i++) {
-    for(int j = 0; j < cam_mat.cols; j++) {
-      printf("%.4f ", cam_mat.at<double>(i, j)); 
-    }
-    printf("\n"); 
-  }
-  printf("\n"); 
-
-  printf("Distortion Coefficients\n"); 
-  for(int i = 0; i < distcoeff.rows; i++) {
-    printf("%.4f ", distcoeff.at<double>(i, 0)); 
-  }
-  printf("\n\n"); 
-
-  int kermitcount = 0; 
-
-  cv::Size patternsize(9, 6); 
-
-  int counter = 0; 
-  for(;;) {
-    *capdev >> frame; // get a new frame from the camera, treat as a stream
-    if( frame.empty() ) {
-      printf("frame is empty\n");
-      break;
-    }  
-
-    bool patternfound = false;
-    std::vector<cv::Point2f> corner_set;
-    std::vector<cv::Vec3f> point_set;  
-    cv::Mat rotations; 
-    cv::Mat translations;
-    std::vector<cv::Point2f> image_points; 
-
-    detect_chessboard(frame, patternsize, corner_set, patternfound); 
-
-    frame.copyTo(dst); 
-
-    if(patternfound) {
-      get_point_set(patternsize, point_set); // Get the point set for the panner
-      cv::solvePnP(point_set, corner_set, cam_mat, distcoeff, rotations, translations);
-
-      printf("Rotations:\n");
-      for(int i = 0; i < rotations.rows; i++) {
-        printf("%.4f ", rotations.at<double>(i, 0));
-      } 
-      printf("\n\n"); 
-
-      printf("Translations:\n");
-      for(int i = 0; i < translations.rows; i++) {
-        printf("%.4f ", rotations.at<double>(i, 0)); 
-      }
-      printf("\n\n");
-      
-      // These are the points relative to the origin we are drawing to
-      std::vector<cv::Vec3f> drawpoints {
-        cv::Vec3f(0, 0, 0), // 0
-        cv::Vec3f(9, 0, 0), // 1
-        cv::Vec3f(9, -6, 0), // 2
-        cv::Vec3f(0, -6, 0) // 3
-      }; 
-
-      cv::projectPoints(drawpoints, rotations, translations, cam_mat, distcoeff, image_points);  
-      printf("Image Points ( %d )\n[", image_points.size()); 
-      for(int i = 0; i < image_points.size(); i++) {
-        printf("(%.4f, %.4f) ", image_points[i].x, image_points[i].y); 
-      }
-      printf("\b]\n\n");
-      // read in the kermit image
-      std::string fname = "kerm/input-" + std::to_string(kermitcount) + ".png"; 
-      cv::Mat kerm = cv::imread(fname); 
-      // create points of kermit image
-      std::vector<cv::Point2f> kermPoints {
-        cv::Point2f(0, 0), 
-        cv::Point2f(kerm.cols, 0), 
-        cv::Point2f(kerm.cols, kerm.rows), 
-        cv::Point2f(0, kerm.rows)
-      }; 
-      
-      cv::Mat h = cv::findHomography(kermPoints, image_points); // find the homography
-      cv::Mat warpedKermit; 
-      cv::warpPerspective(kerm, warpedKermit, h, frame.size(), cv::INTER_CUBIC); // warp the perspective of the kermit image based on the homography
-
-      // convert the points to integers rather than floats
-      std::vector<cv::Point2i> newpoints; 
-      for(int i = 0; i < image_points.size(); i++) {
-        cv::Point2i newpnt; 
-        newpnt.x = (int) image_points[i].x; 
-        newpnt.y = (int) image_points[i].y; 
-        newpoints.push_back(newpnt); 
-      }
-
-      cv::Mat mask; 
-      dst.copyTo(mask); 
-      for(int i = 0; i < mask.rows; i++) {
-        for(int j = 0; j < mask.cols; j++) {
-          mask.at<cv::Vec3b>(i, j) = {0, 0, 0}; 
-        }
-      }
-      // fill the mask object with 
-      cv::fillConvexPoly(mask, newpoints, cv::Scalar::all(255), cv::LINE_AA); 
-
-      warpedKermit.copyTo(dst, mask); 
-
-      kermitcount++;
-      if(kermitcount > 18) kermitcount = 0;  
-    }
-
-    cv::imshow("Kermit", dst);
-
-    char keyEx = cv::waitKeyEx(10); 
-    if(keyEx == 'q') {
-      break; 
-    } 
-  }
-
-  printf("Bye!\n"); 
-  delete capdev;
-  return(0);
+/**
+ * @file ar_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for the gif extension
+ * @date 2022-03-24
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/cal_profile.h"
+#include "../include/ar.h"
+#include "../include/profiler.h"
+#include "../include/logger.h"
+#include "../include/video_recorder.h"
+#include "../include/frame_workspace.h"
+#include "../include/display.h"
+#include "../include/board_tracker.h"
+#include "../include/frame_pipeline.h"
+
+int main(int argc, char *argv[]) {
+  cv::VideoCapture *capdev;
+
+  char prof_fn[256] = "profile.csv"; // stage timings, written on 'p' and at exit
+  char trace_fn[256] = ""; // with --trace every stage of every frame is written here at exit
+  bool headless = false; // --no-display runs as fast as the frames can be processed
+  bool async_detect = false; // --async-detect draws every frame and detects on a thread of its own
+  int log_level = LOG_INFO; // debug also logs the pose of every frame
+  char log_fn[256] = ""; // log to stdout unless --log is given
+  char record_fn[256] = ""; // with --record the composited output is encoded on a background thread
+  double record_fps = 0; // 0 to use the camera frame rate
+  int record_policy = RECORD_DROP_NEWEST; 
+  int record_queue = 8; 
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      strncpy(prof_fn, argv[++i], sizeof(prof_fn) - 1);
+    } else if(strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+      log_level = parse_log_level(argv[++i]);
+      if(log_level < 0) {
+        printf("Unknown log level %s (debug, info, warn, error, off)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      strncpy(log_fn, argv[++i], sizeof(log_fn) - 1);
+    } else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      strncpy(trace_fn, argv[++i], sizeof(trace_fn) - 1);
+      trace_start();
+    } else if(strcmp(argv[i], "--no-display") == 0) {
+      headless = true;
+    } else if(strcmp(argv[i], "--async-detect") == 0) {
+      async_detect = true;
+    } else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      strncpy(record_fn, argv[++i], sizeof(record_fn) - 1);
+    } else if(strcmp(argv[i], "--record-fps") == 0 && i + 1 < argc) {
+      record_fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--record-queue") == 0 && i + 1 < argc) {
+      record_queue = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--record-policy") == 0 && i + 1 < argc) {
+      record_policy = parse_record_policy(argv[++i]);
+      if(record_policy < 0) {
+        printf("Unknown record policy %s (drop, drop-oldest, queue)\n", argv[i]);
+        return(-1);
+      }
+    }
+  }
+
+  log_start(log_level, log_fn); 
+
+  // open the video device
+  capdev = new cv::VideoCapture(0);
+  if( !capdev->isOpened() ) {
+    printf("Unable to open kermit.gif\n");
+    return(-1);
+  }
+  
+   // get some properties of the image
+  cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
+                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
+  printf("Expected size: %d %d\n", refS.width, refS.height);
+
+  cv::Mat frame;
+  cv::Mat dst; 
+
+  cal_profile calib; 
+  if(read_cal_profile_csv("calibration.csv", "", calib, 0) != 0) {
+    printf("Unable to read calibration.csv\n"); 
+    return(-1); 
+  }
+
+  // print calibration data
+  print_cal_profile(calib); 
+
+  cv::Size patternsize(9, 6); 
+
+  // read every kermit frame once instead of from disk on every frame
+  pipeline_model model; 
+  if(load_pipeline_model(PIPELINE_GIF, patternsize, NULL, "kerm", model) != 0) {
+    return(-1); 
+  }
+
+  // detection, pose and compositing, the same steps replay.exe --mode gif checks recordings with,
+  // detecting on every frame as gif.exe always has
+  pipeline_settings set; 
+  init_pipeline_settings(set); 
+  set.mode = PIPELINE_GIF; 
+  set.gating = false; 
+  frame_pipeline pipe; 
+  if(open_frame_pipeline(set, calib, &model, pipe) != 0) {
+    return(-1); 
+  }
+  pipeline_result result; 
+
+  video_recorder recorder; 
+  bool have_recorder = strlen(record_fn) > 0; 
+  if(have_recorder) {
+    double fps = record_fps > 0 ? record_fps : capdev->get(cv::CAP_PROP_FPS); 
+    if(open_video_recorder(record_fn, fps, record_policy, record_queue, recorder) != 0) {
+      return(-1); 
+    }
+  }
+  bool recording = have_recorder; 
+
+  // the window is shown and its events pumped on a thread of its own
+  frame_display display; 
+  open_display("Kermit", headless, display); 
+
+  // with --async-detect the loop runs at the camera rate whatever the detector costs
+  board_tracker tracker; 
+  if(async_detect) {
+    open_board_tracker(DETECT_CLASSIC, patternsize, tracker); 
+    pipe.tracker = &tracker; 
+  }
+
+  int counter = 0; 
+  long frame_no = 0; 
+  for(;;) {
+    log_frame(frame_no++); 
+    begin_frame(pipe.ws); 
+    int64_t frame_start = prof_now(); 
+    if(recording && !frame.empty()) {
+      // the last frame now belongs to the encoder, capture into a buffer it is done with
+      frame = next_record_frame(recorder, frame.size(), frame.type()); 
+    }
+    *capdev >> frame; // get a new frame from the camera, treat as a stream
+    prof_record(STAGE_CAPTURE, prof_now() - frame_start); 
+    if( frame.empty() ) {
+      printf("frame is empty\n");
+      break;
+    }  
+
+    {
+      PROF_SCOPE(STAGE_GRAY); 
+      cv::cvtColor(frame, pipe.gray, cv::COLOR_BGR2GRAY); 
+    }
+
+    // kermit is drawn on the frame in place
+    dst = frame; 
+    run_frame_pipeline(pipe, pipe.gray, dst, frame_start, result); 
+
+    if(recording) {
+      record_frame(recorder, dst); 
+    }
+
+    int64_t t0 = prof_now(); 
+    show_frame(display, dst); 
+
+    char keyEx = poll_key(display); 
+    prof_record(STAGE_DISPLAY, prof_now() - t0); 
+    prof_record(STAGE_FRAME, prof_now() - frame_start); 
+    if(keyEx == 'q') {
+      break; 
+    } else if (keyEx == 'p') {
+      prof_print(); 
+      prof_dump_csv(prof_fn); 
+    } else if (keyEx == 'r' && have_recorder) {
+      recording = !recording; 
+      if(!recording) {
+        // the encoder may still hold the last frame
+        frame.release(); 
+        dst.release(); 
+      }
+      log_msg(LOG_INFO, "Recording %s", recording ? "resumed" : "paused"); 
+    } 
+  }
+
+  if(async_detect) {
+    close_board_tracker(tracker, "gif"); 
+  }
+  print_frame_allocs(pipe.ws, "gif"); 
+  print_frame_copies(pipe.ws, "gif"); 
+  prof_print(); 
+  prof_dump_csv(prof_fn); 
+  if(trace_enabled()) {
+    trace_dump_json(trace_fn); 
+  }
+
+  if(have_recorder) {
+    close_video_recorder(recorder); 
+  }
+  log_stop(); 
+  close_display(display); 
+  printf("Bye!\n"); 
+  delete capdev;
+  return(0);
 }
\ No newline at end of file
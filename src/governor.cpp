@@ -0,0 +1,262 @@
+/**
+ * @file governor.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Adjusts detection and drawing settings to hold a frame rate or cpu budget
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+#include "../include/governor.h"
+#include "../include/logger.h"
+
+#define SLOW_FPS 0.95 // below this share of the target the frame rate is missed
+#define SLOW_WORK 0.9 // but only if the loop's own work is this much of the frame time
+#define ROOM_WORK 0.7 // room to spare below this share of the frame time
+#define ROOM_CORES 0.75 // and below this share of the core budget
+
+static const char *knob_names[NUM_KNOBS] = { "detect scale", "detect every", "subpix iterations", "overlay lod", "harris scale" };
+
+// each knob's ladder, step 0 is full quality
+#define MAX_STEPS 5
+static const int num_steps[NUM_KNOBS] = { 4, 5, 4, 4, 4 };
+static const double steps[NUM_KNOBS][MAX_STEPS] = {
+  { 1.0, 0.75, 0.5, 0.35 }, // times --detect-scale
+  { 1, 2, 3, 5, 8 },
+  { 30, 15, 8, 4 },
+  { 0, 1, 2, 3 },
+  { 1.0, 0.75, 0.5, 0.35 }
+};
+
+/**
+ * @brief Function to get the cpu time the process used so far, every thread together
+ *
+ * @return double seconds of user and system time
+ */
+static double process_cpu_seconds() {
+#ifdef _WIN32
+  FILETIME create, exit, kernel, user;
+  if(!GetProcessTimes(GetCurrentProcess(), &create, &exit, &kernel, &user)) {
+    return 0;
+  }
+  ULARGE_INTEGER k, u;
+  k.LowPart = kernel.dwLowDateTime;
+  k.HighPart = kernel.dwHighDateTime;
+  u.LowPart = user.dwLowDateTime;
+  u.HighPart = user.dwHighDateTime;
+  return (k.QuadPart + u.QuadPart) * 1e-7; // 100 ns units
+#else
+  struct rusage ru;
+  if(getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+  return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+/**
+ * @brief Function to get the time per frame spent in the stages a knob saves on
+ *
+ * @param knob governor_knob
+ * @param ms milliseconds per frame of every stage in the window
+ * @return double
+ */
+static double knob_cost(int knob, const double *ms) {
+  switch(knob) {
+    case KNOB_DET_SCALE:
+      return ms[STAGE_FIND] + ms[STAGE_SUBPIX] + ms[STAGE_MOTION];
+    case KNOB_DETECT_EVERY:
+      return ms[STAGE_FIND] + ms[STAGE_SUBPIX] + ms[STAGE_PNP];
+    case KNOB_SUBPIX:
+      return ms[STAGE_SUBPIX];
+    case KNOB_LOD:
+      return ms[STAGE_DRAW];
+    case KNOB_HARRIS_SCALE:
+      return ms[STAGE_HARRIS];
+  }
+  return 0;
+}
+
+/**
+ * @brief Function to set the loop's settings from the knob levels
+ *
+ * @param g governor
+ */
+static void apply_levels(compute_governor &g) {
+  g.det_scale = g.base_det_scale * (float) steps[KNOB_DET_SCALE][g.level[KNOB_DET_SCALE]];
+  g.detect_every = (int) steps[KNOB_DETECT_EVERY][g.level[KNOB_DETECT_EVERY]];
+  g.subpix_iters = (int) steps[KNOB_SUBPIX][g.level[KNOB_SUBPIX]];
+  g.lod = (int) steps[KNOB_LOD][g.level[KNOB_LOD]];
+  g.harris_scale = (float) steps[KNOB_HARRIS_SCALE][g.level[KNOB_HARRIS_SCALE]];
+}
+
+/**
+ * @brief Function to get the name of a knob
+ *
+ * @param knob governor_knob
+ * @return const char*
+ */
+const char *governor_knob_name(int knob) {
+  if(knob < 0 || knob >= NUM_KNOBS) {
+    return "unknown";
+  }
+  return knob_names[knob];
+}
+
+/**
+ * @brief Function to set up a governor with every knob at full quality
+ *
+ * @param target_fps frame rate to hold, 0 for none
+ * @param core_budget cores of cpu the process may use, 0 for none
+ * @param knobs bit (1 << governor_knob) for every knob the loop applies
+ * @param det_scale detection scale at full quality
+ * @param g governor to set up
+ * @return int return non-zero value if there is neither a target nor a budget
+ */
+int init_governor(double target_fps, double core_budget, unsigned knobs, float det_scale, compute_governor &g) {
+  if(target_fps < 0 || core_budget < 0 || (target_fps == 0 && core_budget == 0)) {
+    return(-1);
+  }
+
+  g.target_fps = target_fps;
+  g.core_budget = core_budget;
+  g.knobs = knobs;
+  g.base_det_scale = det_scale;
+  for(int k = 0; k < NUM_KNOBS; k++) {
+    g.level[k] = 0;
+  }
+  g.lowered.clear();
+  g.calm = 0;
+  g.window_start = prof_now();
+  g.cpu_start = process_cpu_seconds();
+  g.frames = 0;
+  prof_stage_sums(g.stage_start);
+  g.windows = 0;
+  g.changes = 0;
+  apply_levels(g);
+
+  return(0);
+}
+
+/**
+ * @brief Function to count a frame, and at the end of a window decide whether to change a knob
+ *
+ * Call once per frame after its stages were recorded.
+ *
+ * @param g governor
+ * @return true if a setting changed and the loop has to apply it
+ */
+bool governor_frame(compute_governor &g) {
+  g.frames++;
+  int64_t now = prof_now();
+  if(now - g.window_start < GOVERNOR_WINDOW_NS) {
+    return false;
+  }
+
+  // what the window cost, then start the next one
+  int64_t sums[NUM_STAGES];
+  prof_stage_sums(sums);
+  double cpu = process_cpu_seconds();
+  double secs = (now - g.window_start) * 1e-9;
+  double fps = g.frames / secs;
+  double cores = (cpu - g.cpu_start) / secs;
+  double ms[NUM_STAGES];
+  for(int s = 0; s < NUM_STAGES; s++) {
+    ms[s] = (sums[s] - g.stage_start[s]) * 1e-6 / g.frames;
+    g.stage_start[s] = sums[s];
+  }
+  g.window_start = now;
+  g.cpu_start = cpu;
+  g.frames = 0;
+  g.windows++;
+
+  // waiting on the camera is not work, lowering a knob would not get it back
+  double work = std::max(0.0, ms[STAGE_FRAME] - ms[STAGE_CAPTURE]);
+  double frame_ms = g.target_fps > 0 ? 1000.0 / g.target_fps : 0;
+  bool slow = g.target_fps > 0 && fps < SLOW_FPS * g.target_fps && work > SLOW_WORK * frame_ms;
+  bool hot = g.core_budget > 0 && cores > g.core_budget;
+  bool room = (g.target_fps <= 0 || work < ROOM_WORK * frame_ms) && (g.core_budget <= 0 || cores < ROOM_CORES * g.core_budget);
+
+  if(slow || hot) {
+    g.calm = 0;
+    // the knob saving the most, spread over the knobs already lowered
+    int best = -1;
+    double best_score = 0;
+    for(int k = 0; k < NUM_KNOBS; k++) {
+      if(!(g.knobs & (1u << k)) || g.level[k] + 1 >= num_steps[k]) {
+        continue;
+      }
+      double score = knob_cost(k, ms) / (1 + g.level[k]);
+      if(score > best_score) {
+        best = k;
+        best_score = score;
+      }
+    }
+    if(best < 0) {
+      log_event(LOG_INFO, "governor: %.1f fps, %.2f cores, %.1f ms work per frame, over %s with no knob left to lower",
+              fps, cores, work, slow ? "the frame rate target" : "the cpu budget");
+      return false;
+    }
+    double from = steps[best][g.level[best]];
+    g.level[best]++;
+    g.lowered.push_back(best);
+    g.changes++;
+    apply_levels(g);
+    log_event(LOG_INFO, "governor: %.1f fps, %.2f cores, %.1f ms work per frame, over %s; lowered %s %g -> %g (%.1f ms per frame in its stages)",
+            fps, cores, work, slow ? "the frame rate target" : "the cpu budget", knob_names[best], from,
+            steps[best][g.level[best]], knob_cost(best, ms));
+    return true;
+  }
+
+  if(!room) {
+    g.calm = 0;
+    log_event(LOG_INFO, "governor: %.1f fps, %.2f cores, %.1f ms work per frame, holding", fps, cores, work);
+    return false;
+  }
+
+  g.calm++;
+  if(g.calm < GOVERNOR_CALM_WINDOWS || g.lowered.empty()) {
+    log_event(LOG_INFO, "governor: %.1f fps, %.2f cores, %.1f ms work per frame, room to spare for %d windows",
+            fps, cores, work, g.calm);
+    return false;
+  }
+
+  // undo the newest compromise first
+  int k = g.lowered.back();
+  g.lowered.pop_back();
+  double from = steps[k][g.level[k]];
+  g.level[k]--;
+  g.calm = 0;
+  g.changes++;
+  apply_levels(g);
+  log_event(LOG_INFO, "governor: %.1f fps, %.2f cores, %.1f ms work per frame, room to spare for %d windows; raised %s %g -> %g",
+          fps, cores, work, GOVERNOR_CALM_WINDOWS, knob_names[k], from, steps[k][g.level[k]]);
+  return true;
+}
+
+/**
+ * @brief Function to print how often the governor changed a knob and where they ended
+ *
+ * @param g governor
+ * @param name loop name to print
+ * @return int
+ */
+int print_governor(const compute_governor &g, const char *name) {
+  printf("%s: governor made %ld changes over %ld windows, ended at", name, g.changes, g.windows);
+  bool first = true;
+  for(int k = 0; k < NUM_KNOBS; k++) {
+    if(g.knobs & (1u << k)) {
+      printf("%s %s %g", first ? "" : ",", knob_names[k], steps[k][g.level[k]]);
+      first = false;
+    }
+  }
+  printf("\n");
+
+  return(0);
+}
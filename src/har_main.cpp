@@ -1,80 +1,238 @@
-/**
- * @file ar_main.cpp
- * @author Nate Novak (novak.n@northeastern.edu)
- * @brief Main function for the Harris Corners portion of project 4
- * @date 2022-03-24
- */
-
-#include <cstdio>
-#include <cstring>
-#include <cstdlib>
-#include <dirent.h>
-#include <iostream>
-#include <fstream>
-#include <string>
-#include <opencv2/opencv.hpp>
-#include "../include/csv_util.h"
-#include "../include/ar.h"
-
-int main(int argc, char *argv[]) {
-  cv::VideoCapture *capdev;
-
-  // open the video device
-  capdev = new cv::VideoCapture(0);
-  if( !capdev->isOpened() ) {
-    printf("Unable to open video device\n");
-    return(-1);
-  }
-
-  // get some properties of the image
-  cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
-                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
-  printf("Expected size: %d %d\n", refS.width, refS.height);
-  
-  cv::namedWindow("Harris Corners", 1); 
-  cv::Mat frame;
-  cv::Mat dst; 
-  int counter = 0; 
-  for(;;) {
-    *capdev >> frame; // get a new frame from the camera, treat as a stream
-    if( frame.empty() ) {
-      printf("frame is empty\n");
-      break;
-    }  
-
-    frame.copyTo(dst);
-    // convert frame to gray
-    cv::Mat frame_gray; 
-    cv::cvtColor(frame, frame_gray, cv::COLOR_BGR2GRAY);
-    cv::Mat har_data = cv::Mat::zeros(frame.size(), CV_32FC1);
-
-    cv::cornerHarris(frame_gray, har_data, 2, 3, 0.04); // calculate harris corners
-    cv::Mat har_data_norm; 
-    cv::normalize(har_data, har_data_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1); // normalize the points
-
-    for( int i = 0; i < har_data_norm.rows ; i++ ) {
-      for( int j = 0; j < har_data_norm.cols; j++ ) {
-        if( (int) har_data_norm.at<float>(i,j) > 190) {
-          cv::circle( dst, cv::Point(j,i), 5, cv::Scalar(255, 0, 0), 2, 8, 0 ); // draw circles when over the threshold
-        }
-      }
-    }
-    
-    cv::imshow("Harris Corners", dst);
-
-    char keyEx = cv::waitKeyEx(10); 
-    if(keyEx == 'q') {
-      break; 
-    } else if (keyEx == 's') {
-      int id = -1; 
-      printf("Please enter the id for this image\n"); 
-      std::cin >> id; 
-      std::string path = "./imgs/image" + std::to_string(id) + ".png"; 
-      cv::imwrite(path, dst); 
-    }
-  }
-
-  printf("Bye!\n"); 
-  delete capdev;
-  return(0);
+/**
+ * @file ar_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for the Harris Corners portion of project 4
+ * @date 2022-03-24
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/ar.h"
+#include "../include/profiler.h"
+#include "../include/image_writer.h"
+#include "../include/video_recorder.h"
+#include "../include/frame_workspace.h"
+#include "../include/display.h"
+#include "../include/luma.h"
+#include "../include/logger.h"
+#include "../include/governor.h"
+
+int main(int argc, char *argv[]) {
+  cv::VideoCapture *capdev;
+
+  char prof_fn[256] = "profile.csv"; // stage timings, written on 'p' and at exit
+  char trace_fn[256] = ""; // with --trace every stage of every frame is written here at exit
+  bool headless = false; // --no-display runs as fast as the frames can be processed
+  bool bgr_capture = false; // --bgr-capture leaves the BGR conversion to the backend
+  std::string img_format = "png"; // snapshots are encoded on a background thread
+  int img_quality = -1; 
+  int burst_every = 10; // with burst on ('b') every burst_every-th frame is saved
+  char record_fn[256] = ""; // with --record the composited output is encoded on a background thread
+  double record_fps = 0; // 0 to use the camera frame rate
+  int record_policy = RECORD_DROP_NEWEST; 
+  int record_queue = 8; 
+  double target_fps = 0; // with --target-fps or --core-budget cornerHarris runs on a smaller frame when it has to
+  double core_budget = 0; 
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      strncpy(prof_fn, argv[++i], sizeof(prof_fn) - 1);
+    } else if(strcmp(argv[i], "--img-format") == 0 && i + 1 < argc) {
+      img_format = argv[++i];
+    } else if(strcmp(argv[i], "--img-quality") == 0 && i + 1 < argc) {
+      img_quality = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--burst") == 0 && i + 1 < argc) {
+      burst_every = std::max(1, atoi(argv[++i]));
+    } else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      strncpy(trace_fn, argv[++i], sizeof(trace_fn) - 1);
+      trace_start();
+    } else if(strcmp(argv[i], "--no-display") == 0) {
+      headless = true;
+    } else if(strcmp(argv[i], "--bgr-capture") == 0) {
+      bgr_capture = true;
+    } else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      strncpy(record_fn, argv[++i], sizeof(record_fn) - 1);
+    } else if(strcmp(argv[i], "--record-fps") == 0 && i + 1 < argc) {
+      record_fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--record-queue") == 0 && i + 1 < argc) {
+      record_queue = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--target-fps") == 0 && i + 1 < argc) {
+      target_fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--core-budget") == 0 && i + 1 < argc) {
+      core_budget = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--record-policy") == 0 && i + 1 < argc) {
+      record_policy = parse_record_policy(argv[++i]);
+      if(record_policy < 0) {
+        printf("Unknown record policy %s (drop, drop-oldest, queue)\n", argv[i]);
+        return(-1);
+      }
+    }
+  }
+
+  bool governing = target_fps > 0 || core_budget > 0; 
+  compute_governor gov; 
+  if(governing && init_governor(target_fps, core_budget, 1u << KNOB_HARRIS_SCALE, 1.0f, gov) != 0) {
+    printf("--target-fps and --core-budget must not be negative\n");
+    return(-1);
+  }
+  float harris_scale = 1.0f; 
+
+  // open the video device
+  capdev = new cv::VideoCapture(0);
+  if( !capdev->isOpened() ) {
+    printf("Unable to open video device\n");
+    return(-1);
+  }
+
+  // get some properties of the image
+  cv::Size refS( (int) capdev->get(cv::CAP_PROP_FRAME_WIDTH ),
+                  (int) capdev->get(cv::CAP_PROP_FRAME_HEIGHT));
+  printf("Expected size: %d %d\n", refS.width, refS.height);
+
+  // cornerHarris only needs the gray plane, take it from the camera's YUV frames when it can
+  int raw_format = bgr_capture ? RAW_BGR : open_luma_capture(capdev); 
+  luma_frame lf; 
+  
+  cv::Mat frame;
+  cv::Mat dst; 
+  image_writer snapshots; 
+  if(open_image_writer("./imgs/", "image", img_format, img_quality, 16, 2, snapshots) != 0) {
+    return(-1); 
+  }
+  bool bursting = false; 
+
+  video_recorder recorder; 
+  bool have_recorder = strlen(record_fn) > 0; 
+  if(have_recorder) {
+    double fps = record_fps > 0 ? record_fps : capdev->get(cv::CAP_PROP_FPS); 
+    if(open_video_recorder(record_fn, fps, record_policy, record_queue, recorder) != 0) {
+      return(-1); 
+    }
+  }
+  bool recording = have_recorder; 
+
+  // the window is shown and its events pumped on a thread of its own
+  frame_display display; 
+  open_display("Harris Corners", headless, display); 
+
+  frame_workspace ws; 
+  init_frame_workspace(ws); 
+
+  int counter = 0; 
+  for(;;) {
+    begin_frame(ws); 
+    int64_t frame_start = prof_now(); 
+    if(recording && raw_format == RAW_BGR && !frame.empty()) {
+      // the last frame now belongs to the encoder, capture into a buffer it is done with
+      frame = next_record_frame(recorder, frame.size(), frame.type()); 
+    }
+    *capdev >> frame; // get a new frame from the camera, treat as a stream
+    prof_record(STAGE_CAPTURE, prof_now() - frame_start); 
+    if( frame.empty() || load_luma_frame(frame, raw_format, lf) != 0 ) {
+      printf("frame is empty\n");
+      break;
+    }  
+
+    // the gray plane comes from the capture, BGR is only built when something shows, records or saves it
+    cv::Mat &frame_gray = lf.gray; 
+    if(!headless || recording || bursting) {
+      if(recording && !lf.have_bgr) {
+        lf.bgr = next_record_frame(recorder, frame_gray.size(), CV_8UC3); 
+      }
+      dst = luma_bgr(lf); // the circles are drawn on it in place, after the gray plane is taken
+    } else {
+      dst.release(); 
+    }
+    cv::Mat &har_data = ws.har_data; // every pixel is written by cornerHarris
+
+    int64_t t0 = prof_now(); 
+    const cv::Mat *har_src = &frame_gray; 
+    if(harris_scale < 1.0f) {
+      cv::resize(frame_gray, ws.har_small, cv::Size(), harris_scale, harris_scale, cv::INTER_AREA); 
+      har_src = &ws.har_small; 
+    }
+    cv::cornerHarris(*har_src, har_data, 2, 3, 0.04); // calculate harris corners
+    cv::Mat &har_data_norm = ws.har_norm; 
+    cv::normalize(har_data, har_data_norm, 0, 255, cv::NORM_MINMAX, CV_32FC1); // normalize the points
+    prof_record(STAGE_HARRIS, prof_now() - t0); 
+
+    t0 = prof_now(); 
+    for( int i = 0; i < har_data_norm.rows && !dst.empty(); i++ ) {
+      for( int j = 0; j < har_data_norm.cols; j++ ) {
+        if( (int) har_data_norm.at<float>(i,j) > 190) {
+          cv::circle( dst, cv::Point(cvRound(j / harris_scale), cvRound(i / harris_scale)), 5, cv::Scalar(255, 0, 0), 2, 8, 0 ); // draw circles when over the threshold
+        }
+      }
+    }
+    prof_record(STAGE_DRAW, prof_now() - t0); 
+    watch_frame_workspace(ws); 
+
+    if(bursting && counter % burst_every == 0) {
+      queue_image(snapshots, dst); 
+    }
+    counter++; 
+
+    if(recording) {
+      record_frame(recorder, dst); 
+    }
+    
+    t0 = prof_now(); 
+    show_frame(display, dst); 
+
+    char keyEx = poll_key(display); 
+    prof_record(STAGE_DISPLAY, prof_now() - t0); 
+    prof_record(STAGE_FRAME, prof_now() - frame_start); 
+    if(governing && governor_frame(gov)) {
+      harris_scale = gov.harris_scale; 
+    }
+    if(keyEx == 'q') {
+      break; 
+    } else if (keyEx == 'p') {
+      prof_print(); 
+      prof_dump_csv(prof_fn); 
+    } else if (keyEx == 's') {
+      std::string path; 
+      if(queue_image(snapshots, dst, &path) == 0) {
+        printf("Saving %s\n", path.c_str()); 
+      }
+    } else if (keyEx == 'b') {
+      bursting = !bursting; 
+      printf("Burst %s, every %d frames\n", bursting ? "on" : "off", burst_every); 
+    } else if (keyEx == 'r' && have_recorder) {
+      recording = !recording; 
+      if(!recording) {
+        // the encoder may still hold the last frame
+        frame.release(); 
+        lf.bgr.release(); 
+        dst.release(); 
+      }
+      printf("Recording %s\n", recording ? "resumed" : "paused"); 
+    }
+  }
+
+  if(governing) {
+    print_governor(gov, "har"); 
+  }
+  print_frame_allocs(ws, "har"); 
+  print_frame_copies(ws, "har"); 
+  close_image_writer(snapshots); 
+  if(have_recorder) {
+    close_video_recorder(recorder); 
+  }
+  prof_print(); 
+  prof_dump_csv(prof_fn); 
+  if(trace_enabled()) {
+    trace_dump_json(trace_fn); 
+  }
+
+  close_display(display); 
+  printf("Bye!\n"); 
+  delete capdev;
+  return(0);
 }
\ No newline at end of file
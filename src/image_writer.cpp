@@ -0,0 +1,198 @@
+/**
+ * @file image_writer.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Background image writer for snapshots and calibration images
+ * @date 2022-04-16
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <algorithm>
+#include "../include/image_writer.h"
+
+/**
+ * @brief Function to get the next free image number in a directory
+ *
+ * @param dir directory to look in
+ * @param prefix start of the file names
+ * @param ext file extension
+ * @return int one past the highest number in use, 0 if there are none
+ */
+static int next_free_id(const std::string &dir, const std::string &prefix, const std::string &ext) {
+  DIR *dirp = opendir(dir.c_str());
+  if(!dirp) {
+    return 0;
+  }
+
+  int next = 0;
+  struct dirent *dp;
+  while((dp = readdir(dirp)) != NULL) {
+    const char *name = dp->d_name;
+    if(strncmp(name, prefix.c_str(), prefix.size()) != 0) {
+      continue;
+    }
+    char *end;
+    long id = strtol(name + prefix.size(), &end, 10);
+    if(end != name + prefix.size() && strcmp(end, ext.c_str()) == 0) {
+      next = std::max(next, (int) id + 1);
+    }
+  }
+  closedir(dirp);
+
+  return next;
+}
+
+/**
+ * @brief Function run on each writer thread
+ *
+ * @param w writer the thread belongs to
+ */
+static void run_writer(image_writer *w) {
+  for(;;) {
+    image_job job;
+    {
+      std::unique_lock<std::mutex> guard(w->lock);
+      w->ready.wait(guard, [w] { return w->stopping || !w->jobs.empty(); });
+      if(w->jobs.empty()) {
+        return; // stopping and nothing left
+      }
+      job = w->jobs.front();
+      w->jobs.pop_front();
+      w->busy++;
+    }
+
+    bool ok = false;
+    try {
+      ok = cv::imwrite(job.path, job.img, w->params);
+    } catch(const cv::Exception &e) {
+      ok = false;
+    }
+    if(ok) {
+      w->written++;
+    } else {
+      w->failed++;
+      printf("Unable to write %s\n", job.path.c_str());
+    }
+
+    std::lock_guard<std::mutex> guard(w->lock);
+    w->busy--;
+    if(w->jobs.empty() && w->busy == 0) {
+      w->idle.notify_all();
+    }
+  }
+}
+
+/**
+ * @brief Function to start an image writer
+ *
+ * @param dir directory to write to
+ * @param prefix start of every file name, followed by the image number
+ * @param format "png" or "jpg"
+ * @param quality png compression 0-9 or jpg quality 0-100, -1 for the default (png 3, jpg 95)
+ * @param max_queue images waiting to be written, more are dropped
+ * @param nthreads writer threads
+ * @param w writer to start
+ * @return int return non-zero value on failure
+ */
+int open_image_writer(const std::string &dir, const std::string &prefix, const std::string &format, int quality, int max_queue, int nthreads, image_writer &w) {
+  w.dir = dir;
+  if(!w.dir.empty() && w.dir[w.dir.size() - 1] != '/') {
+    w.dir += "/";
+  }
+  w.prefix = prefix;
+  w.params.clear();
+
+  if(format == "png") {
+    w.ext = ".png";
+    w.params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+    w.params.push_back(quality >= 0 ? std::min(quality, 9) : 3); // 0 is fastest and largest, 9 smallest and slowest
+  } else if(format == "jpg" || format == "jpeg") {
+    w.ext = ".jpg";
+    w.params.push_back(cv::IMWRITE_JPEG_QUALITY);
+    w.params.push_back(quality >= 0 ? std::min(quality, 100) : 95);
+  } else {
+    printf("Unknown image format %s (png, jpg)\n", format.c_str());
+    return(-1);
+  }
+
+  w.max_queue = std::max(1, max_queue);
+  w.next_id = next_free_id(w.dir.empty() ? "." : w.dir, prefix, w.ext);
+  w.busy = 0;
+  w.stopping = false;
+  w.written = 0;
+  w.dropped = 0;
+  w.failed = 0;
+  for(int i = 0; i < std::max(1, nthreads); i++) {
+    w.threads.push_back(std::thread(run_writer, &w));
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to queue an image to be written, never blocks on encoding
+ *
+ * @param w open writer
+ * @param img image to write, copied
+ * @param path if not NULL, the file name it will be written to
+ * @return int return non-zero value if the queue was full and the image was dropped
+ */
+int queue_image(image_writer &w, const cv::Mat &img, std::string *path) {
+  image_job job;
+  {
+    // a dropped image costs nothing, the frame is only copied once it is accepted
+    std::lock_guard<std::mutex> guard(w.lock);
+    if(w.jobs.size() >= w.max_queue) {
+      w.dropped++;
+      return(-1);
+    }
+    job.path = w.dir + w.prefix + std::to_string(w.next_id++) + w.ext;
+  }
+  if(path) {
+    *path = job.path;
+  }
+
+  // copied outside the lock so the writer threads can keep taking jobs
+  job.img = img.clone(); // the caller keeps drawing into its frame
+  {
+    std::lock_guard<std::mutex> guard(w.lock);
+    w.jobs.push_back(job);
+  }
+  w.ready.notify_one();
+
+  return(0);
+}
+
+/**
+ * @brief Function to write everything still queued and stop the writer threads
+ *
+ * @param w writer to close
+ * @return int
+ */
+int close_image_writer(image_writer &w) {
+  {
+    std::unique_lock<std::mutex> guard(w.lock);
+    w.idle.wait(guard, [&w] { return w.jobs.empty() && w.busy == 0; });
+    w.stopping = true;
+  }
+  w.ready.notify_all();
+  for(int i = 0; i < w.threads.size(); i++) {
+    w.threads[i].join();
+  }
+  w.threads.clear();
+
+  if(w.written > 0 || w.dropped > 0 || w.failed > 0) {
+    printf("Wrote %ld images to %s", w.written.load(), w.dir.c_str());
+    if(w.dropped > 0) {
+      printf(", %ld dropped on a full queue", w.dropped.load());
+    }
+    if(w.failed > 0) {
+      printf(", %ld failed", w.failed.load());
+    }
+    printf("\n");
+  }
+
+  return(0);
+}
@@ -0,0 +1,160 @@
+/**
+ * @file latest_capture.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Camera reader that grabs and decodes continuously and hands out the newest frame
+ * @date 2022-04-18
+ */
+
+#include <cstdio>
+#include "../include/latest_capture.h"
+#include "../include/profiler.h"
+
+/**
+ * @brief Function to get the time a grabbed frame was captured
+ *
+ * V4L2 reports the buffer timestamp through CAP_PROP_POS_MSEC, on the same
+ * monotonic clock as prof_now. Anything that does not look like that clock,
+ * such as a file position or a backend that reports 0, falls back to when
+ * grab() returned.
+ *
+ * @param lc capture
+ * @param grab_ns time grab() returned
+ * @return int64_t capture time in ns
+ */
+static int64_t capture_time(latest_capture &lc, int64_t grab_ns) {
+  double ms = lc.cap->get(cv::CAP_PROP_POS_MSEC);
+  int64_t hw_ns = (int64_t) (ms * 1e6);
+  int64_t age = grab_ns - hw_ns;
+  if(hw_ns > 0 && age >= 0 && age < 1000000000LL) {
+    lc.hw_time = true;
+    return hw_ns;
+  }
+  return grab_ns;
+}
+
+/**
+ * @brief Function run on the grab thread
+ *
+ * @param lc capture the thread belongs to
+ */
+static void run_grab(latest_capture *lc) {
+  for(;;) {
+    bool decode = true;
+    {
+      std::lock_guard<std::mutex> guard(lc->lock);
+      if(lc->stopping) {
+        break;
+      }
+    }
+
+    bool ok = lc->cap->grab();
+    int64_t t = capture_time(*lc, prof_now());
+    if(ok) {
+      lc->grabbed++;
+      if(lc->lazy) {
+        std::lock_guard<std::mutex> guard(lc->lock);
+        decode = lc->want;
+      }
+      if(!decode) {
+        continue; // nobody is waiting, skip it without decoding
+      }
+      // decoded outside the lock, the loop can take the previous frame meanwhile
+      ok = lc->cap->retrieve(lc->back) && !lc->back.empty();
+    }
+
+    std::lock_guard<std::mutex> guard(lc->lock);
+    if(!ok) {
+      lc->failed = true;
+      lc->ready.notify_all();
+      break;
+    }
+    lc->retrieved++;
+    cv::swap(lc->slot, lc->back); // an untaken older frame goes to the back and is decoded over
+    lc->slot_time = t;
+    lc->want = false;
+    lc->fresh = true;
+    lc->ready.notify_all();
+  }
+}
+
+/**
+ * @brief Function to shrink the driver queue and start grabbing
+ *
+ * @param cap open camera, read only through the latest_capture until it is closed
+ * @param lc capture to start
+ * @param lazy only decode frames grabbed after the loop asks for one
+ * @return int return non-zero value on failure
+ */
+int open_latest_capture(cv::VideoCapture *cap, latest_capture &lc, bool lazy) {
+  if(!cap || !cap->isOpened()) {
+    return(-1);
+  }
+
+  lc.cap = cap;
+  lc.lazy = lazy;
+  lc.want = false;
+  lc.fresh = false;
+  lc.failed = false;
+  lc.stopping = false;
+  lc.slot_time = 0;
+  lc.hw_time = false;
+  lc.grabbed = 0;
+  lc.retrieved = 0;
+  lc.taken = 0;
+
+  // the grab thread keeps the queue empty anyway, a short one just saves memory and a stale frame at start up
+  if(!cap->set(cv::CAP_PROP_BUFFERSIZE, 1)) {
+    printf("Camera does not support CAP_PROP_BUFFERSIZE, using the driver's queue length\n");
+  }
+  lc.thread = std::thread(run_grab, &lc);
+
+  return(0);
+}
+
+/**
+ * @brief Function to get the newest frame not taken yet, waits at most one frame interval
+ *
+ * The frame's buffer is swapped with the one passed in, which is decoded
+ * into later on, so nothing is copied or allocated once sizes settle.
+ *
+ * @param lc open capture
+ * @param frame frame to write to
+ * @param time_ns capture time of the frame, ns on the prof_now clock
+ * @return int return non-zero value when the camera has stopped
+ */
+int read_latest(latest_capture &lc, cv::Mat &frame, int64_t &time_ns) {
+  std::unique_lock<std::mutex> guard(lc.lock);
+  lc.want = true;
+  lc.ready.wait(guard, [&lc] { return lc.fresh || lc.failed; });
+  if(!lc.fresh) {
+    return(-1);
+  }
+
+  cv::swap(frame, lc.slot);
+  time_ns = lc.slot_time;
+  lc.fresh = false;
+  lc.taken++;
+
+  return(0);
+}
+
+/**
+ * @brief Function to stop grabbing and print how many frames were skipped
+ *
+ * @param lc capture to close
+ * @return int
+ */
+int close_latest_capture(latest_capture &lc) {
+  {
+    std::lock_guard<std::mutex> guard(lc.lock);
+    lc.stopping = true;
+  }
+  if(lc.thread.joinable()) {
+    lc.thread.join(); // returns after the grab in progress
+  }
+
+  printf("Grabbed %ld frames, decoded %ld, used %ld (%s timestamps)\n", lc.grabbed.load(), lc.retrieved.load(),
+         lc.taken.load(), lc.hw_time ? "driver" : "grab");
+
+  return(0);
+}
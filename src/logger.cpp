@@ -0,0 +1,295 @@
+/**
+ * @file logger.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Asynchronous logger that keeps console I/O off the frame loop
+ * @date 2022-04-13
+ */
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "../include/logger.h"
+
+#define LOG_QUEUE_LEN 1024 // records, must be a power of two
+
+// one queued message, fixed size so queueing never allocates
+struct log_record {
+  double time; // seconds since log_start
+  long frame;
+  int level;
+  char msg[LOG_MSG_LEN];
+};
+
+static const char level_chars[LOG_OFF] = { 'D', 'I', 'W', 'E' };
+static const char *level_names[LOG_OFF + 1] = { "debug", "info", "warn", "error", "off" };
+
+static std::atomic<int> log_threshold(LOG_INFO);
+static std::atomic<bool> log_running(false);
+static std::atomic<long> cur_frame(-1);
+static std::atomic<int> frame_count(0); // messages so far this frame
+static std::atomic<long> suppressed(0); // over the per-frame limit
+static std::atomic<long> dropped(0); // queue was full
+static int frame_limit = 8;
+static std::chrono::steady_clock::time_point log_epoch;
+
+static std::mutex queue_lock;
+static std::condition_variable queue_ready;
+static std::vector<log_record> queue(LOG_QUEUE_LEN);
+static unsigned long head = 0; // next record to write out
+static unsigned long tail = 0; // next free record
+static bool stopping = false;
+static FILE *log_fp = NULL;
+static std::thread writer;
+
+// stops the writer on exit paths that never called log_stop, a running
+// std::thread would otherwise abort the program when it is destroyed
+static struct log_guard {
+  ~log_guard() { log_stop(); }
+} stop_at_exit;
+
+/**
+ * @brief Function to get a log level from its name
+ *
+ * @param name "debug", "info", "warn", "error" or "off"
+ * @return int log_level, -1 if the name is unknown
+ */
+int parse_log_level(const char *name) {
+  for(int i = 0; i <= LOG_OFF; i++) {
+    if(strcmp(name, level_names[i]) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Function to write one record
+ *
+ * @param fp file to write to
+ * @param rec record to write
+ */
+static void write_record(FILE *fp, const log_record &rec) {
+  if(rec.frame >= 0) {
+    fprintf(fp, "[%9.3f] %c frame %ld: %s\n", rec.time, level_chars[rec.level], rec.frame, rec.msg);
+  } else {
+    fprintf(fp, "[%9.3f] %c %s\n", rec.time, level_chars[rec.level], rec.msg);
+  }
+}
+
+/**
+ * @brief Function run on the writer thread, writes queued records in batches
+ */
+static void writer_loop() {
+  std::vector<log_record> batch;
+  batch.reserve(LOG_QUEUE_LEN);
+  long reported_suppressed = 0;
+  long reported_dropped = 0;
+
+  for(;;) {
+    bool done = false;
+    {
+      std::unique_lock<std::mutex> guard(queue_lock);
+      // no wakeup per message, the hot path would pay for it
+      queue_ready.wait_for(guard, std::chrono::milliseconds(50), [] { return stopping || tail - head >= LOG_QUEUE_LEN / 2; });
+      for(; head != tail; head++) {
+        batch.push_back(queue[head & (LOG_QUEUE_LEN - 1)]);
+      }
+      done = stopping;
+    }
+
+    for(int i = 0; i < batch.size(); i++) {
+      write_record(log_fp, batch[i]);
+    }
+
+    long s = suppressed.load();
+    long d = dropped.load();
+    if(s != reported_suppressed || d != reported_dropped) {
+      fprintf(log_fp, "[log] %ld messages over the per-frame limit, %ld dropped on a full queue\n", s - reported_suppressed,
+              d - reported_dropped);
+      reported_suppressed = s;
+      reported_dropped = d;
+    }
+    if(!batch.empty()) {
+      fflush(log_fp);
+    }
+    batch.clear();
+
+    if(done) {
+      break;
+    }
+  }
+}
+
+/**
+ * @brief Function to start the background writer
+ *
+ * Until this is called log_msg writes straight to stdout.
+ *
+ * @param level messages below this level are dropped before they are queued
+ * @param filename file to append to, NULL for stdout
+ * @param max_per_frame messages kept per frame, the rest of the frame's messages are counted and dropped
+ * @return int return non-zero value on failure
+ */
+int log_start(int level, const char *filename, int max_per_frame) {
+  if(log_running) {
+    return(-1);
+  }
+
+  log_fp = stdout;
+  if(filename && strlen(filename) > 0) {
+    log_fp = fopen(filename, "a");
+    if(!log_fp) {
+      printf("Unable to open log file %s\n", filename);
+      log_fp = stdout;
+      return(-1);
+    }
+  }
+
+  log_threshold = level;
+  frame_limit = max_per_frame;
+  log_epoch = std::chrono::steady_clock::now();
+  stopping = false;
+  writer = std::thread(writer_loop);
+  log_running = true;
+
+  return(0);
+}
+
+/**
+ * @brief Function to write everything still queued and stop the writer
+ *
+ * @return int
+ */
+int log_stop() {
+  if(!log_running) {
+    return(0);
+  }
+  log_running = false;
+
+  {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    stopping = true;
+  }
+  queue_ready.notify_one();
+  writer.join();
+
+  if(log_fp != stdout) {
+    fclose(log_fp);
+  }
+  log_fp = NULL;
+
+  return(0);
+}
+
+/**
+ * @brief Function to check whether a message of this level would be kept
+ *
+ * Lets a caller skip building a message nobody will see.
+ *
+ * @param level log_level
+ * @return true if log_msg would queue it
+ */
+bool log_enabled(int level) {
+  return level >= log_threshold.load(std::memory_order_relaxed) && level < LOG_OFF;
+}
+
+/**
+ * @brief Function to mark the start of a new frame for rate limiting and the log prefix
+ *
+ * @param frame frame number
+ */
+void log_frame(long frame) {
+  cur_frame.store(frame, std::memory_order_relaxed);
+  frame_count.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Function to format and queue a message
+ *
+ * @param level log_level
+ * @param capped whether the message counts against the per-frame cap
+ * @param fmt printf format
+ * @param args format arguments
+ */
+static void log_vmsg(int level, bool capped, const char *fmt, va_list args) {
+  if(!log_running) {
+    vprintf(fmt, args);
+    printf("\n");
+    return;
+  }
+
+  long frame = cur_frame.load(std::memory_order_relaxed);
+  // errors always get through, everything else is capped per frame
+  if(capped && frame >= 0 && level < LOG_ERROR && frame_count.fetch_add(1, std::memory_order_relaxed) >= frame_limit) {
+    suppressed++;
+    return;
+  }
+
+  log_record rec;
+  rec.time = std::chrono::duration<double>(std::chrono::steady_clock::now() - log_epoch).count();
+  rec.frame = frame;
+  rec.level = level;
+  vsnprintf(rec.msg, sizeof(rec.msg), fmt, args);
+
+  bool wake = false;
+  {
+    std::lock_guard<std::mutex> guard(queue_lock);
+    if(tail - head >= LOG_QUEUE_LEN) {
+      dropped++;
+      return;
+    }
+    queue[tail & (LOG_QUEUE_LEN - 1)] = rec;
+    tail++;
+    wake = tail - head == LOG_QUEUE_LEN / 2;
+  }
+  if(wake) {
+    queue_ready.notify_one();
+  }
+}
+
+/**
+ * @brief Function to log a message
+ *
+ * The message is formatted into a fixed-size record and queued, the writer
+ * thread does the actual I/O. If the queue is full the message is dropped and
+ * counted rather than blocking the caller.
+ *
+ * @param level log_level
+ * @param fmt printf format
+ */
+void log_msg(int level, const char *fmt, ...) {
+  if(!log_enabled(level)) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, fmt);
+  log_vmsg(level, true, fmt, args);
+  va_end(args);
+}
+
+/**
+ * @brief Function to log a message that is not counted against the per-frame cap
+ *
+ * For rare decisions that must never be lost to a frame's chatter, like the
+ * governor's once a window. The queue being full still drops it.
+ *
+ * @param level log_level
+ * @param fmt printf format
+ */
+void log_event(int level, const char *fmt, ...) {
+  if(!log_enabled(level)) {
+    return;
+  }
+
+  va_list args;
+  va_start(args, fmt);
+  log_vmsg(level, false, fmt, args);
+  va_end(args);
+}
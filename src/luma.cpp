@@ -0,0 +1,157 @@
+/**
+ * @file luma.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Gray plane straight from the capture buffer, BGR only on demand
+ * @date 2022-04-19
+ */
+
+#include <cstdio>
+#include "../include/luma.h"
+#include "../include/profiler.h"
+
+static const char *format_names[] = { "BGR", "GREY", "YUYV", "UYVY", "NV12", "NV21", "I420", "YV12" };
+
+/**
+ * @brief Function to map a V4L2 fourcc to a raw format
+ *
+ * @param fourcc CAP_PROP_FOURCC of the camera
+ * @return int raw_format, -1 if the format is compressed or unknown
+ */
+static int fourcc_format(int fourcc) {
+  if(fourcc == cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V') || fourcc == cv::VideoWriter::fourcc('Y', 'U', 'Y', '2')) {
+    return RAW_YUYV;
+  } else if(fourcc == cv::VideoWriter::fourcc('U', 'Y', 'V', 'Y')) {
+    return RAW_UYVY;
+  } else if(fourcc == cv::VideoWriter::fourcc('N', 'V', '1', '2')) {
+    return RAW_NV12;
+  } else if(fourcc == cv::VideoWriter::fourcc('N', 'V', '2', '1')) {
+    return RAW_NV21;
+  } else if(fourcc == cv::VideoWriter::fourcc('Y', 'U', '1', '2') || fourcc == cv::VideoWriter::fourcc('I', '4', '2', '0')) {
+    return RAW_I420;
+  } else if(fourcc == cv::VideoWriter::fourcc('Y', 'V', '1', '2')) {
+    return RAW_YV12;
+  } else if(fourcc == cv::VideoWriter::fourcc('G', 'R', 'E', 'Y') || fourcc == cv::VideoWriter::fourcc('Y', '8', '0', '0')) {
+    return RAW_GRAY;
+  }
+  return(-1);
+}
+
+/**
+ * @brief Function to ask the camera for frames without the BGR conversion
+ *
+ * Sets CAP_PROP_CONVERT_RGB to false and checks the pixel format it gets.
+ * Compressed formats such as MJPG would need decoding anyway, so the conversion
+ * is switched back on for those.
+ *
+ * @param cap open camera
+ * @return int raw_format the frames will arrive in
+ */
+int open_luma_capture(cv::VideoCapture *cap) {
+  int format = fourcc_format((int) cap->get(cv::CAP_PROP_FOURCC));
+  if(format < 0 || !cap->set(cv::CAP_PROP_CONVERT_RGB, 0)) {
+    cap->set(cv::CAP_PROP_CONVERT_RGB, 1);
+    printf("Camera frames are converted to BGR by the backend\n");
+    return RAW_BGR;
+  }
+
+  printf("Camera frames arrive as %s, the gray plane is taken straight from them\n", format_names[format]);
+  return format;
+}
+
+/**
+ * @brief Function to get the name of a raw format
+ *
+ * @param format raw_format
+ * @return const char*
+ */
+const char *raw_format_name(int format) {
+  if(format < RAW_BGR || format > RAW_YV12) {
+    return "unknown";
+  }
+  return format_names[format];
+}
+
+/**
+ * @brief Function to take a captured frame and produce its gray plane
+ *
+ * The gray plane is made once per frame here, everything that needs intensity
+ * shares it. Frames that do not match format, for example a BGR frame from a
+ * backend that ignored CAP_PROP_CONVERT_RGB, are treated as what they are.
+ *
+ * @param raw captured frame
+ * @param format raw_format from open_luma_capture
+ * @param lf frame to write to, its buffers are reused
+ * @return int return non-zero value on failure
+ */
+int load_luma_frame(const cv::Mat &raw, int format, luma_frame &lf) {
+  if(raw.empty()) {
+    return(-1);
+  }
+
+  // trust the frame over the format it was supposed to have
+  if(raw.type() == CV_8UC3) {
+    format = RAW_BGR;
+  } else if(raw.type() == CV_8UC2) {
+    format = format == RAW_UYVY ? RAW_UYVY : RAW_YUYV;
+  } else if(raw.type() != CV_8UC1) {
+    return(-1);
+  } else if(format == RAW_BGR || format == RAW_YUYV || format == RAW_UYVY) {
+    format = RAW_GRAY;
+  }
+
+  if(lf.bgr.data == lf.raw.data) {
+    lf.bgr.release(); // it was the last raw frame, do not convert into the capture buffer
+  }
+  lf.raw = raw;
+  lf.format = format;
+  lf.have_bgr = false;
+
+  PROF_SCOPE(STAGE_GRAY);
+  if(format == RAW_BGR) {
+    cv::cvtColor(raw, lf.gray, cv::COLOR_BGR2GRAY);
+    lf.bgr = raw;
+    lf.have_bgr = true;
+  } else if(format == RAW_YUYV || format == RAW_UYVY) {
+    cv::extractChannel(raw, lf.gray, format == RAW_YUYV ? 0 : 1); // Y is every other byte
+  } else if(format == RAW_GRAY) {
+    lf.gray = raw;
+  } else {
+    lf.gray = raw.rowRange(0, raw.rows * 2 / 3); // the planar formats start with the whole Y plane, no copy
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to get the frame in BGR, converting it the first time it is asked for
+ *
+ * The conversion writes into lf.bgr, so a caller that needs a particular
+ * buffer (for example one from next_record_frame) can put it there first.
+ *
+ * @param lf loaded frame
+ * @return cv::Mat& the BGR frame
+ */
+cv::Mat &luma_bgr(luma_frame &lf) {
+  if(lf.have_bgr) {
+    return lf.bgr;
+  }
+
+  int code = cv::COLOR_GRAY2BGR;
+  if(lf.format == RAW_YUYV) {
+    code = cv::COLOR_YUV2BGR_YUYV;
+  } else if(lf.format == RAW_UYVY) {
+    code = cv::COLOR_YUV2BGR_UYVY;
+  } else if(lf.format == RAW_NV12) {
+    code = cv::COLOR_YUV2BGR_NV12;
+  } else if(lf.format == RAW_NV21) {
+    code = cv::COLOR_YUV2BGR_NV21;
+  } else if(lf.format == RAW_I420) {
+    code = cv::COLOR_YUV2BGR_I420;
+  } else if(lf.format == RAW_YV12) {
+    code = cv::COLOR_YUV2BGR_YV12;
+  }
+  cv::cvtColor(lf.raw, lf.bgr, code);
+  lf.have_bgr = true;
+
+  return lf.bgr;
+}
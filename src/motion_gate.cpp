@@ -0,0 +1,156 @@
+/**
+ * @file motion_gate.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Block SAD change detector that lets static frames skip detection
+ * @date 2022-04-19
+ */
+
+#include <cstdio>
+#include <algorithm>
+#include "../include/frame_workspace.h"
+#include "../include/motion_gate.h"
+#include "../include/profiler.h"
+#include <opencv2/core/hal/intrin.hpp>
+
+/**
+ * @brief Function to get the sum of absolute differences of two rows
+ *
+ * @param a first row
+ * @param b second row
+ * @param n number of pixels
+ * @return unsigned
+ */
+static unsigned row_sad(const uchar *a, const uchar *b, int n) {
+  unsigned sad = 0;
+  int i = 0;
+#if CV_SIMD128
+  for(; i + 16 <= n; i += 16) {
+    sad += cv::v_reduce_sad(cv::v_load(a + i), cv::v_load(b + i));
+  }
+#endif
+  for(; i < n; i++) {
+    sad += std::abs(a[i] - b[i]);
+  }
+  return sad;
+}
+
+/**
+ * @brief Function to check whether any block overlapping roi moved
+ *
+ * @param cur downsampled frame
+ * @param ref downsampled reference frame, same size
+ * @param roi area to check in downsampled pixels
+ * @param threshold mean absolute difference per pixel for a block to count as moved
+ * @return true at the first block that moved
+ */
+static bool blocks_moved(const cv::Mat &cur, const cv::Mat &ref, const cv::Rect &roi, int threshold) {
+  int bx0 = roi.x / MOTION_BLOCK;
+  int by0 = roi.y / MOTION_BLOCK;
+  int bx1 = (roi.x + roi.width - 1) / MOTION_BLOCK;
+  int by1 = (roi.y + roi.height - 1) / MOTION_BLOCK;
+
+  for(int by = by0; by <= by1; by++) {
+    int y0 = by * MOTION_BLOCK;
+    int y1 = std::min(y0 + MOTION_BLOCK, cur.rows);
+    for(int bx = bx0; bx <= bx1; bx++) {
+      int x0 = bx * MOTION_BLOCK;
+      int w = std::min(MOTION_BLOCK, cur.cols - x0);
+      unsigned sad = 0;
+      for(int y = y0; y < y1; y++) {
+        sad += row_sad(cur.ptr<uchar>(y) + x0, ref.ptr<uchar>(y) + x0, w);
+      }
+      if(sad > (unsigned) (threshold * w * (y1 - y0))) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Function to set up a motion gate
+ *
+ * @param scale downsample factor before comparing, at least 1
+ * @param threshold mean absolute difference per pixel for a block to count as moved
+ * @param max_reuse most frames in a row to reuse a result for
+ * @param g gate to set up
+ * @return int return non-zero value on failure
+ */
+int init_motion_gate(int scale, int threshold, int max_reuse, motion_gate &g) {
+  if(scale < 1 || threshold < 0 || max_reuse < 0) {
+    return(-1);
+  }
+
+  g.scale = scale;
+  g.threshold = threshold;
+  g.max_reuse = max_reuse;
+  g.small.release();
+  g.ref.release();
+  g.reused = 0;
+  g.frames = 0;
+  g.gated = 0;
+
+  return(0);
+}
+
+/**
+ * @brief Function to decide whether the last detection can be reused for this frame
+ *
+ * Only the blocks overlapping roi are compared, and the comparison stops at
+ * the first one that moved. When the answer is no the caller is expected to
+ * detect on this frame, and it becomes the new reference.
+ *
+ * @param g gate
+ * @param gray gray frame the detection runs on
+ * @param roi area the last result depends on in gray's pixels, empty for the whole frame
+ * @return true if nothing in roi moved since the last detection
+ */
+bool motion_reuse(motion_gate &g, const cv::Mat &gray, const cv::Rect &roi) {
+  PROF_SCOPE(STAGE_MOTION);
+  g.frames++;
+
+  cv::Size small_size(std::max(1, gray.cols / g.scale), std::max(1, gray.rows / g.scale));
+  if(g.scale > 1) {
+    ALLOC_EXEMPT(EXEMPT_IMGPROC);
+    cv::resize(gray, g.small, small_size, 0, 0, cv::INTER_AREA);
+  } else {
+    gray.copyTo(g.small);
+  }
+
+  bool reuse = false;
+  if(g.ref.size() == g.small.size() && g.reused < g.max_reuse) {
+    cv::Rect area(0, 0, small_size.width, small_size.height);
+    if(roi.area() > 0) {
+      // a board is only affected by motion on or next to it
+      cv::Rect scaled(roi.x / g.scale - 1, roi.y / g.scale - 1, roi.width / g.scale + 3, roi.height / g.scale + 3);
+      area &= scaled;
+    }
+    reuse = area.area() == 0 || !blocks_moved(g.small, g.ref, area, g.threshold);
+  }
+
+  if(reuse) {
+    g.reused++;
+    g.gated++;
+  } else {
+    cv::swap(g.small, g.ref); // this frame gets detected on, compare against it from now on
+    g.reused = 0;
+  }
+
+  return reuse;
+}
+
+/**
+ * @brief Function to print how many detections the gate saved
+ *
+ * @param g gate
+ * @param name loop name to print
+ * @return int
+ */
+int print_motion_gate(const motion_gate &g, const char *name) {
+  if(g.frames == 0) {
+    return 0;
+  }
+  printf("%s: motion gate reused the last detection on %ld of %ld frames (%.1f%%)\n", name, g.gated, g.frames,
+         100.0 * g.gated / g.frames);
+  return 0;
+}
@@ -0,0 +1,170 @@
+/**
+ * @file multi_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for running AR on several cameras at once
+ * @date 2022-04-05
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <dirent.h>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/ar.h"
+#include "../include/session.h"
+#include "../include/profiler.h"
+#include "../include/pose_log.h"
+
+int main(int argc, char *argv[]) {
+  char cal_fn[256] = "calibration.csv";
+  int nthreads = 0;
+  int overlay = OVERLAY_AXES;
+  bool display = true;
+  char prof_fn[256] = "profile.csv"; // stage timings over every session, written on 'p' and at exit
+  char trace_fn[256] = ""; // with --trace every stage of every frame is written here at exit
+  char pose_fn[256] = ""; // with --pose-log every pose of every camera is recorded here
+  long pose_capacity = 1 << 20;
+  std::vector<std::string> specs;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--calibration") == 0 && i + 1 < argc) {
+      strncpy(cal_fn, argv[++i], sizeof(cal_fn) - 1);
+    } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      nthreads = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--overlay") == 0 && i + 1 < argc) {
+      i++;
+      if(strcmp(argv[i], "house") == 0) {
+        overlay = OVERLAY_HOUSE;
+      } else if(strcmp(argv[i], "obj") == 0) {
+        overlay = OVERLAY_OBJ;
+      }
+    } else if(strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+      strncpy(prof_fn, argv[++i], sizeof(prof_fn) - 1);
+    } else if(strcmp(argv[i], "--pose-log") == 0 && i + 1 < argc) {
+      strncpy(pose_fn, argv[++i], sizeof(pose_fn) - 1);
+    } else if(strcmp(argv[i], "--pose-log-capacity") == 0 && i + 1 < argc) {
+      pose_capacity = atol(argv[++i]);
+    } else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      strncpy(trace_fn, argv[++i], sizeof(trace_fn) - 1);
+      trace_start();
+    } else if(strcmp(argv[i], "--no-display") == 0) {
+      display = false;
+    } else {
+      specs.push_back(argv[i]);
+    }
+  }
+
+  if(specs.empty()) {
+    printf("usage: %s [--calibration file] [--threads n] [--overlay axes|house|obj] [--no-display] [--profile file] [--trace file.json] [--pose-log file.bin] source[@camera_id] ...\n", argv[0]);
+    printf("  source is a camera index, a video file or a directory of images\n");
+    return(-1);
+  }
+
+  ar_model model;
+  model.patternsize = cv::Size(9, 6);
+  if(overlay == OVERLAY_OBJ && read_vo_data_obj("shuttle.obj", model.objpoints, model.connections) != 0) {
+    return(-1);
+  }
+
+  // every session already runs in parallel on the pool, opencv's own threads
+  // on top of that would only fight it for the same cores
+  cv::setNumThreads(1);
+  thread_pool pool(nthreads);
+  printf("%d sessions on %d threads\n", (int) specs.size(), pool.size());
+
+  std::vector<ar_session *> sessions;
+  for(int i = 0; i < specs.size(); i++) {
+    ar_session *s = new ar_session();
+    if(open_session(i, specs[i], cal_fn, &model, overlay, *s) != 0) {
+      printf("Unable to open session %s\n", specs[i].c_str());
+      delete s;
+      continue;
+    }
+    sessions.push_back(s);
+  }
+  if(sessions.empty()) {
+    return(-1);
+  }
+
+  pose_log poses;
+  bool record_poses = strlen(pose_fn) > 0;
+  if(record_poses) {
+    if(open_pose_log(pose_fn, pose_capacity, poses) != 0) {
+      return(-1);
+    }
+    for(int i = 0; i < sessions.size(); i++) {
+      sessions[i]->poses = &poses;
+    }
+  }
+
+  for(int i = 0; i < sessions.size(); i++) {
+    start_session(pool, *sessions[i]);
+  }
+
+  frame_time last_report = std::chrono::steady_clock::now();
+  for(;;) {
+    bool all_done = true;
+    for(int i = 0; i < sessions.size(); i++) {
+      ar_session &s = *sessions[i];
+      cv::Mat out;
+      {
+        std::lock_guard<std::mutex> guard(s.lock);
+        all_done = all_done && s.done && !s.busy;
+        if(display && s.out_new) {
+          out = s.out;
+          s.out_new = false;
+        }
+      }
+      if(!out.empty()) {
+        PROF_SCOPE(STAGE_DISPLAY);
+        cv::imshow("cam " + std::to_string(s.id), out);
+      }
+    }
+    if(all_done) {
+      break;
+    }
+
+    if(display) {
+      char keyEx = cv::waitKeyEx(10);
+      if(keyEx == 'q') {
+        break;
+      } else if(keyEx == 'p') {
+        prof_print();
+        prof_dump_csv(prof_fn);
+      }
+    } else {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    frame_time now = std::chrono::steady_clock::now();
+    if(now - last_report >= std::chrono::seconds(2)) {
+      print_session_stats(sessions);
+      last_report = now;
+    }
+  }
+
+  for(int i = 0; i < sessions.size(); i++) {
+    stop_session(*sessions[i]);
+  }
+  pool.wait_idle();
+  if(record_poses) {
+    close_pose_log(poses);
+  }
+  print_session_stats(sessions);
+  prof_print();
+  prof_dump_csv(prof_fn);
+  if(trace_enabled()) {
+    trace_dump_json(trace_fn);
+  }
+
+  for(int i = 0; i < sessions.size(); i++) {
+    delete sessions[i];
+  }
+
+  printf("Bye!\n");
+  return(0);
+}
@@ -0,0 +1,141 @@
+/**
+ * @file offline.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Frame-parallel processing of a recording, split into segments with a warm-up overlap
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "../include/frame_source.h"
+#include "../include/profiler.h"
+#include "../include/offline.h"
+
+/**
+ * @brief Function to split a recording into segments
+ *
+ * @param total frames in the recording
+ * @param segment frames per segment
+ * @param warmup frames processed before each segment's first, and not kept
+ * @param job job to write the segments to, source and settings are set by the caller
+ * @return int return non-zero value on failure
+ */
+int plan_offline_job(long total, long segment, int warmup, offline_job &job) {
+  if(total <= 0 || segment <= 0 || warmup < 0) {
+    return(-1);
+  }
+
+  job.total = total;
+  job.warmup = warmup;
+  job.segments.clear();
+  for(long first = 0; first < total; first += segment) {
+    offline_segment s;
+    s.first = first;
+    s.end = std::min(total, first + segment);
+    s.warmup_first = std::max(0L, first - warmup);
+    s.done_end = first;
+    s.done = false;
+    s.failed = false;
+    s.secs = 0;
+    job.segments.push_back(s);
+  }
+  job.results.assign(total, pipeline_result());
+  job.frames_done = 0;
+  job.warmup_frames = 0;
+
+  return(0);
+}
+
+/**
+ * @brief Function to run one segment, on a pool worker
+ *
+ * @param job job
+ * @param idx index of the segment
+ */
+static void run_offline_segment(offline_job &job, int idx) {
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  offline_segment &s = job.segments[idx];
+  long k = s.warmup_first;
+  bool failed = false;
+
+  // every segment reads and tracks on its own, nothing is shared with the others while it runs
+  frame_source src;
+  frame_pipeline pipe;
+  if(open_frame_source(job.source, src) != 0 || seek_frame_source(src, s.warmup_first) != 0 ||
+     open_frame_pipeline(job.set, job.calib, job.model, pipe) != 0) {
+    printf("Segment at frame %ld could not start\n", s.first);
+    failed = true;
+  }
+
+  cv::Mat frame;
+  pipeline_result warm;
+  for(; !failed && k < s.end; k++) {
+    int64_t t0 = prof_now();
+    if(read_frame_source(src, frame) != 0) {
+      break; // the source was shorter than it said
+    }
+    prof_record(STAGE_CAPTURE, prof_now() - t0);
+
+    int64_t time_ns = (int64_t) (k * 1e9 / job.fps);
+    if(k < s.first) {
+      replay_frame(pipe, frame, time_ns, warm, false);
+      job.warmup_frames++;
+      continue;
+    }
+
+    bool draw = !job.img_dir.empty();
+    if(replay_frame(pipe, frame, time_ns, job.results[k], draw) != 0) {
+      failed = true;
+      break;
+    }
+    if(draw) {
+      char name[64];
+      snprintf(name, sizeof(name), "/frame%06ld.", k);
+      std::string path = job.img_dir + name + job.img_format;
+      if(!cv::imwrite(path, frame)) {
+        printf("Unable to write %s\n", path.c_str());
+        failed = true;
+        break;
+      }
+    }
+    job.frames_done++;
+  }
+  close_frame_source(src);
+
+  std::lock_guard<std::mutex> guard(job.lock);
+  s.done_end = std::max(s.first, std::min(k, s.end));
+  s.failed = failed;
+  s.secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  s.done = true;
+  job.finished.notify_all();
+}
+
+/**
+ * @brief Function to queue every segment of a job on a pool
+ *
+ * @param pool pool to run on, work stealing keeps every worker busy when segments differ in cost
+ * @param job planned job, it has to outlive the pool's work
+ * @return int
+ */
+int start_offline_job(thread_pool &pool, offline_job &job) {
+  for(int i = 0; i < job.segments.size(); i++) {
+    pool.submit([&job, i] { run_offline_segment(job, i); });
+  }
+  return(0);
+}
+
+/**
+ * @brief Function to wait for a segment to finish
+ *
+ * @param job job
+ * @param idx index of the segment
+ * @return int return non-zero value if the segment failed
+ */
+int wait_offline_segment(offline_job &job, int idx) {
+  std::unique_lock<std::mutex> guard(job.lock);
+  job.finished.wait(guard, [&job, idx] { return job.segments[idx].done; });
+  return job.segments[idx].failed ? -1 : 0;
+}
@@ -0,0 +1,280 @@
+/**
+ * @file offline_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for drawing the AR overlay over a recording on every core
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "../include/csv_util.h"
+#include "../include/cal_profile.h"
+#include "../include/frame_source.h"
+#include "../include/profiler.h"
+#include "../include/replay.h"
+#include "../include/offline.h"
+#include "../include/thread_pool.h"
+#include "../include/video_recorder.h"
+
+/**
+ * @brief Function to check whether an output name is a video rather than a directory
+ *
+ * @param name output name
+ * @return true for .avi, .mp4, .mkv, .mov and .y4m
+ */
+static bool is_video_name(const std::string &name) {
+  const char *exts[] = { ".avi", ".mp4", ".mkv", ".mov", ".y4m" };
+  for(int i = 0; i < 5; i++) {
+    size_t n = strlen(exts[i]);
+    if(name.size() >= n && name.compare(name.size() - n, n, exts[i]) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+  pipeline_settings set;
+  init_pipeline_settings(set);
+
+  char cal_fn[256] = "calibration.csv";
+  char obj_fn[256] = "shuttle.obj";
+  char kerm_dir[256] = "kerm";
+  cv::Size patternsize(9, 6);
+  double fps = 0; // 0 for the video's own rate
+  int nthreads = 0; // 0 for one per hardware thread
+  long segment = 300; // frames per segment
+  int warmup = 30; // frames run before every segment to bring the tracking state up to date
+  std::string img_format = "png";
+  std::string poses_dir = ""; // with --poses the results are written in replay.exe's golden format
+  std::string source = "";
+  std::string out = "";
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+      set.mode = parse_pipeline_mode(argv[++i]);
+      if(set.mode < 0) {
+        printf("Unknown mode %s (ar, gif)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--overlay") == 0 && i + 1 < argc) {
+      i++;
+      set.overlay = strcmp(argv[i], "house") == 0 ? OVERLAY_HOUSE : (strcmp(argv[i], "obj") == 0 ? OVERLAY_OBJ : OVERLAY_AXES);
+    } else if(strcmp(argv[i], "--detector") == 0 && i + 1 < argc) {
+      set.backend = parse_detector_backend(argv[++i]);
+      if(!detector_available(set.backend)) {
+        printf("Unknown or unavailable detector %s (classic, sb, charuco)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--detect-scale") == 0 && i + 1 < argc) {
+      set.det_scale = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--no-motion-gate") == 0) {
+      set.gating = false;
+    } else if(strcmp(argv[i], "--motion-threshold") == 0 && i + 1 < argc) {
+      set.motion_threshold = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--motion-max-reuse") == 0 && i + 1 < argc) {
+      set.motion_max_reuse = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--pose-filter") == 0) {
+      set.filtering = true;
+    } else if(strcmp(argv[i], "--pose-lead-ms") == 0 && i + 1 < argc) {
+      set.filtering = true;
+      set.pose_lead_ms = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--calib") == 0 && i + 1 < argc) {
+      strncpy(cal_fn, argv[++i], sizeof(cal_fn) - 1);
+    } else if(strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+      strncpy(obj_fn, argv[++i], sizeof(obj_fn) - 1);
+    } else if(strcmp(argv[i], "--kerm") == 0 && i + 1 < argc) {
+      strncpy(kerm_dir, argv[++i], sizeof(kerm_dir) - 1);
+    } else if(strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%dx%d", &patternsize.width, &patternsize.height);
+    } else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      nthreads = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--segment") == 0 && i + 1 < argc) {
+      segment = atol(argv[++i]);
+    } else if(strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+      warmup = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--img-format") == 0 && i + 1 < argc) {
+      img_format = argv[++i];
+    } else if(strcmp(argv[i], "--poses") == 0 && i + 1 < argc) {
+      poses_dir = argv[++i];
+    } else if(source.empty()) {
+      source = argv[i];
+    } else {
+      out = argv[i];
+    }
+  }
+
+  if(source.empty() || out.empty()) {
+    printf("usage: %s [--threads n] [--segment frames] [--warmup frames] [--poses dir] [--img-format png|jpg]\n", argv[0]);
+    printf("          [--mode ar|gif] [--overlay axes|house|obj] [--detector name] [--detect-scale s] [--no-motion-gate]\n");
+    printf("          [--pose-filter] [--pose-lead-ms ms] [--calib calibration.csv] [--board WxH] [--fps f]\n");
+    printf("          <video or image dir> <out.avi|out.mp4|out.y4m|out_dir>\n");
+    printf("  draws the overlay on every frame of a recording, in segments on every core\n");
+    return(-1);
+  }
+  if(segment < 1 || warmup < 0) {
+    printf("--segment must be at least 1 and --warmup not negative\n");
+    return(-1);
+  }
+
+  cal_profile calib;
+  if(read_cal_profile_csv(cal_fn, "", calib, 0) != 0) {
+    printf("Unable to read %s\n", cal_fn);
+    return(-1);
+  }
+  pipeline_model model;
+  if(load_pipeline_model(set.mode, patternsize, obj_fn, kerm_dir, model) != 0) {
+    return(-1);
+  }
+
+  // the segments need to know where they are, so only files with a known length work
+  frame_source src;
+  if(open_frame_source(source, src) != 0) {
+    return(-1);
+  }
+  long total = frame_source_length(src);
+  if(total <= 0) {
+    printf("%s has no frame count, it needs to be a video file or an image directory\n", source.c_str());
+    return(-1);
+  }
+  if(fps <= 0) {
+    fps = src.files.empty() ? src.cap.get(cv::CAP_PROP_FPS) : 0;
+    fps = fps > 0 ? fps : 30;
+  }
+
+  // every segment already runs on a core of its own, opencv's threads would only compete with them
+  cv::setNumThreads(1);
+  thread_pool pool(nthreads);
+
+  // short recordings get shorter segments so every worker has a few to steal,
+  // but never shorter than the warm-up, or most of the work would be warming up
+  long per_worker = (total + 4 * pool.size() - 1) / (4 * pool.size());
+  segment = std::min(segment, std::max((long) std::max(warmup, 1), per_worker));
+
+  offline_job job;
+  job.source = source;
+  job.set = set;
+  job.model = &model;
+  job.calib = calib;
+  job.fps = fps;
+  job.img_format = img_format;
+  bool video_out = is_video_name(out);
+  if(!video_out) {
+#ifdef _WIN32
+    _mkdir(out.c_str());
+#else
+    mkdir(out.c_str(), 0755);
+#endif
+    job.img_dir = out;
+  }
+  if(plan_offline_job(total, segment, warmup, job) != 0) {
+    return(-1);
+  }
+  // draws the overlays of a video output, opening it first also checks the settings
+  frame_pipeline writer_pipe;
+  if(open_frame_pipeline(set, calib, &model, writer_pipe) != 0) {
+    return(-1);
+  }
+
+  printf("%s: %ld frames at %.2f fps in %d segments of %ld with %d warm-up frames, %d threads\n", source.c_str(), total,
+         fps, (int) job.segments.size(), segment, warmup, pool.size());
+
+  // a video is encoded in frame order: the segments measured every pose, and the
+  // overlays are drawn here from those poses as the frames are read once more
+  video_recorder recorder;
+  if(video_out && open_video_recorder(out, fps, RECORD_BLOCK, 8, recorder) != 0) {
+    return(-1);
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  start_offline_job(pool, job);
+  long written = 0;
+  bool failed = false;
+  cv::Mat frame;
+  if(video_out) {
+    seek_frame_source(src, 0);
+  }
+  for(int i = 0; i < job.segments.size() && !failed; i++) {
+    if(wait_offline_segment(job, i) != 0) {
+      failed = true;
+      break;
+    }
+    const offline_segment &s = job.segments[i];
+    if(video_out) {
+      for(long k = s.first; k < s.done_end; k++) {
+        if(!frame.empty()) {
+          frame = next_record_frame(recorder, frame.size(), frame.type());
+        }
+        if(read_frame_source(src, frame) != 0) {
+          break;
+        }
+        draw_pipeline_result(writer_pipe, frame, job.results[k]);
+        record_frame(recorder, frame);
+      }
+    }
+    written = s.done_end;
+    if(s.done_end < s.end) {
+      printf("%s ended at frame %ld, before the %ld it said it has\n", source.c_str(), s.done_end, total);
+      break;
+    }
+
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(i % 10 == 9 || i + 1 == job.segments.size()) {
+      printf("%ld/%ld frames in order, %ld processed, %.1f fps\n", written, total, (long) job.frames_done, job.frames_done / secs);
+    }
+  }
+  // segments past the end of a short source still run, wait for them before anything goes away
+  pool.wait_idle();
+  close_frame_source(src);
+  if(video_out) {
+    close_video_recorder(recorder);
+  }
+  if(failed) {
+    printf("A segment failed, %s is incomplete\n", out.c_str());
+    return(-1);
+  }
+
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  double seg_secs = 0;
+  for(int i = 0; i < job.segments.size(); i++) {
+    seg_secs += job.segments[i].secs;
+  }
+  int found = 0;
+  for(long k = 0; k < written; k++) {
+    found += job.results[k].found ? 1 : 0;
+  }
+  printf("%ld frames in %.1f s (%.1f fps), board found in %d, %ld warm-up frames (%.1f%% extra), workers busy %.0f%%\n",
+         written, secs, secs > 0 ? written / secs : 0.0, found, (long) job.warmup_frames,
+         written > 0 ? 100.0 * job.warmup_frames / written : 0.0, secs > 0 ? 100.0 * seg_secs / (secs * pool.size()) : 0.0);
+  prof_print();
+
+  if(!poses_dir.empty()) {
+    std::vector<std::string> names;
+    std::vector<int64_t> times;
+    std::vector<pipeline_result> results(job.results.begin(), job.results.begin() + written);
+    for(long k = 0; k < written; k++) {
+      char name[32];
+      snprintf(name, sizeof(name), "%05ld", k);
+      names.push_back(name);
+      times.push_back((int64_t) (k * 1e9 / fps));
+    }
+    if(write_replay_golden(poses_dir, names, times, results) != 0) {
+      return(-1);
+    }
+    printf("Wrote corners.csv and poses.csv to %s\n", poses_dir.c_str());
+  }
+
+  return(0);
+}
@@ -0,0 +1,261 @@
+/**
+ * @file pose_filter.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Constant velocity pose filter, predicts the pose at display time
+ * @date 2022-04-20
+ */
+
+#include <cmath>
+#include <algorithm>
+#include "../include/frame_workspace.h"
+#include "../include/pose_filter.h"
+
+#define MAX_GAP_S 0.5 // restart after going this long without a measurement
+#define MAX_JUMP_RAD 0.5 // restart when a measurement is this far from the prediction
+#define MAX_PREDICT_S 0.2 // cap on extrapolation past the last measurement
+
+/**
+ * @brief Function to turn a rotation vector into a rotation matrix
+ *
+ * @param r rotation vector
+ * @return cv::Matx33d
+ */
+static cv::Matx33d so3_exp(const cv::Vec3d &r) {
+  cv::Matx33d m;
+  ALLOC_EXEMPT(EXEMPT_POSE);
+  cv::Rodrigues(r, m);
+  return m;
+}
+
+/**
+ * @brief Function to turn a rotation matrix into a rotation vector
+ *
+ * @param m rotation matrix
+ * @return cv::Vec3d
+ */
+static cv::Vec3d so3_log(const cv::Matx33d &m) {
+  cv::Vec3d r;
+  ALLOC_EXEMPT(EXEMPT_POSE);
+  cv::Rodrigues(m, r);
+  return r;
+}
+
+/**
+ * @brief Function to read a 3x1 vector from solvePnP
+ *
+ * @param v rotation or translation vector, CV_64F
+ * @return cv::Vec3d
+ */
+static cv::Vec3d read_vec3(const cv::Mat &v) {
+  return cv::Vec3d(v.at<double>(0), v.at<double>(1), v.at<double>(2));
+}
+
+/**
+ * @brief Function to write a 3x1 CV_64F vector, reusing its buffer
+ *
+ * @param src vector to write
+ * @param v Mat to write to
+ */
+static void write_vec3(const cv::Vec3d &src, cv::Mat &v) {
+  v.create(3, 1, CV_64F);
+  for(int i = 0; i < 3; i++) {
+    v.at<double>(i) = src[i];
+  }
+}
+
+/**
+ * @brief Function to move one axis covariance forward in time
+ *
+ * White noise acceleration model, F = [1 dt; 0 1].
+ *
+ * @param cov [value, rate] covariance to update
+ * @param dt seconds
+ * @param accel acceleration std
+ */
+static void predict_cov(cv::Matx22d &cov, double dt, double accel) {
+  cv::Matx22d F(1, dt, 0, 1);
+  double q = accel * accel;
+  cv::Matx22d Q(q * dt * dt * dt / 3, q * dt * dt / 2, q * dt * dt / 2, q * dt);
+  cov = F * cov * F.t() + Q;
+}
+
+/**
+ * @brief Function to get the Kalman gain of one axis and shrink its covariance
+ *
+ * @param cov [value, rate] covariance to update
+ * @param noise measurement std
+ * @param gain value and rate gain to write to
+ */
+static void correct_cov(cv::Matx22d &cov, double noise, double gain[2]) {
+  double s = cov(0, 0) + noise * noise;
+  gain[0] = cov(0, 0) / s;
+  gain[1] = cov(1, 0) / s;
+  cv::Matx22d next;
+  for(int i = 0; i < 2; i++) {
+    for(int j = 0; j < 2; j++) {
+      next(i, j) = cov(i, j) - gain[i] * cov(0, j);
+    }
+  }
+  cov = next;
+}
+
+/**
+ * @brief Function to restart the filter at a measurement with unknown velocity
+ *
+ * @param f filter
+ * @param time_ns time of the measurement
+ * @param r measured rotation
+ * @param t measured translation
+ */
+static void restart_pose_filter(pose_filter &f, int64_t time_ns, const cv::Matx33d &r, const cv::Vec3d &t) {
+  f.init = true;
+  f.time_ns = time_ns;
+  f.rot = r;
+  f.rot_vel = cv::Vec3d(0, 0, 0);
+  f.trans = t;
+  f.trans_vel = cv::Vec3d(0, 0, 0);
+  // the velocity is anything a hand can manage until a second measurement arrives
+  f.rot_cov = cv::Matx22d(f.rot_noise * f.rot_noise, 0, 0, 4.0);
+  f.trans_cov = cv::Matx22d(f.trans_noise * f.trans_noise, 0, 0, 100.0);
+}
+
+/**
+ * @brief Function to set up a pose filter
+ *
+ * @param rot_accel angular acceleration std in rad/s^2, larger follows faster motion with less smoothing
+ * @param trans_accel acceleration std in board squares/s^2
+ * @param rot_noise rotation measurement std in rad
+ * @param trans_noise translation measurement std in board squares
+ * @param f filter to set up
+ * @return int return non-zero value on failure
+ */
+int init_pose_filter(double rot_accel, double trans_accel, double rot_noise, double trans_noise, pose_filter &f) {
+  if(rot_accel <= 0 || trans_accel <= 0 || rot_noise <= 0 || trans_noise <= 0) {
+    return(-1);
+  }
+
+  f.rot_accel = rot_accel;
+  f.trans_accel = trans_accel;
+  f.rot_noise = rot_noise;
+  f.trans_noise = trans_noise;
+  f.init = false;
+  f.time_ns = 0;
+  f.updates = 0;
+  f.resets = 0;
+
+  return(0);
+}
+
+/**
+ * @brief Function to correct the filter with a measured pose
+ *
+ * The filter restarts from the measurement after a gap of more than half a
+ * second or a jump that no smooth motion explains, such as solvePnP flipping
+ * to the mirrored solution.
+ *
+ * @param f filter
+ * @param time_ns time the frame was captured
+ * @param rvec rotation vector from solvePnP
+ * @param tvec translation vector from solvePnP
+ * @return int return non-zero value on failure
+ */
+int update_pose_filter(pose_filter &f, int64_t time_ns, const cv::Mat &rvec, const cv::Mat &tvec) {
+  if(rvec.total() != 3 || tvec.total() != 3) {
+    return(-1);
+  }
+  cv::Matx33d r_meas = so3_exp(read_vec3(rvec));
+  cv::Vec3d t_meas = read_vec3(tvec);
+  f.updates++;
+
+  double dt = (time_ns - f.time_ns) * 1e-9;
+  if(!f.init || dt > MAX_GAP_S) {
+    restart_pose_filter(f, time_ns, r_meas, t_meas);
+    return(0);
+  }
+  dt = std::max(dt, 0.0); // a late frame is treated as simultaneous
+
+  // predict to the measurement
+  cv::Matx33d r_pred = so3_exp(f.rot_vel * dt) * f.rot;
+  cv::Vec3d t_pred = f.trans + f.trans_vel * dt;
+  predict_cov(f.rot_cov, dt, f.rot_accel);
+  predict_cov(f.trans_cov, dt, f.trans_accel);
+
+  // residuals, the rotation one in the tangent space at the prediction
+  cv::Vec3d r_err = so3_log(r_meas * r_pred.t());
+  cv::Vec3d t_err = t_meas - t_pred;
+  if(cv::norm(r_err) > MAX_JUMP_RAD) {
+    f.resets++;
+    restart_pose_filter(f, time_ns, r_meas, t_meas);
+    return(0);
+  }
+
+  double rot_gain[2];
+  double trans_gain[2];
+  correct_cov(f.rot_cov, f.rot_noise, rot_gain);
+  correct_cov(f.trans_cov, f.trans_noise, trans_gain);
+
+  f.rot = so3_exp(r_err * rot_gain[0]) * r_pred;
+  f.rot_vel += r_err * rot_gain[1];
+  f.trans = t_pred + t_err * trans_gain[0];
+  f.trans_vel += t_err * trans_gain[1];
+  f.time_ns = time_ns;
+
+  return(0);
+}
+
+/**
+ * @brief Function to get the filtered pose at a time, extrapolated with the velocities
+ *
+ * Extrapolation is capped at 200 ms past the last measurement.
+ *
+ * @param f filter
+ * @param time_ns time to get the pose at, usually capture time plus the display latency
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int return non-zero value if the filter holds no pose
+ */
+int predict_pose(const pose_filter &f, int64_t time_ns, cv::Mat &rvec, cv::Mat &tvec) {
+  if(!f.init) {
+    return(-1);
+  }
+
+  double dt = std::min(std::max((time_ns - f.time_ns) * 1e-9, -MAX_PREDICT_S), MAX_PREDICT_S);
+  write_vec3(so3_log(so3_exp(f.rot_vel * dt) * f.rot), rvec);
+  write_vec3(f.trans + f.trans_vel * dt, tvec);
+
+  return(0);
+}
+
+/**
+ * @brief Function to interpolate between two poses, SLERP on rotation and lerp on translation
+ *
+ * alpha outside [0, 1] extrapolates along the same motion.
+ *
+ * @param rvec0 first rotation vector
+ * @param tvec0 first translation vector
+ * @param rvec1 second rotation vector
+ * @param tvec1 second translation vector
+ * @param alpha 0 for the first pose, 1 for the second
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int
+ */
+int interpolate_pose(const cv::Vec3d &rvec0, const cv::Vec3d &tvec0, const cv::Vec3d &rvec1, const cv::Vec3d &tvec1,
+                     double alpha, cv::Vec3d &rvec, cv::Vec3d &tvec) {
+  cv::Matx33d r0 = so3_exp(rvec0);
+  cv::Vec3d delta = so3_log(so3_exp(rvec1) * r0.t()); // shortest rotation from the first pose to the second
+  rvec = so3_log(so3_exp(delta * alpha) * r0);
+  tvec = tvec0 + (tvec1 - tvec0) * alpha;
+  return 0;
+}
+
+/**
+ * @brief Function to get the angle between two rotations
+ *
+ * @param rvec0 first rotation vector
+ * @param rvec1 second rotation vector
+ * @return double angle in radians
+ */
+double rotation_distance(const cv::Vec3d &rvec0, const cv::Vec3d &rvec1) {
+  return cv::norm(so3_log(so3_exp(rvec1) * so3_exp(rvec0).t()));
+}
@@ -0,0 +1,303 @@
+/**
+ * @file pose_log.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Memory-mapped binary pose recorder
+ * @date 2022-04-14
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "../include/pose_log.h"
+
+static const char pose_magic[8] = "POSELOG";
+
+/**
+ * @brief Function to write the mapped pages back to the file
+ *
+ * @param log open pose log
+ * @param wait true to block until the data is on disk
+ */
+static void flush_pose_log(pose_log &log, bool wait) {
+#ifdef _WIN32
+  FlushViewOfFile(log.base, 0);
+  if(wait) {
+    FlushFileBuffers((HANDLE) log.file);
+  }
+#else
+  msync(log.base, log.map_size, wait ? MS_SYNC : MS_ASYNC);
+#endif
+}
+
+/**
+ * @brief Function run on the flusher thread, flushes once a second
+ *
+ * @param log open pose log
+ */
+static void run_flusher(pose_log *log) {
+  while(!log->stop) {
+    for(int i = 0; i < 10 && !log->stop; i++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    flush_pose_log(*log, false);
+  }
+}
+
+/**
+ * @brief Function to create a pose log and map it
+ *
+ * @param filename file to create, overwritten if it exists
+ * @param capacity number of poses the file has room for
+ * @param log pose log to write to
+ * @return int return non-zero value on failure
+ */
+int open_pose_log(const std::string &filename, uint64_t capacity, pose_log &log) {
+  log.filename = filename;
+  log.capacity = capacity;
+  log.map_size = sizeof(pose_log_header) + capacity * sizeof(pose_record);
+  log.next = 0;
+  log.dropped = 0;
+  log.stop = false;
+  log.base = NULL;
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(file == INVALID_HANDLE_VALUE) {
+    printf("Unable to open pose log %s\n", filename.c_str());
+    return(-1);
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD) (log.map_size >> 32), (DWORD) log.map_size, NULL);
+  if(!mapping) {
+    printf("Unable to size pose log %s\n", filename.c_str());
+    CloseHandle(file);
+    return(-1);
+  }
+  log.base = (char *) MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, log.map_size);
+  if(!log.base) {
+    printf("Unable to map pose log %s\n", filename.c_str());
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return(-1);
+  }
+  log.file = file;
+  log.mapping = mapping;
+#else
+  log.fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(log.fd < 0) {
+    printf("Unable to open pose log %s\n", filename.c_str());
+    return(-1);
+  }
+  if(ftruncate(log.fd, log.map_size) != 0) {
+    printf("Unable to size pose log %s\n", filename.c_str());
+    close(log.fd);
+    return(-1);
+  }
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE; // fault the pages in now rather than on the frame threads
+#endif
+  void *base = mmap(NULL, log.map_size, PROT_READ | PROT_WRITE, flags, log.fd, 0);
+  if(base == MAP_FAILED) {
+    printf("Unable to map pose log %s\n", filename.c_str());
+    close(log.fd);
+    return(-1);
+  }
+  log.base = (char *) base;
+#endif
+
+#ifndef MAP_POPULATE
+  // touch every page so the first pose on each one does not fault on a frame thread
+  for(uint64_t off = 0; off < log.map_size; off += 4096) {
+    log.base[off] = 0;
+  }
+#endif
+
+  pose_log_header *header = (pose_log_header *) log.base;
+  memcpy(header->magic, pose_magic, sizeof(header->magic));
+  header->version = POSE_LOG_VERSION;
+  header->record_size = sizeof(pose_record);
+  header->capacity = capacity;
+  header->count = 0;
+
+  log.flusher = std::thread(run_flusher, &log);
+
+  return(0);
+}
+
+/**
+ * @brief Function to record a pose, safe to call from several threads at once
+ *
+ * @param log open pose log
+ * @param camera camera or session id
+ * @param frame frame number within the camera
+ * @param capture_ns capture time of the frame, ns on the prof_now clock
+ * @param rvec rotation vector from solvePnP
+ * @param tvec translation vector from solvePnP
+ * @param reproj_err rms reprojection error in pixels
+ * @return int return non-zero value if the log is full
+ */
+int write_pose(pose_log &log, int camera, long frame, int64_t capture_ns, const cv::Mat &rvec, const cv::Mat &tvec, float reproj_err) {
+  uint64_t idx = log.next.fetch_add(1, std::memory_order_relaxed);
+  if(idx >= log.capacity) {
+    log.dropped++;
+    return(-1);
+  }
+
+  pose_record rec;
+  rec.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+  rec.capture_ns = capture_ns;
+  rec.camera = camera;
+  rec.frame = (uint32_t) frame;
+  for(int i = 0; i < 3; i++) {
+    rec.rvec[i] = rvec.at<double>(i, 0);
+    rec.tvec[i] = tvec.at<double>(i, 0);
+  }
+  rec.reproj_err = reproj_err;
+  rec.valid = 0;
+
+  pose_record *slot = (pose_record *) (log.base + sizeof(pose_log_header)) + idx;
+  memcpy(slot, &rec, sizeof(rec));
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->valid = 1;
+
+  return(0);
+}
+
+/**
+ * @brief Function to flush a pose log, trim it to the poses written and unmap it
+ *
+ * @param log pose log to close
+ * @return int return non-zero value on failure
+ */
+int close_pose_log(pose_log &log) {
+  if(!log.base) {
+    return(-1);
+  }
+
+  log.stop = true;
+  if(log.flusher.joinable()) {
+    log.flusher.join();
+  }
+
+  uint64_t count = std::min(log.next.load(), log.capacity);
+  pose_log_header *header = (pose_log_header *) log.base;
+  header->count = count;
+  flush_pose_log(log, true);
+
+  uint64_t used = sizeof(pose_log_header) + count * sizeof(pose_record);
+#ifdef _WIN32
+  UnmapViewOfFile(log.base);
+  CloseHandle((HANDLE) log.mapping);
+  LARGE_INTEGER size;
+  size.QuadPart = used;
+  SetFilePointerEx((HANDLE) log.file, size, NULL, FILE_BEGIN);
+  SetEndOfFile((HANDLE) log.file);
+  CloseHandle((HANDLE) log.file);
+#else
+  munmap(log.base, log.map_size);
+  if(ftruncate(log.fd, used) != 0) {
+    printf("Unable to trim pose log %s\n", log.filename.c_str());
+  }
+  close(log.fd);
+#endif
+  log.base = NULL;
+
+  printf("Wrote %llu poses to %s", (unsigned long long) count, log.filename.c_str());
+  if(log.dropped > 0) {
+    printf(", %llu more did not fit", (unsigned long long) log.dropped.load());
+  }
+  printf("\n");
+
+  return(0);
+}
+
+/**
+ * @brief Function to read every complete pose from a pose log
+ *
+ * Also reads logs that were never closed, for example after a crash, by
+ * skipping every record that was not finished.
+ *
+ * @param filename pose log file
+ * @param records vector of poses to write to
+ * @return int return non-zero value on failure
+ */
+int read_pose_log(const char *filename, std::vector<pose_record> &records) {
+  FILE *fp = fopen(filename, "rb");
+  if(!fp) {
+    printf("Unable to open pose log %s\n", filename);
+    return(-1);
+  }
+
+  pose_log_header header;
+  if(fread(&header, sizeof(header), 1, fp) != 1 || memcmp(header.magic, pose_magic, sizeof(pose_magic)) != 0) {
+    printf("%s is not a pose log\n", filename);
+    fclose(fp);
+    return(-1);
+  }
+  if(header.version != POSE_LOG_VERSION || header.record_size != sizeof(pose_record)) {
+    printf("%s is pose log version %u, expected %d\n", filename, header.version, POSE_LOG_VERSION);
+    fclose(fp);
+    return(-1);
+  }
+
+  // count is only filled in on close, otherwise scan the whole file
+  uint64_t n = header.count > 0 ? header.count : header.capacity;
+  pose_record rec;
+  int skipped = 0;
+  for(uint64_t i = 0; i < n && fread(&rec, sizeof(rec), 1, fp) == 1; i++) {
+    if(rec.valid != 1) {
+      skipped++;
+      continue;
+    }
+    records.push_back(rec);
+  }
+  fclose(fp);
+
+  if(header.count == 0 && records.size() > 0) {
+    printf("%s was not closed, recovered %d poses\n", filename, (int) records.size());
+  } else if(skipped > 0) {
+    printf("%s: %d unfinished poses skipped\n", filename, skipped);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to convert a pose log to a csv
+ *
+ * @param filename pose log file
+ * @param csv_filename name of csv file
+ * @return int return non-zero value on failure
+ */
+int pose_log_to_csv(const char *filename, const char *csv_filename) {
+  std::vector<pose_record> records;
+  if(read_pose_log(filename, records) != 0) {
+    return(-1);
+  }
+
+  FILE *fp = fopen(csv_filename, "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", csv_filename);
+    return(-1);
+  }
+
+  fprintf(fp, "time_ns,camera,frame,rx,ry,rz,tx,ty,tz,reproj_err,capture_ns\n");
+  for(int i = 0; i < records.size(); i++) {
+    pose_record &r = records[i];
+    fprintf(fp, "%lld,%u,%u,%.6f,%.6f,%.6f,%.6f,%.6f,%.6f,%.4f,%lld\n", (long long) r.time_ns, r.camera, r.frame,
+            r.rvec[0], r.rvec[1], r.rvec[2], r.tvec[0], r.tvec[1], r.tvec[2], r.reproj_err, (long long) r.capture_ns);
+  }
+  fclose(fp);
+
+  printf("Wrote %d poses to %s\n", (int) records.size(), csv_filename);
+  return(0);
+}
@@ -0,0 +1,39 @@
+/**
+ * @file posecsv_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for converting a binary pose log to csv
+ * @date 2022-04-14
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include "../include/pose_log.h"
+
+int main(int argc, char *argv[]) {
+  if(argc < 2) {
+    printf("usage: %s poses.bin [poses.csv]\n", argv[0]);
+    printf("  converts a pose log from ar.exe or multi.exe --pose-log to csv\n");
+    return(-1);
+  }
+
+  std::string csv_fn;
+  if(argc > 2) {
+    csv_fn = argv[2];
+  } else {
+    // poses.bin -> poses.csv
+    csv_fn = argv[1];
+    size_t dot = csv_fn.rfind('.');
+    if(dot != std::string::npos && csv_fn.find_first_of("/\\", dot) == std::string::npos) {
+      csv_fn = csv_fn.substr(0, dot);
+    }
+    csv_fn += ".csv";
+  }
+
+  if(pose_log_to_csv(argv[1], csv_fn.c_str()) != 0) {
+    return(-1);
+  }
+
+  return(0);
+}
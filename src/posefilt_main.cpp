@@ -0,0 +1,242 @@
+/**
+ * @file posefilt_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for evaluating the pose filter on a recorded pose log
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "../include/pose_log.h"
+#include "../include/pose_filter.h"
+
+#define MAX_REF_GAP_NS 100000000LL // reference poses are only interpolated across gaps shorter than this
+
+// errors at one lead time over the whole log
+struct lead_result {
+  double lead_ms;
+  int scored; // poses that had a reference lead_ms later
+  double hold_rot_sum; // holding the last measured pose, what the lag costs
+  double hold_trans_sum;
+  double filt_rot_sum; // the filter's prediction
+  double filt_trans_sum;
+  double filt_rot_max;
+  double filt_trans_max;
+};
+
+/**
+ * @brief Function to get the measured pose at a time between two records
+ *
+ * @param recs records of one camera in time order
+ * @param time_ns time to get the pose at
+ * @param rvec rotation vector to write to
+ * @param tvec translation vector to write to
+ * @return int return non-zero value if no two records close enough surround time_ns
+ */
+static int reference_pose(const std::vector<pose_record> &recs, int64_t time_ns, cv::Vec3d &rvec, cv::Vec3d &tvec) {
+  // first record at or after time_ns
+  int lo = 0, hi = recs.size();
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if(recs[mid].capture_ns < time_ns) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if(lo >= recs.size()) {
+    return(-1);
+  }
+  const pose_record &b = recs[lo];
+  cv::Vec3d rb(b.rvec[0], b.rvec[1], b.rvec[2]);
+  cv::Vec3d tb(b.tvec[0], b.tvec[1], b.tvec[2]);
+  if(b.capture_ns == time_ns) {
+    rvec = rb;
+    tvec = tb;
+    return(0);
+  }
+  if(lo == 0 || b.capture_ns - recs[lo - 1].capture_ns > MAX_REF_GAP_NS) {
+    return(-1);
+  }
+  const pose_record &a = recs[lo - 1];
+  double alpha = (double) (time_ns - a.capture_ns) / (b.capture_ns - a.capture_ns);
+  interpolate_pose(cv::Vec3d(a.rvec[0], a.rvec[1], a.rvec[2]), cv::Vec3d(a.tvec[0], a.tvec[1], a.tvec[2]), rb, tb,
+                   alpha, rvec, tvec);
+  return(0);
+}
+
+int main(int argc, char *argv[]) {
+  char csv_fn[256] = "";
+  int camera = -1;
+  std::vector<double> leads;
+  double rot_accel = POSE_ROT_ACCEL;
+  double trans_accel = POSE_TRANS_ACCEL;
+  double rot_noise = POSE_ROT_NOISE;
+  double trans_noise = POSE_TRANS_NOISE;
+  std::string log_fn = "";
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
+      strncpy(csv_fn, argv[++i], sizeof(csv_fn) - 1);
+    } else if(strcmp(argv[i], "--camera") == 0 && i + 1 < argc) {
+      camera = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--lead") == 0 && i + 1 < argc) {
+      leads.push_back(atof(argv[++i]));
+    } else if(strcmp(argv[i], "--rot-accel") == 0 && i + 1 < argc) {
+      rot_accel = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--trans-accel") == 0 && i + 1 < argc) {
+      trans_accel = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--rot-noise") == 0 && i + 1 < argc) {
+      rot_noise = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--trans-noise") == 0 && i + 1 < argc) {
+      trans_noise = atof(argv[++i]);
+    } else {
+      log_fn = argv[i];
+    }
+  }
+
+  if(log_fn.empty()) {
+    printf("usage: %s [--camera id] [--lead ms]... [--rot-accel a] [--trans-accel a] [--rot-noise s] [--trans-noise s] [--csv results.csv] poses.bin\n", argv[0]);
+    printf("  replays a pose log from ar.exe or multi.exe --pose-log through the pose filter and compares\n");
+    printf("  its prediction lead ms ahead with the pose measured then\n");
+    return(-1);
+  }
+  if(leads.empty()) {
+    double defaults[] = { 0, 16, 33, 50, 100 };
+    leads.assign(defaults, defaults + 5);
+  }
+
+  std::vector<pose_record> all;
+  if(read_pose_log(log_fn.c_str(), all) != 0) {
+    return(-1);
+  }
+  if(all.empty()) {
+    printf("No poses in %s\n", log_fn.c_str());
+    return(-1);
+  }
+  if(camera < 0) {
+    camera = all[0].camera;
+  }
+  std::vector<pose_record> recs;
+  for(int i = 0; i < all.size(); i++) {
+    if(all[i].camera == camera) {
+      recs.push_back(all[i]);
+    }
+  }
+  std::stable_sort(recs.begin(), recs.end(), [](const pose_record &a, const pose_record &b) { return a.capture_ns < b.capture_ns; });
+  double secs = (recs.back().capture_ns - recs.front().capture_ns) * 1e-9;
+  printf("camera %d: %d poses over %.1f s\n\n", camera, (int) recs.size(), secs);
+
+  std::vector<lead_result> results;
+  pose_filter filter;
+  long resets = 0;
+  double raw_jitter[2] = { 0, 0 };
+  double filt_jitter[2] = { 0, 0 };
+  int jitter_count = 0;
+  for(int l = 0; l < leads.size(); l++) {
+    lead_result res = lead_result();
+    res.lead_ms = leads[l];
+    if(init_pose_filter(rot_accel, trans_accel, rot_noise, trans_noise, filter) != 0) {
+      printf("the filter noise settings must be positive\n");
+      return(-1);
+    }
+
+    cv::Mat rmat(3, 1, CV_64F), tmat(3, 1, CV_64F);
+    cv::Mat rpred, tpred;
+    std::vector<cv::Vec3d> raw_r, raw_t, filt_r, filt_t; // lead 0 outputs for the jitter
+    for(int k = 0; k < recs.size(); k++) {
+      const pose_record &rec = recs[k];
+      for(int i = 0; i < 3; i++) {
+        rmat.at<double>(i) = rec.rvec[i];
+        tmat.at<double>(i) = rec.tvec[i];
+      }
+      update_pose_filter(filter, rec.capture_ns, rmat, tmat);
+
+      int64_t target = rec.capture_ns + (int64_t) (res.lead_ms * 1e6);
+      cv::Vec3d ref_r, ref_t;
+      if(reference_pose(recs, target, ref_r, ref_t) != 0 || predict_pose(filter, target, rpred, tpred) != 0) {
+        continue;
+      }
+      cv::Vec3d hold_r(rec.rvec[0], rec.rvec[1], rec.rvec[2]);
+      cv::Vec3d hold_t(rec.tvec[0], rec.tvec[1], rec.tvec[2]);
+      cv::Vec3d pred_r(rpred.at<double>(0), rpred.at<double>(1), rpred.at<double>(2));
+      cv::Vec3d pred_t(tpred.at<double>(0), tpred.at<double>(1), tpred.at<double>(2));
+
+      double filt_rot = rotation_distance(pred_r, ref_r) * 180.0 / CV_PI;
+      double filt_trans = cv::norm(pred_t - ref_t);
+      res.scored++;
+      res.hold_rot_sum += rotation_distance(hold_r, ref_r) * 180.0 / CV_PI;
+      res.hold_trans_sum += cv::norm(hold_t - ref_t);
+      res.filt_rot_sum += filt_rot;
+      res.filt_trans_sum += filt_trans;
+      res.filt_rot_max = std::max(res.filt_rot_max, filt_rot);
+      res.filt_trans_max = std::max(res.filt_trans_max, filt_trans);
+
+      if(l == 0) {
+        raw_r.push_back(hold_r);
+        raw_t.push_back(hold_t);
+        filt_r.push_back(pred_r);
+        filt_t.push_back(pred_t);
+      }
+    }
+    results.push_back(res);
+    resets = filter.resets;
+
+    // jitter, rms of the frame to frame change in velocity
+    for(int k = 2; k < raw_r.size(); k++) {
+      raw_jitter[0] += pow(cv::norm(raw_r[k] - raw_r[k - 1] * 2.0 + raw_r[k - 2]) * 180.0 / CV_PI, 2);
+      raw_jitter[1] += pow(cv::norm(raw_t[k] - raw_t[k - 1] * 2.0 + raw_t[k - 2]), 2);
+      filt_jitter[0] += pow(cv::norm(filt_r[k] - filt_r[k - 1] * 2.0 + filt_r[k - 2]) * 180.0 / CV_PI, 2);
+      filt_jitter[1] += pow(cv::norm(filt_t[k] - filt_t[k - 1] * 2.0 + filt_t[k - 2]), 2);
+      jitter_count++;
+    }
+  }
+
+  printf("%8s %7s | %10s %10s | %10s %10s %10s %10s | %7s %7s\n", "lead ms", "scored", "hold deg", "hold tr",
+         "filter deg", "filter tr", "max deg", "max tr", "hid rot", "hid tr");
+  for(int l = 0; l < results.size(); l++) {
+    lead_result &res = results[l];
+    int n = std::max(1, res.scored);
+    double hold_rot = res.hold_rot_sum / n, hold_trans = res.hold_trans_sum / n;
+    double filt_rot = res.filt_rot_sum / n, filt_trans = res.filt_trans_sum / n;
+    printf("%8.1f %7d | %10.3f %10.4f | %10.3f %10.4f %10.3f %10.4f |", res.lead_ms, res.scored, hold_rot, hold_trans,
+           filt_rot, filt_trans, res.filt_rot_max, res.filt_trans_max);
+    if(hold_rot > 0 && hold_trans > 0) {
+      printf(" %6.1f%% %6.1f%%\n", 100.0 * (1.0 - filt_rot / hold_rot), 100.0 * (1.0 - filt_trans / hold_trans));
+    } else {
+      printf(" %7s %7s\n", "-", "-");
+    }
+  }
+  printf("\nhold: the last measured pose as is, the error the lag costs\n");
+  printf("filter: the filter's prediction lead ms ahead, at lead 0 this is the error smoothing adds\n");
+  printf("hid: share of the hold error the prediction removes\n");
+  if(jitter_count > 0) {
+    printf("jitter (rms change in velocity per pose, lead %.0f ms): raw %.4f deg %.5f, filtered %.4f deg %.5f\n", leads[0],
+           sqrt(raw_jitter[0] / jitter_count), sqrt(raw_jitter[1] / jitter_count),
+           sqrt(filt_jitter[0] / jitter_count), sqrt(filt_jitter[1] / jitter_count));
+  }
+  printf("filter restarts: %ld\n", resets);
+
+  if(strlen(csv_fn) > 0) {
+    FILE *fp = fopen(csv_fn, "w");
+    if(!fp) {
+      printf("Unable to open output file %s\n", csv_fn);
+      return(-1);
+    }
+    fprintf(fp, "lead_ms,scored,hold_rot_deg,hold_trans,filter_rot_deg,filter_trans,filter_rot_max_deg,filter_trans_max\n");
+    for(int l = 0; l < results.size(); l++) {
+      lead_result &res = results[l];
+      int n = std::max(1, res.scored);
+      fprintf(fp, "%.2f,%d,%.5f,%.6f,%.5f,%.6f,%.5f,%.6f\n", res.lead_ms, res.scored, res.hold_rot_sum / n,
+              res.hold_trans_sum / n, res.filt_rot_sum / n, res.filt_trans_sum / n, res.filt_rot_max, res.filt_trans_max);
+    }
+    fclose(fp);
+  }
+
+  return(0);
+}
@@ -0,0 +1,496 @@
+/**
+ * @file profiler.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Per-stage latency histograms
+ * @date 2022-04-12
+ */
+
+#include <cstdio>
+#include <cmath>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <new>
+#include "../include/profiler.h"
+
+// Log-linear buckets in nanoseconds, like an HDR histogram: values under
+// SUB_COUNT get a bucket each, above that every power of two is split into
+// SUB_COUNT buckets, so a bucket is never wider than ~3% of its value.
+#define SUB_BITS 5
+#define SUB_COUNT (1 << SUB_BITS)
+#define MAX_EXP 40 // 2^40 ns is about 18 minutes
+#define NUM_BUCKETS (SUB_COUNT + (MAX_EXP - SUB_BITS + 1) * SUB_COUNT)
+
+static const char *stage_names[NUM_STAGES] = {
+  "capture", "gray", "find", "subpix", "solvepnp", "project", "harris", "draw", "display", "frame", "latency", "motion"
+};
+
+// histograms of one thread, only that thread writes to them
+struct thread_hist {
+  std::atomic<uint64_t> counts[NUM_STAGES][NUM_BUCKETS];
+  std::atomic<int64_t> sum[NUM_STAGES];
+  std::atomic<int64_t> max[NUM_STAGES];
+};
+
+// every thread_hist ever made, kept after their threads exit so nothing is lost
+static std::mutex &registry_lock() {
+  static std::mutex lock;
+  return lock;
+}
+static std::vector<thread_hist *> &registry() {
+  static std::vector<thread_hist *> hists;
+  return hists;
+}
+
+static thread_local thread_hist *tl_hist = NULL;
+
+// one finished stage in the trace ring. The fields are atomics so a dump can
+// read a slot while it is being overwritten, seq tells it when that happened.
+struct trace_event {
+  std::atomic<uint64_t> seq; // position in the trace + 1, 0 while being written
+  std::atomic<int64_t> start; // ns on the prof_now clock
+  std::atomic<int64_t> dur;
+  std::atomic<int> stage;
+  std::atomic<int> tid;
+};
+
+static trace_event *trace_ring = NULL;
+static uint64_t trace_mask = 0;
+static std::atomic<uint64_t> trace_next(0);
+static std::atomic<bool> trace_on(false);
+static std::atomic<int> next_tid(0);
+static thread_local int tl_tid = -1;
+
+/**
+ * @brief Function to get the calling thread's histograms, making them on first use
+ *
+ * @return thread_hist*
+ */
+static thread_hist *local_hist() {
+  if(!tl_hist) {
+    tl_hist = new thread_hist(); // value-initialized, all zero
+    std::lock_guard<std::mutex> guard(registry_lock());
+    registry().push_back(tl_hist);
+  }
+  return tl_hist;
+}
+
+/**
+ * @brief Function to get the bucket a duration falls in
+ *
+ * @param ns duration in nanoseconds
+ * @return int
+ */
+static int bucket_index(uint64_t ns) {
+  if(ns < SUB_COUNT) {
+    return (int) ns;
+  }
+  int e = 63 - __builtin_clzll(ns);
+  if(e > MAX_EXP) {
+    return NUM_BUCKETS - 1;
+  }
+  int sub = (int) (ns >> (e - SUB_BITS)) - SUB_COUNT;
+  return SUB_COUNT + (e - SUB_BITS) * SUB_COUNT + sub;
+}
+
+/**
+ * @brief Function to get the duration a bucket stands for, its midpoint
+ *
+ * @param idx bucket index
+ * @return double nanoseconds
+ */
+static double bucket_value(int idx) {
+  if(idx < SUB_COUNT) {
+    return idx;
+  }
+  int e = (idx - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+  int sub = (idx - SUB_COUNT) % SUB_COUNT;
+  double width = ldexp(1.0, e - SUB_BITS);
+  return (SUB_COUNT + sub) * width + 0.5 * width;
+}
+
+/**
+ * @brief Function to get the name of a stage
+ *
+ * @param stage prof_stage
+ * @return const char*
+ */
+const char *prof_stage_name(int stage) {
+  if(stage < 0 || stage >= NUM_STAGES) {
+    return "unknown";
+  }
+  return stage_names[stage];
+}
+
+/**
+ * @brief Function to add one timing to a stage's histogram
+ *
+ * Every thread writes to its own histograms, so recording takes no lock and
+ * no atomic read-modify-write.
+ *
+ * @param stage prof_stage
+ * @param ns duration in nanoseconds
+ */
+void prof_record(int stage, int64_t ns) {
+  if(stage < 0 || stage >= NUM_STAGES) {
+    return;
+  }
+  if(ns < 0) {
+    ns = 0;
+  }
+
+  thread_hist *h = local_hist();
+  std::atomic<uint64_t> &count = h->counts[stage][bucket_index(ns)];
+  count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  h->sum[stage].store(h->sum[stage].load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+  if(ns > h->max[stage].load(std::memory_order_relaxed)) {
+    h->max[stage].store(ns, std::memory_order_relaxed);
+  }
+
+  if(trace_on.load(std::memory_order_relaxed)) {
+    if(tl_tid < 0) {
+      tl_tid = next_tid++;
+    }
+    uint64_t pos = trace_next.fetch_add(1, std::memory_order_relaxed);
+    trace_event &ev = trace_ring[pos & trace_mask];
+    ev.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    ev.start.store(prof_now() - ns, std::memory_order_relaxed);
+    ev.dur.store(ns, std::memory_order_relaxed);
+    ev.stage.store(stage, std::memory_order_relaxed);
+    ev.tid.store(tl_tid, std::memory_order_relaxed);
+    ev.seq.store(pos + 1, std::memory_order_release);
+  }
+}
+
+/**
+ * @brief Function to start recording every timed stage into a trace
+ *
+ * Events go into a ring buffer allocated here, so recording never allocates.
+ * Once it is full the oldest events are overwritten.
+ *
+ * @param capacity number of events kept, rounded up to a power of two
+ * @return int return non-zero value on failure
+ */
+int trace_start(int capacity) {
+  if(!trace_ring) {
+    uint64_t size = 1;
+    while(size < (uint64_t) std::max(capacity, 1)) {
+      size <<= 1;
+    }
+    // never freed, a thread can still be writing to it when the program ends
+    trace_ring = new (std::nothrow) trace_event[size]();
+    if(!trace_ring) {
+      printf("Unable to allocate a trace of %llu events\n", (unsigned long long) size);
+      return(-1);
+    }
+    trace_mask = size - 1;
+  }
+  trace_on = true;
+  return(0);
+}
+
+/**
+ * @brief Function to check whether a trace is being recorded
+ *
+ * @return true between trace_start and trace_stop
+ */
+bool trace_enabled() {
+  return trace_on.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Function to stop recording the trace, events already recorded are kept
+ *
+ * @return int
+ */
+int trace_stop() {
+  trace_on = false;
+  return(0);
+}
+
+/**
+ * @brief Function to write the recorded events as Chrome trace JSON
+ *
+ * The file opens in chrome://tracing or ui.perfetto.dev, with one track per thread.
+ *
+ * @param filename name of json file
+ * @return int return non-zero value on failure
+ */
+int trace_dump_json(const char *filename) {
+  if(!trace_ring) {
+    printf("No trace was recorded\n");
+    return(-1);
+  }
+
+  FILE *fp = fopen(filename, "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename);
+    return(-1);
+  }
+
+  uint64_t end = trace_next.load(std::memory_order_acquire);
+  uint64_t begin = end > trace_mask + 1 ? end - (trace_mask + 1) : 0;
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  int nthreads = next_tid.load();
+  for(int t = 0; t < nthreads; t++) {
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}},\n", t, t);
+  }
+
+  int written = 0;
+  int skipped = 0;
+  for(uint64_t pos = begin; pos < end; pos++) {
+    trace_event &ev = trace_ring[pos & trace_mask];
+    uint64_t seq = ev.seq.load(std::memory_order_acquire);
+    int64_t start = ev.start.load(std::memory_order_relaxed);
+    int64_t dur = ev.dur.load(std::memory_order_relaxed);
+    int stage = ev.stage.load(std::memory_order_relaxed);
+    int tid = ev.tid.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(seq != pos + 1 || ev.seq.load(std::memory_order_relaxed) != seq) {
+      skipped++; // still being written, or already overwritten
+      continue;
+    }
+    fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+            written > 0 ? ",\n" : "", prof_stage_name(stage), tid, start / 1e3, dur / 1e3);
+    written++;
+  }
+  if(written == 0) {
+    // drop the trailing comma after the thread names
+    fprintf(fp, "{\"name\":\"empty\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{}}");
+  }
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+
+  printf("Wrote %d trace events to %s", written, filename);
+  if(begin > 0 || skipped > 0) {
+    printf(" (%llu older events overwritten, %d in flight)", (unsigned long long) begin, skipped);
+  }
+  printf("\n");
+
+  return(0);
+}
+
+// one stage merged over every thread
+struct stage_summary {
+  uint64_t count;
+  double mean, p50, p95, p99, max; // milliseconds
+};
+
+/**
+ * @brief Function to merge the histograms of every thread and get the percentiles
+ *
+ * @param summaries NUM_STAGES summaries to write to
+ */
+static void summarize(stage_summary *summaries) {
+  std::vector<uint64_t> merged(NUM_BUCKETS);
+
+  std::lock_guard<std::mutex> guard(registry_lock());
+  std::vector<thread_hist *> &hists = registry();
+
+  for(int s = 0; s < NUM_STAGES; s++) {
+    uint64_t total = 0;
+    int64_t sum = 0;
+    int64_t max = 0;
+    for(int b = 0; b < NUM_BUCKETS; b++) {
+      merged[b] = 0;
+    }
+    for(int t = 0; t < hists.size(); t++) {
+      for(int b = 0; b < NUM_BUCKETS; b++) {
+        merged[b] += hists[t]->counts[s][b].load(std::memory_order_relaxed);
+      }
+      sum += hists[t]->sum[s].load(std::memory_order_relaxed);
+      max = std::max(max, (int64_t) hists[t]->max[s].load(std::memory_order_relaxed));
+    }
+    for(int b = 0; b < NUM_BUCKETS; b++) {
+      total += merged[b];
+    }
+
+    stage_summary &out = summaries[s];
+    out.count = total;
+    out.mean = total > 0 ? sum / 1e6 / total : 0;
+    out.max = max / 1e6;
+
+    const double pcts[3] = { 0.50, 0.95, 0.99 };
+    double *vals[3] = { &out.p50, &out.p95, &out.p99 };
+    for(int k = 0; k < 3; k++) {
+      *vals[k] = 0;
+      uint64_t target = (uint64_t) ceil(pcts[k] * total);
+      uint64_t seen = 0;
+      for(int b = 0; b < NUM_BUCKETS && total > 0; b++) {
+        seen += merged[b];
+        if(seen >= target) {
+          *vals[k] = std::min(bucket_value(b), (double) max) / 1e6;
+          break;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * @brief Function to write p50/p95/p99 of every stage, merged over all threads, to a csv
+ *
+ * @param filename name of csv file
+ * @return int return non-zero value on failure
+ */
+int prof_dump_csv(const char *filename) {
+  stage_summary summaries[NUM_STAGES];
+  summarize(summaries);
+
+  FILE *fp = fopen(filename, "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename);
+    return(-1);
+  }
+
+  fprintf(fp, "stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n");
+  for(int s = 0; s < NUM_STAGES; s++) {
+    stage_summary &st = summaries[s];
+    if(st.count == 0) {
+      continue;
+    }
+    fprintf(fp, "%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f\n", stage_names[s], (unsigned long long) st.count,
+            st.mean, st.p50, st.p95, st.p99, st.max);
+  }
+
+  fclose(fp);
+  return(0);
+}
+
+/**
+ * @brief Function to print p50/p95/p99 of every stage
+ *
+ * @return int
+ */
+int prof_print() {
+  stage_summary summaries[NUM_STAGES];
+  summarize(summaries);
+
+  printf("%-9s %8s %9s %9s %9s %9s %9s\n", "stage", "count", "mean ms", "p50 ms", "p95 ms", "p99 ms", "max ms");
+  for(int s = 0; s < NUM_STAGES; s++) {
+    stage_summary &st = summaries[s];
+    if(st.count == 0) {
+      continue;
+    }
+    printf("%-9s %8llu %9.3f %9.3f %9.3f %9.3f %9.3f\n", stage_names[s], (unsigned long long) st.count,
+           st.mean, st.p50, st.p95, st.p99, st.max);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to get p95 of every stage, merged over all threads
+ *
+ * @param p95_ms NUM_STAGES values in milliseconds to write to, 0 for stages never timed
+ * @param counts if not NULL, NUM_STAGES timing counts to write to
+ * @return int
+ */
+int prof_stage_p95(double *p95_ms, uint64_t *counts) {
+  stage_summary summaries[NUM_STAGES];
+  summarize(summaries);
+
+  for(int s = 0; s < NUM_STAGES; s++) {
+    p95_ms[s] = summaries[s].p95;
+    if(counts) {
+      counts[s] = summaries[s].count;
+    }
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to read the p95 of every stage back from a csv written by prof_dump_csv
+ *
+ * @param filename name of csv file
+ * @param p95_ms NUM_STAGES values in milliseconds to write to, -1 for stages not in the file
+ * @return int return non-zero value on failure
+ */
+int prof_read_p95_csv(const char *filename, double *p95_ms) {
+  FILE *fp = fopen(filename, "r");
+  if(!fp) {
+    printf("Unable to open %s\n", filename);
+    return(-1);
+  }
+
+  for(int s = 0; s < NUM_STAGES; s++) {
+    p95_ms[s] = -1;
+  }
+
+  // stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms, the first line is the header
+  char line[256];
+  char name[64];
+  unsigned long long count;
+  double mean, p50, p95;
+  int rows = 0;
+  while(fgets(line, sizeof(line), fp)) {
+    if(sscanf(line, "%63[^,],%llu,%lf,%lf,%lf", name, &count, &mean, &p50, &p95) != 5) {
+      continue;
+    }
+    for(int s = 0; s < NUM_STAGES; s++) {
+      if(strcmp(name, stage_names[s]) == 0) {
+        p95_ms[s] = p95;
+        rows++;
+      }
+    }
+  }
+
+  fclose(fp);
+  if(rows == 0) {
+    printf("No stage timings in %s\n", filename);
+    return(-1);
+  }
+  return(0);
+}
+
+/**
+ * @brief Function to get the total time spent in every stage, summed over all threads
+ *
+ * Cheap enough to call once a second, the difference between two calls is the
+ * time spent in between.
+ *
+ * @param sums NUM_STAGES totals in nanoseconds to write to
+ * @return int
+ */
+int prof_stage_sums(int64_t *sums) {
+  std::lock_guard<std::mutex> guard(registry_lock());
+  std::vector<thread_hist *> &hists = registry();
+
+  for(int s = 0; s < NUM_STAGES; s++) {
+    sums[s] = 0;
+    for(int t = 0; t < hists.size(); t++) {
+      sums[s] += hists[t]->sum[s].load(std::memory_order_relaxed);
+    }
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to clear every histogram
+ *
+ * Only meant for between runs, counts recorded at the same time can be lost.
+ *
+ * @return int
+ */
+int prof_reset() {
+  std::lock_guard<std::mutex> guard(registry_lock());
+  std::vector<thread_hist *> &hists = registry();
+
+  for(int t = 0; t < hists.size(); t++) {
+    for(int s = 0; s < NUM_STAGES; s++) {
+      for(int b = 0; b < NUM_BUCKETS; b++) {
+        hists[t]->counts[s][b].store(0, std::memory_order_relaxed);
+      }
+      hists[t]->sum[s].store(0, std::memory_order_relaxed);
+      hists[t]->max[s].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  return(0);
+}
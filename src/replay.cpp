@@ -0,0 +1,148 @@
+/**
+ * @file replay.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief The ar.exe and gif.exe frame loops run over recordings, and their golden files
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "../include/csv_util.h"
+#include "../include/profiler.h"
+#include "../include/synth.h"
+#include "../include/replay.h"
+
+/**
+ * @brief Function to run one frame of a recording through a pipeline
+ *
+ * Converts the frame to gray and runs it through run_frame_pipeline like the
+ * camera loops do, timing the whole frame into the profiler and counting it
+ * with end_frame if it allocated.
+ *
+ * @param p pipeline
+ * @param frame BGR or gray frame, the overlay is drawn on it in place
+ * @param time_ns capture time of the frame, for the pose filter
+ * @param r result to write to
+ * @param draw whether to draw the overlay, frames that are only run to bring the state up to date skip it
+ * @return int return non-zero value on failure
+ */
+int replay_frame(frame_pipeline &p, cv::Mat &frame, int64_t time_ns, pipeline_result &r, bool draw) {
+  if(frame.empty()) {
+    return(-1);
+  }
+  int64_t frame_start = prof_now();
+  begin_frame(p.ws);
+
+  if(frame.channels() == 3) {
+    PROF_SCOPE(STAGE_GRAY);
+    ALLOC_EXEMPT(EXEMPT_IMGPROC);
+    cv::cvtColor(frame, p.gray, cv::COLOR_BGR2GRAY);
+  } else {
+    p.gray = frame;
+  }
+
+  cv::Mat none;
+  int ret = run_frame_pipeline(p, p.gray, draw ? frame : none, time_ns, r);
+  end_frame(p.ws);
+
+  prof_record(STAGE_FRAME, prof_now() - frame_start);
+  return ret;
+}
+
+/**
+ * @brief Function to write the results of a sequence as golden files
+ *
+ * dir gets corners.csv (a row per frame, just the name where the board was not
+ * found) and poses.csv (the measured pose of the frames where it was).
+ *
+ * @param dir directory to write to, created if it does not exist
+ * @param names name of each frame
+ * @param times capture time of each frame
+ * @param results result of each frame
+ * @return int return non-zero value on failure
+ */
+int write_replay_golden(const std::string &dir, const std::vector<std::string> &names, const std::vector<int64_t> &times, const std::vector<pipeline_result> &results) {
+#ifdef _WIN32
+  _mkdir(dir.c_str());
+#else
+  mkdir(dir.c_str(), 0755);
+#endif
+  std::string corners_fn = dir + "/corners.csv";
+  std::string poses_fn = dir + "/poses.csv";
+
+  std::vector<std::string> found_names;
+  std::vector<synth_pose> poses;
+  for(int i = 0; i < results.size(); i++) {
+    const pipeline_result &r = results[i];
+    std::vector<cv::Point2f> none;
+    if(append_corner_data_csv((char *) corners_fn.c_str(), names[i].c_str(), r.found ? r.corners : none, i == 0) != 0) {
+      return(-1);
+    }
+    if(r.found) {
+      synth_pose pose;
+      pose.time_ns = times[i];
+      pose.rvec = r.rvec;
+      pose.tvec = r.tvec;
+      found_names.push_back(names[i]);
+      poses.push_back(pose);
+    }
+  }
+
+  return write_synth_poses_csv(poses_fn.c_str(), found_names, poses);
+}
+
+/**
+ * @brief Function to read golden files written by write_replay_golden
+ *
+ * @param dir directory to read from
+ * @param names name of each frame to write to
+ * @param results result of each frame to write to, without the drawn pose
+ * @return int return non-zero value on failure
+ */
+int read_replay_golden(const std::string &dir, std::vector<std::string> &names, std::vector<pipeline_result> &results) {
+  std::string corners_fn = dir + "/corners.csv";
+  std::string poses_fn = dir + "/poses.csv";
+
+  std::vector<std::vector<cv::Point2f> > corners;
+  if(read_corner_data_csv((char *) corners_fn.c_str(), names, corners) != 0) {
+    return(-1);
+  }
+  std::vector<std::string> pose_names;
+  std::vector<synth_pose> poses;
+  if(read_synth_poses_csv(poses_fn.c_str(), pose_names, poses) != 0) {
+    return(-1);
+  }
+  std::map<std::string, int> pose_of;
+  for(int i = 0; i < pose_names.size(); i++) {
+    pose_of[pose_names[i]] = i;
+  }
+
+  results.clear();
+  for(int i = 0; i < names.size(); i++) {
+    pipeline_result r;
+    r.found = !corners[i].empty();
+    r.corners = corners[i];
+    std::map<std::string, int>::iterator it = pose_of.find(names[i]);
+    if(r.found && it == pose_of.end()) {
+      printf("%s has corners for %s but no pose in %s\n", dir.c_str(), names[i].c_str(), poses_fn.c_str());
+      return(-1);
+    }
+    if(r.found) {
+      r.rvec = poses[it->second].rvec;
+      r.tvec = poses[it->second].tvec;
+    }
+    r.draw_rvec = r.rvec;
+    r.draw_tvec = r.tvec;
+    results.push_back(r);
+  }
+
+  return(0);
+}
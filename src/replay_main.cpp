@@ -0,0 +1,368 @@
+/**
+ * @file replay_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for replaying a sequence headless and checking it against golden poses and timings
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "../include/csv_util.h"
+#include "../include/cal_profile.h"
+#include "../include/frame_source.h"
+#include "../include/profiler.h"
+#include "../include/pose_filter.h"
+#include "../include/replay.h"
+
+#define TIME_FLOOR_MS 0.05 // added to every stage budget, sub-millisecond stages jitter by more than any slack
+
+// how far a frame may be from its golden result
+struct replay_tolerance {
+  double corner_px; // largest corner distance
+  double rot_rad; // rotation_distance between the poses
+  double trans; // translation distance in board squares
+};
+
+// one frame compared against its golden result
+struct frame_diff {
+  bool found_changed;
+  double corner_err; // largest corner distance, -1 when there is nothing to compare
+  double rot_err;
+  double trans_err;
+  bool failed;
+};
+
+/**
+ * @brief Function to compare one frame against its golden result
+ *
+ * @param golden golden result
+ * @param now result of this run
+ * @param tol tolerances
+ * @param d diff to write to
+ * @return int
+ */
+static int diff_frame(const pipeline_result &golden, const pipeline_result &now, const replay_tolerance &tol, frame_diff &d) {
+  d.found_changed = golden.found != now.found;
+  d.corner_err = -1;
+  d.rot_err = -1;
+  d.trans_err = -1;
+  d.failed = d.found_changed;
+  if(!golden.found || !now.found) {
+    return 0;
+  }
+
+  if(golden.corners.size() != now.corners.size()) {
+    d.corner_err = HUGE_VAL; // a ChArUco board saw a different part of the board
+  } else {
+    d.corner_err = 0;
+    for(int i = 0; i < now.corners.size(); i++) {
+      d.corner_err = std::max(d.corner_err, (double) cv::norm(now.corners[i] - golden.corners[i]));
+    }
+  }
+  d.rot_err = rotation_distance(golden.rvec, now.rvec);
+  d.trans_err = cv::norm(now.tvec - golden.tvec);
+  d.failed = d.corner_err > tol.corner_px || d.rot_err > tol.rot_rad || d.trans_err > tol.trans;
+
+  return 0;
+}
+
+int main(int argc, char *argv[]) {
+  pipeline_settings set;
+  init_pipeline_settings(set);
+
+  char cal_fn[256] = "";
+  char obj_fn[256] = "shuttle.obj";
+  char kerm_dir[256] = "kerm";
+  cv::Size patternsize(9, 6);
+  double fps = 30; // frame times for the pose filter
+  std::string golden_dir = "";
+  std::string update_dir = "";
+  char budget_fn[256] = ""; // golden_dir/profile.csv unless given
+  bool timing = true;
+  bool check_allocs = false; // fail when a frame allocates or reallocates a pipeline buffer after warm up
+  double time_slack = 1.5; // a stage fails when its p95 is over budget * slack + TIME_FLOOR_MS
+  char report_fn[256] = "";
+  int show = 20; // failing frames printed
+  replay_tolerance tol;
+  tol.corner_px = 0.05;
+  tol.rot_rad = 1e-3;
+  tol.trans = 1e-3;
+  std::string source = "";
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+      set.mode = parse_pipeline_mode(argv[++i]);
+      if(set.mode < 0) {
+        printf("Unknown mode %s (ar, gif)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--overlay") == 0 && i + 1 < argc) {
+      i++;
+      set.overlay = strcmp(argv[i], "house") == 0 ? OVERLAY_HOUSE : (strcmp(argv[i], "obj") == 0 ? OVERLAY_OBJ : OVERLAY_AXES);
+    } else if(strcmp(argv[i], "--detector") == 0 && i + 1 < argc) {
+      set.backend = parse_detector_backend(argv[++i]);
+      if(!detector_available(set.backend)) {
+        printf("Unknown or unavailable detector %s (classic, sb, charuco)\n", argv[i]);
+        return(-1);
+      }
+    } else if(strcmp(argv[i], "--detect-scale") == 0 && i + 1 < argc) {
+      set.det_scale = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--no-motion-gate") == 0) {
+      set.gating = false;
+    } else if(strcmp(argv[i], "--multi-board") == 0) {
+      set.multi_board = true;
+    } else if(strcmp(argv[i], "--max-boards") == 0 && i + 1 < argc) {
+      set.max_boards = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--motion-threshold") == 0 && i + 1 < argc) {
+      set.motion_threshold = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--motion-max-reuse") == 0 && i + 1 < argc) {
+      set.motion_max_reuse = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--pose-filter") == 0) {
+      set.filtering = true;
+    } else if(strcmp(argv[i], "--pose-lead-ms") == 0 && i + 1 < argc) {
+      set.filtering = true;
+      set.pose_lead_ms = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--calib") == 0 && i + 1 < argc) {
+      strncpy(cal_fn, argv[++i], sizeof(cal_fn) - 1);
+    } else if(strcmp(argv[i], "--obj") == 0 && i + 1 < argc) {
+      strncpy(obj_fn, argv[++i], sizeof(obj_fn) - 1);
+    } else if(strcmp(argv[i], "--kerm") == 0 && i + 1 < argc) {
+      strncpy(kerm_dir, argv[++i], sizeof(kerm_dir) - 1);
+    } else if(strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%dx%d", &patternsize.width, &patternsize.height);
+    } else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+      golden_dir = argv[++i];
+    } else if(strcmp(argv[i], "--update") == 0 && i + 1 < argc) {
+      update_dir = argv[++i];
+    } else if(strcmp(argv[i], "--budget") == 0 && i + 1 < argc) {
+      strncpy(budget_fn, argv[++i], sizeof(budget_fn) - 1);
+    } else if(strcmp(argv[i], "--check-allocs") == 0) {
+      check_allocs = true;
+    } else if(strcmp(argv[i], "--no-timing") == 0) {
+      timing = false;
+    } else if(strcmp(argv[i], "--time-slack") == 0 && i + 1 < argc) {
+      time_slack = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--corner-tol") == 0 && i + 1 < argc) {
+      tol.corner_px = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--rot-tol") == 0 && i + 1 < argc) {
+      tol.rot_rad = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--trans-tol") == 0 && i + 1 < argc) {
+      tol.trans = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+      strncpy(report_fn, argv[++i], sizeof(report_fn) - 1);
+    } else if(strcmp(argv[i], "--show") == 0 && i + 1 < argc) {
+      show = atoi(argv[++i]);
+    } else {
+      source = argv[i];
+    }
+  }
+
+  if(source.empty() || golden_dir.empty() == update_dir.empty()) {
+    printf("usage: %s (--golden dir | --update dir) [--mode ar|gif] [--overlay axes|house|obj] [--detector name]\n", argv[0]);
+    printf("          [--detect-scale s] [--no-motion-gate] [--multi-board] [--max-boards n] [--pose-filter] [--pose-lead-ms ms]\n");
+    printf("          [--calib calibration.csv] [--board WxH] [--fps f] [--budget profile.csv] [--no-timing] [--time-slack x]\n");
+    printf("          [--check-allocs] [--corner-tol px] [--rot-tol rad] [--trans-tol squares] [--report diff.csv] <video or image dir>\n");
+    printf("  runs every frame through the ar.exe (or gif.exe) processing without a window. --update writes\n");
+    printf("  the corners, poses and stage timings as golden files, --golden checks a run against them\n");
+    return(-1);
+  }
+  if(fps <= 0 || time_slack <= 0) {
+    printf("--fps and --time-slack must be positive\n");
+    return(-1);
+  }
+
+  // an image directory from synth.exe carries the calibration it was rendered with
+  if(strlen(cal_fn) == 0) {
+    std::string own = source + "/calibration.csv";
+    FILE *fp = fopen(own.c_str(), "r");
+    strncpy(cal_fn, fp ? own.c_str() : "calibration.csv", sizeof(cal_fn) - 1);
+    if(fp) {
+      fclose(fp);
+    }
+  }
+  cal_profile calib;
+  if(read_cal_profile_csv(cal_fn, "", calib, 0) != 0) {
+    printf("Unable to read %s\n", cal_fn);
+    return(-1);
+  }
+
+  pipeline_model model;
+  if(load_pipeline_model(set.mode, patternsize, obj_fn, kerm_dir, model) != 0) {
+    return(-1);
+  }
+  frame_pipeline pipe;
+  if(open_frame_pipeline(set, calib, &model, pipe) != 0) {
+    return(-1);
+  }
+
+  frame_source src;
+  if(open_frame_source(source, src) != 0) {
+    return(-1);
+  }
+  if(src.live) {
+    printf("%s is a camera, replay a recording\n", source.c_str());
+    return(-1);
+  }
+
+  // every frame goes through, however long it takes, and nothing is shown
+  std::vector<std::string> names;
+  std::vector<int64_t> times;
+  std::vector<pipeline_result> results;
+  pipeline_result result; // reused, so a frame's corners are only copied out after it is counted
+  cv::Mat frame;
+  prof_reset();
+  for(long k = 0; ; k++) {
+    int64_t t0 = prof_now();
+    if(read_frame_source(src, frame) != 0) {
+      break;
+    }
+    prof_record(STAGE_CAPTURE, prof_now() - t0);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%05ld", k);
+    names.push_back(name);
+    times.push_back((int64_t) (k * 1e9 / fps));
+    if(replay_frame(pipe, frame, times.back(), result) != 0) {
+      printf("Unable to process frame %ld\n", k);
+      return(-1);
+    }
+    results.push_back(result);
+  }
+  close_frame_source(src);
+
+  int found = 0;
+  for(int i = 0; i < results.size(); i++) {
+    found += results[i].found ? 1 : 0;
+  }
+  printf("%s: %d frames, board found in %d\n", source.c_str(), (int) results.size(), found);
+  prof_print();
+
+  // once warmed up a frame must not go to the heap outside the exempt OpenCV calls,
+  // and the pipeline's buffers have to keep their memory from frame to frame
+  bool allocated = print_frame_allocs(pipe.ws, "replay") != 0;
+  if(check_allocs && alloc_count() < 0) {
+    printf("replay: built without -DAR_COUNT_ALLOCS, --check-allocs only checks that buffers kept their memory\n");
+  }
+  if(check_allocs && allocated) {
+    printf("FAIL: frames allocated on the heap or reallocated pipeline buffers after warm up\n");
+  }
+  bool alloc_failed = check_allocs && allocated;
+
+  if(!update_dir.empty()) {
+    if(write_replay_golden(update_dir, names, times, results) != 0) {
+      return(-1);
+    }
+    std::string prof_fn = update_dir + "/profile.csv";
+    if(prof_dump_csv(prof_fn.c_str()) != 0) {
+      return(-1);
+    }
+    printf("Wrote corners.csv, poses.csv and the profile.csv budget to %s\n", update_dir.c_str());
+    return(alloc_failed ? 1 : 0);
+  }
+
+  std::vector<std::string> golden_names;
+  std::vector<pipeline_result> golden;
+  if(read_replay_golden(golden_dir, golden_names, golden) != 0) {
+    return(-1);
+  }
+
+  int failed = alloc_failed ? 1 : 0;
+  if(golden.size() != results.size()) {
+    printf("FAIL: %d frames, the golden files have %d\n", (int) results.size(), (int) golden.size());
+    failed++;
+  }
+
+  // per-frame diff, every frame goes in the report and the failing ones are printed
+  FILE *report = NULL;
+  if(strlen(report_fn) > 0) {
+    report = fopen(report_fn, "w");
+    if(!report) {
+      printf("Unable to open output file %s\n", report_fn);
+      return(-1);
+    }
+    fprintf(report, "frame,golden_found,found,corner_err_px,rot_err_rad,trans_err,status\n");
+  }
+  int failed_frames = 0;
+  int found_changed = 0;
+  double worst_corner = 0, worst_rot = 0, worst_trans = 0;
+  int n = std::min(golden.size(), results.size());
+  for(int i = 0; i < n; i++) {
+    frame_diff d;
+    diff_frame(golden[i], results[i], tol, d);
+    worst_corner = std::max(worst_corner, d.corner_err);
+    worst_rot = std::max(worst_rot, d.rot_err);
+    worst_trans = std::max(worst_trans, d.trans_err);
+    found_changed += d.found_changed ? 1 : 0;
+    if(report) {
+      fprintf(report, "%s,%d,%d,%.5f,%.6f,%.6f,%s\n", names[i].c_str(), golden[i].found ? 1 : 0, results[i].found ? 1 : 0,
+              d.corner_err, d.rot_err, d.trans_err, d.failed ? "FAIL" : "ok");
+    }
+    if(!d.failed) {
+      continue;
+    }
+    if(failed_frames < show) {
+      if(d.found_changed) {
+        printf("  frame %s: board %s, golden %s\n", names[i].c_str(), results[i].found ? "found" : "lost",
+               golden[i].found ? "found" : "lost");
+      } else {
+        printf("  frame %s: corners %.4f px, rotation %.6f rad, translation %.6f\n", names[i].c_str(), d.corner_err,
+               d.rot_err, d.trans_err);
+      }
+    }
+    failed_frames++;
+  }
+  if(report) {
+    fclose(report);
+  }
+  printf("poses: %d/%d frames differ (%d found or lost), worst corner %.4f px, rotation %.6f rad, translation %.6f\n",
+         failed_frames, n, found_changed, worst_corner, worst_rot, worst_trans);
+  if(failed_frames > 0) {
+    printf("FAIL: poses outside --corner-tol %.4f --rot-tol %.6f --trans-tol %.6f\n", tol.corner_px, tol.rot_rad, tol.trans);
+    failed++;
+  }
+
+  if(timing) {
+    if(strlen(budget_fn) == 0) {
+      snprintf(budget_fn, sizeof(budget_fn), "%s/profile.csv", golden_dir.c_str());
+    }
+    double budget[NUM_STAGES];
+    double p95[NUM_STAGES];
+    uint64_t counts[NUM_STAGES];
+    if(prof_read_p95_csv(budget_fn, budget) != 0) {
+      return(-1);
+    }
+    prof_stage_p95(p95, counts);
+
+    printf("%-9s %10s %10s %10s\n", "stage", "p95 ms", "budget ms", "limit ms");
+    int over = 0;
+    for(int s = 0; s < NUM_STAGES; s++) {
+      if(budget[s] < 0 || counts[s] == 0) {
+        continue;
+      }
+      double limit = budget[s] * time_slack + TIME_FLOOR_MS;
+      bool slow = p95[s] > limit;
+      over += slow ? 1 : 0;
+      printf("%-9s %10.3f %10.3f %10.3f%s\n", prof_stage_name(s), p95[s], budget[s], limit, slow ? "  SLOW" : "");
+    }
+    if(over > 0) {
+      printf("FAIL: %d stages over their p95 budget in %s\n", over, budget_fn);
+      failed++;
+    }
+  }
+
+  if(failed > 0) {
+    if(strlen(report_fn) > 0) {
+      printf("Per-frame diff in %s\n", report_fn);
+    }
+    return(1);
+  }
+  printf("PASS\n");
+  return(0);
+}
@@ -0,0 +1,288 @@
+/**
+ * @file session.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Functions for running several AR cameras on one thread pool
+ * @date 2022-04-05
+ */
+
+#include "../include/session.h"
+#include "../include/csv_util.h"
+#include "../include/profiler.h"
+
+/**
+ * @brief Function to get the milliseconds between two times
+ *
+ * @param from earlier time
+ * @param to later time
+ * @return double
+ */
+static double elapsed_ms(frame_time from, frame_time to) {
+  return std::chrono::duration<double, std::milli>(to - from).count();
+}
+
+/**
+ * @brief Function to open a session's source and calibration
+ *
+ * @param id index of the session
+ * @param spec frame source, optionally followed by @camera_id to pick the calibration profile
+ * @param cal_fn calibration csv
+ * @param model shared board and obj data
+ * @param overlay overlay_mode to draw
+ * @param s session to write to
+ * @return int return non-zero value on failure
+ */
+int open_session(int id, const std::string &spec, char *cal_fn, const ar_model *model, int overlay, ar_session &s) {
+  std::string source = spec;
+  std::string camera_id = "";
+  size_t at = spec.rfind('@');
+  if(at != std::string::npos) {
+    source = spec.substr(0, at);
+    camera_id = spec.substr(at + 1);
+  }
+
+  if(read_cal_profile_csv(cal_fn, camera_id, s.calib, 0) != 0) {
+    return(-1);
+  }
+  if(open_frame_source(source, s.source) != 0) {
+    return(-1);
+  }
+
+  s.id = id;
+  s.overlay = overlay;
+  s.model = model;
+  s.poses = NULL;
+  s.frame_no = 0;
+  s.pose_valid = false;
+  s.busy = false;
+  s.out_new = false;
+  s.stats = session_stats();
+  s.stats.window_start = std::chrono::steady_clock::now();
+  s.stop = false;
+  s.done = false;
+
+  return(0);
+}
+
+/**
+ * @brief Function to record a finished frame
+ *
+ * @param s session the frame belongs to
+ * @param dst frame with the overlay drawn on it
+ * @param captured time the frame was captured
+ */
+static void finish_session_frame(ar_session &s, cv::Mat &dst, frame_time captured) {
+  double latency = elapsed_ms(captured, std::chrono::steady_clock::now());
+  prof_record(STAGE_FRAME, (int64_t) (latency * 1e6));
+
+  std::lock_guard<std::mutex> guard(s.lock);
+  s.out = dst;
+  s.out_new = true;
+  s.stats.frames++;
+  s.stats.found += s.pose_valid ? 1 : 0;
+  s.stats.latency_sum += latency;
+  s.stats.latency_max = std::max(s.stats.latency_max, latency);
+}
+
+/**
+ * @brief Function run on the pool for a live frame, then for whatever frame arrived meanwhile
+ *
+ * @param pool pool shared by all sessions
+ * @param s session the frame belongs to
+ * @param frame captured frame
+ * @param captured time the frame was captured
+ */
+static void run_live_frame(thread_pool &pool, ar_session &s, cv::Mat frame, frame_time captured) {
+  cv::Mat dst;
+  process_session_frame(s, frame, dst, captured);
+  finish_session_frame(s, dst, captured);
+
+  std::lock_guard<std::mutex> guard(s.lock);
+  if(s.pending.empty() || s.stop) {
+    s.busy = false;
+    return;
+  }
+
+  // go to the back of the line so the other cameras get their turn first
+  cv::Mat next = s.pending;
+  frame_time next_time = s.pending_time;
+  s.pending.release();
+  pool.submit([&pool, &s, next, next_time] { run_live_frame(pool, s, next, next_time); });
+}
+
+/**
+ * @brief Function run on the pool to read and process the next frame of a file source
+ *
+ * @param pool pool shared by all sessions
+ * @param s session to step
+ */
+static void run_file_step(thread_pool &pool, ar_session &s) {
+  cv::Mat frame;
+  if(s.stop || read_frame_source(s.source, frame) != 0) {
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.done = true;
+    s.busy = false;
+    return;
+  }
+
+  frame_time captured = std::chrono::steady_clock::now();
+  cv::Mat dst;
+  process_session_frame(s, frame, dst, captured);
+  finish_session_frame(s, dst, captured);
+
+  pool.submit([&pool, &s] { run_file_step(pool, s); });
+}
+
+/**
+ * @brief Function run on a session's own thread to pull frames off a camera
+ *
+ * The thread only waits on the driver. Processing goes to the pool, and a frame
+ * that arrives while the previous one is still being processed replaces any
+ * frame already waiting.
+ *
+ * @param pool pool shared by all sessions
+ * @param s session to capture for
+ */
+static void run_capture(thread_pool &pool, ar_session &s) {
+  while(!s.stop) {
+    cv::Mat frame;
+    int64_t t0 = prof_now();
+    if(read_frame_source(s.source, frame) != 0) {
+      s.done = true;
+      break;
+    }
+    prof_record(STAGE_CAPTURE, prof_now() - t0);
+    frame_time captured = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> guard(s.lock);
+    if(s.busy) {
+      if(!s.pending.empty()) {
+        s.stats.dropped++;
+      }
+      s.pending = frame;
+      s.pending_time = captured;
+      continue;
+    }
+    s.busy = true;
+    pool.submit([&pool, &s, frame, captured] { run_live_frame(pool, s, frame, captured); });
+  }
+}
+
+/**
+ * @brief Function to start feeding a session's frames to the pool
+ *
+ * @param pool pool shared by all sessions
+ * @param s session to start
+ * @return int return non-zero value on failure
+ */
+int start_session(thread_pool &pool, ar_session &s) {
+  if(s.source.live) {
+    s.capture_thread = std::thread(run_capture, std::ref(pool), std::ref(s));
+    return(0);
+  }
+
+  s.busy = true;
+  pool.submit([&pool, &s] { run_file_step(pool, s); });
+  return(0);
+}
+
+/**
+ * @brief Function to stop a session and wait for its capture thread
+ *
+ * Frames already queued on the pool still finish, call pool.wait_idle() before
+ * destroying the session.
+ *
+ * @param s session to stop
+ * @return int
+ */
+int stop_session(ar_session &s) {
+  s.stop = true;
+  if(s.capture_thread.joinable()) {
+    s.capture_thread.join();
+  }
+  return(0);
+}
+
+/**
+ * @brief Function to detect the board and draw the overlay on one frame
+ *
+ * @param s session the frame belongs to
+ * @param frame captured frame, the overlay is drawn on it in place
+ * @param dst frame with the overlay drawn on it, shares frame's pixels
+ * @param captured time the frame was captured
+ * @return int return non-zero value on failure
+ */
+int process_session_frame(ar_session &s, cv::Mat &frame, cv::Mat &dst, frame_time captured) {
+  if(frame.size() != s.frame_calib.image_size) {
+    if(s.calib.image_size.area() == 0) {
+      s.calib.image_size = frame.size(); // old calibration file, assume it matches the camera
+    }
+    scale_cal_profile(s.calib, frame.size(), s.frame_calib);
+  }
+
+  long frame_id = s.frame_no++;
+  bool patternfound = false;
+  std::vector<cv::Point2f> corner_set;
+  detect_chessboard(frame, s.model->patternsize, corner_set, patternfound);
+
+  dst = frame; // the caller is done with the raw frame, draw on it in place
+
+  if(!patternfound) {
+    s.pose_valid = false;
+    return(0);
+  }
+
+  std::vector<cv::Vec3f> point_set;
+  get_point_set(s.model->patternsize, point_set);
+  // start from the last pose while the board stays in view
+  int64_t t0 = prof_now();
+  cv::solvePnP(point_set, corner_set, s.frame_calib.cam_mat, s.frame_calib.distcoeff, s.rotations, s.translations, s.pose_valid);
+  prof_record(STAGE_PNP, prof_now() - t0);
+  s.pose_valid = true;
+  if(s.poses) {
+    std::vector<cv::Point2f> projected;
+    double err = reprojection_error(point_set, corner_set, s.rotations, s.translations, s.frame_calib.cam_mat, s.frame_calib.distcoeff, projected);
+    int64_t capture_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(captured.time_since_epoch()).count();
+    write_pose(*s.poses, s.id, frame_id, capture_ns, s.rotations, s.translations, err);
+  }
+
+  std::vector<cv::Vec3f> drawpoints;
+  std::vector<cv::Point2f> image_points;
+  get_overlay_points(s.overlay, s.model->patternsize, s.model->objpoints, drawpoints);
+  t0 = prof_now();
+  cv::projectPoints(drawpoints, s.rotations, s.translations, s.frame_calib.cam_mat, s.frame_calib.distcoeff, image_points);
+  prof_record(STAGE_PROJECT, prof_now() - t0);
+  t0 = prof_now();
+  draw_overlay(dst, s.overlay, image_points, s.model->connections);
+  prof_record(STAGE_DRAW, prof_now() - t0);
+
+  return(0);
+}
+
+/**
+ * @brief Function to print each session's fps and latency since the last report
+ *
+ * @param sessions sessions to report on
+ * @return int
+ */
+int print_session_stats(std::vector<ar_session *> &sessions) {
+  frame_time now = std::chrono::steady_clock::now();
+
+  for(int i = 0; i < sessions.size(); i++) {
+    ar_session &s = *sessions[i];
+    session_stats st;
+    {
+      std::lock_guard<std::mutex> guard(s.lock);
+      st = s.stats;
+      s.stats = session_stats();
+      s.stats.window_start = now;
+    }
+
+    double secs = elapsed_ms(st.window_start, now) / 1000.0;
+    printf("cam %d (%s): %.1f fps, latency avg %.1f ms max %.1f ms, found %d/%d, dropped %d\n",
+           s.id, s.source.spec.c_str(), secs > 0 ? st.frames / secs : 0.0,
+           st.frames > 0 ? st.latency_sum / st.frames : 0.0, st.latency_max,
+           st.found, st.frames, st.dropped);
+  }
+
+  return(0);
+}
@@ -0,0 +1,346 @@
+/**
+ * @file shm_pub.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Shared memory ring for publishing poses to other processes
+ * @date 2022-04-15
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "../include/shm_pub.h"
+
+static const char shm_magic[8] = "ARSHM";
+
+#define SHM_ALIGN 64 // keep slots on their own cache lines
+
+/**
+ * @brief Function to round a size up to SHM_ALIGN
+ *
+ * @param n size in bytes
+ * @return size_t
+ */
+static size_t shm_align(size_t n) {
+  return (n + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+}
+
+/**
+ * @brief Function to get a slot of the ring
+ *
+ * @param base mapped segment
+ * @param number publish number, slots are reused round-robin
+ * @return shm_slot*
+ */
+static shm_slot *get_slot(char *base, uint64_t number) {
+  shm_header *header = (shm_header *) base;
+  return (shm_slot *) (base + shm_align(sizeof(shm_header)) + (number % header->slots) * header->slot_size);
+}
+
+/**
+ * @brief Function to get the steady clock in ns, comparable between processes on one host
+ *
+ * @return int64_t
+ */
+int64_t shm_now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/**
+ * @brief Function to create the shared memory ring and map it
+ *
+ * @param name shared memory name, like "/ar_pose"
+ * @param slots frames kept in the ring, a reader has slots - 1 frames of time to copy one out
+ * @param max_corners most corners a frame can carry
+ * @param max_frame_bytes most bytes of pixels a frame can carry, 0 to publish poses only
+ * @param pub publisher to write to
+ * @return int return non-zero value on failure
+ */
+int open_shm_publisher(const char *name, int slots, int max_corners, size_t max_frame_bytes, shm_publisher &pub) {
+#ifdef _WIN32
+  printf("Publishing to shared memory needs POSIX shared memory\n");
+  return(-1);
+#else
+  if(slots < 2) {
+    slots = 2;
+  }
+  size_t slot_size = shm_align(sizeof(shm_slot) + max_corners * sizeof(cv::Point2f) + max_frame_bytes);
+  size_t size = shm_align(sizeof(shm_header)) + slots * slot_size;
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0) {
+    printf("Unable to create shared memory %s\n", name);
+    return(-1);
+  }
+  if(ftruncate(fd, size) != 0) {
+    printf("Unable to size shared memory %s\n", name);
+    close(fd);
+    shm_unlink(name);
+    return(-1);
+  }
+  void *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    printf("Unable to map shared memory %s\n", name);
+    shm_unlink(name);
+    return(-1);
+  }
+
+  pub.name = name;
+  pub.base = (char *) base;
+  pub.size = size;
+  pub.number = 0;
+
+  // the segment starts zeroed, so every slot seq is 0 and latest is 0
+  shm_header *header = (shm_header *) pub.base;
+  header->version = SHM_VERSION;
+  header->slots = slots;
+  header->slot_size = slot_size;
+  header->max_corners = max_corners;
+  header->max_frame_bytes = max_frame_bytes;
+  std::atomic_thread_fence(std::memory_order_release);
+  memcpy(header->magic, shm_magic, sizeof(header->magic)); // written last, readers check it first
+
+  return(0);
+#endif
+}
+
+/**
+ * @brief Function to publish one frame's pose, corners and optionally the frame itself
+ *
+ * Never waits for readers. A reader that is still copying the slot being
+ * overwritten sees the sequence change and retries.
+ *
+ * @param pub open publisher
+ * @param found true if the board was found and rvec/tvec are valid
+ * @param corner_set corners found, cut to max_corners
+ * @param rvec rotation vector from solvePnP, ignored if not found
+ * @param tvec translation vector from solvePnP, ignored if not found
+ * @param frame frame to publish, NULL or too large to skip it
+ * @return int return non-zero value on failure
+ */
+int shm_publish(shm_publisher &pub, bool found, const std::vector<cv::Point2f> &corner_set, const cv::Mat &rvec, const cv::Mat &tvec, const cv::Mat *frame) {
+  if(!pub.base) {
+    return(-1);
+  }
+  shm_header *header = (shm_header *) pub.base;
+  uint64_t number = ++pub.number;
+  shm_slot *slot = get_slot(pub.base, number);
+
+  uint64_t seq = slot->seq.load(std::memory_order_relaxed);
+  slot->seq.store(seq + 1, std::memory_order_relaxed); // odd, readers back off
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->number = number;
+  slot->found = found ? 1 : 0;
+  for(int i = 0; i < 3; i++) {
+    slot->rvec[i] = found ? rvec.at<double>(i, 0) : 0;
+    slot->tvec[i] = found ? tvec.at<double>(i, 0) : 0;
+  }
+  slot->ncorners = std::min((uint32_t) corner_set.size(), header->max_corners);
+  if(slot->ncorners > 0) {
+    memcpy((char *) slot + sizeof(shm_slot), corner_set.data(), slot->ncorners * sizeof(cv::Point2f));
+  }
+
+  slot->frame_bytes = 0;
+  slot->width = slot->height = slot->type = 0;
+  if(frame && !frame->empty()) {
+    size_t bytes = frame->total() * frame->elemSize();
+    if(bytes <= header->max_frame_bytes) {
+      // written row by row so a submatrix or padded frame publishes packed
+      char *dst = (char *) slot + sizeof(shm_slot) + header->max_corners * sizeof(cv::Point2f);
+      size_t row = frame->cols * frame->elemSize();
+      for(int r = 0; r < frame->rows; r++) {
+        memcpy(dst + r * row, frame->ptr(r), row);
+      }
+      slot->width = frame->cols;
+      slot->height = frame->rows;
+      slot->type = frame->type();
+      slot->frame_bytes = bytes;
+    }
+  }
+  slot->time_ns = shm_now();
+
+  slot->seq.store(seq + 2, std::memory_order_release); // even again, consistent
+  header->latest.store(number, std::memory_order_release);
+
+  return(0);
+}
+
+/**
+ * @brief Function to unmap and remove the shared memory ring
+ *
+ * @param pub publisher to close
+ * @return int
+ */
+int close_shm_publisher(shm_publisher &pub) {
+#ifndef _WIN32
+  if(pub.base) {
+    munmap(pub.base, pub.size);
+    shm_unlink(pub.name.c_str());
+  }
+#endif
+  pub.base = NULL;
+  return(0);
+}
+
+/**
+ * @brief Function to map a publisher's ring for reading
+ *
+ * @param name shared memory name the publisher used
+ * @param sub subscriber to write to
+ * @return int return non-zero value on failure, for example no publisher yet
+ */
+int open_shm_subscriber(const char *name, shm_subscriber &sub) {
+  sub.base = NULL;
+#ifdef _WIN32
+  printf("Reading from shared memory needs POSIX shared memory\n");
+  return(-1);
+#else
+  int fd = shm_open(name, O_RDONLY, 0);
+  if(fd < 0) {
+    return(-1);
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(shm_header)) {
+    close(fd);
+    return(-1);
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED) {
+    return(-1);
+  }
+
+  shm_header *header = (shm_header *) base;
+  if(memcmp(header->magic, shm_magic, sizeof(shm_magic)) != 0 || header->version != SHM_VERSION) {
+    munmap(base, st.st_size); // not set up yet, or from another version
+    return(-1);
+  }
+  std::atomic_thread_fence(std::memory_order_acquire);
+
+  sub.name = name;
+  sub.base = (char *) base;
+  sub.size = st.st_size;
+  return(0);
+#endif
+}
+
+/**
+ * @brief Function to get the number of the newest published frame
+ *
+ * @param sub open subscriber
+ * @return uint64_t 0 before the first frame
+ */
+uint64_t shm_latest(const shm_subscriber &sub) {
+  return ((shm_header *) sub.base)->latest.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Function to copy out a consistent frame
+ *
+ * @param sub open subscriber
+ * @param number frame to read, 0 for the newest
+ * @param pose pose to write to
+ * @param frame if not NULL, the frame pixels are copied here (empty if none were published)
+ * @return int return non-zero value if the frame was already overwritten
+ */
+int shm_read(shm_subscriber &sub, uint64_t number, shm_pose &pose, cv::Mat *frame) {
+  shm_header *header = (shm_header *) sub.base;
+  if(number == 0) {
+    number = shm_latest(sub);
+    if(number == 0) {
+      return(-1);
+    }
+  }
+  shm_slot *slot = get_slot(sub.base, number);
+
+  for(;;) {
+    uint64_t seq = slot->seq.load(std::memory_order_acquire);
+    if(seq & 1) {
+      std::this_thread::yield(); // publisher is mid-write
+      continue;
+    }
+    if(slot->number != number) {
+      return(-1); // overwritten by a newer frame
+    }
+
+    pose.number = slot->number;
+    pose.time_ns = slot->time_ns;
+    pose.found = slot->found != 0;
+    pose.rvec = cv::Vec3d(slot->rvec[0], slot->rvec[1], slot->rvec[2]);
+    pose.tvec = cv::Vec3d(slot->tvec[0], slot->tvec[1], slot->tvec[2]);
+    uint32_t ncorners = std::min(slot->ncorners, header->max_corners);
+    pose.corner_set.resize(ncorners);
+    if(ncorners > 0) {
+      memcpy(pose.corner_set.data(), (char *) slot + sizeof(shm_slot), ncorners * sizeof(cv::Point2f));
+    }
+    if(frame) {
+      uint32_t bytes = slot->frame_bytes;
+      int width = slot->width, height = slot->height, type = slot->type;
+      if(bytes > 0 && bytes <= header->max_frame_bytes && width > 0 && height > 0) {
+        frame->create(height, width, type);
+        if(frame->total() * frame->elemSize() == bytes) {
+          memcpy(frame->data, (char *) slot + sizeof(shm_slot) + header->max_corners * sizeof(cv::Point2f), bytes);
+        }
+      } else {
+        frame->release();
+      }
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if(slot->seq.load(std::memory_order_relaxed) == seq) {
+      return(0);
+    }
+    // the publisher came back around to this slot while it was being copied
+  }
+}
+
+/**
+ * @brief Function to wait for a frame newer than the one last read
+ *
+ * Spins, then yields, so a waiting reader sees a new frame within microseconds.
+ *
+ * @param sub open subscriber
+ * @param last number of the last frame read
+ * @param timeout_ms give up after this long
+ * @return uint64_t number of the newest frame, 0 on timeout
+ */
+uint64_t shm_wait(const shm_subscriber &sub, uint64_t last, int timeout_ms) {
+  int64_t deadline = shm_now() + (int64_t) timeout_ms * 1000000;
+  for(int spins = 0;; spins++) {
+    uint64_t latest = shm_latest(sub);
+    if(latest > last) {
+      return latest;
+    }
+    if(spins > 1000) {
+      std::this_thread::yield();
+      if(shm_now() > deadline) {
+        return 0;
+      }
+    }
+  }
+}
+
+/**
+ * @brief Function to unmap the ring
+ *
+ * @param sub subscriber to close
+ * @return int
+ */
+int close_shm_subscriber(shm_subscriber &sub) {
+#ifndef _WIN32
+  if(sub.base) {
+    munmap(sub.base, sub.size);
+  }
+#endif
+  sub.base = NULL;
+  return(0);
+}
@@ -0,0 +1,157 @@
+/**
+ * @file shmbench_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for measuring shared memory pose latency between two processes
+ * @date 2022-04-15
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#include "../include/shm_pub.h"
+#ifndef _WIN32
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Function run in the consumer process, reads every frame and prints the latency
+ *
+ * @param name shared memory name
+ * @param count frames the publisher sends
+ * @param read_frame true to copy the frame pixels out as well
+ * @return int return non-zero value on failure
+ */
+static int run_consumer(const char *name, int count, bool read_frame) {
+  shm_subscriber sub;
+  if(open_shm_subscriber(name, sub) != 0) {
+    printf("consumer: unable to open %s\n", name);
+    return(-1);
+  }
+
+  std::vector<double> latencies; // us
+  latencies.reserve(count);
+  long missed = 0;
+  long torn = 0;
+  uint64_t last = 0;
+  shm_pose pose;
+  cv::Mat frame;
+
+  while(last < count) {
+    uint64_t n = shm_wait(sub, last, 2000);
+    if(n == 0) {
+      break; // publisher stopped
+    }
+    if(shm_read(sub, n, pose, read_frame ? &frame : NULL) != 0) {
+      torn++;
+      last = n;
+      continue;
+    }
+    latencies.push_back((shm_now() - pose.time_ns) / 1e3);
+    missed += n - last - 1;
+    last = n;
+  }
+  close_shm_subscriber(sub);
+
+  if(latencies.empty()) {
+    printf("consumer: no frames received\n");
+    return(-1);
+  }
+  std::sort(latencies.begin(), latencies.end());
+  int n = latencies.size();
+  double sum = 0;
+  for(int i = 0; i < n; i++) {
+    sum += latencies[i];
+  }
+  printf("received %d frames, %ld skipped (newer frame already there), %ld overwritten while reading\n", n, missed, torn);
+  printf("latency us: mean %.2f p50 %.2f p95 %.2f p99 %.2f max %.2f\n", sum / n, latencies[n / 2],
+         latencies[std::min(n - 1, (int) (n * 0.95))], latencies[std::min(n - 1, (int) (n * 0.99))], latencies[n - 1]);
+
+  return(0);
+}
+
+int main(int argc, char *argv[]) {
+#ifdef _WIN32
+  printf("shmbench needs POSIX shared memory and fork\n");
+  return(-1);
+#else
+  int count = 10000;
+  int rate = 1000; // frames per second
+  cv::Size frame_size(0, 0);
+  int slots = 8;
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+      count = std::max(1, atoi(argv[++i]));
+    } else if(strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+      rate = std::max(1, atoi(argv[++i]));
+    } else if(strcmp(argv[i], "--frame") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%dx%d", &frame_size.width, &frame_size.height);
+    } else if(strcmp(argv[i], "--slots") == 0 && i + 1 < argc) {
+      slots = atoi(argv[++i]);
+    } else {
+      printf("usage: %s [--count n] [--rate fps] [--frame WxH] [--slots n]\n", argv[0]);
+      return(-1);
+    }
+  }
+
+  std::string name = "/ar_shmbench_" + std::to_string(getpid());
+  cv::Mat frame;
+  if(frame_size.area() > 0) {
+    frame = cv::Mat(frame_size, CV_8UC3, cv::Scalar(40, 80, 120));
+  }
+
+  shm_publisher pub;
+  if(open_shm_publisher(name.c_str(), slots, 54, frame.total() * frame.elemSize(), pub) != 0) {
+    return(-1);
+  }
+
+  printf("%d frames at %d fps, %d slots, frame %dx%d\n", count, rate, slots, frame_size.width, frame_size.height);
+  fflush(stdout);
+
+  pid_t child = fork();
+  if(child < 0) {
+    printf("Unable to fork the consumer\n");
+    close_shm_publisher(pub);
+    return(-1);
+  }
+  if(child == 0) {
+    int ret = run_consumer(name.c_str(), count, !frame.empty());
+    fflush(stdout); // _exit skips the stdio buffers
+    _exit(ret == 0 ? 0 : 1);
+  }
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200)); // let the consumer map the ring
+
+  std::vector<cv::Point2f> corner_set;
+  for(int i = 0; i < 54; i++) {
+    corner_set.push_back(cv::Point2f(i % 9 * 20.0f, i / 9 * 20.0f));
+  }
+  cv::Mat rvec = (cv::Mat_<double>(3, 1) << 0.1, 0.2, 0.3);
+  cv::Mat tvec = (cv::Mat_<double>(3, 1) << 1.0, 2.0, 30.0);
+
+  std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+  std::chrono::nanoseconds period(1000000000LL / rate);
+  double publish_us = 0;
+  for(int i = 0; i < count; i++) {
+    std::this_thread::sleep_until(next);
+    next += period;
+    int64_t t0 = shm_now();
+    shm_publish(pub, true, corner_set, rvec, tvec, frame.empty() ? NULL : &frame);
+    publish_us += (shm_now() - t0) / 1e3;
+  }
+  printf("publish: %.2f us per frame\n", publish_us / count);
+  fflush(stdout);
+
+  int status = 0;
+  waitpid(child, &status, 0);
+  close_shm_publisher(pub);
+
+  return(WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1);
+#endif
+}
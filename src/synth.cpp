@@ -0,0 +1,458 @@
+/**
+ * @file synth.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Renders chessboard sequences with known poses for the benchmarks
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include "../include/synth.h"
+#include "../include/ar.h"
+#include "../include/pose_filter.h"
+
+#define BLACK 35.0f // square brightness before lighting, printed boards are never 0 and 255
+#define WHITE 215.0f
+#define BACKGROUND 110.0f
+#define OCCLUDER 150.0f
+#define MARGIN 1.0 // white border around the squares, in squares
+#define SHUTTER_SAMPLES 5 // poses averaged over the exposure
+#define UNDISTORT_PASSES 3 // corrections after undistortPoints, so rays and projectPoints agree
+
+/**
+ * @brief Function to get a rotation matrix from an angle about an axis
+ *
+ * @param x x component of the rotation vector, degrees
+ * @param y y component, degrees
+ * @param z z component, degrees
+ * @return cv::Matx33d
+ */
+static cv::Matx33d rotation_deg(double x, double y, double z) {
+  cv::Matx33d m;
+  cv::Rodrigues(cv::Vec3d(x, y, z) * (CV_PI / 180.0), m);
+  return m;
+}
+
+/**
+ * @brief Function to get the pose of a board facing the camera, turned and moved
+ *
+ * @param patsize inner corners of the board
+ * @param time_ns time of the pose
+ * @param yaw turn about the vertical, degrees
+ * @param pitch tilt toward the camera, degrees
+ * @param roll turn in the image plane, degrees
+ * @param center where the board center ends up in camera coordinates, board squares
+ * @return synth_pose
+ */
+static synth_pose facing_pose(cv::Size patsize, int64_t time_ns, double yaw, double pitch, double roll, const cv::Vec3d &center) {
+  // board x to the right, y up and z out of the board; the camera looks down its z with y down
+  cv::Matx33d facing(1, 0, 0, 0, -1, 0, 0, 0, -1);
+  cv::Matx33d rot = rotation_deg(0, 0, roll) * rotation_deg(pitch, 0, 0) * rotation_deg(0, yaw, 0) * facing;
+  cv::Vec3d board_center((patsize.width - 1) * 0.5, -(patsize.height - 1) * 0.5, 0);
+
+  synth_pose p;
+  p.time_ns = time_ns;
+  cv::Rodrigues(rot, p.rvec);
+  p.tvec = center - rot * board_center;
+  return p;
+}
+
+/**
+ * @brief Function to read the poses of one camera from a posecsv.exe csv
+ *
+ * @param filename name of csv file
+ * @param frames most poses to read
+ * @param poses vector of poses to write to
+ * @return int return non-zero value on failure
+ */
+static int read_pose_log_csv(const char *filename, int frames, std::vector<synth_pose> &poses) {
+  FILE *fp = fopen(filename, "r");
+  if(!fp) {
+    printf("Unknown trajectory %s (orbit, sweep, shake, static or a csv from posecsv.exe)\n", filename);
+    return(-1);
+  }
+
+  char line[512];
+  long long first = -1;
+  unsigned camera = 0;
+  while(fgets(line, sizeof(line), fp) && poses.size() < frames) {
+    long long time_ns, capture_ns;
+    unsigned cam, frame;
+    float err;
+    synth_pose p;
+    int n = sscanf(line, "%lld,%u,%u,%lf,%lf,%lf,%lf,%lf,%lf,%f,%lld", &time_ns, &cam, &frame, &p.rvec[0], &p.rvec[1],
+                   &p.rvec[2], &p.tvec[0], &p.tvec[1], &p.tvec[2], &err, &capture_ns);
+    if(n < 9) {
+      continue; // the header
+    }
+    if(n == 11) {
+      time_ns = capture_ns; // the frame's own time rather than when its pose was written
+    }
+    if(first < 0) {
+      first = time_ns;
+      camera = cam;
+    }
+    if(cam != camera) {
+      continue;
+    }
+    p.time_ns = time_ns - first;
+    poses.push_back(p);
+  }
+  fclose(fp);
+
+  if(poses.empty()) {
+    printf("No poses in %s\n", filename);
+    return(-1);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to make a trajectory
+ *
+ * Built in are orbit (the camera swings around the board), sweep (the board
+ * crosses the view at a slant), shake (hand tremor on a slow drift) and static.
+ * Anything else is read as a csv from posecsv.exe, so a recorded session can be
+ * rendered again; its poses keep their times and frames is only an upper limit.
+ *
+ * @param name built in trajectory or csv file
+ * @param cal intrinsics at the output size, the built in ones are sized to fill about half the frame
+ * @param patsize inner corners of the board
+ * @param frames number of frames
+ * @param fps frame rate of the built in trajectories
+ * @param poses vector of poses to write to
+ * @return int return non-zero value on failure
+ */
+int synth_trajectory(const std::string &name, const cal_profile &cal, cv::Size patsize, int frames, double fps, std::vector<synth_pose> &poses) {
+  poses.clear();
+  if(frames <= 0 || fps <= 0 || cal.cam_mat.empty() || cal.image_size.area() == 0) {
+    return(-1);
+  }
+
+  bool builtin = name == "orbit" || name == "sweep" || name == "shake" || name == "static";
+  if(!builtin) {
+    return read_pose_log_csv(name.c_str(), frames, poses);
+  }
+
+  double fx = cal.cam_mat.at<double>(0, 0);
+  double fy = cal.cam_mat.at<double>(1, 1);
+  // far enough for the board with its border to span about half the width
+  double dist = fx * (patsize.width + 1 + 2 * MARGIN) / (0.5 * cal.image_size.width);
+  double two_pi = 2 * CV_PI;
+
+  for(int k = 0; k < frames; k++) {
+    double t = k / fps;
+    int64_t time_ns = (int64_t) (t * 1e9);
+    if(name == "orbit") {
+      double d = dist * (1 + 0.25 * sin(two_pi * t / 7.1));
+      poses.push_back(facing_pose(patsize, time_ns, 35 * sin(two_pi * t / 6), -10 + 20 * sin(two_pi * t / 4.3),
+                                  12 * sin(two_pi * t / 8.9), cv::Vec3d(0, 0, d)));
+    } else if(name == "sweep") {
+      double x = 0.2 * cal.image_size.width * dist / fx * sin(two_pi * t / 5);
+      double y = 0.15 * cal.image_size.height * dist / fy * sin(two_pi * t / 3.7);
+      poses.push_back(facing_pose(patsize, time_ns, 20, -20, 0, cv::Vec3d(x, y, dist)));
+    } else if(name == "shake") {
+      // a slow drift with a hand's 5-8 Hz tremor on top
+      double yaw = 10 * sin(two_pi * t / 5) + 1.5 * sin(two_pi * 6.1 * t);
+      double pitch = -10 + 1.2 * sin(two_pi * 7.3 * t + 1);
+      double roll = 1.0 * sin(two_pi * 5.2 * t + 2);
+      double x = 0.01 * dist * sin(two_pi * 8.3 * t);
+      poses.push_back(facing_pose(patsize, time_ns, yaw, pitch, roll, cv::Vec3d(x, 0, dist)));
+    } else {
+      poses.push_back(facing_pose(patsize, time_ns, 20, -15, 5, cv::Vec3d(0, 0, dist)));
+    }
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to make intrinsics for a distortion free camera with a 60 degree field of view
+ *
+ * For rendering on a machine without a calibration.csv.
+ *
+ * @param size image size
+ * @param cal profile to write to
+ * @return int
+ */
+int default_synth_camera(cv::Size size, cal_profile &cal) {
+  cal.camera_id = "synth";
+  cal.image_size = size;
+  cal.cam_mat = cv::Mat::eye(3, 3, CV_64FC1);
+  cal.cam_mat.at<double>(0, 0) = cal.cam_mat.at<double>(1, 1) = 0.866 * size.width;
+  cal.cam_mat.at<double>(0, 2) = (size.width - 1) * 0.5;
+  cal.cam_mat.at<double>(1, 2) = (size.height - 1) * 0.5;
+  cal.distcoeff = cv::Mat::zeros(5, 1, CV_64FC1);
+  return(0);
+}
+
+/**
+ * @brief Function to set up a renderer
+ *
+ * @param cal intrinsics, image_size is the output size
+ * @param patsize inner corners of the board
+ * @param supersample samples per pixel each way, at least 1
+ * @param r renderer to set up
+ * @return int return non-zero value on failure
+ */
+int init_synth_renderer(const cal_profile &cal, cv::Size patsize, int supersample, synth_renderer &r) {
+  if(cal.cam_mat.empty() || cal.image_size.area() == 0 || supersample < 1 || patsize.area() == 0) {
+    return(-1);
+  }
+
+  r.cal.camera_id = cal.camera_id;
+  r.cal.image_size = cal.image_size;
+  r.cal.cam_mat = cal.cam_mat.clone();
+  r.cal.distcoeff = cal.distcoeff.clone();
+  r.patsize = patsize;
+  r.supersample = supersample;
+
+  // sample centers in output pixel coordinates
+  cv::Size ss(cal.image_size.width * supersample, cal.image_size.height * supersample);
+  std::vector<cv::Point2f> pixels(ss.area());
+  for(int i = 0; i < ss.height; i++) {
+    for(int j = 0; j < ss.width; j++) {
+      pixels[i * ss.width + j] = cv::Point2f((j + 0.5f) / supersample - 0.5f, (i + 0.5f) / supersample - 0.5f);
+    }
+  }
+
+  // undistortPoints stops after a few iterations, correct what is left against the forward model
+  std::vector<cv::Point2f> rays;
+  cv::undistortPoints(pixels, rays, r.cal.cam_mat, r.cal.distcoeff);
+  double fx = r.cal.cam_mat.at<double>(0, 0);
+  double fy = r.cal.cam_mat.at<double>(1, 1);
+  std::vector<cv::Point3f> points(rays.size());
+  std::vector<cv::Point2f> projected;
+  for(int pass = 0; pass < UNDISTORT_PASSES; pass++) {
+    for(int i = 0; i < rays.size(); i++) {
+      points[i] = cv::Point3f(rays[i].x, rays[i].y, 1.0f);
+    }
+    cv::projectPoints(points, cv::Vec3d(0, 0, 0), cv::Vec3d(0, 0, 0), r.cal.cam_mat, r.cal.distcoeff, projected);
+    for(int i = 0; i < rays.size(); i++) {
+      rays[i].x += (float) ((pixels[i].x - projected[i].x) / fx);
+      rays[i].y += (float) ((pixels[i].y - projected[i].y) / fy);
+    }
+  }
+  r.rays = cv::Mat(rays, true).reshape(2, ss.height);
+  r.samples.create(ss, CV_32F);
+
+  return(0);
+}
+
+/**
+ * @brief Function to render the board at one pose, without noise or lighting
+ *
+ * @param r renderer
+ * @param rvec rotation vector
+ * @param tvec translation vector
+ * @param dst CV_32F image at the output size, 0 to 255
+ * @return int
+ */
+int render_board(synth_renderer &r, const cv::Vec3d &rvec, const cv::Vec3d &tvec, cv::Mat &dst) {
+  cv::Matx33d rot;
+  cv::Rodrigues(rvec, rot);
+  // the board plane z = 0 maps to normalized image coordinates by [r1 r2 t], go back with its inverse
+  cv::Matx33d plane(rot(0, 0), rot(0, 1), tvec[0], rot(1, 0), rot(1, 1), tvec[1], rot(2, 0), rot(2, 1), tvec[2]);
+  cv::Matx33d back = plane.inv();
+
+  // squares cover x in [-1, width] and y in [-height, 1], get_point_set's corners are between them
+  double sq_x0 = -1, sq_x1 = r.patsize.width, sq_y0 = -r.patsize.height, sq_y1 = 1;
+  cv::Mat &samples = r.samples;
+  const cv::Mat &rays = r.rays;
+
+  cv::parallel_for_(cv::Range(0, samples.rows), [&](const cv::Range &range) {
+    for(int i = range.start; i < range.end; i++) {
+      const cv::Vec2f *ray = rays.ptr<cv::Vec2f>(i);
+      float *out = samples.ptr<float>(i);
+      for(int j = 0; j < samples.cols; j++) {
+        double x = ray[j][0], y = ray[j][1];
+        double w = back(2, 0) * x + back(2, 1) * y + back(2, 2);
+        if(w <= 0) {
+          out[j] = BACKGROUND; // the ray meets the plane behind the camera
+          continue;
+        }
+        double bx = (back(0, 0) * x + back(0, 1) * y + back(0, 2)) / w;
+        double by = (back(1, 0) * x + back(1, 1) * y + back(1, 2)) / w;
+        if(bx < sq_x0 - MARGIN || bx >= sq_x1 + MARGIN || by < sq_y0 - MARGIN || by >= sq_y1 + MARGIN) {
+          out[j] = BACKGROUND;
+        } else if(bx < sq_x0 || bx >= sq_x1 || by < sq_y0 || by >= sq_y1) {
+          out[j] = WHITE;
+        } else {
+          int parity = ((int) floor(bx) + (int) floor(by)) & 1;
+          out[j] = parity ? WHITE : BLACK;
+        }
+      }
+    }
+  });
+
+  if(r.supersample > 1) {
+    cv::resize(samples, dst, r.cal.image_size, 0, 0, cv::INTER_AREA);
+  } else {
+    samples.copyTo(dst);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function to render one frame of a trajectory as a camera would have taken it
+ *
+ * With exposure the frame averages poses around its own, interpolated toward
+ * the neighbouring frames, so fast motion smears like it does on a real shutter.
+ *
+ * @param r renderer
+ * @param p effects
+ * @param poses trajectory
+ * @param k frame to render
+ * @param rng random numbers for noise and occlusion, seed it for repeatable sequences
+ * @param dst CV_8UC1 frame to write to
+ * @param occluded if not NULL, set to whether part of the board was covered
+ * @return int return non-zero value on failure
+ */
+int render_synth_frame(synth_renderer &r, const synth_params &p, const std::vector<synth_pose> &poses, int k, cv::RNG &rng, cv::Mat &dst, bool *occluded) {
+  if(k < 0 || k >= poses.size() || r.rays.empty()) {
+    return(-1);
+  }
+  const synth_pose &pose = poses[k];
+
+  // the shutter is centered on the frame's pose, which stays the ground truth
+  cv::Mat frame, sub;
+  int shots = p.exposure > 0 && poses.size() > 1 ? SHUTTER_SAMPLES : 1;
+  for(int s = 0; s < shots; s++) {
+    double offset = shots > 1 ? p.exposure * ((s + 0.5) / shots - 0.5) : 0; // in frame intervals
+    const synth_pose &other = poses[offset < 0 ? std::max(k - 1, 0) : std::min(k + 1, (int) poses.size() - 1)];
+    cv::Vec3d rvec = pose.rvec, tvec = pose.tvec;
+    if(offset != 0 && &other != &pose) {
+      interpolate_pose(pose.rvec, pose.tvec, other.rvec, other.tvec, fabs(offset), rvec, tvec);
+    }
+    render_board(r, rvec, tvec, s == 0 ? frame : sub);
+    if(s > 0) {
+      frame += sub;
+    }
+  }
+  if(shots > 1) {
+    frame *= 1.0 / shots;
+  }
+
+  // something in front of the board, a hand or a cable, before the blur so its edges blur too
+  bool covered = false;
+  if(p.occlusion > 0 && rng.uniform(0.0, 1.0) < p.occlusion) {
+    std::vector<cv::Point2f> corners;
+    synth_corners(r, pose, corners);
+    cv::Rect board = cv::boundingRect(corners) & cv::Rect(0, 0, frame.cols, frame.rows);
+    if(board.area() > 0) {
+      int w = std::max(1, (int) (board.width * rng.uniform(0.15, 0.35)));
+      int h = std::max(1, (int) (board.height * rng.uniform(0.3, 0.7)));
+      int x = board.x + rng.uniform(0, std::max(1, board.width - w));
+      int y = board.y + rng.uniform(0, std::max(1, board.height - h));
+      cv::rectangle(frame, cv::Rect(x, y, w, h), cv::Scalar(OCCLUDER), cv::FILLED);
+      covered = true;
+    }
+  }
+  if(occluded) {
+    *occluded = covered;
+  }
+
+  if(p.blur > 0) {
+    cv::GaussianBlur(frame, frame, cv::Size(0, 0), p.blur);
+  }
+
+  // uneven lighting, brighter on one side
+  if(p.gain != 1.0 || p.gradient != 0) {
+    for(int i = 0; i < frame.rows; i++) {
+      float *row = frame.ptr<float>(i);
+      for(int j = 0; j < frame.cols; j++) {
+        row[j] *= (float) (p.gain * (1 + p.gradient * ((double) j / std::max(1, frame.cols - 1) - 0.5)));
+      }
+    }
+  }
+
+  if(p.noise > 0) {
+    cv::Mat noise(frame.size(), CV_32F);
+    rng.fill(noise, cv::RNG::NORMAL, 0, p.noise);
+    frame += noise;
+  }
+
+  frame.convertTo(dst, CV_8U);
+
+  return(0);
+}
+
+/**
+ * @brief Function to get the corners a perfect detector would find at a pose
+ *
+ * @param r renderer
+ * @param pose pose of the frame
+ * @param corners corners in get_point_set order to write to
+ * @return int
+ */
+int synth_corners(const synth_renderer &r, const synth_pose &pose, std::vector<cv::Point2f> &corners) {
+  std::vector<cv::Vec3f> point_set;
+  get_point_set(r.patsize, point_set);
+  cv::projectPoints(point_set, pose.rvec, pose.tvec, r.cal.cam_mat, r.cal.distcoeff, corners);
+  return(0);
+}
+
+/**
+ * @brief Function to write a trajectory as csv, one "image,time_ns,rx,ry,rz,tx,ty,tz" row per frame
+ *
+ * @param filename name of csv file
+ * @param names image name of each pose
+ * @param poses trajectory
+ * @return int return non-zero value on failure
+ */
+int write_synth_poses_csv(const char *filename, const std::vector<std::string> &names, const std::vector<synth_pose> &poses) {
+  FILE *fp = fopen(filename, "w");
+  if(!fp) {
+    printf("Unable to open output file %s\n", filename);
+    return(-1);
+  }
+
+  fprintf(fp, "image,time_ns,rx,ry,rz,tx,ty,tz\n");
+  for(int k = 0; k < poses.size() && k < names.size(); k++) {
+    const synth_pose &p = poses[k];
+    fprintf(fp, "%s,%lld,%.9f,%.9f,%.9f,%.9f,%.9f,%.9f\n", names[k].c_str(), (long long) p.time_ns, p.rvec[0], p.rvec[1],
+            p.rvec[2], p.tvec[0], p.tvec[1], p.tvec[2]);
+  }
+  fclose(fp);
+
+  return(0);
+}
+
+/**
+ * @brief Function to read a trajectory written by write_synth_poses_csv
+ *
+ * @param filename name of csv file
+ * @param names image name of each pose to write to
+ * @param poses trajectory to write to
+ * @return int return non-zero value on failure
+ */
+int read_synth_poses_csv(const char *filename, std::vector<std::string> &names, std::vector<synth_pose> &poses) {
+  FILE *fp = fopen(filename, "r");
+  if(!fp) {
+    printf("Unable to open pose file %s\n", filename);
+    return(-1);
+  }
+
+  names.clear();
+  poses.clear();
+  char line[512];
+  char name[256];
+  while(fgets(line, sizeof(line), fp)) {
+    long long time_ns;
+    synth_pose p;
+    if(sscanf(line, "%255[^,],%lld,%lf,%lf,%lf,%lf,%lf,%lf", name, &time_ns, &p.rvec[0], &p.rvec[1], &p.rvec[2],
+              &p.tvec[0], &p.tvec[1], &p.tvec[2]) != 8) {
+      continue; // the header
+    }
+    p.time_ns = time_ns;
+    names.push_back(name);
+    poses.push_back(p);
+  }
+  fclose(fp);
+
+  return(0);
+}
@@ -0,0 +1,171 @@
+/**
+ * @file synth_main.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Main function for rendering a synthetic chessboard sequence with ground truth
+ * @date 2022-04-20
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+#include "../include/csv_util.h"
+#include "../include/cal_profile.h"
+#include "../include/synth.h"
+
+int main(int argc, char *argv[]) {
+  char cal_fn[256] = "calibration.csv";
+  cv::Size size(0, 0); // 0x0 for the calibration's own resolution
+  cv::Size patternsize(9, 6);
+  int frames = 300;
+  double fps = 30;
+  std::string trajectory = "orbit";
+  int supersample = 3;
+  int seed = 1;
+  synth_params params;
+  params.blur = 0;
+  params.exposure = 0;
+  params.noise = 2;
+  params.gain = 1;
+  params.gradient = 0;
+  params.occlusion = 0;
+  std::string out_dir = "";
+
+  for(int i = 1; i < argc; i++) {
+    if(strcmp(argv[i], "--calib") == 0 && i + 1 < argc) {
+      strncpy(cal_fn, argv[++i], sizeof(cal_fn) - 1);
+    } else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%dx%d", &size.width, &size.height);
+    } else if(strcmp(argv[i], "--board") == 0 && i + 1 < argc) {
+      sscanf(argv[++i], "%dx%d", &patternsize.width, &patternsize.height);
+    } else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      frames = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+      fps = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--trajectory") == 0 && i + 1 < argc) {
+      trajectory = argv[++i];
+    } else if(strcmp(argv[i], "--blur") == 0 && i + 1 < argc) {
+      params.blur = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--exposure") == 0 && i + 1 < argc) {
+      params.exposure = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--noise") == 0 && i + 1 < argc) {
+      params.noise = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--gain") == 0 && i + 1 < argc) {
+      params.gain = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--gradient") == 0 && i + 1 < argc) {
+      params.gradient = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--occlusion") == 0 && i + 1 < argc) {
+      params.occlusion = atof(argv[++i]);
+    } else if(strcmp(argv[i], "--supersample") == 0 && i + 1 < argc) {
+      supersample = atoi(argv[++i]);
+    } else if(strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = atoi(argv[++i]);
+    } else {
+      out_dir = argv[i];
+    }
+  }
+
+  if(out_dir.empty()) {
+    printf("usage: %s [--calib calibration.csv] [--size WxH] [--board WxH] [--frames n] [--fps f]\n", argv[0]);
+    printf("          [--trajectory orbit|sweep|shake|static|poses.csv] [--blur sigma] [--exposure e] [--noise std]\n");
+    printf("          [--gain g] [--gradient g] [--occlusion p] [--supersample n] [--seed n] out_dir\n");
+    printf("  renders a chessboard sequence through the calibrated camera and writes the frames with\n");
+    printf("  corners.csv (detbench.exe --truth), poses.csv and the calibration.csv they were rendered with\n");
+    return(-1);
+  }
+  if(supersample < 1 || params.exposure < 0 || params.exposure > 1 || params.occlusion < 0 || params.occlusion > 1) {
+    printf("--supersample must be at least 1, --exposure and --occlusion in [0, 1]\n");
+    return(-1);
+  }
+
+  // without a calibration any box can still render, with a plain 60 degree lens
+  cal_profile calib;
+  if(read_cal_profile_csv(cal_fn, "", calib, 0) != 0) {
+    if(size.area() == 0) {
+      size = cv::Size(640, 480);
+    }
+    printf("No calibration in %s, using a distortion free camera at %dx%d\n", cal_fn, size.width, size.height);
+    default_synth_camera(size, calib);
+  }
+  if(calib.image_size.area() == 0) {
+    // old calibration file, only usable with the size it was made at
+    if(size.area() == 0) {
+      printf("%s has no resolution, give the size it was calibrated at with --size\n", cal_fn);
+      return(-1);
+    }
+    calib.image_size = size;
+  }
+  cal_profile cal;
+  scale_cal_profile(calib, size.area() > 0 ? size : calib.image_size, cal);
+
+  std::vector<synth_pose> poses;
+  if(synth_trajectory(trajectory, cal, patternsize, frames, fps, poses) != 0) {
+    return(-1);
+  }
+  synth_renderer renderer;
+  if(init_synth_renderer(cal, patternsize, supersample, renderer) != 0) {
+    printf("Unable to set up the renderer\n");
+    return(-1);
+  }
+
+#ifdef _WIN32
+  _mkdir(out_dir.c_str());
+#else
+  mkdir(out_dir.c_str(), 0755);
+#endif
+  std::string corners_fn = out_dir + "/corners.csv";
+  std::string poses_fn = out_dir + "/poses.csv";
+  std::string out_cal_fn = out_dir + "/calibration.csv";
+  if(append_cal_profile_csv((char *) out_cal_fn.c_str(), cal, 1) != 0) {
+    return(-1);
+  }
+
+  printf("%d frames at %dx%d, board %dx%d, trajectory %s\n", (int) poses.size(), cal.image_size.width,
+         cal.image_size.height, patternsize.width, patternsize.height, trajectory.c_str());
+
+  cv::RNG rng(seed);
+  std::vector<std::string> names;
+  std::vector<cv::Point2f> corners;
+  cv::Mat frame;
+  int occluded_frames = 0;
+  for(int k = 0; k < poses.size(); k++) {
+    bool occluded = false;
+    if(render_synth_frame(renderer, params, poses, k, rng, frame, &occluded) != 0) {
+      return(-1);
+    }
+    occluded_frames += occluded ? 1 : 0;
+
+    char name[64];
+    snprintf(name, sizeof(name), "frame%05d.png", k);
+    std::string path = out_dir + "/" + name;
+    if(!cv::imwrite(path, frame)) {
+      printf("Unable to write %s\n", path.c_str());
+      return(-1);
+    }
+    names.push_back(name);
+
+    // every corner is written, covered or not, it is where the corner is
+    synth_corners(renderer, poses[k], corners);
+    if(append_corner_data_csv((char *) corners_fn.c_str(), name, corners, k == 0) != 0) {
+      return(-1);
+    }
+    if(k % 50 == 49) {
+      printf("%d/%d\n", k + 1, (int) poses.size());
+    }
+  }
+  if(write_synth_poses_csv(poses_fn.c_str(), names, poses) != 0) {
+    return(-1);
+  }
+
+  printf("Wrote %d frames (%d occluded) with corners.csv, poses.csv and calibration.csv to %s\n", (int) poses.size(),
+         occluded_frames, out_dir.c_str());
+
+  return(0);
+}
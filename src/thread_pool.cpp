@@ -0,0 +1,145 @@
+/**
+ * @file thread_pool.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Work-stealing thread pool
+ * @date 2022-04-05
+ */
+
+#include <algorithm>
+#include "../include/thread_pool.h"
+
+static thread_local int tl_worker_index = -1;
+
+/**
+ * @brief Construct a new thread pool
+ *
+ * @param nthreads number of workers, 0 for one per hardware thread
+ */
+thread_pool::thread_pool(int nthreads) : queued(0), pending(0), next_queue(0), stopping(false) {
+  if(nthreads <= 0) {
+    nthreads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  for(int i = 0; i < nthreads; i++) {
+    queues.push_back(std::unique_ptr<worker_queue>(new worker_queue));
+  }
+  for(int i = 0; i < nthreads; i++) {
+    workers.push_back(std::thread(&thread_pool::worker_loop, this, i));
+  }
+}
+
+/**
+ * @brief Destroy the thread pool, finishing every queued task first
+ */
+thread_pool::~thread_pool() {
+  wait_idle();
+  {
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for(int i = 0; i < workers.size(); i++) {
+    workers[i].join();
+  }
+}
+
+/**
+ * @brief Function to get the index of the calling worker
+ *
+ * @return int worker index, -1 when not called from a worker of any pool
+ */
+int thread_pool::worker_index() {
+  return tl_worker_index;
+}
+
+/**
+ * @brief Function to queue a task
+ *
+ * @param task task to run on one of the workers
+ */
+void thread_pool::submit(std::function<void()> task) {
+  pending++;
+
+  unsigned idx = next_queue.fetch_add(1) % queues.size();
+  {
+    std::lock_guard<std::mutex> guard(queues[idx]->lock);
+    queues[idx]->tasks.push_back(std::move(task));
+  }
+
+  {
+    // taking the lock orders this with a worker that is about to sleep
+    std::lock_guard<std::mutex> guard(sleep_lock);
+    queued++;
+  }
+  wake.notify_one();
+}
+
+/**
+ * @brief Function to block until every submitted task has finished
+ */
+void thread_pool::wait_idle() {
+  std::unique_lock<std::mutex> guard(sleep_lock);
+  idle.wait(guard, [this] { return pending.load() == 0; });
+}
+
+/**
+ * @brief Function to take a task, from its own queue first and then from the others
+ *
+ * @param idx index of the worker looking for work
+ * @param task task to write to
+ * @return true if a task was found
+ */
+bool thread_pool::pop_task(int idx, std::function<void()> &task) {
+  {
+    worker_queue &own = *queues[idx];
+    std::lock_guard<std::mutex> guard(own.lock);
+    if(!own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+
+  // steal from the back so the victim keeps its oldest work
+  for(int k = 1; k < queues.size(); k++) {
+    worker_queue &victim = *queues[(idx + k) % queues.size()];
+    std::lock_guard<std::mutex> guard(victim.lock);
+    if(!victim.tasks.empty()) {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Function run by each worker thread
+ *
+ * @param idx index of the worker
+ */
+void thread_pool::worker_loop(int idx) {
+  tl_worker_index = idx;
+
+  for(;;) {
+    std::function<void()> task;
+    if(pop_task(idx, task)) {
+      queued--;
+      task();
+      task = nullptr; // release captures before reporting the task as done
+
+      if(--pending == 0) {
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        idle.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock<std::mutex> guard(sleep_lock);
+    wake.wait(guard, [this] { return stopping || queued.load() > 0; });
+    if(stopping && queued.load() == 0) {
+      break;
+    }
+  }
+}
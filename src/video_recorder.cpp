@@ -0,0 +1,285 @@
+/**
+ * @file video_recorder.cpp
+ * @author Nate Novak (novak.n@northeastern.edu)
+ * @brief Background video recorder for the composited AR output
+ * @date 2022-04-17
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include "../include/video_recorder.h"
+
+/**
+ * @brief Function to check the end of a file name
+ *
+ * @param name file name
+ * @param ext extension, with the dot
+ * @return true if name ends in ext
+ */
+static bool ends_with(const std::string &name, const char *ext) {
+  size_t n = strlen(ext);
+  return name.size() >= n && name.compare(name.size() - n, n, ext) == 0;
+}
+
+/**
+ * @brief Function to open the output on the first frame, once the size is known
+ *
+ * @param rec recorder
+ * @param frame first frame
+ * @return int return non-zero value on failure
+ */
+static int open_output(video_recorder &rec, const cv::Mat &frame) {
+  rec.size = frame.size();
+  if(rec.y4m) {
+    rec.size = cv::Size(frame.cols & ~1, frame.rows & ~1); // 4:2:0 needs an even size
+    rec.y4m_fp = fopen(rec.filename.c_str(), "wb");
+    if(!rec.y4m_fp) {
+      return(-1);
+    }
+    int fps_num = (int) (rec.fps * 1000 + 0.5);
+    fprintf(rec.y4m_fp, "YUV4MPEG2 W%d H%d F%d:1000 Ip A1:1 C420jpeg\n", rec.size.width, rec.size.height, fps_num);
+    return(0);
+  }
+
+  int fourcc = ends_with(rec.filename, ".mp4") ? cv::VideoWriter::fourcc('m', 'p', '4', 'v') : cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+  rec.writer.open(rec.filename, fourcc, rec.fps, rec.size, frame.channels() == 3);
+
+  return(rec.writer.isOpened() ? 0 : -1);
+}
+
+/**
+ * @brief Function to encode one frame
+ *
+ * @param rec recorder
+ * @param frame frame to encode
+ * @param yuv scratch for the Y4M conversion, kept between frames
+ * @return int return non-zero value on failure
+ */
+static int encode_frame(video_recorder &rec, const cv::Mat &frame, cv::Mat &yuv) {
+  cv::Mat src = frame;
+  if(src.size() != rec.size) {
+    if(src.cols >= rec.size.width && src.rows >= rec.size.height) {
+      src = src(cv::Rect(0, 0, rec.size.width, rec.size.height));
+    } else {
+      cv::resize(frame, src, rec.size);
+    }
+  }
+
+  if(!rec.y4m) {
+    rec.writer.write(src);
+    return(0);
+  }
+
+  if(src.channels() == 1) {
+    cv::cvtColor(src, src, cv::COLOR_GRAY2BGR);
+  }
+  cv::cvtColor(src, yuv, cv::COLOR_BGR2YUV_I420);
+  fputs("FRAME\n", rec.y4m_fp);
+  size_t bytes = yuv.total() * yuv.elemSize();
+  if(fwrite(yuv.data, 1, bytes, rec.y4m_fp) != bytes) {
+    return(-1);
+  }
+
+  return(0);
+}
+
+/**
+ * @brief Function run on the encoder thread
+ *
+ * @param rec recorder the thread belongs to
+ */
+static void run_encoder(video_recorder *rec) {
+  bool opened = false;
+  bool failed = false;
+  cv::Mat yuv;
+
+  for(;;) {
+    cv::Mat frame;
+    {
+      std::unique_lock<std::mutex> guard(rec->lock);
+      rec->ready.wait(guard, [rec] { return rec->stopping || !rec->queue.empty(); });
+      if(rec->queue.empty()) {
+        break; // stopping and nothing left
+      }
+      frame = rec->queue.front();
+      rec->queue.pop_front();
+    }
+    rec->room.notify_one();
+
+    if(!opened && !failed) {
+      try {
+        failed = open_output(*rec, frame) != 0;
+      } catch(const cv::Exception &e) {
+        failed = true;
+      }
+      opened = !failed;
+      if(failed) {
+        printf("Unable to record to %s\n", rec->filename.c_str());
+      }
+    }
+
+    if(failed) {
+      rec->dropped++;
+    } else {
+      try {
+        if(encode_frame(*rec, frame, yuv) == 0) {
+          rec->written++;
+        } else {
+          rec->dropped++;
+        }
+      } catch(const cv::Exception &e) {
+        rec->dropped++;
+      }
+    }
+
+    std::lock_guard<std::mutex> guard(rec->lock);
+    if(rec->pool.size() < rec->max_queue + 2) {
+      rec->pool.push_back(frame); // the caller gets this buffer back from next_record_frame
+    }
+  }
+
+  if(rec->y4m_fp) {
+    fclose(rec->y4m_fp);
+    rec->y4m_fp = NULL;
+  }
+  rec->writer.release();
+}
+
+/**
+ * @brief Function to get a record policy from its name
+ *
+ * @param name "drop", "drop-oldest" or "queue"
+ * @return int record_policy, -1 if the name is unknown
+ */
+int parse_record_policy(const char *name) {
+  if(strcmp(name, "drop") == 0) {
+    return RECORD_DROP_NEWEST;
+  } else if(strcmp(name, "drop-oldest") == 0) {
+    return RECORD_DROP_OLDEST;
+  } else if(strcmp(name, "queue") == 0) {
+    return RECORD_QUEUE;
+  }
+  return(-1);
+}
+
+/**
+ * @brief Function to start a recording
+ *
+ * A .y4m filename writes raw YUV4MPEG2, anything else goes to cv::VideoWriter
+ * (MJPG for .avi, mp4v for .mp4).
+ *
+ * @param filename file to record to
+ * @param fps frame rate written to the file
+ * @param policy record_policy when the encoder is behind
+ * @param max_queue frames that can wait for the encoder
+ * @param rec recorder to start
+ * @return int return non-zero value on failure
+ */
+int open_video_recorder(const std::string &filename, double fps, int policy, int max_queue, video_recorder &rec) {
+  if(policy < RECORD_DROP_NEWEST || policy > RECORD_BLOCK) {
+    printf("Unknown record policy %d\n", policy);
+    return(-1);
+  }
+
+  rec.filename = filename;
+  rec.fps = fps > 0 ? fps : 30;
+  rec.policy = policy;
+  rec.max_queue = std::max(1, max_queue);
+  rec.y4m = ends_with(filename, ".y4m");
+  rec.y4m_fp = NULL;
+  rec.size = cv::Size(0, 0);
+  rec.stopping = false;
+  rec.written = 0;
+  rec.dropped = 0;
+  rec.max_depth = 0;
+  rec.thread = std::thread(run_encoder, &rec);
+
+  return(0);
+}
+
+/**
+ * @brief Function to get a frame buffer to draw the next frame into
+ *
+ * @param rec open recorder
+ * @param size frame size
+ * @param type frame type
+ * @return cv::Mat a buffer from the pool, or a new one if none is free
+ */
+cv::Mat next_record_frame(video_recorder &rec, cv::Size size, int type) {
+  {
+    std::lock_guard<std::mutex> guard(rec.lock);
+    while(!rec.pool.empty()) {
+      cv::Mat buf = rec.pool.back();
+      rec.pool.pop_back();
+      if(buf.size() == size && buf.type() == type) {
+        return buf;
+      }
+    }
+  }
+
+  return cv::Mat(size, type);
+}
+
+/**
+ * @brief Function to hand a finished frame to the encoder
+ *
+ * Only the reference is queued, so the caller must not draw into the frame
+ * afterwards. Get the next one from next_record_frame.
+ *
+ * @param rec open recorder
+ * @param frame finished frame
+ * @return int return non-zero value if a frame was dropped
+ */
+int record_frame(video_recorder &rec, const cv::Mat &frame) {
+  int ret = 0;
+  {
+    std::unique_lock<std::mutex> guard(rec.lock);
+    if(rec.policy == RECORD_BLOCK) {
+      rec.room.wait(guard, [&rec] { return rec.queue.size() < rec.max_queue; });
+    }
+    if(rec.queue.size() >= rec.max_queue && rec.policy < RECORD_QUEUE) {
+      rec.dropped++;
+      ret = -1;
+      if(rec.policy == RECORD_DROP_NEWEST) {
+        if(rec.pool.size() < rec.max_queue + 2) {
+          rec.pool.push_back(frame);
+        }
+        return(ret);
+      }
+      rec.pool.push_back(rec.queue.front());
+      rec.queue.pop_front();
+    }
+    rec.queue.push_back(frame);
+    rec.max_depth = std::max(rec.max_depth, (int) rec.queue.size());
+  }
+  rec.ready.notify_one();
+
+  return(ret);
+}
+
+/**
+ * @brief Function to encode everything queued, close the file and report dropped frames
+ *
+ * @param rec recorder to close
+ * @return int
+ */
+int close_video_recorder(video_recorder &rec) {
+  {
+    std::lock_guard<std::mutex> guard(rec.lock);
+    rec.stopping = true;
+  }
+  rec.ready.notify_all();
+  if(rec.thread.joinable()) {
+    rec.thread.join();
+  }
+  rec.pool.clear();
+
+  printf("Recorded %ld frames to %s", rec.written.load(), rec.filename.c_str());
+  if(rec.dropped > 0) {
+    printf(", %ld dropped", rec.dropped.load());
+  }
+  printf(", queue reached %d of %d\n", rec.max_depth, rec.max_queue);
+
+  return(0);
+}